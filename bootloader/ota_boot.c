@@ -0,0 +1,631 @@
+/*! \file *********************************************************************
+ *
+ * \brief   Over-the-air update bootloader for the ATmega128 and the
+ *          AT86RF231 (see ota.h in the application).
+ *
+ *          Linked at OTA_BOOT_START and entered on every reset (BOOTRST). It
+ *          starts the application unless the application left a request in
+ *          the EEPROM:
+ *
+ *          - OTA_BOOT_RECEIVE: receive an image from the server into the
+ *            staging area. The fragments are collected in RAM page buffers,
+ *            and a full page is erased and written while the radio keeps
+ *            receiving the next ones: the bootloader runs from the NRWW
+ *            section, so only the staging area is blocked during SPM. Pages
+ *            may complete in any order. The application is not touched, so
+ *            a failed transfer just starts it again.
+ *          - OTA_BOOT_SWAP: copy the verified staging area over the
+ *            application. The request is only cleared once the application
+ *            matches the CRC, so a copy cut short by a reset is repeated.
+ *
+ *          The radio is polled, interrupts stay disabled and the vectors of
+ *          the application are left alone.
+ *
+ *          Fuses: BOOTSZ = 00 (4096 words), BOOTRST programmed.
+ *
+ ******************************************************************************/
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/boot.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <avr/wdt.h>
+
+#include "compiler.h"
+#include "at86rf231.h"
+#include "hal_avr.h"
+#include "ota.h"
+/*============================ MACROS ========================================*/
+#define BOOT_PAGE_BUFFERS        ( 4 ) //!< Pages received ahead of the flash.
+#define BOOT_NO_PAGE             ( 0xFF ) //!< Page of a free buffer.
+#define BOOT_MAX_FRAME_LENGTH    ( 127 )
+#define BOOT_TIMEOUT_OVERFLOWS   ( 10 * HAL_US_PER_SYMBOL ) //!< Timer1 overflows (about 10 s) without a frame from the server.
+#define BOOT_SWAP_ATTEMPTS       ( 2 )
+
+#define BOOT_SPI_REGISTER_READ   ( 0x80 )
+#define BOOT_SPI_REGISTER_WRITE  ( 0xC0 )
+#define BOOT_SPI_FRAME_READ      ( 0x20 )
+#define BOOT_SPI_FRAME_WRITE     ( 0x60 )
+
+#define BOOT_TIME_P_ON           ( 510 ) //!< us, see tat.c.
+#define BOOT_TIME_RESET          ( 6 )
+#define BOOT_STATE_POLLS         ( 1000 ) //!< Polls of TRX_STATUS for a state transition.
+#define BOOT_TX_POLLS            ( 50000 ) //!< Polls of IRQ_STATUS for the end of TX_ARET.
+
+#define BOOT_PAGE_ADDRESS( base, page ) ( (base) + (uint32_t)(page) * OTA_PAGE_SIZE )
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  A page of the image being collected in RAM. */
+typedef struct{
+    uint8_t page;           //!< Page of the image, BOOT_NO_PAGE if free.
+    uint8_t fragments;      //!< Bit i set: fragment i of the page is in data.
+    uint8_t data[ OTA_PAGE_SIZE ];
+}boot_page_buffer_t;
+
+/*! \brief  Progress of the SPM of one page. */
+typedef enum{
+    BOOT_WRITER_IDLE = 0,
+    BOOT_WRITER_ERASING,
+    BOOT_WRITER_WRITING
+}boot_writer_t;
+/*============================ VARIABLES =====================================*/
+static ota_boot_request_t boot_request;
+
+static boot_page_buffer_t boot_buffers[ BOOT_PAGE_BUFFERS ];
+static uint8_t boot_received[ OTA_MAX_FRAGMENTS / 8 ]; //!< Bit set: fragment in a page buffer or in flash.
+static uint16_t boot_fragments; //!< Fragments in the image.
+
+static boot_writer_t boot_writer;
+static boot_page_buffer_t *boot_writing; //!< Buffer on its way to flash.
+
+static uint8_t boot_frame[ BOOT_MAX_FRAME_LENGTH ];
+static uint8_t boot_sequence_number;
+/*============================ PROTOTYPES ====================================*/
+static bool boot_receive_image( void );
+static void boot_receive_fragment( uint8_t *body );
+static boot_page_buffer_t *boot_buffer( uint8_t page );
+static uint8_t boot_full_mask( uint8_t page );
+static bool boot_is_received( uint16_t fragment );
+static uint16_t boot_first_missing( void );
+static bool boot_writer_poll( void );
+static void boot_writer_flush( void );
+static bool boot_swap( void );
+static uint32_t boot_image_crc( uint32_t base );
+static void boot_send_status( uint8_t state );
+static void boot_radio_init( void );
+static bool boot_radio_send( uint8_t length );
+static uint8_t boot_radio_read( void );
+static void boot_set_state( uint8_t command, uint8_t state );
+static uint8_t boot_spi( uint8_t data );
+static uint8_t boot_register_read( uint8_t address );
+static void boot_register_write( uint8_t address, uint8_t value );
+static uint8_t boot_subregister_read( uint8_t address, uint8_t mask, uint8_t position );
+static void boot_subregister_write( uint8_t address, uint8_t mask, uint8_t position, uint8_t value );
+static void boot_set_request_state( uint8_t state );
+static void boot_start_application( void );
+
+int main( void ){
+
+    wdt_disable( ); //The application resets into the bootloader with the watchdog.
+
+    eeprom_read_block( &boot_request, (void *)OTA_EEPROM_ADDRESS, sizeof( boot_request ) );
+
+    //That reset is not one for the application to count (see watchdog_start).
+    if (boot_request.state != OTA_BOOT_IDLE) { MCUCSR = 0; }
+
+    if (boot_request.state == OTA_BOOT_RECEIVE) {
+        boot_set_request_state( boot_receive_image( ) ? OTA_BOOT_SWAP : OTA_BOOT_IDLE );
+    }
+
+    if (boot_request.state == OTA_BOOT_SWAP) {
+
+        for (uint8_t attempt = 0; attempt < BOOT_SWAP_ATTEMPTS; attempt++) {
+            if (boot_swap( ) == true) { break; }
+        }
+
+        //Even if the copy failed: retrying forever would not run anything either.
+        boot_set_request_state( OTA_BOOT_IDLE );
+    }
+
+    boot_start_application( );
+
+    return 0;
+}
+
+/*! \brief  Receive the image of the request into the staging area.
+ *
+ *  \return true if the server sent COMMIT and the staging area matches the
+ *          CRC of the request.
+ */
+static bool boot_receive_image( void ){
+
+    boot_radio_init( );
+
+    if ((boot_request.image_length == 0) || (boot_request.image_length > OTA_IMAGE_MAX)) {
+        boot_send_status( OTA_STATE_TOO_LARGE );
+        return false;
+    }
+
+    boot_fragments = (boot_request.image_length + OTA_FRAGMENT_SIZE - 1) / OTA_FRAGMENT_SIZE;
+    memset( boot_received, 0, sizeof( boot_received ) );
+
+    for (uint8_t i = 0; i < BOOT_PAGE_BUFFERS; i++) {
+        boot_buffers[ i ].page = BOOT_NO_PAGE;
+    }
+
+    boot_writer = BOOT_WRITER_IDLE;
+
+    TCCR1B = HAL_TCCR1B_CONFIG;
+    TIFR = (1 << TOV1);
+    uint8_t overflows = 0;
+
+    boot_send_status( OTA_STATE_RECEIVING ); //The server waits for it after START.
+
+    while (true) {
+
+        boot_writer_poll( );
+
+        if (TIFR & (1 << TOV1)) {
+            TIFR = (1 << TOV1);
+            if (++overflows == BOOT_TIMEOUT_OVERFLOWS) { return false; }
+        }
+
+        uint8_t length = boot_radio_read( );
+
+        if ((length < OTA_CONTROL_LENGTH) || (boot_frame[ OTA_MAC_HEADER_LENGTH ] != OTA_DISPATCH) ||
+            (boot_frame[ OTA_MAC_HEADER_LENGTH + 2 ] != boot_request.session) ||
+            ((boot_frame[ 7 ] | (boot_frame[ 8 ] << 8)) != boot_request.server)) {
+            continue;
+        }
+
+        overflows = 0;
+
+        switch (boot_frame[ OTA_MAC_HEADER_LENGTH + 1 ]) {
+        case OTA_DATA:
+            if (length == OTA_DATA_LENGTH) { boot_receive_fragment( &boot_frame[ OTA_HEADER_LENGTH ] ); }
+            break;
+
+        case OTA_START:
+            boot_send_status( OTA_STATE_RECEIVING ); //The first STATUS was lost.
+            break;
+
+        case OTA_QUERY:
+            if (boot_first_missing( ) == boot_fragments) {
+                boot_writer_flush( );
+                boot_send_status( OTA_STATE_COMPLETE );
+            } else {
+                boot_send_status( OTA_STATE_RECEIVING );
+            }
+            break;
+
+        case OTA_COMMIT:
+            if (boot_first_missing( ) != boot_fragments) {
+                boot_send_status( OTA_STATE_RECEIVING );
+                break;
+            }
+
+            boot_writer_flush( );
+
+            if (boot_image_crc( OTA_STAGING_START ) == boot_request.image_crc) {
+                boot_send_status( OTA_STATE_VERIFIED );
+                return true;
+            }
+
+            boot_send_status( OTA_STATE_CRC_ERROR );
+            return false;
+
+        default:
+            break;
+        } // end: switch (boot_frame[ OTA_MAC_HEADER_LENGTH + 1 ]) ...
+    } // end: while (true) ...
+}
+
+/*! \brief  Copy the fragment of a DATA frame into its page buffer. A fragment
+ *          without a buffer is dropped, the server repeats it after QUERY.
+ *
+ *  \param  body Fragment number and data.
+ */
+static void boot_receive_fragment( uint8_t *body ){
+
+    uint16_t fragment = body[ 0 ] | (body[ 1 ] << 8);
+
+    if ((fragment >= boot_fragments) || (boot_is_received( fragment ) == true)) { return; }
+
+    uint8_t page = fragment / OTA_FRAGMENTS_PER_PAGE;
+    uint8_t index = fragment % OTA_FRAGMENTS_PER_PAGE;
+    boot_page_buffer_t *buffer = boot_buffer( page );
+
+    if (buffer == NULL) { return; }
+
+    memcpy( &buffer->data[ index * OTA_FRAGMENT_SIZE ], &body[ 2 ], OTA_FRAGMENT_SIZE );
+    buffer->fragments |= (1 << index);
+    boot_received[ fragment >> 3 ] |= (1 << (fragment & 7));
+}
+
+/*! \brief  Buffer of a page: the one already collecting it, or a free one.
+ *
+ *          If all buffers hold incomplete pages, the highest of them is given
+ *          up for a lower page, so the first missing fragment always finds a
+ *          buffer and the repeats make progress.
+ *
+ *  \return NULL if there is no buffer for the page now.
+ */
+static boot_page_buffer_t *boot_buffer( uint8_t page ){
+
+    boot_page_buffer_t *free_buffer = NULL;
+    boot_page_buffer_t *highest = NULL;
+
+    for (uint8_t i = 0; i < BOOT_PAGE_BUFFERS; i++) {
+
+        boot_page_buffer_t *buffer = &boot_buffers[ i ];
+
+        if (buffer->page == page) { return buffer; }
+
+        if (buffer->page == BOOT_NO_PAGE) {
+            free_buffer = buffer;
+        } else if ((buffer != boot_writing) && (buffer->fragments != boot_full_mask( buffer->page )) &&
+                   (buffer->page > page) && ((highest == NULL) || (buffer->page > highest->page))) {
+            highest = buffer;
+        }
+    } // end: for (uint8_t i ...
+
+    if (free_buffer == NULL) {
+
+        if (highest == NULL) { return NULL; }
+
+        //Its fragments are reported missing again.
+        for (uint8_t index = 0; index < OTA_FRAGMENTS_PER_PAGE; index++) {
+            if (highest->fragments & (1 << index)) {
+                uint16_t fragment = highest->page * OTA_FRAGMENTS_PER_PAGE + index;
+                boot_received[ fragment >> 3 ] &= ~(1 << (fragment & 7));
+            }
+        }
+
+        free_buffer = highest;
+    } // end: if (free_buffer == NULL) ...
+
+    free_buffer->page = page;
+    free_buffer->fragments = 0;
+    memset( free_buffer->data, 0xFF, OTA_PAGE_SIZE ); //The last page is padded like erased flash.
+
+    return free_buffer;
+}
+
+/*! \brief  Fragments of a full page: OTA_FRAGMENTS_PER_PAGE, fewer for the
+ *          last page of the image. */
+static uint8_t boot_full_mask( uint8_t page ){
+
+    uint16_t left = boot_fragments - page * OTA_FRAGMENTS_PER_PAGE;
+
+    if (left >= OTA_FRAGMENTS_PER_PAGE) { return (1 << OTA_FRAGMENTS_PER_PAGE) - 1; }
+
+    return (1 << left) - 1;
+}
+
+/*! \brief  Check the bitmap of received fragments. */
+static bool boot_is_received( uint16_t fragment ){
+    return (boot_received[ fragment >> 3 ] & (1 << (fragment & 7))) != 0;
+}
+
+/*! \brief  First fragment not received, boot_fragments if there is none. */
+static uint16_t boot_first_missing( void ){
+
+    uint16_t fragment = 0;
+
+    while ((fragment < boot_fragments) && (boot_is_received( fragment ) == true)) {
+        fragment++;
+    }
+
+    return fragment;
+}
+
+/*! \brief  Advance the flash write of one page without waiting for SPM:
+ *          fill the page buffer of the CPU and erase, then write, then
+ *          re-enable the RWW section and free the RAM buffer.
+ *
+ *  \return false if there was no full page left to write.
+ */
+static bool boot_writer_poll( void ){
+
+    if (boot_spm_busy( )) { return true; }
+
+    switch (boot_writer) {
+    case BOOT_WRITER_IDLE:
+        boot_writing = NULL;
+
+        for (uint8_t i = 0; i < BOOT_PAGE_BUFFERS; i++) {
+
+            boot_page_buffer_t *buffer = &boot_buffers[ i ];
+
+            if ((buffer->page != BOOT_NO_PAGE) && (buffer->fragments == boot_full_mask( buffer->page ))) {
+                boot_writing = buffer;
+                break;
+            }
+        } // end: for (uint8_t i ...
+
+        if (boot_writing == NULL) { return false; }
+
+        uint32_t address = BOOT_PAGE_ADDRESS( OTA_STAGING_START, boot_writing->page );
+
+        for (uint16_t i = 0; i < OTA_PAGE_SIZE; i += 2) {
+            boot_page_fill( address + i, boot_writing->data[ i ] | (boot_writing->data[ i + 1 ] << 8) );
+        }
+
+        boot_page_erase( address );
+        boot_writer = BOOT_WRITER_ERASING;
+        break;
+
+    case BOOT_WRITER_ERASING:
+        boot_page_write( BOOT_PAGE_ADDRESS( OTA_STAGING_START, boot_writing->page ) );
+        boot_writer = BOOT_WRITER_WRITING;
+        break;
+
+    case BOOT_WRITER_WRITING:
+        boot_rww_enable( );
+        boot_writing->page = BOOT_NO_PAGE;
+        boot_writing = NULL;
+        boot_writer = BOOT_WRITER_IDLE;
+        break;
+    } // end: switch (boot_writer) ...
+
+    return true;
+}
+
+/*! \brief  Write all full pages, e.g. before the staging area is read. */
+static void boot_writer_flush( void ){
+
+    while (boot_writer_poll( ) == true) {
+        ;
+    }
+}
+
+/*! \brief  Copy the staging area over the application, page by page.
+ *
+ *  \return true if the application matches the CRC of the request.
+ */
+static bool boot_swap( void ){
+
+    if (boot_image_crc( OTA_STAGING_START ) != boot_request.image_crc) { return false; }
+
+    uint8_t pages = (boot_request.image_length + OTA_PAGE_SIZE - 1) / OTA_PAGE_SIZE;
+
+    for (uint8_t page = 0; page < pages; page++) {
+
+        uint32_t from = BOOT_PAGE_ADDRESS( OTA_STAGING_START, page );
+        uint32_t to = BOOT_PAGE_ADDRESS( OTA_APP_START, page );
+
+        for (uint16_t i = 0; i < OTA_PAGE_SIZE; i += 2) {
+            boot_page_fill( to + i, pgm_read_word_far( from + i ) );
+        }
+
+        boot_page_erase( to );
+        boot_spm_busy_wait( );
+        boot_page_write( to );
+        boot_spm_busy_wait( );
+        boot_rww_enable( ); //The next page is read from the RWW section.
+    } // end: for (uint8_t page ...
+
+    return boot_image_crc( OTA_APP_START ) == boot_request.image_crc;
+}
+
+/*! \brief  CRC-32 of image_length bytes of flash, see ota_crc32_update. */
+static uint32_t boot_image_crc( uint32_t base ){
+
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (uint32_t i = 0; i < boot_request.image_length; i++) {
+        crc = ota_crc32_update( crc, pgm_read_byte_far( base + i ) );
+    }
+
+    return ~crc;
+}
+
+/*! \brief  Send a STATUS with the bitmap of the missing fragments to the
+ *          server. */
+static void boot_send_status( uint8_t state ){
+
+    uint16_t first = (state == OTA_STATE_RECEIVING) ? boot_first_missing( ) : boot_fragments;
+    uint8_t *body = &boot_frame[ OTA_HEADER_LENGTH ];
+
+    boot_frame[ 0 ]  = 0x61; //FCF: data frame, acknowledge request, PAN ID compression.
+    boot_frame[ 1 ]  = 0x88; //FCF: short addresses.
+    boot_frame[ 2 ]  = boot_sequence_number++;
+    boot_frame[ 3 ]  = boot_request.pan_id & 0xFF;
+    boot_frame[ 4 ]  = (boot_request.pan_id >> 8) & 0xFF;
+    boot_frame[ 5 ]  = boot_request.server & 0xFF;
+    boot_frame[ 6 ]  = (boot_request.server >> 8) & 0xFF;
+    boot_frame[ 7 ]  = boot_request.short_address & 0xFF;
+    boot_frame[ 8 ]  = (boot_request.short_address >> 8) & 0xFF;
+    boot_frame[ 9 ]  = OTA_DISPATCH;
+    boot_frame[ 10 ] = OTA_STATUS;
+    boot_frame[ 11 ] = boot_request.session;
+
+    body[ 0 ] = state;
+    body[ 1 ] = first & 0xFF;
+    body[ 2 ] = (first >> 8) & 0xFF;
+
+    for (uint8_t i = 0; i < OTA_STATUS_WINDOW; i++) {
+
+        uint16_t fragment = first + i;
+
+        if ((i & 7) == 0) { body[ 3 + (i >> 3) ] = 0; }
+
+        if ((fragment < boot_fragments) && (boot_is_received( fragment ) == false)) {
+            body[ 3 + (i >> 3) ] |= (1 << (i & 7));
+        }
+    } // end: for (uint8_t i ...
+
+    boot_radio_send( OTA_STATUS_LENGTH );
+}
+
+/*! \brief  Reset the radio transceiver and listen in RX_AACK_ON with the
+ *          address of the application.
+ *
+ *          RX_SAFE_MODE keeps a received frame in the frame buffer until it
+ *          is read: a frame that arrives before that, e.g. during a page
+ *          fill, is not acknowledged and the server repeats it.
+ */
+static void boot_radio_init( void ){
+
+    DDR_SLP_TR |= (1 << SLP_TR);
+    DDR_RST    |= (1 << RST);
+    hal_set_slptr_low( );
+
+    HAL_DDR_SPI  |= (1 << HAL_DD_SS) | (1 << HAL_DD_SCK) | (1 << HAL_DD_MOSI);
+    HAL_PORT_SPI |= (1 << HAL_DD_SS) | (1 << HAL_DD_SCK);
+    SPCR         = (1 << SPE) | (1 << MSTR);
+    SPSR         = (1 << SPI2X);
+
+    hal_set_rst_low( );
+    delay_us( BOOT_TIME_RESET );
+    hal_set_rst_high( );
+
+    boot_register_write( RG_TRX_STATE, CMD_FORCE_TRX_OFF );
+    delay_us( BOOT_TIME_P_ON );
+
+    boot_register_write( RG_IRQ_MASK, TRX_IRQ_TRX_END );
+    boot_subregister_write( SR_TX_AUTO_CRC_ON, 1 );
+    boot_subregister_write( SR_RX_SAFE_MODE, 1 );
+    boot_subregister_write( SR_CHANNEL, boot_request.channel );
+    boot_register_write( RG_SHORT_ADDR_0, boot_request.short_address & 0xFF );
+    boot_register_write( RG_SHORT_ADDR_1, (boot_request.short_address >> 8) & 0xFF );
+    boot_register_write( RG_PAN_ID_0, boot_request.pan_id & 0xFF );
+    boot_register_write( RG_PAN_ID_1, (boot_request.pan_id >> 8) & 0xFF );
+
+    boot_set_state( CMD_PLL_ON, PLL_ON );
+    boot_set_state( CMD_RX_AACK_ON, RX_AACK_ON );
+}
+
+/*! \brief  Send boot_frame with TX_ARET and go back to RX_AACK_ON.
+ *
+ *  \return true if the frame was acknowledged.
+ */
+static bool boot_radio_send( uint8_t length ){
+
+    boot_set_state( CMD_PLL_ON, PLL_ON ); //Waits for a frame being received.
+    boot_set_state( CMD_TX_ARET_ON, TX_ARET_ON );
+
+    HAL_SS_LOW( );
+    boot_spi( BOOT_SPI_FRAME_WRITE );
+    boot_spi( length );
+    for (uint8_t i = 0; i < length - 2; i++) { boot_spi( boot_frame[ i ] ); } //The FCS is added by the radio.
+    HAL_SS_HIGH( );
+
+    boot_register_read( RG_IRQ_STATUS );
+    hal_set_slptr_high( );
+    hal_set_slptr_low( );
+
+    for (uint16_t poll = 0; poll < BOOT_TX_POLLS; poll++) {
+        if (boot_register_read( RG_IRQ_STATUS ) & TRX_IRQ_TRX_END) { break; }
+    }
+
+    bool acknowledged = (boot_subregister_read( SR_TRAC_STATUS ) == TRAC_SUCCESS);
+
+    boot_set_state( CMD_PLL_ON, PLL_ON );
+    boot_set_state( CMD_RX_AACK_ON, RX_AACK_ON );
+
+    return acknowledged;
+}
+
+/*! \brief  Read a received frame into boot_frame.
+ *
+ *  \return Frame length including the FCS, 0 if no frame was received.
+ */
+static uint8_t boot_radio_read( void ){
+
+    if ((boot_register_read( RG_IRQ_STATUS ) & TRX_IRQ_TRX_END) == 0) { return 0; }
+
+    HAL_SS_LOW( );
+    boot_spi( BOOT_SPI_FRAME_READ );
+
+    uint8_t length = boot_spi( 0 );
+
+    if (length > BOOT_MAX_FRAME_LENGTH) { length = 0; }
+
+    for (uint8_t i = 0; i < length; i++) { boot_frame[ i ] = boot_spi( 0 ); }
+
+    HAL_SS_HIGH( ); //Releases the frame buffer for the next frame.
+
+    return length;
+}
+
+/*! \brief  Issue a TRX_CMD and wait until TRX_STATUS reaches the state. */
+static void boot_set_state( uint8_t command, uint8_t state ){
+
+    boot_subregister_write( SR_TRX_CMD, command );
+
+    for (uint16_t poll = 0; poll < BOOT_STATE_POLLS; poll++) {
+        if (boot_subregister_read( SR_TRX_STATUS ) == state) { break; }
+        delay_us( 1 );
+    }
+}
+
+/*! \brief  Exchange one byte on the SPI. */
+static uint8_t boot_spi( uint8_t data ){
+
+    SPDR = data;
+    while ((SPSR & (1 << SPIF)) == 0) { ; }
+
+    return SPDR;
+}
+
+/*! \brief  Read a register of the radio transceiver. */
+static uint8_t boot_register_read( uint8_t address ){
+
+    HAL_SS_LOW( );
+    boot_spi( BOOT_SPI_REGISTER_READ | address );
+    uint8_t value = boot_spi( 0 );
+    HAL_SS_HIGH( );
+
+    return value;
+}
+
+/*! \brief  Write a register of the radio transceiver. */
+static void boot_register_write( uint8_t address, uint8_t value ){
+
+    HAL_SS_LOW( );
+    boot_spi( BOOT_SPI_REGISTER_WRITE | address );
+    boot_spi( value );
+    HAL_SS_HIGH( );
+}
+
+/*! \brief  Read a subregister, with the SR_* access parameters. */
+static uint8_t boot_subregister_read( uint8_t address, uint8_t mask, uint8_t position ){
+    return (boot_register_read( address ) & mask) >> position;
+}
+
+/*! \brief  Write a subregister, with the SR_* access parameters. */
+static void boot_subregister_write( uint8_t address, uint8_t mask, uint8_t position, uint8_t value ){
+
+    uint8_t register_value = boot_register_read( address ) & ~mask;
+
+    boot_register_write( address, register_value | ((value << position) & mask) );
+}
+
+/*! \brief  Update the state of the request in the EEPROM, after SPM. */
+static void boot_set_request_state( uint8_t state ){
+
+    boot_spm_busy_wait( );
+    eeprom_write_byte( (uint8_t *)OTA_EEPROM_ADDRESS, state ); //state is the first field.
+
+    boot_request.state = state;
+}
+
+/*! \brief  Put back what the bootloader changed and jump to the reset
+ *          vector of the application. */
+static void boot_start_application( void ){
+
+    void (*application)( void ) = (void (*)( void ))OTA_APP_START;
+
+    hal_set_rst_low( ); //The application resets the radio transceiver itself.
+    SPCR = 0;
+    SPSR = 0;
+    TCCR1B = 0;
+    TIFR = (1 << TOV1);
+
+    application( );
+}
+/*EOF*/
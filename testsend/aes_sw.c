@@ -0,0 +1,126 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "aes_sw.h"
+/*============================ MACROS ========================================*/
+#define AES_SW_ROUNDS            ( 10 )
+#define AES_SW_SBOX( x )         ( pgm_read_byte( &aes_sw_sbox[ (x) ] ) )
+#define AES_SW_XTIME( x )        ( (uint8_t)(((x) << 1) ^ (((x) & 0x80) ? 0x1B : 0x00)) )
+/*============================ TYPEDEFS ======================================*/
+/*============================ VARIABLES =====================================*/
+
+/*! \brief  AES S-box, kept in flash. */
+static const uint8_t aes_sw_sbox[ 256 ] PROGMEM = {
+    0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+    0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+    0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+    0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+    0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+    0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+    0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+    0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+    0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+    0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+    0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+    0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+    0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+    0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+    0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+    0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
+};
+
+static uint8_t aes_sw_round_keys[ (AES_SW_ROUNDS + 1) * AES_SW_BLOCK_SIZE ]; //!< Expanded key.
+/*============================ PROTOTYPES ====================================*/
+
+/*! \brief  Expand an AES-128 key for aes_sw_encrypt.
+ *
+ *          This is the software reference for the AES engine of the
+ *          AT86RF231 (see sal.c). Only encryption is implemented, which is all
+ *          that CCM* needs.
+ *
+ *  \param  key 16 byte key.
+ *
+ *  \ingroup aes_sw
+ */
+void aes_sw_setup( uint8_t *key ){
+
+    uint8_t rcon = 0x01;
+
+    memcpy( aes_sw_round_keys, key, AES_SW_KEY_SIZE );
+
+    for (uint8_t i = AES_SW_KEY_SIZE; i < sizeof( aes_sw_round_keys ); i += 4) {
+
+        uint8_t *word = &aes_sw_round_keys[ i ];
+        uint8_t *previous = word - 4;
+
+        if ((i % AES_SW_KEY_SIZE) == 0) {
+
+            //RotWord, SubWord and the round constant.
+            word[ 0 ] = AES_SW_SBOX( previous[ 1 ] ) ^ rcon;
+            word[ 1 ] = AES_SW_SBOX( previous[ 2 ] );
+            word[ 2 ] = AES_SW_SBOX( previous[ 3 ] );
+            word[ 3 ] = AES_SW_SBOX( previous[ 0 ] );
+            rcon = AES_SW_XTIME( rcon );
+        } else {
+            memcpy( word, previous, 4 );
+        }
+
+        for (uint8_t j = 0; j < 4; j++) { word[ j ] ^= word[ j - AES_SW_KEY_SIZE ]; }
+    }
+}
+
+/*! \brief  Encrypt one block with the key from aes_sw_setup.
+ *
+ *  \param  input 16 byte plaintext.
+ *  \param  output 16 byte ciphertext. May be the same as input.
+ *
+ *  \ingroup aes_sw
+ */
+void aes_sw_encrypt( uint8_t *input, uint8_t *output ){
+
+    uint8_t state[ AES_SW_BLOCK_SIZE ];
+    uint8_t const *round_key = aes_sw_round_keys;
+
+    for (uint8_t i = 0; i < AES_SW_BLOCK_SIZE; i++) { state[ i ] = input[ i ] ^ round_key[ i ]; }
+
+    for (uint8_t round = 1; round <= AES_SW_ROUNDS; round++) {
+
+        uint8_t t;
+
+        //SubBytes and ShiftRows. The state is column major.
+        for (uint8_t i = 0; i < AES_SW_BLOCK_SIZE; i++) { state[ i ] = AES_SW_SBOX( state[ i ] ); }
+
+        t = state[ 1 ]; state[ 1 ] = state[ 5 ]; state[ 5 ] = state[ 9 ]; state[ 9 ] = state[ 13 ]; state[ 13 ] = t;
+        t = state[ 2 ]; state[ 2 ] = state[ 10 ]; state[ 10 ] = t;
+        t = state[ 6 ]; state[ 6 ] = state[ 14 ]; state[ 14 ] = t;
+        t = state[ 15 ]; state[ 15 ] = state[ 11 ]; state[ 11 ] = state[ 7 ]; state[ 7 ] = state[ 3 ]; state[ 3 ] = t;
+
+        //MixColumns, not in the last round.
+        if (round != AES_SW_ROUNDS) {
+
+            for (uint8_t c = 0; c < AES_SW_BLOCK_SIZE; c += 4) {
+
+                uint8_t a0 = state[ c ];
+                uint8_t a1 = state[ c + 1 ];
+                uint8_t a2 = state[ c + 2 ];
+                uint8_t a3 = state[ c + 3 ];
+                uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+
+                state[ c ]     ^= all ^ AES_SW_XTIME( a0 ^ a1 );
+                state[ c + 1 ] ^= all ^ AES_SW_XTIME( a1 ^ a2 );
+                state[ c + 2 ] ^= all ^ AES_SW_XTIME( a2 ^ a3 );
+                state[ c + 3 ] ^= all ^ AES_SW_XTIME( a3 ^ a0 );
+            }
+        }
+
+        round_key += AES_SW_BLOCK_SIZE;
+
+        for (uint8_t i = 0; i < AES_SW_BLOCK_SIZE; i++) { state[ i ] ^= round_key[ i ]; }
+    }
+
+    memcpy( output, state, AES_SW_BLOCK_SIZE );
+}
+/*EOF*/
@@ -0,0 +1,568 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "config_uart_extended.h"
+#include "at86rf231.h"
+
+#include "compiler.h"
+#include "hal.h"
+#include "tat.h"
+#include "arq.h"
+
+#if defined( ARQ )
+/*============================ MACROS ========================================*/
+#define ARQ_WINDOW_MASK          ( ARQ_WINDOW_SIZE - 1 )
+#define ARQ_BITMAP_SIZE          ( 32 )
+#define ARQ_RESYNC_DUPLICATES    ( 8 ) //!< Old frames in a row that mean the sender restarted.
+
+#if ((ARQ_WINDOW_SIZE & ARQ_WINDOW_MASK) != 0) || (ARQ_WINDOW_SIZE > ARQ_BITMAP_SIZE)
+    #error "ARQ_WINDOW_SIZE must be a power of two, at most 32."
+#endif
+
+#if (ARQ_MAX_FRAME_LENGTH < ARQ_MIN_DATA_LENGTH) || (ARQ_MAX_FRAME_LENGTH > 127)
+    #error "ARQ_MAX_FRAME_LENGTH must hold a data frame and fit in a PSDU."
+#endif
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  State of a sender window slot. */
+typedef enum{
+    ARQ_SLOT_FREE = 0,      //!< Acknowledged, given up, or never used.
+    ARQ_SLOT_QUEUED,        //!< Waiting for its (next) transmission.
+    ARQ_SLOT_IN_FLIGHT      //!< Sent, waiting for a SACK or the timeout.
+}arq_slot_state_t;
+
+/*! \brief  Copy of a frame that is not yet acknowledged. */
+typedef struct{
+    uint8_t frame[ ARQ_MAX_FRAME_LENGTH ];
+    uint8_t length;
+    uint8_t state;              //!< arq_slot_state_t.
+    uint8_t transmissions;
+    uint16_t sequence_number;
+    uint32_t sent_time;         //!< System time of the last transmission.
+}arq_slot_t;
+
+/*! \brief  What the receiver knows about one sender. */
+typedef struct{
+    bool used;
+    uint16_t address;           //!< Short address of the sender.
+    uint16_t expected;          //!< Next sequence number in order.
+    uint32_t bitmap;            //!< Bit i: expected + 1 + i was received.
+    uint32_t last_heard;        //!< For replacing the least recently heard sender.
+    uint32_t first_unacked;     //!< Time of the oldest frame not yet in a SACK.
+    uint8_t unacked;            //!< New frames since the last SACK.
+    uint8_t old_run;            //!< Old frames in a row.
+    bool sack_now;              //!< A duplicate or a gap was seen.
+}arq_peer_t;
+/*============================ VARIABLES =====================================*/
+static arq_slot_t arq_slots[ ARQ_WINDOW_SIZE ]; //!< Sender window, indexed by sequence number.
+static uint16_t arq_base; //!< Oldest sequence number not yet acknowledged or given up.
+static uint16_t arq_next; //!< Sequence number of the next queued frame.
+static uint16_t arq_peer_address; //!< Receiver the SACKs must come from.
+static uint32_t arq_rto; //!< Retransmission timeout in symbols.
+static arq_slot_t *arq_current; //!< Slot returned by arq_sender_next.
+static arq_sender_statistics_t arq_statistics; //!< Sender counters.
+
+static arq_peer_t arq_peers[ ARQ_RX_PEERS ]; //!< Receiver state per sender.
+static uint8_t arq_sack_sequence_number; //!< MAC sequence number of standalone SACKs.
+/*============================ PROTOTYPES ====================================*/
+static uint16_t arq_seq_add( uint16_t sequence_number, uint16_t n );
+static uint16_t arq_seq_distance( uint16_t from, uint16_t to );
+static void arq_sender_advance_base( void );
+static arq_peer_t *arq_find_peer( uint16_t address, bool allocate );
+static void arq_peer_slide( arq_peer_t *peer );
+
+/*! \brief  Start a sender session. Frames in the window are discarded.
+ *
+ *  \param  peer_address Short address of the receiver.
+ *  \param  rto Retransmission timeout in symbols, ARQ_RTO if zero.
+ *
+ *  \ingroup arq
+ */
+void arq_sender_init( uint16_t peer_address, uint32_t rto ){
+
+    for (uint8_t i = 0; i < ARQ_WINDOW_SIZE; i++) { arq_slots[ i ].state = ARQ_SLOT_FREE; }
+
+    arq_base = 0;
+    arq_next = 0;
+    arq_peer_address = peer_address;
+    arq_rto = (rto == 0) ? ARQ_RTO : rto;
+    arq_current = NULL;
+
+    memset( &arq_statistics, 0, sizeof( arq_statistics ) );
+}
+
+/*! \brief  Check if arq_sender_queue will accept a frame.
+ *
+ *  \ingroup arq
+ */
+bool arq_sender_window_open( void ){
+    return arq_seq_distance( arq_base, arq_next ) < ARQ_WINDOW_SIZE;
+}
+
+/*! \brief  Put a data frame in the window.
+ *
+ *          The next sequence number is written to the seq and carry bytes of
+ *          the frame, and a copy is kept until the receiver acknowledges it.
+ *
+ *  \param  frame Data frame with room for the FCS at the end.
+ *  \param  length Frame length including the FCS.
+ *  \param  sequence_number Where the assigned sequence number is stored, or
+ *                          NULL.
+ *
+ *  \retval TAT_SUCCESS The frame is queued.
+ *  \retval TAT_BUSY_STATE The window is full.
+ *  \retval TAT_INVALID_ARGUMENT The length is out of bounds.
+ *
+ *  \ingroup arq
+ */
+tat_status_t arq_sender_queue( uint8_t *frame, uint8_t length, uint16_t *sequence_number ){
+
+    if ((length < ARQ_MIN_DATA_LENGTH) || (length > ARQ_MAX_FRAME_LENGTH)) { return TAT_INVALID_ARGUMENT; }
+
+    if (arq_sender_window_open( ) == false) { return TAT_BUSY_STATE; }
+
+    arq_slot_t *slot = &arq_slots[ arq_next & ARQ_WINDOW_MASK ];
+
+    frame[ ARQ_SEQ_OFFSET ]   = arq_next % 255;
+    frame[ ARQ_CARRY_OFFSET ] = arq_next / 255;
+
+    memcpy( slot->frame, frame, length );
+    slot->length          = length;
+    slot->state           = ARQ_SLOT_QUEUED;
+    slot->transmissions   = 0;
+    slot->sequence_number = arq_next;
+
+    if (sequence_number != NULL) { *sequence_number = arq_next; }
+
+    arq_next = arq_seq_add( arq_next, 1 );
+    arq_statistics.queued++;
+
+    return TAT_SUCCESS;
+}
+
+/*! \brief  Pick the frame to put on air next.
+ *
+ *          The oldest frame whose retransmission timer expired comes first,
+ *          then the oldest frame not sent yet. The caller transmits it in
+ *          TX_ARET_ON and reports the result with arq_sender_sent.
+ *
+ *  \param  frame Where the pointer to the frame is stored.
+ *
+ *  \return Frame length, or 0 if nothing is due.
+ *
+ *  \ingroup arq
+ */
+uint8_t arq_sender_next( uint8_t **frame ){
+
+    arq_slot_t *queued = NULL;
+    uint16_t sequence_number = arq_base;
+
+    arq_current = NULL;
+
+    while (sequence_number != arq_next) {
+
+        arq_slot_t *slot = &arq_slots[ sequence_number & ARQ_WINDOW_MASK ];
+
+        if ((slot->state == ARQ_SLOT_IN_FLIGHT) && (HAL_ELAPSED_TIME( slot->sent_time ) >= arq_rto)) {
+
+            if (slot->transmissions >= ARQ_MAX_TRANSMISSIONS) {
+
+                //Give up; the window moves on below.
+                slot->state = ARQ_SLOT_FREE;
+                arq_statistics.failed++;
+            } else {
+
+                arq_statistics.timeouts++;
+                arq_current = slot;
+                break;
+            }
+        }
+
+        if ((slot->state == ARQ_SLOT_QUEUED) && (queued == NULL)) { queued = slot; }
+
+        sequence_number = arq_seq_add( sequence_number, 1 );
+    }
+
+    arq_sender_advance_base( );
+
+    if (arq_current == NULL) { arq_current = queued; }
+
+    if (arq_current == NULL) { return 0; }
+
+    *frame = arq_current->frame;
+
+    return arq_current->length;
+}
+
+/*! \brief  Report the result of transmitting the frame from arq_sender_next.
+ *
+ *          A frame that failed on the MAC level is queued again at once;
+ *          otherwise its retransmission timer is started. A frame is given up
+ *          after ARQ_MAX_TRANSMISSIONS, when the last one fails or times out.
+ *
+ *  \param  status Result of the transmission.
+ *
+ *  \ingroup arq
+ */
+void arq_sender_sent( tat_status_t status ){
+
+    arq_slot_t *slot = arq_current;
+
+    if ((slot == NULL) || (slot->state == ARQ_SLOT_FREE)) { return; }
+
+    arq_current = NULL;
+    slot->transmissions++;
+    slot->sent_time = hal_get_system_time( );
+    arq_statistics.transmissions++;
+
+    if ((status != TAT_SUCCESS) && (slot->transmissions >= ARQ_MAX_TRANSMISSIONS)) {
+
+        slot->state = ARQ_SLOT_FREE;
+        arq_statistics.failed++;
+        arq_sender_advance_base( );
+
+        return;
+    }
+
+    slot->state = (status == TAT_SUCCESS) ? ARQ_SLOT_IN_FLIGHT : ARQ_SLOT_QUEUED;
+}
+
+/*! \brief  Process a frame received by the sender.
+ *
+ *          Every frame in the window that the SACK reports as received is
+ *          released, and the window moves on.
+ *
+ *  \param  frame Received frame, including the FCS.
+ *  \param  length Frame length.
+ *
+ *  \retval true The frame carried a SACK from the receiver.
+ *  \retval false The frame was not a SACK from the receiver.
+ *
+ *  \ingroup arq
+ */
+bool arq_sender_receive( uint8_t *frame, uint8_t length ){
+
+    if (length < ARQ_SACK_FRAME_LENGTH) { return false; }
+
+    uint16_t source = frame[ ARQ_SOURCE_OFFSET ] | ((uint16_t)frame[ ARQ_SOURCE_OFFSET + 1 ] << 8);
+    uint8_t *sack = &frame[ length - 2 - ARQ_SACK_LENGTH ];
+
+    if ((source != arq_peer_address) || (sack[ 6 ] != ARQ_SACK_MAGIC_0) || (sack[ 7 ] != ARQ_SACK_MAGIC_1)) {
+        return false;
+    }
+
+    uint16_t cumulative = sack[ 0 ] | ((uint16_t)sack[ 1 ] << 8);
+    uint32_t bitmap = sack[ 2 ] | ((uint32_t)sack[ 3 ] << 8) | ((uint32_t)sack[ 4 ] << 16) | ((uint32_t)sack[ 5 ] << 24);
+
+    if (cumulative >= ARQ_SEQ_MODULUS) { return false; }
+
+    arq_statistics.sacks++;
+
+    for (uint16_t sequence_number = arq_base; sequence_number != arq_next;
+         sequence_number = arq_seq_add( sequence_number, 1 )) {
+
+        arq_slot_t *slot = &arq_slots[ sequence_number & ARQ_WINDOW_MASK ];
+
+        if (slot->state == ARQ_SLOT_FREE) { continue; }
+
+        uint16_t distance = arq_seq_distance( cumulative, sequence_number );
+        bool received;
+
+        if (distance >= (ARQ_SEQ_MODULUS / 2)) {
+            received = true; //Before the cumulative acknowledge.
+        } else if ((distance == 0) || (distance > ARQ_BITMAP_SIZE)) {
+            received = false;
+        } else {
+            received = ((bitmap >> (distance - 1)) & 1) != 0;
+        }
+
+        if (received == true) {
+
+            if (slot == arq_current) { arq_current = NULL; }
+
+            slot->state = ARQ_SLOT_FREE;
+            arq_statistics.delivered++;
+        }
+    }
+
+    arq_sender_advance_base( );
+
+    return true;
+}
+
+/*! \brief  Number of frames in the window that are not acknowledged.
+ *
+ *  \ingroup arq
+ */
+uint8_t arq_sender_in_flight( void ){
+    return (uint8_t)arq_seq_distance( arq_base, arq_next );
+}
+
+/*! \brief  Read the sender counters.
+ *
+ *  \param  statistics Pointer to where the counters are copied.
+ *
+ *  \ingroup arq
+ */
+void arq_sender_get_statistics( arq_sender_statistics_t *statistics ){
+    *statistics = arq_statistics;
+}
+
+/*! \brief  Forget all senders.
+ *
+ *  \ingroup arq
+ */
+void arq_receiver_init( void ){
+
+    for (uint8_t i = 0; i < ARQ_RX_PEERS; i++) { arq_peers[ i ].used = false; }
+
+    arq_sack_sequence_number = 0;
+}
+
+/*! \brief  Register a data frame that left the rx_pool.
+ *
+ *          Must be called when the frame is delivered, not when it is
+ *          received, so that frames dropped by a pool overflow are
+ *          retransmitted.
+ *
+ *  \param  frame Received data frame.
+ *  \param  length Frame length.
+ *
+ *  \retval ARQ_NEW First copy of the frame; deliver it.
+ *  \retval ARQ_DUPLICATE The frame was delivered before.
+ *  \retval ARQ_NOT_ARQ The frame has no sequence number.
+ *
+ *  \ingroup arq
+ */
+arq_accept_t arq_receiver_accept( uint8_t *frame, uint8_t length ){
+
+    if ((length < ARQ_MIN_DATA_LENGTH) || (frame[ ARQ_SEQ_OFFSET ] == 255)) { return ARQ_NOT_ARQ; }
+
+    uint16_t address = frame[ ARQ_SOURCE_OFFSET ] | ((uint16_t)frame[ ARQ_SOURCE_OFFSET + 1 ] << 8);
+    uint16_t sequence_number = frame[ ARQ_CARRY_OFFSET ] * 255U + frame[ ARQ_SEQ_OFFSET ];
+    arq_peer_t *peer = arq_find_peer( address, false );
+
+    if (peer == NULL) {
+
+        peer = arq_find_peer( address, true );
+        peer->expected = sequence_number;
+    }
+
+    peer->last_heard = hal_get_system_time( );
+
+    uint16_t distance = arq_seq_distance( peer->expected, sequence_number );
+
+    if (distance >= (ARQ_SEQ_MODULUS / 2)) {
+
+        //Delivered before, unless the sender restarted.
+        if (++peer->old_run < ARQ_RESYNC_DUPLICATES) {
+
+            peer->sack_now = true;
+
+            return ARQ_DUPLICATE;
+        }
+
+        peer->expected = sequence_number;
+        peer->bitmap   = 0;
+        distance       = 0;
+    } else if (distance > (2 * ARQ_BITMAP_SIZE)) {
+
+        //Far ahead: everything in between is given up.
+        peer->expected = sequence_number;
+        peer->bitmap   = 0;
+        distance       = 0;
+    }
+
+    //Give up the oldest missing frames until the new one fits the bitmap.
+    while (distance > ARQ_BITMAP_SIZE) {
+
+        arq_peer_slide( peer );
+        distance = arq_seq_distance( peer->expected, sequence_number );
+    }
+
+    if (distance == 0) {
+        arq_peer_slide( peer );
+    } else {
+
+        uint32_t bit = 1UL << (distance - 1);
+
+        if ((peer->bitmap & bit) != 0) {
+
+            peer->sack_now = true;
+
+            return ARQ_DUPLICATE;
+        }
+
+        peer->bitmap |= bit;
+        peer->sack_now = true; //A gap: tell the sender now.
+    }
+
+    peer->old_run = 0;
+
+    if (peer->unacked++ == 0) { peer->first_unacked = peer->last_heard; }
+
+    return ARQ_NEW;
+}
+
+/*! \brief  Build a standalone SACK frame if one is due for any sender.
+ *
+ *          A SACK is due after ARQ_ACK_EVERY new frames, ARQ_ACK_DELAY
+ *          symbols after the oldest unacknowledged one, or at once after a
+ *          duplicate or a gap. Must be called from the main loop; the caller
+ *          sends the frame in TX_ARET_ON.
+ *
+ *  \param  frame Buffer of at least ARQ_SACK_FRAME_LENGTH bytes.
+ *
+ *  \return Frame length including the FCS, or 0 if no SACK is due.
+ *
+ *  \ingroup arq
+ */
+uint8_t arq_receiver_build_sack( uint8_t *frame ){
+
+    for (uint8_t i = 0; i < ARQ_RX_PEERS; i++) {
+
+        arq_peer_t *peer = &arq_peers[ i ];
+
+        if (peer->used == false) { continue; }
+
+        if ((peer->sack_now == false) && (peer->unacked < ARQ_ACK_EVERY) &&
+            ((peer->unacked == 0) || (HAL_ELAPSED_TIME( peer->first_unacked ) < ARQ_ACK_DELAY))) {
+            continue;
+        }
+
+        frame[ 0 ] = 0x61; //FCF: data frame, acknowledge request, PAN ID compression.
+        frame[ 1 ] = 0x88; //FCF: short addresses.
+        frame[ 2 ] = arq_sack_sequence_number++;
+        frame[ 3 ] = PAN_ID & 0xFF;
+        frame[ 4 ] = (PAN_ID >> 8) & 0xFF;
+        frame[ 5 ] = peer->address & 0xFF;
+        frame[ 6 ] = (peer->address >> 8) & 0xFF;
+        frame[ 7 ] = SHORT_ADDRESS & 0xFF;
+        frame[ 8 ] = (SHORT_ADDRESS >> 8) & 0xFF;
+
+        return arq_append_sack( frame, 9 + 2, peer->address );
+    }
+
+    return 0;
+}
+
+/*! \brief  Piggy-back a SACK on a frame to a sender.
+ *
+ *          The trailer is inserted in front of the FCS. Any acknowledge that
+ *          was due for the sender is then considered sent.
+ *
+ *  \param  frame Frame to the sender, with room for ARQ_SACK_LENGTH more
+ *                bytes.
+ *  \param  length Frame length including the FCS.
+ *  \param  peer_address Short address of the sender.
+ *
+ *  \return New frame length, or length if the sender is unknown or the frame
+ *          would be too long.
+ *
+ *  \ingroup arq
+ */
+uint8_t arq_append_sack( uint8_t *frame, uint8_t length, uint16_t peer_address ){
+
+    arq_peer_t *peer = arq_find_peer( peer_address, false );
+
+    if ((peer == NULL) || (length < 2) || ((length + ARQ_SACK_LENGTH) > RF231_MAX_TX_FRAME_LENGTH)) {
+        return length;
+    }
+
+    uint8_t *sack = &frame[ length - 2 ];
+
+    sack[ 0 ] = peer->expected & 0xFF;
+    sack[ 1 ] = peer->expected >> 8;
+    sack[ 2 ] = peer->bitmap & 0xFF;
+    sack[ 3 ] = (peer->bitmap >> 8) & 0xFF;
+    sack[ 4 ] = (peer->bitmap >> 16) & 0xFF;
+    sack[ 5 ] = (peer->bitmap >> 24) & 0xFF;
+    sack[ 6 ] = ARQ_SACK_MAGIC_0;
+    sack[ 7 ] = ARQ_SACK_MAGIC_1;
+
+    peer->unacked  = 0;
+    peer->sack_now = false;
+
+    return length + ARQ_SACK_LENGTH;
+}
+
+/*! \brief  Add n to a sequence number. */
+static uint16_t arq_seq_add( uint16_t sequence_number, uint16_t n ){
+
+    uint32_t sum = (uint32_t)sequence_number + n;
+
+    return (sum >= ARQ_SEQ_MODULUS) ? (uint16_t)(sum - ARQ_SEQ_MODULUS) : (uint16_t)sum;
+}
+
+/*! \brief  Number of steps from one sequence number to another. */
+static uint16_t arq_seq_distance( uint16_t from, uint16_t to ){
+    return (to >= from) ? (to - from) : (uint16_t)(to + ARQ_SEQ_MODULUS - from);
+}
+
+/*! \brief  Move the window past acknowledged and given up frames. */
+static void arq_sender_advance_base( void ){
+
+    while ((arq_base != arq_next) && (arq_slots[ arq_base & ARQ_WINDOW_MASK ].state == ARQ_SLOT_FREE)) {
+        arq_base = arq_seq_add( arq_base, 1 );
+    }
+}
+
+/*! \brief  Look up a sender, optionally replacing the least recently heard
+ *          one.
+ */
+static arq_peer_t *arq_find_peer( uint16_t address, bool allocate ){
+
+    arq_peer_t *oldest = &arq_peers[ 0 ];
+
+    for (uint8_t i = 0; i < ARQ_RX_PEERS; i++) {
+
+        arq_peer_t *peer = &arq_peers[ i ];
+
+        if (peer->used == false) {
+
+            if (allocate == true) {
+                oldest = peer;
+                break;
+            }
+
+            continue;
+        }
+
+        if (peer->address == address) { return peer; }
+
+        if ((oldest->used == true) &&
+            (HAL_ELAPSED_TIME( peer->last_heard ) > HAL_ELAPSED_TIME( oldest->last_heard ))) {
+            oldest = peer;
+        }
+    }
+
+    if (allocate == false) { return NULL; }
+
+    oldest->used     = true;
+    oldest->address  = address;
+    oldest->bitmap   = 0;
+    oldest->unacked  = 0;
+    oldest->old_run  = 0;
+    oldest->sack_now = false;
+
+    return oldest;
+}
+
+/*! \brief  The expected frame was received or given up: move past it and
+ *          every frame after it that was already received.
+ */
+static void arq_peer_slide( arq_peer_t *peer ){
+
+    bool received;
+
+    do {
+
+        received = (peer->bitmap & 1) != 0;
+        peer->bitmap >>= 1;
+        peer->expected = arq_seq_add( peer->expected, 1 );
+    } while (received == true);
+}
+#endif /* defined( ARQ ) */
+/*EOF*/
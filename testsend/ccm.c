@@ -0,0 +1,404 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config_uart_extended.h"
+#include "at86rf231.h"
+
+#include "compiler.h"
+#include "hal.h"
+#include "tat.h"
+#include "com.h"
+#include "entropy.h"
+#include "sal.h"
+#include "aes_sw.h"
+#include "ccm.h"
+
+#if defined( SECURITY )
+/*============================ MACROS ========================================*/
+#define CCM_BLOCK_SIZE           ( AES_BLOCKSIZE )
+#define CCM_NONCE_LENGTH         ( 13 )
+#define CCM_HEADER_LENGTH        ( CCM_MAC_HEADER_LENGTH + CCM_AUX_HEADER_LENGTH ) //!< Authenticated, not encrypted.
+#define CCM_FLAGS_AUTH           ( 0x40 | (((CCM_MIC_LENGTH - 2) / 2) << 3) | (2 - 1) ) //!< B0: Adata, M = 4, L = 2.
+#define CCM_FLAGS_ENC            ( 2 - 1 ) //!< Ai: L = 2.
+#define CCM_SYMBOLS_PER_SECOND   ( 62500UL )
+/*============================ TYPEDEFS ======================================*/
+/*============================ VARIABLES =====================================*/
+static ccm_aes_t ccm_aes = CCM_AES_HARDWARE; //!< AES implementation in use.
+static uint8_t ccm_key[ AES_KEYSIZE ]; //!< Key, loaded into the AES engine for every frame.
+static uint32_t ccm_frame_counter; //!< Frame counter of the next secured frame.
+static uint8_t ccm_block[ CCM_BLOCK_SIZE ]; //!< Block being built.
+static uint8_t ccm_x[ CCM_BLOCK_SIZE ]; //!< CBC-MAC state of the software AES.
+
+static uint8_t debug_ccm[] = "\r\nCCM "; //!< Debug Text.
+/*============================ PROTOTYPES ====================================*/
+static void ccm_nonce( uint8_t *frame, uint8_t *nonce );
+static void ccm_mac( uint8_t *nonce, uint8_t *header, uint8_t *payload, uint8_t payload_length, uint8_t *mic );
+static void ccm_mac_data( uint8_t *data, uint8_t length, uint8_t used );
+static void ccm_mac_block( uint8_t *block );
+static void ccm_ctr( uint8_t *nonce, uint8_t *data, uint8_t length, uint8_t *s0 );
+static void ccm_ctr_block( uint8_t *nonce, uint8_t counter );
+static void ccm_ctr_apply( uint8_t counter, uint8_t *keystream, uint8_t *data, uint8_t length, uint8_t *s0 );
+
+/*! \brief  Load the key into both AES implementations.
+ *
+ *          The frame counter starts at a random value from the entropy pool,
+ *          so that nonces are not repeated after a reset. Call after
+ *          entropy_harvest.
+ *
+ *  \param  key 16 byte key, shared by all nodes.
+ *
+ *  \ingroup ccm
+ */
+void ccm_init( uint8_t *key ){
+
+    uint8_t seed[ 3 ] = { 0, 0, 0 };
+
+    entropy_get_bytes( seed, sizeof( seed ) );
+
+    //The 8 LSB start at 0, which leaves at least 2^8 frames before a wrap.
+    ccm_frame_counter = ((uint32_t)(seed[ 0 ] & 0x7F) << 24) | ((uint32_t)seed[ 1 ] << 16) | ((uint16_t)seed[ 2 ] << 8);
+
+    memcpy( ccm_key, key, AES_KEYSIZE );
+
+    sal_init( );
+    aes_sw_setup( key );
+}
+
+/*! \brief  Select the AES implementation. The hardware engine is the default.
+ *
+ *  \param  aes CCM_AES_HARDWARE or CCM_AES_SOFTWARE.
+ *
+ *  \ingroup ccm
+ */
+void ccm_set_aes( ccm_aes_t aes ){
+    ccm_aes = aes;
+}
+
+/*! \brief  Encrypt and authenticate a data frame.
+ *
+ *          The auxiliary security header and the MIC are added, so the frame
+ *          grows by CCM_OVERHEAD bytes.
+ *
+ *  \param  frame Frame in the clear: 9 byte MAC header, payload, room for the
+ *                FCS.
+ *  \param  length Frame length including the FCS.
+ *  \param  secured Buffer for the secured frame, RF231_MAX_TX_FRAME_LENGTH
+ *                  bytes. Must not overlap frame.
+ *
+ *  \return Length of the secured frame, or 0 if it would be too long or the
+ *          frame counter is exhausted.
+ *
+ *  \ingroup ccm
+ */
+uint8_t ccm_secure( uint8_t *frame, uint8_t length, uint8_t *secured ){
+
+    if ((length < (CCM_MAC_HEADER_LENGTH + 2)) || ((length + CCM_OVERHEAD) > RF231_MAX_TX_FRAME_LENGTH)) { return 0; }
+
+    if (ccm_frame_counter == 0xFFFFFFFF) { return 0; }
+
+    uint8_t payload_length = length - CCM_MAC_HEADER_LENGTH - 2;
+    uint8_t *payload = &secured[ CCM_HEADER_LENGTH ];
+    uint8_t nonce[ CCM_NONCE_LENGTH ];
+    uint8_t mic[ CCM_BLOCK_SIZE ];
+    uint8_t s0[ CCM_BLOCK_SIZE ];
+
+    memcpy( secured, frame, CCM_MAC_HEADER_LENGTH );
+    secured[ 0 ] |= CCM_FCF_SECURITY;
+    secured[ 1 ] |= CCM_FCF_VERSION_2006;
+    secured[ 9 ]  = CCM_SECURITY_LEVEL;
+    secured[ 10 ] = ccm_frame_counter & 0xFF;
+    secured[ 11 ] = (ccm_frame_counter >> 8) & 0xFF;
+    secured[ 12 ] = (ccm_frame_counter >> 16) & 0xFF;
+    secured[ 13 ] = (ccm_frame_counter >> 24) & 0xFF;
+    ccm_frame_counter++;
+
+    memcpy( payload, &frame[ CCM_MAC_HEADER_LENGTH ], payload_length );
+
+    ccm_nonce( secured, nonce );
+    ccm_mac( nonce, secured, payload, payload_length, mic );
+    ccm_ctr( nonce, payload, payload_length, s0 );
+
+    for (uint8_t i = 0; i < CCM_MIC_LENGTH; i++) { payload[ payload_length + i ] = mic[ i ] ^ s0[ i ]; }
+
+    return length + CCM_OVERHEAD;
+}
+
+/*! \brief  Check and decrypt a secured frame in place.
+ *
+ *          On success the auxiliary security header and the MIC are removed
+ *          and the security bits cleared, so the frame looks as it did before
+ *          ccm_secure. Frame counters are not checked for replays.
+ *
+ *  \param  frame Received frame, including the FCS.
+ *  \param  length Frame length; updated on success.
+ *
+ *  \retval TAT_SUCCESS The frame is authentic and decrypted.
+ *  \retval TAT_INVALID_ARGUMENT The frame is not secured as described in
+ *                               ccm.h.
+ *  \retval TAT_CRC_FAILED The MIC does not match; drop the frame.
+ *
+ *  \ingroup ccm
+ */
+tat_status_t ccm_unsecure( uint8_t *frame, uint8_t *length ){
+
+    if (((frame[ 0 ] & CCM_FCF_SECURITY) == 0) || (*length < (CCM_HEADER_LENGTH + CCM_MIC_LENGTH + 2)) ||
+        (frame[ 9 ] != CCM_SECURITY_LEVEL)) {
+        return TAT_INVALID_ARGUMENT;
+    }
+
+    uint8_t payload_length = *length - CCM_HEADER_LENGTH - CCM_MIC_LENGTH - 2;
+    uint8_t *payload = &frame[ CCM_HEADER_LENGTH ];
+    uint8_t nonce[ CCM_NONCE_LENGTH ];
+    uint8_t mic[ CCM_BLOCK_SIZE ];
+    uint8_t s0[ CCM_BLOCK_SIZE ];
+    uint8_t difference = 0;
+
+    ccm_nonce( frame, nonce );
+    ccm_ctr( nonce, payload, payload_length, s0 );
+    ccm_mac( nonce, frame, payload, payload_length, mic );
+
+    for (uint8_t i = 0; i < CCM_MIC_LENGTH; i++) { difference |= payload[ payload_length + i ] ^ mic[ i ] ^ s0[ i ]; }
+
+    if (difference != 0) { return TAT_CRC_FAILED; }
+
+    frame[ 0 ] &= ~CCM_FCF_SECURITY;
+    frame[ 1 ] &= ~CCM_FCF_VERSION_2006;
+    memmove( &frame[ CCM_MAC_HEADER_LENGTH ], payload, payload_length );
+    *length -= CCM_OVERHEAD;
+
+    return TAT_SUCCESS;
+}
+
+/*! \brief  Measure CCM* with the software AES and the AES engine, and print
+ *          the results on the UART.
+ *
+ *          Frames of the largest payload that fits are secured
+ *          CCM_BENCHMARK_FRAMES times with each implementation. One line is
+ *          printed per implementation, as hex: implementation (ccm_aes_t),
+ *          microseconds per frame (2 bytes) and payload bytes per second (4
+ *          bytes), MSB first. The time includes the interrupts served
+ *          meanwhile, and has symbol (16 us) resolution over the whole run.
+ *
+ *  \ingroup ccm
+ */
+void ccm_benchmark( void ){
+
+    static uint8_t frame[ RF231_MAX_TX_FRAME_LENGTH ];
+    static uint8_t secured[ RF231_MAX_TX_FRAME_LENGTH ];
+    uint8_t length = RF231_MAX_TX_FRAME_LENGTH - CCM_OVERHEAD;
+    uint32_t bytes = (uint32_t)(length - CCM_MAC_HEADER_LENGTH - 2) * CCM_BENCHMARK_FRAMES;
+    ccm_aes_t saved_aes = ccm_aes;
+
+    for (uint8_t i = 0; i < length; i++) { frame[ i ] = i; }
+    frame[ 0 ] = 0x61;
+    frame[ 1 ] = 0x88;
+
+    for (uint8_t aes = CCM_AES_SOFTWARE; aes <= CCM_AES_HARDWARE; aes++) {
+
+        ccm_aes = (ccm_aes_t)aes;
+
+        uint32_t start = hal_get_system_time( );
+
+        for (uint8_t n = 0; n < CCM_BENCHMARK_FRAMES; n++) { ccm_secure( frame, length, secured ); }
+
+        uint32_t symbols = HAL_ELAPSED_TIME( start );
+        if (symbols == 0) { symbols = 1; }
+
+        uint16_t us_per_frame = (uint16_t)((symbols * 16) / CCM_BENCHMARK_FRAMES);
+        uint32_t bytes_per_second = (bytes * CCM_SYMBOLS_PER_SECOND) / symbols;
+
+        com_send_string( debug_ccm, sizeof( debug_ccm ) );
+        com_send_hex( aes );
+        com_send_hex( us_per_frame >> 8 );
+        com_send_hex( us_per_frame & 0xFF );
+        com_send_hex( (bytes_per_second >> 24) & 0xFF );
+        com_send_hex( (bytes_per_second >> 16) & 0xFF );
+        com_send_hex( (bytes_per_second >> 8) & 0xFF );
+        com_send_hex( bytes_per_second & 0xFF );
+    }
+
+    ccm_aes = saved_aes;
+}
+
+/*! \brief  Handle a command received on the UART. Must be called from the
+ *          main loop, with the result of com_get_command.
+ *
+ *  \param  command Command character. Only CCM_COMMAND_BENCHMARK is handled.
+ *
+ *  \retval true The benchmark was run.
+ *  \retval false The command is not a CCM command.
+ *
+ *  \ingroup ccm
+ */
+bool ccm_command( uint8_t command ){
+
+    if (command != CCM_COMMAND_BENCHMARK) { return false; }
+
+    ccm_benchmark( );
+
+    return true;
+}
+
+/*! \brief  Build the nonce from the MAC header and the auxiliary security
+ *          header of a secured frame.
+ */
+static void ccm_nonce( uint8_t *frame, uint8_t *nonce ){
+
+    nonce[ 0 ]  = 0x00;
+    nonce[ 1 ]  = 0x00;
+    nonce[ 2 ]  = frame[ 4 ]; //PAN ID.
+    nonce[ 3 ]  = frame[ 3 ];
+    nonce[ 4 ]  = 0x00;
+    nonce[ 5 ]  = 0x00;
+    nonce[ 6 ]  = frame[ 8 ]; //Source short address.
+    nonce[ 7 ]  = frame[ 7 ];
+    nonce[ 8 ]  = frame[ 13 ]; //Frame counter.
+    nonce[ 9 ]  = frame[ 12 ];
+    nonce[ 10 ] = frame[ 11 ];
+    nonce[ 11 ] = frame[ 10 ];
+    nonce[ 12 ] = frame[ 9 ]; //Security level.
+}
+
+/*! \brief  Compute the CBC-MAC over B0, the headers and the payload in the
+ *          clear. The tag is the first CCM_MIC_LENGTH bytes of mic.
+ *
+ *          The AES engine chains the blocks itself in CBC mode, so each block
+ *          is only written; the tag is read once at the end.
+ */
+static void ccm_mac( uint8_t *nonce, uint8_t *header, uint8_t *payload, uint8_t payload_length, uint8_t *mic ){
+
+    ccm_block[ 0 ] = CCM_FLAGS_AUTH;
+    memcpy( &ccm_block[ 1 ], nonce, CCM_NONCE_LENGTH );
+    ccm_block[ 14 ] = 0;
+    ccm_block[ 15 ] = payload_length;
+
+    if (ccm_aes == CCM_AES_HARDWARE) {
+
+        //The key is lost in SLEEP, and aes_bench.c loads its own, so load it
+        //again for every frame.
+        sal_aes_setup( ccm_key, AES_MODE_ECB, AES_DIR_ENCRYPT );
+        sal_aes_wrrd( ccm_block, NULL );
+        sal_aes_setup( NULL, AES_MODE_CBC, AES_DIR_ENCRYPT );
+    } else {
+        aes_sw_encrypt( ccm_block, ccm_x );
+    }
+
+    //Additional data, preceded by its length.
+    ccm_block[ 0 ] = 0;
+    ccm_block[ 1 ] = CCM_HEADER_LENGTH;
+    ccm_mac_data( header, CCM_HEADER_LENGTH, 2 );
+
+    ccm_mac_data( payload, payload_length, 0 );
+
+    if (ccm_aes == CCM_AES_HARDWARE) {
+        sal_aes_read( mic );
+    } else {
+        memcpy( mic, ccm_x, CCM_BLOCK_SIZE );
+    }
+}
+
+/*! \brief  Add data to the CBC-MAC in zero padded blocks.
+ *
+ *  \param  data Data.
+ *  \param  length Data length.
+ *  \param  used Bytes already in ccm_block.
+ */
+static void ccm_mac_data( uint8_t *data, uint8_t length, uint8_t used ){
+
+    while ((used != 0) || (length != 0)) {
+
+        while ((used < CCM_BLOCK_SIZE) && (length != 0)) {
+
+            ccm_block[ used++ ] = *data++;
+            length--;
+        }
+
+        memset( &ccm_block[ used ], 0, CCM_BLOCK_SIZE - used );
+        ccm_mac_block( ccm_block );
+        used = 0;
+    }
+}
+
+/*! \brief  Run one block through the CBC-MAC. */
+static void ccm_mac_block( uint8_t *block ){
+
+    if (ccm_aes == CCM_AES_HARDWARE) {
+        sal_aes_wrrd( block, NULL );
+    } else {
+
+        for (uint8_t i = 0; i < CCM_BLOCK_SIZE; i++) { ccm_x[ i ] ^= block[ i ]; }
+
+        aes_sw_encrypt( ccm_x, ccm_x );
+    }
+}
+
+/*! \brief  Encrypt or decrypt data in counter mode, and return S0 for the
+ *          MIC.
+ *
+ *          With the AES engine every write of counter block Ai reads back
+ *          the key stream of Ai-1 in the same SPI transaction, so each block
+ *          costs one transaction and one AES operation.
+ */
+static void ccm_ctr( uint8_t *nonce, uint8_t *data, uint8_t length, uint8_t *s0 ){
+
+    uint8_t blocks = (length + CCM_BLOCK_SIZE - 1) / CCM_BLOCK_SIZE;
+    uint8_t keystream[ CCM_BLOCK_SIZE ];
+
+    if (ccm_aes == CCM_AES_HARDWARE) {
+
+        sal_aes_setup( NULL, AES_MODE_ECB, AES_DIR_ENCRYPT );
+
+        ccm_ctr_block( nonce, 0 );
+        sal_aes_wrrd( ccm_block, NULL );
+
+        for (uint8_t counter = 1; counter <= blocks; counter++) {
+
+            ccm_ctr_block( nonce, counter );
+            sal_aes_wrrd( ccm_block, keystream );
+            ccm_ctr_apply( counter - 1, keystream, data, length, s0 );
+        }
+
+        sal_aes_read( keystream );
+        ccm_ctr_apply( blocks, keystream, data, length, s0 );
+    } else {
+
+        for (uint8_t counter = 0; counter <= blocks; counter++) {
+
+            ccm_ctr_block( nonce, counter );
+            aes_sw_encrypt( ccm_block, keystream );
+            ccm_ctr_apply( counter, keystream, data, length, s0 );
+        }
+    }
+}
+
+/*! \brief  Build counter block Ai in ccm_block. */
+static void ccm_ctr_block( uint8_t *nonce, uint8_t counter ){
+
+    ccm_block[ 0 ] = CCM_FLAGS_ENC;
+    memcpy( &ccm_block[ 1 ], nonce, CCM_NONCE_LENGTH );
+    ccm_block[ 14 ] = 0;
+    ccm_block[ 15 ] = counter;
+}
+
+/*! \brief  Use the key stream of counter block Ai: S0 is kept for the MIC,
+ *          the others are XORed into the data.
+ */
+static void ccm_ctr_apply( uint8_t counter, uint8_t *keystream, uint8_t *data, uint8_t length, uint8_t *s0 ){
+
+    if (counter == 0) {
+
+        memcpy( s0, keystream, CCM_BLOCK_SIZE );
+
+        return;
+    }
+
+    uint8_t offset = (counter - 1) * CCM_BLOCK_SIZE;
+    uint8_t end = ((length - offset) > CCM_BLOCK_SIZE) ? (offset + CCM_BLOCK_SIZE) : length;
+
+    for (uint8_t i = offset; i < end; i++) { data[ i ] ^= keystream[ i - offset ]; }
+}
+#endif /* defined( SECURITY ) */
+/*EOF*/
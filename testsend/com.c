@@ -6,6 +6,7 @@
 
 #include "compiler.h"
 #include "com.h"
+#include "prof.h"
 /*============================ MACROS ========================================*/
 #define COM_RX_MAX_BYTES (COM_RX_BUFFER_SIZE - 2) //!< Maximal number of bytes that one message can contain (PSDU_LENGTH - CRC_LENGTH).
 /*============================ TYPEDEFS ======================================*/
@@ -26,11 +27,11 @@ static uint8_t dec_lookup[] = "0123456789";
  *  
  *  \param[in] rate Baudrate used by the AVR's USART.
  */
-void com_init( uint8_t rate ){
+void com_init( baud_rate_t rate ){
   
 
-    UBRR0H = 0x00;
-    UBRR0L = rate;
+    UBRR0H = (uint8_t)(rate >> 8);
+    UBRR0L = (uint8_t)rate;
   
     //Enable USART transmitter module. Always on.
     ENABLE_RECEIVER;
@@ -52,11 +53,15 @@ void com_init( uint8_t rate ){
  */
 void com_send_string( uint8_t *data, uint8_t data_length ){
     
+    PROF_ENTER( PROF_UART_SEND );
+    
     while (--data_length > 0) {
         for(; !(UCSR0A & (1 << UDRE0));) {;}
   	    UDR0 = *data++; //Put symbol in data register.
     
     }    
+    
+    PROF_LEAVE( PROF_UART_SEND );
 }
 
 /*! \brief This function prints the supplied argument as a hex number.
@@ -65,6 +70,7 @@ void com_send_string( uint8_t *data, uint8_t data_length ){
  */
  void com_send_hex( uint8_t nmbr ){
 	
+			PROF_ENTER( PROF_UART_SEND );
 
 			//for(; !(UCSR0A & (1 << UDRE0));) {;}
 			//UDR0 = '0'; //Put symbol in data register.
@@ -77,6 +83,7 @@ void com_send_string( uint8_t *data, uint8_t data_length ){
 			
 			for(; !(UCSR0A & (1 << UDRE0));) {;}
 			UDR0 = hex_lookup[ ( nmbr & 0x0F ) ];
+			PROF_LEAVE( PROF_UART_SEND );
 	}
 	
 
@@ -138,6 +145,25 @@ void com_reset_receiver( void ){
     ENABLE_RECEIVE_COMPLETE_INTERRUPT;
 }
 
+/*! \brief This function returns the first character of the last line received
+ *         on the UART, and resets the receiver for the next line. Used for the
+ *         one character debug commands (see prof.h and trace.h).
+ *
+ *  \return The command character, or 0 if no line was received.
+ */
+uint8_t com_get_command( void ){
+    
+    uint8_t length = com_get_number_of_received_bytes( );
+    
+    if (length == 0) { return 0; }
+    
+    uint8_t command = (length > 1) ? *com_get_received_data( ) : 0;
+    
+    com_reset_receiver( );
+    
+    return command;
+}
+
 /*! \brief  Universal receive interrupt service routine for both USART0 and the FTDI USB chip.
  *
  *  This routine is called whenever a new byte is available to be read. This service routine
@@ -188,6 +214,7 @@ ISR( USART0_RX_vect )
 //	TCCR0B = 0x00;
 //	TCNT0 = Timer0_Initvalue;//0x19; //reset timer0 Value
 //	hal_clear_timer0_flag();
+	PROF_ENTER( PROF_UART_RX_ISR );
 	receivedData = ( uint8_t )UDR0;	//Collect data.
 
 	if (com_number_of_received_bytes < COM_RX_MAX_BYTES) 
@@ -247,6 +274,7 @@ ISR( USART0_RX_vect )
 	
 */
 	}
+	PROF_LEAVE( PROF_UART_RX_ISR );
 }
 
 
@@ -0,0 +1,160 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "at86rf231.h"
+
+#include "compiler.h"
+#include "hal.h"
+#include "tat.h"
+#include "entropy.h"
+/*============================ MACROS ========================================*/
+#define ENTROPY_READS_PER_BYTE ( 4 ) //!< RND_VALUE holds 2 random bits.
+#define ENTROPY_BUSY_TIMEOUT   ( 400 ) //!< Symbols to wait for a frame that started in RX_ON: the longest, and its acknowledge.
+/*============================ TYPEDEFS ======================================*/
+/*============================ VARIABLES =====================================*/
+static uint8_t entropy_pool[ ENTROPY_POOL_SIZE ]; //!< Harvested random bytes.
+static uint8_t entropy_head; //!< Index where the next harvested byte is written.
+static uint8_t entropy_tail; //!< Index of the next byte to hand out.
+static uint8_t entropy_count; //!< Number of bytes in the pool.
+/*============================ PROTOTYPES ====================================*/
+
+/*! \brief  Initialize the entropy pool. The pool is empty until 
+ *          entropy_harvest has been called.
+ *
+ *  \ingroup entropy
+ */
+void entropy_init( void ){
+
+    entropy_head  = 0;
+    entropy_tail  = 0;
+    entropy_count = 0;
+}
+
+/*! \brief  Add up to ENTROPY_HARVEST_BYTES random bytes to the pool. Must be 
+ *          called from the main loop, not from an interrupt.
+ *
+ *          The bits come from the RND_VALUE subregister, which is only valid 
+ *          in RX_ON. If the radio transceiver is in RX_AACK_ON it is moved to 
+ *          RX_ON for the few microseconds the harvest takes, and then back. In 
+ *          any other state, or when the pool is full, nothing is done.
+ *
+ *  \ingroup entropy
+ */
+void entropy_harvest( void ){
+
+    if (entropy_count == ENTROPY_POOL_SIZE) { return; }
+
+    uint8_t original_state = tat_get_trx_state( );
+
+    if (original_state == RX_AACK_ON) {
+        if (tat_set_trx_state( RX_ON ) != TAT_SUCCESS) { return; }
+    } else if (original_state != RX_ON) {
+        return;
+    }
+
+    for (uint8_t harvested = 0; 
+         (harvested < ENTROPY_HARVEST_BYTES) && (entropy_count < ENTROPY_POOL_SIZE);
+         harvested++) {
+
+        uint8_t random_byte = 0;
+
+        for (uint8_t i = 0; i < ENTROPY_READS_PER_BYTE; i++) {
+
+            delay_us( 1 ); //RND_VALUE is updated every 1 us.
+            random_byte = (random_byte << 2) | hal_subregister_read( SR_RND_VALUE );
+        }
+
+        entropy_pool[ entropy_head ] = random_byte;
+        entropy_head = (entropy_head + 1) % ENTROPY_POOL_SIZE;
+        entropy_count++;
+    }
+
+    //A frame may have started in RX_ON. It is received without acknowledge,
+    //and the transition is done once the transceiver is no longer busy.
+    if (original_state == RX_AACK_ON) {
+
+        uint32_t busy_start = hal_get_system_time( );
+        tat_status_t state_status;
+
+        do {
+            state_status = tat_set_trx_state( RX_AACK_ON );
+        } while ((state_status == TAT_BUSY_STATE) && (HAL_ELAPSED_TIME( busy_start ) < ENTROPY_BUSY_TIMEOUT));
+
+        if (state_status == TAT_BUSY_STATE) { tat_recover( RX_AACK_ON ); } //Stuck in BUSY_RX.
+    }
+}
+
+/*! \brief  Number of random bytes that can be read without waiting.
+ *
+ *  \ingroup entropy
+ */
+uint8_t entropy_available( void ){
+    return entropy_count;
+}
+
+/*! \brief  Take one random byte from the pool. Never blocks.
+ *
+ *  \param  value Pointer to where the byte is stored.
+ *
+ *  \retval true A byte was stored in value.
+ *  \retval false The pool is empty; value is not changed.
+ *
+ *  \ingroup entropy
+ */
+bool entropy_get_byte( uint8_t *value ){
+
+    if (entropy_count == 0) { return false; }
+
+    *value = entropy_pool[ entropy_tail ];
+    entropy_tail = (entropy_tail + 1) % ENTROPY_POOL_SIZE;
+    entropy_count--;
+
+    return true;
+}
+
+/*! \brief  Take up to length random bytes from the pool, for example for a 
+ *          nonce. Never blocks.
+ *
+ *  \param  buffer Pointer to where the bytes are stored.
+ *  \param  length Number of bytes wanted.
+ *
+ *  \return Number of bytes stored in buffer. Less than length if the pool ran 
+ *          empty.
+ *
+ *  \ingroup entropy
+ */
+uint8_t entropy_get_bytes( uint8_t *buffer, uint8_t length ){
+
+    uint8_t copied = 0;
+
+    while ((copied < length) && (entropy_get_byte( &buffer[ copied ] ) == true)) {
+        copied++;
+    }
+
+    return copied;
+}
+
+/*! \brief  Write a new CSMA_SEED from the pool, so the back-off sequence 
+ *          differs from other nodes running the same image.
+ *
+ *  \retval true The seed was changed.
+ *  \retval false Fewer than two bytes were available; the seed is unchanged.
+ *
+ *  \ingroup entropy
+ */
+bool entropy_seed_csma( void ){
+
+    if (entropy_count < 2) { return false; }
+
+    uint8_t seed_low = 0;
+    uint8_t seed_high = 0;
+
+    entropy_get_byte( &seed_low );
+    entropy_get_byte( &seed_high );
+
+    tat_set_csma_seed( ((uint16_t)seed_high << 8) | seed_low );
+
+    return true;
+}
+/*EOF*/
@@ -0,0 +1,59 @@
+#ifndef AGGR_H
+#define AGGR_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "tat.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  An aggregate is due for transmission when it holds this many
+ *          bytes of messages, length bytes included.
+ *
+ *  \ingroup aggr
+ */
+#ifndef AGGR_BYTE_BUDGET
+#define AGGR_BYTE_BUDGET         ( 96 )
+#endif
+
+/*! \brief  An aggregate is due for transmission this many symbols after its
+ *          first message was added (500 ms), even if it is not full.
+ *
+ *  \ingroup aggr
+ */
+#ifndef AGGR_MAX_DELAY
+#define AGGR_MAX_DELAY           ( 31250 )
+#endif
+
+/*! \name   Aggregate format.
+ *
+ *          An aggregate is a data frame with the usual 9 byte MAC header,
+ *          followed by AGGR_DISPATCH, the number of messages, and then each
+ *          message as a length byte and the message bytes. The FCS follows
+ *          the last message.
+ *
+ *  \ingroup aggr
+ *  @{
+ */
+#define AGGR_DISPATCH            ( 0xF6 )
+#define AGGR_MAC_HEADER_LENGTH   ( 9 )
+#define AGGR_HEADER_LENGTH       ( 2 )
+#define AGGR_MAX_PAYLOAD         ( RF231_MAX_TX_FRAME_LENGTH - AGGR_MAC_HEADER_LENGTH - AGGR_HEADER_LENGTH - 2 )
+#define AGGR_MAX_MESSAGE_LENGTH  ( AGGR_MAX_PAYLOAD - 1 )
+//! @}
+
+#if (AGGR_BYTE_BUDGET == 0) || (AGGR_BYTE_BUDGET > AGGR_MAX_PAYLOAD)
+    #error "AGGR_BYTE_BUDGET must be 1 to AGGR_MAX_PAYLOAD."
+#endif
+/*============================ TYPEDEFS ======================================*/
+/*============================ PROTOTYPES ====================================*/
+void aggr_init( uint16_t dest_address );
+tat_status_t aggr_add( uint8_t *message, uint8_t length );
+bool aggr_ready( void );
+uint8_t aggr_take( uint8_t **frame );
+
+bool aggr_is_aggregate( uint8_t *frame, uint8_t length );
+uint8_t aggr_next_message( uint8_t *frame, uint8_t length, uint8_t *position, uint8_t **message );
+#endif
+/*EOF*/
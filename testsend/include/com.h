@@ -68,6 +68,20 @@ typedef enum
 	BR_57600 = 7,
 	BR_115200= 3
 }baud_rate_t;
+#elif ( F_CPU == 16000000UL )
+typedef enum
+{//Main Freq= 16.0 MHz
+	BR_2400= 416,
+	BR_4800= 207,
+	BR_9600  = 103, /*!< Sets the baud rate to 9600. */
+	BR_14400 = 68,
+	BR_19200 = 51, /*!< Sets the baud rate to 19200. */
+	BR_28800 = 34,
+	BR_31250 = 31,
+	BR_38400 = 25,  /*!< Sets the baud rate to 38400. */
+	BR_57600 = 16,
+	BR_115200= 8
+}baud_rate_t;
 #else
     #error "Clock speed not supported."
 #endif/*============================ VARIABLES =====================================*/
@@ -79,4 +93,5 @@ void com_send_hex( uint8_t nmbr );
 uint8_t * com_get_received_data( void );
 uint8_t com_get_number_of_received_bytes( void );
 void com_reset_receiver( void );
+uint8_t com_get_command( void );
 #endif
@@ -0,0 +1,131 @@
+#ifndef FRAG_H
+#define FRAG_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "tat.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Largest datagram that can be sent or reassembled.
+ *
+ *  \ingroup frag
+ */
+#ifndef FRAG_MAX_DATAGRAM_SIZE
+#define FRAG_MAX_DATAGRAM_SIZE   ( 512 )
+#endif
+
+/*! \brief  Datagrams the receiver reassembles at the same time, each with a
+ *          buffer of FRAG_MAX_DATAGRAM_SIZE bytes. A fragment of another
+ *          datagram is dropped while all buffers are in use.
+ *
+ *  \ingroup frag
+ */
+#ifndef FRAG_REASSEMBLY_BUFFERS
+#define FRAG_REASSEMBLY_BUFFERS  ( 2 )
+#endif
+
+/*! \brief  A datagram is dropped when no fragment of it was received for
+ *          this many symbols (1 s).
+ *
+ *  \ingroup frag
+ */
+#ifndef FRAG_REASSEMBLY_TIMEOUT
+#define FRAG_REASSEMBLY_TIMEOUT  ( 62500 )
+#endif
+
+/*! \brief  Transmissions of one fragment before the sender gives up the
+ *          datagram.
+ *
+ *  \ingroup frag
+ */
+#ifndef FRAG_MAX_ATTEMPTS
+#define FRAG_MAX_ATTEMPTS        ( 4 )
+#endif
+
+/*! \name   Fragment format.
+ *
+ *          A fragment is a data frame with the usual 9 byte MAC header,
+ *          followed by a fragment header, the fragment data and the FCS. The
+ *          header is, all fields LSB first:
+ *          - FRAG_DISPATCH.
+ *          - Datagram size in bytes (2 bytes).
+ *          - Datagram tag: the same for all fragments of a datagram.
+ *          - Offset of the fragment data in the datagram, in bytes (2 bytes).
+ *
+ *          The offset and the length of all but the last fragment are
+ *          multiples of FRAG_BLOCK_SIZE. The receiver keeps one bit per block.
+ *
+ *  \ingroup frag
+ *  @{
+ */
+#define FRAG_DISPATCH            ( 0xF5 )
+#define FRAG_MAC_HEADER_LENGTH   ( 9 )
+#define FRAG_HEADER_LENGTH       ( 6 )
+#define FRAG_BLOCK_SIZE          ( 8 )
+#define FRAG_MAX_PAYLOAD         ( ((RF231_MAX_TX_FRAME_LENGTH - FRAG_MAC_HEADER_LENGTH - FRAG_HEADER_LENGTH - 2) / FRAG_BLOCK_SIZE) * FRAG_BLOCK_SIZE )
+#define FRAG_MAX_FRAME_LENGTH    ( FRAG_MAC_HEADER_LENGTH + FRAG_HEADER_LENGTH + FRAG_MAX_PAYLOAD + 2 )
+//! @}
+
+/*! \name   Stream format.
+ *
+ *          Reassembled data is sent on the UART as soon as it is contiguous,
+ *          in binary records, all multi-byte fields LSB first:
+ *          - FRAG_SYNC_0, FRAG_SYNC_1.
+ *          - Source short address (2 bytes).
+ *          - Datagram tag.
+ *          - Datagram size (2 bytes).
+ *          - Offset of the data in the datagram (2 bytes).
+ *          - Data length (2 bytes).
+ *          - Data.
+ *          - Checksum (2 bytes): crc_ccitt_update (CRC-16/KERMIT) over the
+ *            source address up to the last data byte, initial value 0.
+ *
+ *          A datagram is complete when offset + length equals the size. If
+ *          it times out, no more records follow for its tag.
+ *
+ *  \ingroup frag
+ *  @{
+ */
+#define FRAG_SYNC_0              ( 0xA5 )
+#define FRAG_SYNC_1              ( 0x46 )
+//! @}
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Result of frag_receiver_accept.
+ *
+ *  \ingroup frag
+ */
+typedef enum{
+    FRAG_ACCEPTED = 0,      //!< New data for a datagram.
+    FRAG_DUPLICATE,         //!< Every block was received before.
+    FRAG_DROPPED,           //!< Invalid header, or no buffer free.
+    FRAG_NOT_FRAGMENT       //!< Not a fragment; handle the frame as before.
+}frag_accept_t;
+
+/*! \brief  Fragmentation counters.
+ *
+ *  \ingroup frag
+ */
+typedef struct{
+    uint16_t datagrams_sent;      //!< Datagrams whose last fragment was sent.
+    uint16_t datagrams_aborted;   //!< Datagrams given up after FRAG_MAX_ATTEMPTS.
+    uint16_t fragments_sent;      //!< Fragments put on air, first and repeated.
+    uint16_t datagrams_received;  //!< Datagrams reassembled and streamed.
+    uint16_t datagrams_timed_out; //!< Datagrams dropped after FRAG_REASSEMBLY_TIMEOUT.
+    uint16_t fragments_dropped;   //!< Fragments that were invalid or found no buffer.
+}frag_statistics_t;
+/*============================ PROTOTYPES ====================================*/
+tat_status_t frag_sender_start( uint16_t dest_address, uint8_t *data, uint16_t size );
+bool frag_sender_busy( void );
+uint8_t frag_sender_next( uint8_t *frame );
+void frag_sender_sent( tat_status_t status );
+
+void frag_receiver_init( void );
+frag_accept_t frag_receiver_accept( uint8_t *frame, uint8_t length );
+bool frag_receiver_poll( void );
+
+void frag_get_statistics( frag_statistics_t *statistics );
+#endif
+/*EOF*/
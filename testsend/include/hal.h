@@ -9,6 +9,7 @@
 #include <stdbool.h>
 
 #include "compiler.h"
+#include "at86rf231.h"
 /*============================ MACROS ========================================*/
 #define HAL_BAT_LOW_MASK       ( 0x80 ) //!< Mask for the BAT_LOW interrupt.
 #define HAL_TRX_UR_MASK        ( 0x40 ) //!< Mask for the TRX_UR interrupt.
@@ -21,6 +22,21 @@
 #define HAL_MAX_FRAME_LENGTH   ( 0x7F ) //!< A frame should no more than 127 bytes.
 #define __x 
 #define __z 
+
+/*! \brief  Number of symbols elapsed since the supplied hal_get_system_time( ) 
+ *          sample. Wrapping of the system time is handled.
+ *
+ *  \ingroup hal
+ */
+#define HAL_ELAPSED_TIME( start ) ( ( hal_get_system_time( ) - ( start ) ) & HAL_SYMBOL_MASK )
+
+/*! \brief  True for a register whose bits outside the subregisters that are 
+ *          written are read-only: TRAC_STATUS next to TRX_CMD. Such a 
+ *          subregister is written without reading the register first.
+ *
+ *  \ingroup hal
+ */
+#define HAL_NO_READ_MODIFY_WRITE( address ) ( ( address ) == RG_TRX_STATE )
 /*============================ TYPDEFS =======================================*/
 /*! \brief  This struct defines the rx data container.
  *
@@ -35,15 +51,30 @@ typedef struct{
     bool crc;
 } hal_rx_frame_t;
 
+/*! \brief  Counters of the frame buffer protection (RX_FRAME_PROTECTION).
+ *
+ *  \see hal_get_rx_protection_statistics
+ *
+ *  \ingroup hal
+ */
+typedef struct{
+    uint16_t lost;     //!< Frames that started to arrive while a frame was protected, and were dropped.
+    uint16_t released; //!< Received frames that were released without being read.
+}hal_rx_protection_statistics_t;
+
 //! RX_START event handler callback type. Is called with timestamp in IEEE 802.15.4 symbols and frame length.
 typedef void (*hal_rx_start_isr_event_handler_t)(uint32_t const isr_timestamp, uint8_t const frame_length);
 
 //! RRX_END event handler callback type. Is called with timestamp in IEEE 802.15.4 symbols and frame length.
 typedef void (*hal_trx_end_isr_event_handler_t)(uint32_t const isr_timestamp);
+
+//! Timer event handler callback type. Is called with timestamp in IEEE 802.15.4 symbols.
+typedef void (*hal_timer_isr_event_handler_t)(uint32_t const isr_timestamp);
 /*============================ PROTOTYPES ====================================*/
 void hal_init( void );
 
 void hal_reset_flags( void );
+void hal_raise_cpu_clock( void );
 uint8_t hal_get_bat_low_flag( void );
 void hal_clear_bat_low_flag( void );
 
@@ -62,6 +93,9 @@ hal_rx_start_isr_event_handler_t hal_get_rx_start_event_handler( void );
 void hal_set_rx_start_event_handler( hal_rx_start_isr_event_handler_t rx_start_callback_handle );
 void hal_clear_rx_start_event_handler( void );
 
+bool hal_get_frame_buffer_flag( void );
+void hal_clear_frame_buffer_flag( void );
+
 uint8_t hal_get_unknown_isr_flag( void );   
 void hal_clear_unknown_isr_flag( void );
 
@@ -71,16 +105,88 @@ void hal_clear_pll_unlock_flag( void );
 uint8_t hal_get_pll_lock_flag( void );
 void hal_clear_pll_lock_flag( void );
 
+uint8_t hal_get_timer_flag( void );
+void hal_clear_timer_flag( void );
+void hal_set_timer_event_handler( hal_timer_isr_event_handler_t timer_callback_handle );
+void hal_clear_timer_event_handler( void );
+void hal_start_timer( uint32_t timeout );
+void hal_stop_timer( void );
+
 uint8_t hal_register_read( uint8_t address );
 void hal_register_write( uint8_t address, uint8_t value );
-uint8_t hal_subregister_read( uint8_t address, uint8_t mask, uint8_t position );
-void hal_subregister_write( uint8_t address, uint8_t mask, uint8_t position, 
-                            uint8_t value );
 __z void hal_frame_read( hal_rx_frame_t *rx_frame );
 __z void hal_frame_write( uint8_t *write_buffer, uint8_t length );
 __z void hal_sram_read( uint8_t address, uint8_t length, uint8_t *data );
 __z void hal_sram_write( uint8_t address, uint8_t length, uint8_t *data );
 __z void hal_trx_aes_wrrd(uint8_t addr, uint8_t *idata, uint8_t length);
 uint32_t hal_get_system_time( void );
+uint32_t hal_get_capture_time( void );
+void hal_get_rx_protection_statistics( hal_rx_protection_statistics_t *statistics );
+void hal_clear_rx_protection_statistics( void );
+/*============================ IMPLEMENTATION ================================*/
+
+/*! \brief  This function reads the value of a specific subregister.
+ *
+ *          It is inlined, so that the SR_* triple of at86rf231.h is folded to 
+ *          constants at each call: a full register is read as such, and the 
+ *          mask and shift are resolved at compile time.
+ *
+ *  \see Look at the at86rf231.h file for register and subregister 
+ *       definitions.
+ *
+ *  \param  address  Main register's address.
+ *  \param  mask  Bit mask of the subregister.
+ *  \param  position   Bit position of the subregister
+ *  \retval Value of the read subregister.
+ *
+ *  \ingroup hal_avr_api
+ */
+INLINE uint8_t hal_subregister_read( uint8_t address, uint8_t mask, uint8_t position ){
+    return (hal_register_read( address ) & mask) >> position;
+}
+
+/*! \brief  This function writes a new value to one of the radio transceiver's 
+ *          subregisters.
+ *
+ *          It is inlined like hal_subregister_read. A full register, or a 
+ *          subregister of a register for which HAL_NO_READ_MODIFY_WRITE holds 
+ *          (TRX_CMD), is written without reading the register first. A single 
+ *          bit is set or cleared with its mask, without a shift.
+ *
+ *  \see Look at the at86rf231.h file for register and subregister 
+ *       definitions.
+ *
+ *  \param  address  Main register's address.
+ *  \param  mask  Bit mask of the subregister.
+ *  \param  position  Bit position of the subregister
+ *  \param  value  Value to write into the subregister.
+ *
+ *  \ingroup hal_avr_api
+ */
+INLINE void hal_subregister_write( uint8_t address, uint8_t mask, uint8_t position, 
+                                   uint8_t value ){
+    
+    if ((mask == 0xFF) || HAL_NO_READ_MODIFY_WRITE( address )) {
+        hal_register_write( address, (uint8_t)(value << position) & mask );
+    } else if (mask == (uint8_t)(1 << position)) {
+        
+        uint8_t register_value = hal_register_read( address );
+        
+        if ((value & 0x01) != 0) {
+            register_value |= mask;
+        } else {
+            register_value &= ~mask;
+        }
+        
+        hal_register_write( address, register_value );
+    } else {
+        
+        //Read current register value and mask area outside the subregister.
+        uint8_t register_value = hal_register_read( address ) & ~mask;
+        
+        //Shift the new subregister value in place, mask and merge.
+        hal_register_write( address, register_value | ((uint8_t)(value << position) & mask) );
+    }
+}
 #endif
 /*EOF*/
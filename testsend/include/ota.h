@@ -0,0 +1,182 @@
+#ifndef OTA_H
+#define OTA_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "tat.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Command that sends the own application to DEST_ADDRESS, the first
+ *          character of a line on the UART (see com_get_command).
+ *
+ *  \ingroup ota
+ */
+#define OTA_COMMAND_UPDATE       ( 'U' )
+
+/*! \name   Flash layout of the ATmega128.
+ *
+ *          The application runs from OTA_APP_START. The bootloader (see
+ *          bootloader/ota_boot.c) lives in the 8 KB boot section, which is
+ *          also the No-Read-While-Write section, so it keeps polling the
+ *          radio while a page of the staging area is erased or written. A new
+ *          image is received into the staging area and only copied over the
+ *          application once its CRC is verified. Fuses: BOOTSZ = 00, BOOTRST
+ *          programmed.
+ *
+ *  \ingroup ota
+ *  @{
+ */
+#define OTA_PAGE_SIZE            ( 256 ) //!< SPM_PAGESIZE.
+#define OTA_APP_START            ( 0x00000UL )
+#define OTA_STAGING_START        ( 0x0F000UL )
+#define OTA_BOOT_START           ( 0x1E000UL )
+#define OTA_IMAGE_MAX            ( OTA_STAGING_START - OTA_APP_START ) //!< 60 KB, 240 pages.
+//! @}
+
+/*! \name   Frame format.
+ *
+ *          Data frames with acknowledge request: FCF, sequence number, PAN ID,
+ *          destination and source address, then OTA_DISPATCH, the frame type,
+ *          the session number and the body, and the FCS. All fields LSB first.
+ *
+ *          - START (server): image length (4 bytes), image CRC (4 bytes).
+ *          - DATA (server): fragment number (2 bytes), OTA_FRAGMENT_SIZE bytes
+ *            of the image, padded with 0xFF after its end.
+ *          - QUERY, COMMIT (server): no body.
+ *          - STATUS (bootloader): state, first missing fragment (2 bytes),
+ *            and a bitmap of the OTA_STATUS_WINDOW fragments from there on, a
+ *            set bit for each missing one.
+ *
+ *          The server streams the DATA frames back-to-back and repeats only
+ *          the fragments a STATUS reports missing, so the transfer is not
+ *          held up by the flash writes of the bootloader. A QUERY every
+ *          OTA_QUERY_INTERVAL fragments repeats the losses while their pages
+ *          are still in the RAM of the bootloader.
+ *
+ *  \ingroup ota
+ *  @{
+ */
+#define OTA_DISPATCH             ( 0xF9 )
+#define OTA_MAC_HEADER_LENGTH    ( 9 )
+#define OTA_HEADER_LENGTH        ( OTA_MAC_HEADER_LENGTH + 3 )
+#define OTA_FRAGMENT_SIZE        ( 64 )
+#define OTA_FRAGMENTS_PER_PAGE   ( OTA_PAGE_SIZE / OTA_FRAGMENT_SIZE )
+#define OTA_MAX_FRAGMENTS        ( OTA_IMAGE_MAX / OTA_FRAGMENT_SIZE )
+#define OTA_STATUS_WINDOW        ( 64 )
+#define OTA_QUERY_INTERVAL       ( 16 ) //!< The page buffers of the bootloader.
+#define OTA_START_LENGTH         ( OTA_HEADER_LENGTH + 8 + 2 )
+#define OTA_DATA_LENGTH          ( OTA_HEADER_LENGTH + 2 + OTA_FRAGMENT_SIZE + 2 )
+#define OTA_CONTROL_LENGTH       ( OTA_HEADER_LENGTH + 2 ) //!< QUERY and COMMIT.
+#define OTA_STATUS_LENGTH        ( OTA_HEADER_LENGTH + 3 + OTA_STATUS_WINDOW / 8 + 2 )
+//! @}
+
+/*! \name   Timing, in symbols.
+ *
+ *  \ingroup ota
+ *  @{
+ */
+#define OTA_START_TIMEOUT        ( 31250 ) //!< 500 ms for the target to reset into the bootloader.
+#define OTA_STATUS_TIMEOUT       ( 6250 ) //!< 100 ms for the answer to a QUERY.
+#define OTA_VERIFY_TIMEOUT       ( 125000 ) //!< 2 s for the CRC of the staging area.
+#define OTA_RETRIES              ( 3 ) //!< START, QUERY and COMMIT are sent this many times.
+#define OTA_MAX_IDLE_ROUNDS      ( 8 ) //!< Rounds of repeats without progress before the server gives up.
+//! @}
+
+/*! \name   Request from the application to the bootloader, at the end of the
+ *          EEPROM. An erased EEPROM reads OTA_BOOT_IDLE.
+ *
+ *  \ingroup ota
+ *  @{
+ */
+#define OTA_BOOT_IDLE            ( 0xFF ) //!< Start the application.
+#define OTA_BOOT_RECEIVE         ( 0x01 ) //!< Receive an image into the staging area.
+#define OTA_BOOT_SWAP            ( 0x02 ) //!< Copy the staging area over the application.
+#define OTA_EEPROM_ADDRESS       ( (uint16_t)(E2END + 1 - sizeof( ota_boot_request_t )) )
+//! @}
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Frame types.
+ *
+ *  \ingroup ota
+ */
+typedef enum{
+    OTA_START = 0,
+    OTA_DATA,
+    OTA_QUERY,
+    OTA_COMMIT,
+    OTA_STATUS
+}ota_frame_type_t;
+
+/*! \brief  State reported by the bootloader in a STATUS frame.
+ *
+ *  \ingroup ota
+ */
+typedef enum{
+    OTA_STATE_RECEIVING = 0,    //!< Fragments are missing.
+    OTA_STATE_COMPLETE,         //!< All fragments are in the staging area.
+    OTA_STATE_VERIFIED,         //!< The CRC matched, the image is being installed.
+    OTA_STATE_CRC_ERROR,        //!< The CRC did not match, the old application is started.
+    OTA_STATE_TOO_LARGE         //!< The image does not fit the staging area.
+}ota_state_t;
+
+/*! \brief  Hand-over from the application to the bootloader. The bootloader
+ *          has no configuration of its own: it listens with the address,
+ *          PAN ID and channel of the application.
+ *
+ *  \ingroup ota
+ */
+typedef struct{
+    uint8_t state;          //!< OTA_BOOT_IDLE, OTA_BOOT_RECEIVE or OTA_BOOT_SWAP.
+    uint8_t session;        //!< Frames of other sessions are ignored.
+    uint8_t channel;
+    uint16_t pan_id;
+    uint16_t short_address;
+    uint16_t server;        //!< Address of the node that sends the image.
+    uint32_t image_length;  //!< Bytes.
+    uint32_t image_crc;     //!< See ota_crc32_update.
+}ota_boot_request_t;
+
+/*! \brief  Result of an update, kept by the server.
+ *
+ *  \ingroup ota
+ */
+typedef struct{
+    tat_status_t result;    //!< Of the last ota_server_update.
+    uint8_t state;          //!< Last ota_state_t reported by the target.
+    uint32_t image_length;
+    uint16_t fragments;     //!< DATA frames in the image.
+    uint16_t repeated;      //!< DATA frames sent again after a STATUS.
+    uint16_t failed;        //!< DATA frames not acknowledged.
+    uint16_t rounds;        //!< QUERY frames answered.
+    uint32_t time;          //!< Symbols from START to the verified STATUS.
+}ota_statistics_t;
+/*============================ PROTOTYPES ====================================*/
+
+/*! \brief  One byte step of the CRC-32 of IEEE 802.3 (reflected, polynomial
+ *          0xEDB88320). Start with 0xFFFFFFFF and invert the result.
+ *
+ *          Inline, so the bootloader does not link the application.
+ *
+ *  \ingroup ota
+ */
+static inline uint32_t ota_crc32_update( uint32_t crc, uint8_t data ){
+
+    crc ^= data;
+
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320UL) : (crc >> 1);
+    }
+
+    return crc;
+}
+
+bool ota_is_start( uint8_t *frame, uint8_t length );
+void ota_enter_bootloader( uint8_t *frame );
+tat_status_t ota_server_update( uint16_t target );
+void ota_get_statistics( ota_statistics_t *statistics );
+void ota_report( void );
+bool ota_command( uint8_t command );
+#endif
+/*EOF*/
@@ -0,0 +1,97 @@
+#ifndef PROF_H
+#define PROF_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Command that dumps the region table, the first character of a
+ *          line on the UART (see com_get_command). PROF_COMMAND_RESET dumps 
+ *          the table and then clears it.
+ *
+ *  \ingroup prof
+ */
+#define PROF_COMMAND_DUMP        ( 'P' )
+#define PROF_COMMAND_RESET       ( 'Z' ) //!< Dump, then clear the counters.
+
+/*! \name   Dump format.
+ *
+ *          The table is sent in one binary record, all multi-byte fields LSB
+ *          first:
+ *          - PROF_SYNC_0, PROF_SYNC_1
+ *          - Number of regions (PROF_REGIONS).
+ *          - Timer clock in kHz (2 bytes), F_CPU / 1000.
+ *          - Calibrated PROF_ENTER/PROF_LEAVE overhead in cycles (2 bytes). It
+ *            is already subtracted from every sample.
+ *          - For each region, in prof_region_id_t order: count (4 bytes),
+ *            minimum (4 bytes), maximum (4 bytes) and total (8 bytes) in
+ *            cycles.
+ *          - Checksum (2 bytes): crc_ccitt_update (CRC-16/KERMIT) over the
+ *            number of regions up to the last region, initial value 0.
+ *
+ *  \ingroup prof
+ *  @{
+ */
+#define PROF_SYNC_0              ( 0xA5 )
+#define PROF_SYNC_1              ( 0x50 )
+#define PROF_REGION_RECORD_SIZE  ( 20 )
+//! @}
+
+/*! \brief  Time a region of code.
+ *
+ *          PROF_ENTER declares the start time of the region in the current
+ *          block, so PROF_LEAVE must be placed in the same or an inner block
+ *          of the same function. Regions may nest and may be interrupted; the
+ *          time spent in interrupts is counted in the region that was
+ *          interrupted. Without PROFILING both macros are empty.
+ *
+ *  \param  region Region identifier, one of prof_region_id_t.
+ *
+ *  \ingroup prof
+ */
+#if defined( PROFILING )
+#define PROF_ENTER( region ) uint32_t const prof_start_##region = prof_get_cycles( )
+#define PROF_LEAVE( region ) prof_account( (region), prof_start_##region )
+#else
+#define PROF_ENTER( region )
+#define PROF_LEAVE( region )
+#endif
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Instrumented regions.
+ *
+ *  \ingroup prof
+ */
+typedef enum{
+    PROF_TRX_ISR = 0,           //!< TIMER1_CAPT_vect, including the event handlers.
+    PROF_FRAME_READ,            //!< hal_frame_read.
+    PROF_FRAME_WRITE,           //!< hal_frame_write.
+    PROF_UART_RX_ISR,           //!< USART0_RX_vect.
+    PROF_UART_UDRE_ISR,         //!< USART0_UDRE_vect (sniffer build).
+    PROF_UART_SEND,             //!< Blocking com_send_string and com_send_hex loops.
+    PROF_STATE_TRANSITION,      //!< tat_set_trx_state.
+    PROF_REGIONS
+}prof_region_id_t;
+
+/*! \brief  Accumulated samples of one region, in CPU cycles.
+ *
+ *  \ingroup prof
+ */
+typedef struct{
+    uint32_t count;     //!< Number of samples.
+    uint32_t min;       //!< Shortest sample. UINT32_MAX while count is zero.
+    uint32_t max;       //!< Longest sample.
+    uint64_t total;     //!< Sum of all samples.
+}prof_region_t;
+/*============================ PROTOTYPES ====================================*/
+void prof_init( void );
+uint32_t prof_get_cycles( void );
+void prof_account( prof_region_id_t region, uint32_t start );
+void prof_get_region( prof_region_id_t region, prof_region_t *statistics );
+void prof_reset( void );
+void prof_dump( void );
+bool prof_command( uint8_t command );
+#endif
+/*EOF*/
@@ -17,6 +17,10 @@
 #define RF231_MAX_ED_THRESHOLD                  ( 15 )
 #define RF231_MAX_TX_FRAME_LENGTH               ( 127 ) //!< 127 Byte PSDU.
 
+#ifndef TAT_RESIDENT_FRAME_SIZE
+#define TAT_RESIDENT_FRAME_SIZE                 ( 32 ) //!< Longest frame kept resident in the frame buffer (RESIDENT_TX_FRAME).
+#endif
+
 #define TX_PWR_3DBM                             ( 0 )
 #define TX_PWR_17_2DBM                          ( 15 )
 
@@ -99,6 +103,86 @@ typedef enum{
     CCA_CARRIER_SENSE_WITH_ED = 2
 }tat_cca_mode_t;
 
+/*! \brief  Counters kept by tat_send_data_with_retry.
+ *
+ *  \ingroup tat
+ */
+typedef struct{
+    uint16_t frames;                  //!< Calls that started a transmission.
+    uint16_t acked;                   //!< Frames that were acknowledged.
+    uint16_t no_ack;                  //!< Frames that were never acknowledged.
+    uint16_t channel_access_failures; //!< Frames dropped because CSMA-CA failed.
+    uint16_t retries;                 //!< Known retransmissions (see tat_get_tx_statistics).
+    uint32_t downloaded;              //!< SPI bytes written to the frame buffer, with the command bytes.
+}tat_tx_statistics_t;
+
+/*! \brief  This enumeration defines the traffic classes that have their own 
+ *          CSMA-CA parameters.
+ *
+ *  \ingroup tat
+ */
+typedef enum{
+    //!< Latency critical frames (acknowledges on higher layers, commands).
+    TAT_CSMA_PROFILE_CONTROL = 0,
+    //!< Ordinary data frames.
+    TAT_CSMA_PROFILE_DATA    = 1,
+    //!< Bulk transfers that can wait for the channel.
+    TAT_CSMA_PROFILE_BULK    = 2,
+    //!< Number of profiles.
+    TAT_CSMA_PROFILES
+}tat_csma_profile_id_t;
+
+/*! \brief  CSMA-CA parameters used for one traffic class.
+ *
+ *  \ingroup tat
+ */
+typedef struct{
+    uint8_t min_be;        //!< Minimum back-off exponent (MIN_BE).
+    uint8_t max_be;        //!< Maximum back-off exponent (MAX_BE).
+    uint8_t csma_retries;  //!< MAX_CSMA_RETRIES.
+    uint8_t frame_retries; //!< Retransmissions if no acknowledge is received.
+}tat_csma_profile_t;
+
+/*! \brief  Counters kept for each CSMA profile. Times are in symbols.
+ *
+ *  \ingroup tat
+ */
+typedef struct{
+    uint16_t frames;                  //!< Frames sent with the profile.
+    uint16_t no_ack;                  //!< Frames that were never acknowledged.
+    uint16_t channel_access_failures; //!< Frames dropped because CSMA-CA failed.
+    uint32_t total_delay;             //!< Sum of the access delays.
+    uint32_t max_delay;               //!< Longest access delay.
+}tat_csma_statistics_t;
+
+/*! \brief  Steps of the recovery ladder, from the least to the most drastic.
+ *
+ *  \see tat_recover
+ *  \ingroup tat
+ */
+typedef enum{
+    //!< FORCE_TRX_OFF.
+    TAT_RECOVERY_FORCE_TRX_OFF = 0,
+    //!< FORCE_TRX_OFF, then the configuration saved by tat_save_configuration is written back.
+    TAT_RECOVERY_REINIT        = 1,
+    //!< Hardware reset with tat_reset_trx, then the saved configuration is written back.
+    TAT_RECOVERY_RESET         = 2,
+    //!< Number of steps.
+    TAT_RECOVERY_STEPS
+}tat_recovery_step_t;
+
+/*! \brief  Counters kept by tat_recover. Times are in symbols.
+ *
+ *  \ingroup tat
+ */
+typedef struct{
+    uint16_t timeouts;                        //!< Waits in the TAT that reached their deadline.
+    uint16_t recovered[ TAT_RECOVERY_STEPS ]; //!< Recoveries completed, by the step that brought the radio transceiver back.
+    uint16_t failures;                        //!< Recoveries where every step failed.
+    uint32_t last_time;                       //!< Time to recover of the last recovery.
+    uint32_t max_time;                        //!< Longest time to recover.
+}tat_recovery_statistics_t;
+
 /*============================ PROTOTYPES ====================================*/
 tat_status_t tat_init( void );
 uint8_t tat_get_operating_channel( void );
@@ -144,5 +228,21 @@ __x void tat_set_extended_address( uint8_t *extended_address );
 tat_status_t tat_configure_csma( uint8_t seed0, uint8_t be_csma_seed1 );
 __x tat_status_t tat_send_data_with_retry( uint8_t frame_length, uint8_t *frame, 
                                        uint8_t retries );
+uint8_t tat_get_version_number( void );
+bool tat_uses_hw_frame_retries( void );
+void tat_get_tx_statistics( tat_tx_statistics_t *statistics );
+void tat_reset_tx_statistics( void );
+void tat_set_csma_seed( uint16_t seed );
+tat_status_t tat_randomize_csma_seed( void );
+tat_status_t tat_set_csma_profile( uint8_t profile, uint8_t min_be, uint8_t max_be,
+                                   uint8_t csma_retries, uint8_t frame_retries );
+__x tat_status_t tat_send_data_with_profile( uint8_t profile, uint8_t frame_length, 
+                                         uint8_t *frame );
+tat_status_t tat_get_csma_statistics( uint8_t profile, tat_csma_statistics_t *statistics );
+void tat_reset_csma_statistics( void );
+void tat_save_configuration( void );
+tat_status_t tat_recover( uint8_t new_state );
+void tat_get_recovery_statistics( tat_recovery_statistics_t *statistics );
+void tat_reset_recovery_statistics( void );
 #endif
 /*EOF*/
@@ -0,0 +1,128 @@
+#ifndef TDMA_H
+#define TDMA_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "tat.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Command that runs tdma_report, the first character of a line on
+ *          the UART (see com_get_command).
+ *
+ *  \ingroup tdma
+ */
+#define TDMA_COMMAND_REPORT      ( 'M' )
+
+/*! \name   Superframe.
+ *
+ *          A superframe starts with the schedule period, in which the
+ *          coordinator (TSYNC_ROOT_ADDRESS) broadcasts the schedule and its
+ *          time synchronization beacon. Then comes the join period, in which
+ *          senders without a slot send with CSMA-CA, and then the slots.
+ *          The slots share the rest of the superframe equally. A sender
+ *          keeps its slot as long as it is heard, and the slot of a sender
+ *          that left stays empty until a new sender takes it. The number of
+ *          slots only changes with a new version of the schedule, which is
+ *          announced TDMA_RESIZE_NOTICE superframes before it is used. All
+ *          times are in symbols of global time (see tsync.h).
+ *
+ *  \ingroup tdma
+ *  @{
+ */
+#ifndef TDMA_SUPERFRAME_LENGTH
+#define TDMA_SUPERFRAME_LENGTH   ( 62500 ) //!< 1 s, one frame per sender and superframe.
+#endif
+#define TDMA_SCHEDULE_PERIOD     ( 3125 ) //!< 50 ms, the coordinator may be busy on the UART.
+#define TDMA_JOIN_PERIOD         ( 6250 ) //!< 100 ms.
+#define TDMA_DATA_PERIOD         ( TDMA_SUPERFRAME_LENGTH - TDMA_SCHEDULE_PERIOD - TDMA_JOIN_PERIOD )
+#define TDMA_MAX_SLOTS           ( 32 )
+#define TDMA_SLOT_QUANTUM        ( 8 ) //!< The number of slots is a multiple of this.
+#define TDMA_GUARD               ( 32 ) //!< Symbols at the start of a slot, for the synchronization error.
+#define TDMA_TX_TIME             ( 250 ) //!< A data frame, its acknowledge, one retry and a beacon.
+#define TDMA_MIN_SLOT_LENGTH     ( TDMA_GUARD + TDMA_TX_TIME )
+#define TDMA_LEAVE_SUPERFRAMES   ( 4 ) //!< A sender not heard for this many superframes loses its slot.
+#define TDMA_SCHEDULE_TIMEOUT    ( 4 ) //!< A schedule is used for this many superframes.
+#define TDMA_RESIZE_NOTICE       ( TDMA_SCHEDULE_TIMEOUT ) //!< Every schedule still in use announces a new version.
+#define TDMA_JOIN_SPREAD         ( 8 ) //!< A sender without a slot uses one join period in this many, at random.
+//! @}
+
+/*! \name   Schedule format.
+ *
+ *          Broadcast data frame without acknowledge request: FCF, sequence
+ *          number, PAN ID, 0xFFFF, source address, then TDMA_DISPATCH, the
+ *          superframe number, the start of the superframe (4 bytes), the
+ *          version, its number of slots, the superframes until the next
+ *          version is used (0 if none is announced), the number of slots of
+ *          the next version, the number of owners listed and the address of
+ *          the owner of each slot (2 bytes each, 0xFFFF if free), and the
+ *          FCS. All fields LSB first.
+ *
+ *  \ingroup tdma
+ *  @{
+ */
+#define TDMA_DISPATCH            ( 0xF8 )
+#define TDMA_MAC_HEADER_LENGTH   ( 9 )
+#define TDMA_SCHEDULE_HEADER_LENGTH ( TDMA_MAC_HEADER_LENGTH + 11 )
+#define TDMA_SCHEDULE_LENGTH( slots ) ( TDMA_SCHEDULE_HEADER_LENGTH + 2 * (slots) + 2 )
+#define TDMA_MAX_SCHEDULE_LENGTH ( TDMA_SCHEDULE_LENGTH( TDMA_MAX_SLOTS ) )
+//! @}
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Transmit opportunities of a sender.
+ *
+ *  \ingroup tdma
+ */
+typedef enum{
+    TDMA_NO_SLOT = 0,   //!< Not synchronized, or no schedule.
+    TDMA_OWN_SLOT,      //!< The slot of this sender: one CCA, no back-off.
+    TDMA_JOIN_SLOT      //!< No slot yet: a random time in the join period, with CSMA-CA.
+}tdma_slot_t;
+
+/*! \brief  Counters of the coordinator. A slot is used if its owner was
+ *          heard in that superframe.
+ *
+ *  \ingroup tdma
+ */
+typedef struct{
+    uint16_t superframes;   //!< Schedules sent.
+    uint8_t slots;          //!< Slots in the current superframe.
+    uint16_t slot_length;   //!< Symbols per slot in the current superframe.
+    uint32_t allocated;     //!< Slots in all completed superframes.
+    uint32_t used;          //!< Slots that carried a frame.
+    uint32_t frames;        //!< Data frames received, also in the join period.
+    uint16_t joins;
+    uint16_t leaves;
+}tdma_coordinator_statistics_t;
+
+/*! \brief  Counters of a sender.
+ *
+ *  \ingroup tdma
+ */
+typedef struct{
+    uint16_t schedules;     //!< Schedules received.
+    uint8_t slot;           //!< Own slot, 0xFF if none.
+    uint16_t slot_length;   //!< Symbols per slot.
+    uint16_t sent;          //!< Frames acknowledged in the own slot.
+    uint16_t failed;        //!< Frames sent in the own slot but not acknowledged.
+    uint16_t joins;         //!< Frames sent in the join period.
+    uint16_t missed;        //!< Own slots that had passed when the sender woke up.
+}tdma_sender_statistics_t;
+/*============================ PROTOTYPES ====================================*/
+void tdma_init( void );
+bool tdma_schedule_due( void );
+uint8_t tdma_build_schedule( uint8_t *frame );
+void tdma_coordinator_heard( uint8_t *frame, uint8_t length, uint32_t rx_start_time );
+bool tdma_is_schedule( uint8_t *frame, uint8_t length );
+void tdma_receive_schedule( uint8_t *frame, uint8_t length );
+tdma_slot_t tdma_next_slot( uint32_t *start );
+tdma_slot_t tdma_current_slot( void );
+void tdma_wait_until( uint32_t time );
+void tdma_sent( tdma_slot_t slot, tat_status_t status );
+void tdma_get_coordinator_statistics( tdma_coordinator_statistics_t *statistics );
+void tdma_get_sender_statistics( tdma_sender_statistics_t *statistics );
+void tdma_report( void );
+bool tdma_command( uint8_t command );
+#endif
+/*EOF*/
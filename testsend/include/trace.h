@@ -0,0 +1,121 @@
+#ifndef TRACE_H
+#define TRACE_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Number of events kept in the ring, four bytes each. Must be a
+ *          power of two, at most 256.
+ *
+ *  \ingroup trace
+ */
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE        ( 128 )
+#endif
+
+/*! \brief  Events still recorded after trace_trigger, before the ring is
+ *          frozen for trace_poll. The rest of the ring keeps the history that
+ *          led to the trigger.
+ *
+ *  \ingroup trace
+ */
+#ifndef TRACE_POST_TRIGGER
+#define TRACE_POST_TRIGGER       ( 16 )
+#endif
+
+/*! \brief  Command that dumps the ring, the first character of a line on the
+ *          UART (see com_get_command).
+ *
+ *  \ingroup trace
+ */
+#define TRACE_COMMAND_DUMP       ( 'T' )
+
+/*! \name   Dump format.
+ *
+ *          The ring is sent in one binary record, all multi-byte fields LSB
+ *          first:
+ *          - TRACE_SYNC_0, TRACE_SYNC_1
+ *          - Number of events (2 bytes).
+ *          - Flags: TRACE_FLAG_*.
+ *          - Trigger reason, TRACE_TRIGGER_* (0 if not triggered).
+ *          - Time MSB (2 bytes): the 16 MSB of the system time of the oldest
+ *            event.
+ *          - The events, oldest first, four bytes each: event (TRACE_*),
+ *            argument, and the 16 LSB of the system time in symbols (2 bytes).
+ *            A TRACE_TIME event carries new 16 MSB for the events after it.
+ *          - Checksum (2 bytes): crc_ccitt_update (CRC-16/KERMIT) over the
+ *            number of events up to the last event, initial value 0.
+ *
+ *  \ingroup trace
+ *  @{
+ */
+#define TRACE_SYNC_0             ( 0xA5 )
+#define TRACE_SYNC_1             ( 0x54 )
+#define TRACE_FLAG_WRAPPED       ( 0x01 ) //!< Older events were overwritten.
+#define TRACE_FLAG_TRIGGERED     ( 0x02 ) //!< The dump was caused by trace_trigger.
+//! @}
+
+/*! \brief  Record an event.
+ *
+ *          TRACE_EVENT takes the time stamp itself; TRACE_EVENT_AT uses one
+ *          that the caller already has, e.g. the TRX ISR time stamp. Without
+ *          TRACE both macros are empty.
+ *
+ *  \param  event Event type, one of trace_event_id_t.
+ *  \param  arg Event argument, see trace_event_id_t.
+ *  \param  time System time in symbols.
+ *
+ *  \ingroup trace
+ */
+#if defined( TRACE )
+#define TRACE_EVENT( event, arg )            trace_record( (event), (arg) )
+#define TRACE_EVENT_AT( event, arg, time )   trace_record_at( (event), (arg), (time) )
+#else
+#define TRACE_EVENT( event, arg )
+#define TRACE_EVENT_AT( event, arg, time )
+#endif
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Event types, with the meaning of the argument.
+ *
+ *  \ingroup trace
+ */
+typedef enum{
+    TRACE_TIME = 0,         //!< Time MSB changed. No argument; the time field holds the new MSB.
+    TRACE_IRQ,              //!< Radio IRQ. IRQ_STATUS.
+    TRACE_STATE,            //!< State transition done. TRX_STATUS reached.
+    TRACE_TX,               //!< SLP_TR pulse in TX_ARET_ON. Frame length.
+    TRACE_TRAC,             //!< TX_ARET finished. TRAC_STATUS.
+    TRACE_RX,               //!< Frame uploaded with valid FCS. Frame length.
+    TRACE_RX_CRC_ERROR,     //!< Frame uploaded with bad FCS. Frame length.
+    TRACE_POOL,             //!< Frame stored in the rx_pool. Items used.
+    TRACE_POOL_OVERFLOW,    //!< Frame dropped, the rx_pool is full. Items used.
+    TRACE_TRIGGER,          //!< trace_trigger was called. Reason.
+    TRACE_MARK,             //!< Application defined.
+    TRACE_EVENTS
+}trace_event_id_t;
+
+/*! \brief  Reasons for trace_trigger.
+ *
+ *  \ingroup trace
+ */
+typedef enum{
+    TRACE_TRIGGER_NONE = 0,
+    TRACE_TRIGGER_POOL_OVERFLOW,    //!< The receiver dropped a frame.
+    TRACE_TRIGGER_TX_FAILED,        //!< The sender gave up on a frame.
+    TRACE_TRIGGER_USER              //!< First reason free for the application.
+}trace_trigger_t;
+/*============================ PROTOTYPES ====================================*/
+void trace_init( void );
+void trace_record( uint8_t event, uint8_t arg );
+void trace_record_at( uint8_t event, uint8_t arg, uint32_t time );
+void trace_trigger( uint8_t reason );
+bool trace_is_frozen( void );
+void trace_dump( void );
+bool trace_poll( void );
+bool trace_command( uint8_t command );
+#endif
+/*EOF*/
@@ -1,6 +1,7 @@
 /*============================ INCLDUE =======================================*/
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <clock_config.h>
 #include <util/delay.h>
 #include "config_uart_extended.h" // See this file for all project options. 
@@ -10,10 +11,46 @@
 #include "tat.h"
 #include "com.h"
 #include "hal_avr.h"
+#include "lpl.h"
+#include "entropy.h"
+#include "prof.h"
+#include "trace.h"
+#include "arq.h"
+#include "frag.h"
+#include "aggr.h"
+#include "ccm.h"
+#include "aes_bench.h"
+#include "tsync.h"
+#include "tdma.h"
+#include "ota.h"
+#include "watchdog.h"
 /*============================ MACROS ========================================*/
+#if (defined( ARQ ) + defined( FRAGMENTATION ) + defined( AGGREGATION )) > 1
+    #error "Only one of ARQ, FRAGMENTATION and AGGREGATION can be used."
+#endif
+#if defined( SECURITY ) && (defined( ARQ ) || defined( FRAGMENTATION ) || defined( AGGREGATION ))
+    #error "SECURITY cannot be used with ARQ, FRAGMENTATION or AGGREGATION."
+#endif
+#if defined( TIME_SYNC ) && (defined( ARQ ) || defined( FRAGMENTATION ) || defined( AGGREGATION ))
+    #error "TIME_SYNC cannot be used with ARQ, FRAGMENTATION or AGGREGATION."
+#endif
+#if defined( OTA ) && (defined( ARQ ) || defined( FRAGMENTATION ) || defined( AGGREGATION ) || defined( TDMA ))
+    #error "OTA cannot be used with ARQ, FRAGMENTATION, AGGREGATION or TDMA, their main loops do not take updates."
+#endif
+#if defined( HAL_CLOCK_FROM_CLKM )
+#if defined( LOW_POWER_LISTENING )
+    #error "HAL_CLOCK_FROM_CLKM cannot be used with LOW_POWER_LISTENING, the AVR stops with CLKM while the radio sleeps."
+#endif
+#define TRX_CLKM_SPEED ( HAL_CLKM_CTRL ) //!< CLKM clocks the AVR, see hal_raise_cpu_clock.
+#else
+#define TRX_CLKM_SPEED ( CLKM_NO_CLOCK )
+#endif
 /*============================ TYPEDEFS ======================================*/
 /*============================ VARIABLES =====================================*/
 static uint8_t tx_frame[ 127 ]; //!< Buffer used to build TX frames. (Size must be max PSDU length.)
+#if defined( SECURITY )
+static uint8_t tx_secure_frame[ 127 ]; //!< tx_frame as secured by ccm_secure.
+#endif
 static uint8_t tx_frame_info[16];//½򴮿ڷ
 static hal_rx_frame_t rx_pool[ RX_POOL_SIZE ]; //!< Pool of hal_rx_frame_t's.
 static hal_rx_frame_t *rx_pool_start; //!< Pointer to start of pool.
@@ -23,6 +60,9 @@ static hal_rx_frame_t *rx_pool_tail; //!< Pointer to next hal_rx_frame_t that ca
 static uint8_t rx_pool_items_free; //!< Number of free items (hal_rx_frame_t) in the pool.
 static uint8_t rx_pool_items_used; // !< Number of used items.
 static bool rx_pool_overflow_flag; //!< Flag that is used to signal a pool overflow.
+#if defined( TIME_SYNC )
+static uint32_t rx_pool_sync_time[ RX_POOL_SIZE ]; //!< RX_START capture of each pool item, in Timer1 ticks.
+#endif
 
 static bool rx_flag; //!< Flag used to mask between the two possible TRX_END events.
 
@@ -35,18 +75,39 @@ static uint8_t debug_rx_pool_overflow[] = "RX Buffer Overflow!\r\n"; //!< Debug
 static uint8_t debug_transmission_failed[] = "TX Failed!\r\n"; //!< Debug Text.
 static uint8_t debug_transmission_length[] = "Typed Message too long!!\r\n"; //!< Debug Text.
 static uint8_t debug_fatal_error[] = "A fatal error. System must be reset.\r\n"; //!< Debug Text.
+#if defined( CSMA_STATISTICS )
+static uint8_t debug_csma[] = "\r\nCSMA "; //!< Debug Text.
+#endif
 /*============================ PROTOTYPES ====================================*/
 static bool trx_init( void );
 static void avr_init( void );
 static void trx_end_handler( uint32_t time_stamp );
 static void rx_pool_init( void );
+static void tx_jitter_delay( void );
+#if defined( CSMA_STATISTICS )
+static void csma_report( void );
+#endif
+#if defined( ARQ )
+static void arq_main_loop( void );
+#endif
+#if defined( FRAGMENTATION )
+static void frag_main_loop( void );
+#endif
+#if defined( AGGREGATION )
+static void aggr_send( void );
+static void aggr_main_loop( void );
+#endif
+#if defined( TDMA )
+static void tdma_main_loop( void );
+#endif
 
 static uint8_t length_of_received_data = 20;
 static uint8_t tx_frame_length = 22;
 
 /*! \brief This function is used to initialize the TRX.
  *
- * The TAT will be set up to run on the chosen operating channel, with CLKM diabled,
+ * The TAT will be set up to run on the chosen operating channel, with CLKM diabled
+ * (or at F_CPU if it clocks the AVR),
  * and then configure the RX_AACK and TX_ARET modes.
  *
  *  \retval true if the TRX was successfully configured.
@@ -61,7 +122,7 @@ static bool trx_init( void ){
         status = false;
     } else if (tat_set_operating_channel( OPERATING_CHANNEL ) != TAT_SUCCESS) {
         status = false;
-    } else if (tat_set_clock_speed( true, CLKM_NO_CLOCK ) != TAT_SUCCESS) {
+    } else if (tat_set_clock_speed( true, TRX_CLKM_SPEED ) != TAT_SUCCESS) {
         status = false;
     } else{
 
@@ -70,16 +131,22 @@ static bool trx_init( void ){
         hal_subregister_write(SR_OQPSK_DATA_RATE, ALTRATE_250KBPS);
         hal_subregister_write(SR_ANT_DIV_EN, ANT_DIV_DISABLE );
         hal_subregister_write(SR_ANT_EXT_SW_EN, ANT_EXT_SW_SWITCH_DISABLE);
+#if defined( RX_FRAME_PROTECTION )
+        hal_subregister_write( SR_RX_SAFE_MODE, RX_SAFE_MODE_ENABLE ); //Keep a received frame until it is uploaded.
+#endif
         tat_set_short_address( SHORT_ADDRESS ); //Short Address.
         tat_set_pan_id( PAN_ID ); //PAN ID.
         tat_set_device_role( false ); // No Coordintor support is necessary.
 
         //TX_ARET:
         tat_configure_csma( 234, 0xE2 ); // Default CSMA_SEED_0, MIN_BE = 3, MAX_CSMA_RETRIES = , and CSMA_SEED_1 =
+        tat_randomize_csma_seed( ); //Replace the fixed seed, so that the nodes do not back off alike.
+                                    //MIN_BE, MAX_BE and the retries are set per frame by the CSMA profile.
 
         //Both Modes:
         tat_use_auto_tx_crc( true ); //Automatic CRC must be enabled.
         hal_set_trx_end_event_handler( trx_end_handler ); // Event handler for TRX_END events.
+        tat_save_configuration( ); //Written back if the radio transceiver has to be recovered.
 
         status = true;
     } // end: if (tat_init( ) != TAT_SUCCESS) ...
@@ -91,7 +158,7 @@ static bool trx_init( void ){
  */
 static void avr_init( void )
 {
-    com_init( 51 ); //51 for 9600 baud in 8M clock
+    com_init( BR_9600 );
 }
 
 /*! \brief This function initialize the rx_pool. The rx_pool is in essence a FIFO.
@@ -130,6 +197,9 @@ static void trx_end_handler( uint32_t time_stamp ){
 
             //Then check the CRC. Will not store frames with invalid CRC.
             if (rx_pool_head->crc == true) {
+#if defined( TIME_SYNC )
+                rx_pool_sync_time[ rx_pool_head - rx_pool_start ] = tsync_get_rx_start_time( );
+#endif
 
                 //Handle wrapping of rx_pool.
                 if (rx_pool_head == rx_pool_end) {
@@ -206,11 +276,455 @@ static void upload_print()
 	 }
 
 }
+/*! \brief This function waits a random time of 0 to TX_JITTER_MS ms, so that
+ *         senders that were started together drift apart. No delay is added
+ *         if the entropy pool is empty.
+ */
+static void tx_jitter_delay( void )
+{
+    uint8_t jitter = 0;
+
+    entropy_get_byte( &jitter );
+    jitter %= (TX_JITTER_MS + 1);
+
+    while (jitter-- > 0) {
+        _delay_ms(1);
+    }
+}
+
+#if defined( CSMA_STATISTICS )
+/*! \brief This function prints the counters of each CSMA profile as hex:
+ *         profile, frames, no ack, channel access failures, average and
+ *         maximum access delay in symbols. 16 bit values are sent MSB first.
+ */
+static void csma_report( void )
+{
+    tat_csma_statistics_t statistics;
+
+    for (uint8_t profile = 0; profile < TAT_CSMA_PROFILES; profile++) {
+
+        tat_get_csma_statistics( profile, &statistics );
+
+        uint16_t average_delay = 0;
+        if (statistics.frames != 0) {
+            average_delay = statistics.total_delay / statistics.frames;
+        }
+
+        com_send_string( debug_csma, sizeof( debug_csma ) );
+        com_send_hex( profile );
+        com_send_hex( statistics.frames >> 8 );
+        com_send_hex( statistics.frames & 0xFF );
+        com_send_hex( statistics.no_ack >> 8 );
+        com_send_hex( statistics.no_ack & 0xFF );
+        com_send_hex( statistics.channel_access_failures >> 8 );
+        com_send_hex( statistics.channel_access_failures & 0xFF );
+        com_send_hex( average_delay >> 8 );
+        com_send_hex( average_delay & 0xFF );
+        com_send_hex( (statistics.max_delay >> 8) & 0xFF );
+        com_send_hex( statistics.max_delay & 0xFF );
+    }
+}
+#endif
+
+#if defined( ARQ )
+/*! \brief This function replaces the normal program flow when ARQ is used, and
+ *         never returns. A new frame is queued every ARQ_TX_INTERVAL while
+ *         the window is open, frames are sent and repeated as arq_sender_next
+ *         decides, and the SACKs from the receiver are read from the rx_pool.
+ */
+static void arq_main_loop( void )
+{
+    uint32_t last_queued = hal_get_system_time( ) - ARQ_TX_INTERVAL;
+
+    arq_sender_init( DEST_ADDRESS, 0 );
+
+    while (true) {
+
+        WATCHDOG_KICK( );
+
+        //Read the SACKs.
+        while (rx_pool_items_used != 0) {
+
+            //Handle wrapping of rx_pool.
+            if (rx_pool_tail == rx_pool_end) {
+                rx_pool_tail = rx_pool_start;
+            } else {
+                ++rx_pool_tail;
+            } // end: if (rx_pool_tail == rx_pool_end) ...
+
+            arq_sender_receive( rx_pool_tail->data, rx_pool_tail->length );
+
+            cli( );
+            ++rx_pool_items_free;
+            --rx_pool_items_used;
+            sei( );
+        } // end: while (rx_pool_items_used != 0) ...
+
+        if (rx_pool_overflow_flag == true) {
+            cli( );
+            rx_pool_init( );
+            com_send_string( debug_rx_pool_overflow, sizeof( debug_rx_pool_overflow ) );
+            sei( );
+        } // end: if (rx_pool_overflow_flag == true) ...
+
+        if ((arq_sender_window_open( ) == true) && (HAL_ELAPSED_TIME( last_queued ) >= ARQ_TX_INTERVAL)) {
+
+            //The sequence number and carry are written into tx_frame.
+            if (arq_sender_queue( tx_frame, tx_frame_length, NULL ) == TAT_SUCCESS) {
+                upload_print( );
+                last_queued = hal_get_system_time( );
+            }
+        } // end: if ((arq_sender_window_open( ) == true) ...
+
+        uint8_t *frame;
+        uint8_t length = arq_sender_next( &frame );
+
+        if (length != 0) {
+
+            tat_status_t status = TAT_STATE_TRANSITION_FAILED;
+
+            if (tat_set_trx_state( TX_ARET_ON ) == TAT_SUCCESS) {
+
+                rx_flag = false; // Set the flag false, so that the TRX_END event is not misinterpreted.
+                status = tat_send_data_with_profile( TAT_CSMA_PROFILE_DATA, length, frame );
+            } else {
+                com_send_string( debug_pll_transition, sizeof( debug_pll_transition ) );
+            } // end: if (tat_set_trx_state( TX_ARET_ON ) == TAT_SUCCESS) ...
+
+            arq_sender_sent( status );
+
+            if (tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS) {
+                com_send_string( debug_fatal_error, sizeof( debug_fatal_error ) );
+            } // end: if (tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS) ...
+
+            rx_flag = true;
+        } // end: if (length != 0) ...
+
+#if defined( PROFILING ) || defined( TRACE ) || defined( WATCHDOG )
+        uint8_t command = com_get_command( );
+#endif
+#if defined( PROFILING )
+        prof_command( command );
+#endif
+#if defined( TRACE )
+        trace_command( command );
+        trace_poll( ); //Dump a triggered trace.
+#endif
+#if defined( AES_BENCHMARK )
+        aes_bench_command( command );
+#endif
+#if defined( WATCHDOG )
+        watchdog_command( command );
+#endif
+    } // end: while (true) ...
+}
+#endif
+
+#if defined( FRAGMENTATION )
+/*! \brief This function replaces the normal program flow when FRAGMENTATION
+ *         is used, and never returns. Once per second a test datagram of
+ *         FRAG_TX_SIZE bytes is sent, its fragments back to back in
+ *         TX_ARET_ON. The datagram starts with a 16 bit counter, MSB first,
+ *         followed by a byte ramp.
+ */
+static void frag_main_loop( void )
+{
+    static uint8_t datagram[ FRAG_TX_SIZE ];
+    static uint8_t frame[ FRAG_MAX_FRAME_LENGTH ];
+    uint16_t datagram_number = 0;
+
+    for (uint16_t i = 0; i < FRAG_TX_SIZE; i++) { datagram[ i ] = (uint8_t)i; }
+
+    while (true) {
+
+        WATCHDOG_KICK( );
+
+        datagram[ 0 ] = datagram_number >> 8;
+        datagram[ 1 ] = datagram_number & 0xFF;
+        datagram_number++;
+
+        if (frag_sender_start( DEST_ADDRESS, datagram, FRAG_TX_SIZE ) != TAT_SUCCESS) {
+            com_send_string( debug_transmission_length, sizeof( debug_transmission_length ) );
+        } else if (tat_set_trx_state( TX_ARET_ON ) == TAT_SUCCESS) {
+
+            rx_flag = false; // Set the flag false, so that the TRX_END event is not misinterpreted.
+
+            //Stay in TX_ARET_ON until the last fragment is sent.
+            uint8_t length;
+            while ((length = frag_sender_next( frame )) != 0) {
+                frag_sender_sent( tat_send_data_with_profile( TAT_CSMA_PROFILE_BULK, length, frame ) );
+            }
+
+#if defined( TRACE )
+            frag_statistics_t statistics;
+            static uint16_t datagrams_aborted;
+
+            frag_get_statistics( &statistics );
+            if (statistics.datagrams_aborted != datagrams_aborted) {
+                datagrams_aborted = statistics.datagrams_aborted;
+                trace_trigger( TRACE_TRIGGER_TX_FAILED );
+            }
+#endif
+        } else {
+            com_send_string( debug_pll_transition, sizeof( debug_pll_transition ) );
+        } // end: if (frag_sender_start( ... ) != TAT_SUCCESS) ...
+
+        if (tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS) {
+            com_send_string( debug_fatal_error, sizeof( debug_fatal_error ) );
+        } // end: if (tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS) ...
+
+        rx_flag = true;
+
+#if defined( PROFILING ) || defined( TRACE ) || defined( WATCHDOG )
+        uint8_t command = com_get_command( );
+#endif
+#if defined( PROFILING )
+        prof_command( command );
+#endif
+#if defined( TRACE )
+        trace_command( command );
+        trace_poll( ); //Dump a triggered trace.
+#endif
+#if defined( AES_BENCHMARK )
+        aes_bench_command( command );
+#endif
+#if defined( WATCHDOG )
+        watchdog_command( command );
+#endif
+        _delay_ms(1000);
+    } // end: while (true) ...
+}
+#endif
+
+#if defined( AGGREGATION )
+/*! \brief This function sends the aggregate, if it holds any records.
+ */
+static void aggr_send( void )
+{
+    uint8_t *frame;
+    uint8_t length = aggr_take( &frame );
+
+    if (length == 0) { return; }
+
+    if (tat_set_trx_state( TX_ARET_ON ) == TAT_SUCCESS) {
+
+        rx_flag = false; // Set the flag false, so that the TRX_END event is not misinterpreted.
+
+        if (tat_send_data_with_profile( TAT_CSMA_PROFILE_DATA, length, frame ) != TAT_SUCCESS) {
+#if defined( TRACE )
+            trace_trigger( TRACE_TRIGGER_TX_FAILED );
+#endif
+        }
+    } else {
+        com_send_string( debug_pll_transition, sizeof( debug_pll_transition ) );
+    } // end: if (tat_set_trx_state( TX_ARET_ON ) == TAT_SUCCESS) ...
+
+    if (tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS) {
+        com_send_string( debug_fatal_error, sizeof( debug_fatal_error ) );
+    } // end: if (tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS) ...
+
+    rx_flag = true;
+}
+
+/*! \brief This function replaces the normal program flow when AGGREGATION is
+ *         used, and never returns. Every AGGR_RECORD_INTERVAL the record that
+ *         would otherwise fill a frame of its own (sequence number, carry and
+ *         tx_frame[12..14]) is added to the aggregate, which is sent once
+ *         aggr_ready says so.
+ */
+static void aggr_main_loop( void )
+{
+    uint8_t record[ AGGR_RECORD_LENGTH ];
+    uint8_t frame_sequence_number = 0;
+    uint8_t frame_carry = 0;
+    uint32_t last_record = hal_get_system_time( );
+
+    aggr_init( DEST_ADDRESS );
+
+    while (true) {
+
+        WATCHDOG_KICK( );
+
+        if (HAL_ELAPSED_TIME( last_record ) >= AGGR_RECORD_INTERVAL) {
+
+            last_record = (last_record + AGGR_RECORD_INTERVAL) & HAL_SYMBOL_MASK; //Keeps the cadence.
+
+            frame_sequence_number++;
+            if (frame_sequence_number == 255) {
+                frame_sequence_number = 0;
+                frame_carry++;
+            }
+
+            record[ 0 ] = frame_sequence_number;
+            record[ 1 ] = frame_carry;
+            record[ 2 ] = tx_frame[ 12 ];
+            record[ 3 ] = tx_frame[ 13 ];
+            record[ 4 ] = tx_frame[ 14 ];
+
+            if (aggr_add( record, sizeof( record ) ) == TAT_BUSY_STATE) {
+                aggr_send( );
+                aggr_add( record, sizeof( record ) );
+            }
+        } // end: if (HAL_ELAPSED_TIME( last_record ) >= AGGR_RECORD_INTERVAL) ...
+
+        if (aggr_ready( ) == true) { aggr_send( ); }
+
+#if defined( PROFILING ) || defined( TRACE ) || defined( WATCHDOG )
+        uint8_t command = com_get_command( );
+#endif
+#if defined( PROFILING )
+        prof_command( command );
+#endif
+#if defined( TRACE )
+        trace_command( command );
+        trace_poll( ); //Dump a triggered trace.
+#endif
+#if defined( AES_BENCHMARK )
+        aes_bench_command( command );
+#endif
+#if defined( WATCHDOG )
+        watchdog_command( command );
+#endif
+    } // end: while (true) ...
+}
+#endif
+
+#if defined( TDMA )
+/*! \brief This function replaces the normal program flow when TDMA is used, and
+ *         never returns. The frame is sent once per superframe in the own
+ *         slot, or in the join period until the receiver has given this node
+ *         a slot. Beacons and schedules are read from the rx_pool, and the
+ *         AVR sleeps until the next slot.
+ */
+static void tdma_main_loop( void )
+{
+    static uint8_t frame_sequence_number = 0;
+    static uint8_t frame_carry = 0;
+
+    tdma_init( );
+    tat_set_csma_profile( TAT_CSMA_PROFILE_DATA, 0, 3, 0, 1 ); //The slot is ours: one CCA, no back-off.
+
+    while (true) {
+
+        WATCHDOG_KICK( );
+
+        //Read the beacons and schedules.
+        while (rx_pool_items_used != 0) {
+
+            //Handle wrapping of rx_pool.
+            if (rx_pool_tail == rx_pool_end) {
+                rx_pool_tail = rx_pool_start;
+            } else {
+                ++rx_pool_tail;
+            } // end: if (rx_pool_tail == rx_pool_end) ...
+
+            if (tdma_is_schedule( rx_pool_tail->data, rx_pool_tail->length ) == true) {
+                tdma_receive_schedule( rx_pool_tail->data, rx_pool_tail->length );
+            } else {
+                tsync_receive( rx_pool_tail->data, rx_pool_tail->length, rx_pool_sync_time[ rx_pool_tail - rx_pool_start ] );
+            } // end: if (tdma_is_schedule( ...
+
+            cli( );
+            ++rx_pool_items_free;
+            --rx_pool_items_used;
+            sei( );
+        } // end: while (rx_pool_items_used != 0) ...
+
+        if (rx_pool_overflow_flag == true) {
+            cli( );
+            rx_pool_init( );
+            com_send_string( debug_rx_pool_overflow, sizeof( debug_rx_pool_overflow ) );
+            sei( );
+        } // end: if (rx_pool_overflow_flag == true) ...
+
+        tdma_slot_t slot = tdma_current_slot( );
+
+        if (slot == TDMA_NO_SLOT) {
+
+            //Sleep until the next slot, or a received frame. A new schedule may move it, so it is checked again.
+            uint32_t start;
+
+            if (tdma_next_slot( &start ) != TDMA_NO_SLOT) { tdma_wait_until( start ); }
+        } else {
+
+            tat_status_t status = TAT_STATE_TRANSITION_FAILED;
+
+            frame_sequence_number++; //Sequence Number.
+            if (frame_sequence_number == 255) {
+                frame_sequence_number = 0;
+                frame_carry++;
+            }
+            tx_frame[ 2 ] = frame_sequence_number;
+            tx_frame[ 19 ] = frame_carry;
+#if defined( SECURITY )
+            uint8_t *send_frame = tx_secure_frame;
+            uint8_t send_length = ccm_secure( tx_frame, tx_frame_length, tx_secure_frame ); //0 is refused by the TAT.
+#else
+            uint8_t *send_frame = tx_frame;
+            uint8_t send_length = tx_frame_length;
+#endif
+
+            if (tat_set_trx_state( TX_ARET_ON ) == TAT_SUCCESS) {
+
+                rx_flag = false; // Set the flag false, so that the TRX_END event is not misinterpreted.
+                status = tat_send_data_with_profile( (slot == TDMA_OWN_SLOT) ? TAT_CSMA_PROFILE_DATA : TAT_CSMA_PROFILE_CONTROL,
+                                                     send_length, send_frame );
+
+                //Beacon with the time of the previous one, in the own slot only.
+                if ((slot == TDMA_OWN_SLOT) && (tsync_beacon_due( ) == true)) {
+                    static uint8_t beacon_frame[ TSYNC_BEACON_LENGTH ];
+                    uint8_t beacon_length = tsync_build_beacon( beacon_frame );
+                    tsync_beacon_sent( tat_send_data_with_profile( TAT_CSMA_PROFILE_DATA, beacon_length, beacon_frame ) );
+                } // end: if ((slot == TDMA_OWN_SLOT) ...
+            } else {
+                com_send_string( debug_pll_transition, sizeof( debug_pll_transition ) );
+            } // end: if (tat_set_trx_state( TX_ARET_ON ) == TAT_SUCCESS) ...
+
+            tdma_sent( slot, status );
+
+            if (tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS) {
+                com_send_string( debug_fatal_error, sizeof( debug_fatal_error ) );
+            } // end: if (tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS) ...
+
+            rx_flag = true;
+
+            upload_print( ); //After the slot, the UART is slow.
+            entropy_harvest( );
+        } // end: if (slot == TDMA_NO_SLOT) ...
+
+#if defined( PROFILING ) || defined( TRACE ) || defined( SECURITY ) || defined( TIME_SYNC ) || defined( WATCHDOG )
+        uint8_t command = com_get_command( );
+#endif
+#if defined( PROFILING )
+        prof_command( command );
+#endif
+#if defined( TRACE )
+        trace_command( command );
+        trace_poll( ); //Dump a triggered trace.
+#endif
+#if defined( SECURITY )
+        ccm_command( command );
+#endif
+#if defined( AES_BENCHMARK )
+        aes_bench_command( command );
+#endif
+#if defined( WATCHDOG )
+        watchdog_command( command );
+#endif
+        tsync_command( command );
+        tdma_command( command );
+    } // end: while (true) ...
+}
+#endif
+
 int main( void ){
 
     static uint8_t length_of_received_data = 0;
     static uint8_t frame_sequence_number = 0;
 	static uint8_t frame_carry = 0;
+#if defined( WATCHDOG )
+    watchdog_start( ); //First: counts the reset if it was the watchdog's.
+#endif
     rx_flag = true;
     configure_frame();
     rx_pool_init( );
@@ -223,8 +737,38 @@ int main( void ){
     } // end: if (tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS) ...
 
     sei( );
+#if defined( PROFILING )
+    prof_init( );
+#endif
+#if defined( TRACE )
+    trace_init( );
+#endif
+    entropy_init( );
+    entropy_harvest( ); //Fill the pool, then replace the CSMA seed from trx_init.
+    entropy_harvest( );
+    entropy_seed_csma( );
+#if defined( SECURITY )
+    static uint8_t security_key[] = SECURITY_KEY;
+    ccm_init( security_key ); //After entropy_harvest: the frame counter is seeded from the pool.
+#endif
+#if defined( TIME_SYNC )
+    tsync_init( );
+    hal_set_rx_start_event_handler( tsync_rx_start ); //Reference time of the beacons.
+#endif
 	DDRF |= (1<<1);
     PORTF &= ~(1<<1);
+#if defined( ARQ )
+    arq_main_loop( );
+#endif
+#if defined( FRAGMENTATION )
+    frag_main_loop( );
+#endif
+#if defined( AGGREGATION )
+    aggr_main_loop( );
+#endif
+#if defined( TDMA )
+    tdma_main_loop( );
+#endif
     //Give the user an indication that the system is ready.
     length_of_received_data = hal_register_read(RG_PART_NUM);
     frame_sequence_number = hal_register_read(RG_VERSION_NUM );
@@ -236,6 +780,7 @@ int main( void ){
      */
     while (true)
 	{
+        WATCHDOG_KICK( );
 	    //upload_print();
 
        if (rx_pool_overflow_flag == true) {
@@ -244,6 +789,31 @@ int main( void ){
             com_send_string( debug_rx_pool_overflow, sizeof( debug_rx_pool_overflow ) );
             sei();
         }
+#if defined( TIME_SYNC ) || defined( OTA )
+        //Only beacons and updates are expected, they were received during the delay.
+        while (rx_pool_items_used != 0) {
+
+            //Handle wrapping of rx_pool.
+            if (rx_pool_tail == rx_pool_end) {
+                rx_pool_tail = rx_pool_start;
+            } else {
+                ++rx_pool_tail;
+            } // end: if (rx_pool_tail == rx_pool_end) ...
+#if defined( OTA )
+            if (ota_is_start( rx_pool_tail->data, rx_pool_tail->length ) == true) {
+                ota_enter_bootloader( rx_pool_tail->data ); //The bootloader takes over.
+            }
+#endif
+#if defined( TIME_SYNC )
+            tsync_receive( rx_pool_tail->data, rx_pool_tail->length, rx_pool_sync_time[ rx_pool_tail - rx_pool_start ] );
+#endif
+
+            cli( );
+            ++rx_pool_items_free;
+            --rx_pool_items_used;
+            sei( );
+        } // end: while (rx_pool_items_used != 0) ...
+#endif
         length_of_received_data = 20;
         if (length_of_received_data == 1) {
             com_send_string( debug_transmission_length, sizeof( debug_transmission_length ) );
@@ -265,16 +835,39 @@ int main( void ){
 					}
 					tx_frame[2] = frame_sequence_number;
 					tx_frame[19] = frame_carry;
+#if defined( SECURITY )
+                    uint8_t *send_frame = tx_secure_frame;
+                    uint8_t send_length = ccm_secure( tx_frame, tx_frame_length, tx_secure_frame ); //0 is refused by the TAT.
+#else
+                    uint8_t *send_frame = tx_frame;
+                    uint8_t send_length = tx_frame_length;
+#endif
 					DDRF |= (1<<0);
                     PORTF &= ~(1<<0);
                     //Copy data into the TX frame buffer.
                     rx_flag = false; // Set the flag false, so that the TRX_END event is not misinterpreted.
          			//ͼĴеֵͽڵ
-                    if (tat_send_data_with_retry( tx_frame_length, tx_frame, 1 ) == TAT_SUCCESS) {
+#if defined( LOW_POWER_LISTENING )
+                    //The receiver is sampling the channel, so strobe until it is awake.
+                    if (lpl_send_data( send_length, send_frame ) == TAT_SUCCESS) {
+#else
+                    if (tat_send_data_with_profile( TAT_CSMA_PROFILE_DATA, send_length, send_frame ) == TAT_SUCCESS) {
+#endif
                     } else {
+#if defined( TRACE )
+                        trace_trigger( TRACE_TRIGGER_TX_FAILED );
+#endif
                         //com_send_string( debug_transmission_failed, sizeof( debug_transmission_failed ) );
                     }
 						 // end:  if (tat_send_data_with_retry( tx_frame_length, tx_frame, 1 ) ...
+#if defined( TIME_SYNC )
+                    //Beacon with the time of the previous one, still in TX_ARET_ON.
+                    if (tsync_beacon_due( ) == true) {
+                        static uint8_t beacon_frame[ TSYNC_BEACON_LENGTH ];
+                        uint8_t beacon_length = tsync_build_beacon( beacon_frame );
+                        tsync_beacon_sent( tat_send_data_with_profile( TAT_CSMA_PROFILE_CONTROL, beacon_length, beacon_frame ) );
+                    } // end: if (tsync_beacon_due( ) == true) ...
+#endif
                 } else {
                     com_send_string( debug_pll_transition, sizeof( debug_pll_transition ) );
                 } // end: if (tat_set_trx_state( TX_ARET_ON ) == TAT_SUCCESS) ...
@@ -284,10 +877,47 @@ int main( void ){
                 } // end: if (tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS) ...
 
                 rx_flag = true; // Set the flag back again. Only used to protec the frame transmission.
+#if defined( CSMA_STATISTICS )
+                if (frame_sequence_number == 0) { csma_report( ); } //Once per 255 frames.
+#endif
+                if (frame_sequence_number == 0) { entropy_seed_csma( ); }
+                entropy_harvest( ); //Back in RX_AACK_ON, so the pool can be topped up.
+                tx_jitter_delay( );
+#if defined( PROFILING ) || defined( TRACE ) || defined( SECURITY ) || defined( TIME_SYNC ) || defined( OTA ) || defined( WATCHDOG )
+                uint8_t command = com_get_command( ); //Before the UART input is flushed.
+#endif
+#if defined( PROFILING )
+                prof_command( command );
+#endif
+#if defined( TRACE )
+                trace_command( command );
+                trace_poll( ); //Dump a triggered trace.
+#endif
+#if defined( SECURITY )
+                ccm_command( command );
+#endif
+#if defined( AES_BENCHMARK )
+                aes_bench_command( command );
+#endif
+#if defined( WATCHDOG )
+                watchdog_command( command );
+#endif
+#if defined( TIME_SYNC )
+                tsync_command( command );
+#endif
+#if defined( OTA )
+                ota_command( command );
+#endif
                 com_reset_receiver( );
                 //com_send_string( debug_type_message, sizeof( debug_type_message ) );
                 PORTF |= (1<<0);
+#if defined( LOW_POWER_LISTENING )
+                tat_enter_sleep_mode( ); //Nothing is received between the transmissions.
+		        _delay_ms(1000);
+                tat_leave_sleep_mode( );
+#else
 		        _delay_ms(1000);
+#endif
             } // end:
         } // end: if (length_of_received_data == 1) ...*/
     } // emd: while (true) ... 
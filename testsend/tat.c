@@ -2,20 +2,41 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "config_uart_extended.h"
+
 #include "at86rf231.h"
 
 #include "compiler.h"
 #include "tat.h"
 #include "hal.h"
+#include "prof.h"
+#include "trace.h"
+#include "watchdog.h"
 /*============================ MACROS ========================================*/
 #define TAT_CCA_DONE_MASK     ( 1 << 7 ) //!< Mask used to check the CCA_DONE bit.
 #define TAT_CCA_IDLE_MASK     ( 1 << 6 ) //!< Mask used to check the CCA_STATUS bit.
 
 #define TAT_START_CCA ( 1 ) //!< Value in the CCA_REQUEST subregister that initiate a cca.
 
-#define TAT_TRANSMISSION_SUCCESS  ( 0 )
-#define TAT_BUSY_CHANNEL          ( 3 )
 #define TAT_MIN_IEEE_FRAME_LENGTH ( 5 )
+#define TAT_MAX_HW_FRAME_RETRIES  ( 15 ) //!< Largest value of the MAX_FRAME_RETRIES subregister.
+#define TAT_VERSION_NUM_REV_B     ( 3 ) //!< VERSION_NUM of revision B, the first that retransmits in TX_ARET.
+
+#define TAT_CSMA_SEED_LENGTH      ( 12 ) //!< Random bits collected for CSMA_SEED (11 are used).
+#define TAT_MIN_MAX_BE            ( 3 ) //!< Smallest MAX_BE supported by the radio transceiver.
+#define TAT_MAX_MAX_BE            ( 8 ) //!< Largest MAX_BE supported by the radio transceiver.
+#define TAT_MAX_CSMA_RETRIES      ( 5 ) //!< Largest valid MAX_CSMA_RETRIES.
+
+#define TAT_STATE_TIMEOUT         ( 32 ) //!< Deadline of a state transition in symbols (512 us, the slowest takes 180 us).
+#define TAT_BACKOFF_PERIOD        ( 20 ) //!< aUnitBackoffPeriod in symbols.
+#define TAT_CCA_DURATION          ( 8 ) //!< CCA measurement in symbols.
+#define TAT_FRAME_DURATION        ( 266 ) //!< SHR, PHR and the longest PSDU in symbols.
+#define TAT_ACK_WAIT_DURATION     ( 66 ) //!< macAckWaitDuration and the turnaround to the next attempt, in symbols.
+#define TAT_TRX_END_MARGIN        ( 625 ) //!< Added to the TRX_END deadline for interrupt latency (10 ms).
+
+#define TAT_FRAME_BUFFER_PSDU     ( 1 ) //!< SRAM address of the first PSDU byte, after the PHR.
+#define TAT_SPI_HEADER_LENGTH     ( 2 ) //!< Command and length or address bytes of a frame buffer or SRAM write.
+#define TAT_RESIDENT_MAX_GAP      ( 2 ) //!< Unchanged bytes written over rather than starting a new SRAM write.
 /*============================ TYPEDEFS ======================================*/
 
 /*! \brief  This enumeration defines the necessary timing information for the 
@@ -41,8 +62,47 @@ typedef enum{
     TIME_STATE_TRANSITION_PLL_ACTIVE = 1, //!< Transition time from PLL active state to another.
 }tat_trx_timing_t;
 /*============================ VARIABLES =====================================*/
+static uint8_t tat_version_number; //!< VERSION_NUM read from the radio transceiver in tat_init.
+static bool tat_hw_frame_retries; //!< True if MAX_FRAME_RETRIES can be used (parts newer than rev A).
+static tat_tx_statistics_t tat_tx_statistics; //!< Counters kept by tat_send_data_with_retry.
+
+/*! \brief  CSMA-CA parameters for each traffic class, indexed by 
+ *          tat_csma_profile_id_t. Can be tuned with tat_set_csma_profile.
+ */
+static tat_csma_profile_t tat_csma_profiles[ TAT_CSMA_PROFILES ] = {
+    { 1, 3, 4, 3 }, //TAT_CSMA_PROFILE_CONTROL: Short back-off, several retries.
+    { 3, 5, 4, 1 }, //TAT_CSMA_PROFILE_DATA: IEEE 802.15.4 default back-off.
+    { 5, 8, 5, 1 }  //TAT_CSMA_PROFILE_BULK: Long back-off, yields to the others.
+};
+static tat_csma_statistics_t tat_csma_statistics[ TAT_CSMA_PROFILES ]; //!< Counters kept by tat_send_data_with_profile.
+
+/*! \brief  Registers written back by tat_recover: everything the application
+ *          configures, but not the state, the status and the calibration.
+ */
+static const uint8_t tat_configuration_registers[] = {
+    RG_TRX_CTRL_0, RG_TRX_CTRL_1, RG_PHY_TX_PWR, RG_PHY_CC_CCA, RG_CCA_THRES,
+    RG_RX_CTRL, RG_SFD_VALUE, RG_TRX_CTRL_2, RG_ANT_DIV, RG_IRQ_MASK, RG_BATMON,
+    RG_XOSC_CTRL, RG_RX_SYN, RG_XAH_CTRL_1, RG_SHORT_ADDR_0, RG_SHORT_ADDR_1,
+    RG_PAN_ID_0, RG_PAN_ID_1, RG_IEEE_ADDR_0, RG_IEEE_ADDR_1, RG_IEEE_ADDR_2,
+    RG_IEEE_ADDR_3, RG_IEEE_ADDR_4, RG_IEEE_ADDR_5, RG_IEEE_ADDR_6, RG_IEEE_ADDR_7,
+    RG_XAH_CTRL_0, RG_CSMA_SEED_0, RG_CSMA_SEED_1, RG_CSMA_BE
+};
+static uint8_t tat_configuration[ sizeof( tat_configuration_registers ) ]; //!< Saved by tat_save_configuration.
+static bool tat_configuration_saved; //!< True once tat_save_configuration was called.
+static tat_recovery_statistics_t tat_recovery_statistics; //!< Counters kept by tat_recover.
+
+#if defined( RESIDENT_TX_FRAME )
+static uint8_t tat_resident_frame[ TAT_RESIDENT_FRAME_SIZE ]; //!< Copy of the PSDU in the frame buffer.
+static uint8_t tat_resident_length; //!< Length of tat_resident_frame, 0 if there is none.
+#endif
 /*============================ PROTOTYPES ====================================*/
 static bool is_sleeping( void );
+static tat_status_t tat_change_state( uint8_t new_state );
+static uint8_t tat_wait_for_state( uint8_t state, uint32_t timeout );
+static bool tat_wait_for_trx_end( uint32_t timeout );
+static uint32_t tat_aret_timeout( uint8_t hw_retries );
+static tat_status_t tat_timed_out( uint8_t state );
+static void tat_download_frame( uint8_t frame_length, uint8_t *frame );
 
 /*! \brief  Initialize the Transceiver Access Toolbox and lower layers.
  *
@@ -55,7 +115,8 @@ static bool is_sleeping( void );
  *  \retval TAT_SUCCESS     The radio transceiver was successfully initialized 
  *                          and put into the TRX_OFF state.
  *  \retval TAT_UNSUPPORTED_DEVICE  The connected device is not an Atmel 
- *                                  AT86RF231 radio transceiver.
+ *                                  AT86RF231 radio transceiver (revision A or 
+ *                                  later).
  *  \retval TAT_TIMED_OUT   The radio transceiver was not able to initialize and 
  *                          enter TRX_OFF state within the specified time.
  *
@@ -83,13 +144,20 @@ tat_status_t tat_init( void ){
         //Read Version Number
         uint8_t version_number = hal_register_read( RG_VERSION_NUM );
         
-        if (version_number != AT86RF231_VERSION_NUM) {
+        if ((version_number != AT86RF231_VERSION_NUM) && 
+            (version_number != TAT_VERSION_NUM_REV_B)) {
             init_status = TAT_UNSUPPORTED_DEVICE;
-        } else {       
+        } else {
             if (hal_register_read( RG_MAN_ID_0 ) != SUPPORTED_MANUFACTURER_ID) {
                 init_status = TAT_UNSUPPORTED_DEVICE;
             } else {
                 hal_register_write( RG_IRQ_MASK, RF231_SUPPORTED_INTERRUPT_MASK );
+                
+                //Rev A can not retransmit frames in TX_ARET (errata), so the
+                //retries are done by the MCU on these parts.
+                tat_version_number = version_number;
+                tat_hw_frame_retries = (version_number == TAT_VERSION_NUM_REV_B);
+                tat_reset_tx_statistics( );
             } // end: if (hal_register_read( RG_MAN_ID_0 ) != ...
         } // end: if ((version_number != RF231_REVA ) ...
     } // end: if (tat_get_trx_state( ) ...
@@ -459,7 +527,9 @@ uint8_t tat_get_clock_speed( void ){
  *                     or CLKM_16MHZ.
  *
  *  \retval TAT_SUCCESS Clock speed updated. New state is TRX_OFF.
- *  \retval TAT_INVALID_ARGUMENT Requested clock speed is out of bounds.
+ *  \retval TAT_INVALID_ARGUMENT Requested clock speed is out of bounds, or
+ *                               differs from HAL_CLKM_CTRL while CLKM clocks
+ *                               the AVR (HAL_CLOCK_FROM_CLKM).
  *  
  * \ingroup tat
  */
@@ -467,6 +537,10 @@ tat_status_t tat_set_clock_speed( bool direct, uint8_t clock_speed ){
     
     /*Check function parameter and current clock speed.*/
     if (clock_speed > CLKM_16MHZ) { return TAT_INVALID_ARGUMENT; }
+    
+#if defined( HAL_CLOCK_FROM_CLKM )
+    if (clock_speed != HAL_CLKM_CTRL) { return TAT_INVALID_ARGUMENT; } //Set by hal_raise_cpu_clock.
+#endif
         
     if (tat_get_clock_speed( ) == clock_speed) { return TAT_SUCCESS; }
     
@@ -631,14 +705,34 @@ static bool is_sleeping( void ){
  *                                  successfully.
  *  \retval    TAT_INVALID_ARGUMENT Supplied function parameter out of bounds.  
  *  \retval    TAT_WRONG_STATE      Illegal state to do transition from.
- *  \retval    TAT_BUSY_STATE       The radio transceiver is busy.
+ *  \retval    TAT_BUSY_STATE       The radio transceiver is busy, or a frame
+ *                                  started to arrive during the transition.
  *  \retval    TAT_TIMED_OUT        The state transition could not be completed 
- *                                  within resonable time.
+ *                                  within resonable time, and neither could 
+ *                                  tat_recover bring the radio transceiver to 
+ *                                  new_state.
  *
  *  \ingroup tat
  */
 tat_status_t tat_set_trx_state( uint8_t new_state ){
     
+    tat_status_t set_state_status = tat_change_state( new_state );
+    
+    //A transition that does not complete by its deadline is a radio 
+    //transceiver that hangs.
+    if (set_state_status == TAT_TIMED_OUT) {
+        
+        tat_recovery_statistics.timeouts++;
+        set_state_status = tat_recover( new_state );
+    }
+    
+    return set_state_status;
+}
+
+/*! \brief  The state transition of tat_set_trx_state, without recovery.
+ */
+static tat_status_t tat_change_state( uint8_t new_state ){
+    
     /*Check function paramter and current state of the radio transceiver.*/
     if (!((new_state == TRX_OFF ) || (new_state == RX_ON) || (new_state == PLL_ON) || 
         (new_state == RX_AACK_ON ) || (new_state == TX_ARET_ON ))) { 
@@ -656,6 +750,8 @@ tat_status_t tat_set_trx_state( uint8_t new_state ){
     }
     
     if (new_state == original_state) { return TAT_SUCCESS; }
+    
+    PROF_ENTER( PROF_STATE_TRANSITION );
                         
     //At this point it is clear that the requested new_state is:
     //TRX_OFF, RX_ON, PLL_ON, RX_AACK_ON or TX_ARET_ON.
@@ -694,10 +790,19 @@ tat_status_t tat_set_trx_state( uint8_t new_state ){
         } // end: if (original_state == TRX_OFF) ...
     } // end: if( new_state == TRX_OFF ) ...
         
-    /*Verify state transition.*/
+    /*Verify state transition, allowing a slow one until the deadline.*/
     tat_status_t set_state_status = TAT_TIMED_OUT;
+    uint8_t reached_state = tat_wait_for_state( new_state, TAT_STATE_TIMEOUT );
     
-    if( tat_get_trx_state( ) == new_state ){ set_state_status = TAT_SUCCESS; }
+    if( reached_state == new_state ){ 
+        set_state_status = TAT_SUCCESS; 
+    } else if ((reached_state == BUSY_RX ) || (reached_state == BUSY_RX_AACK)) {
+        set_state_status = TAT_BUSY_STATE; //A frame arrived in the new state.
+    }
+    
+    TRACE_EVENT( TRACE_STATE, reached_state );
+    
+    PROF_LEAVE( PROF_STATE_TRANSITION );
     
     return set_state_status;
 }
@@ -706,13 +811,23 @@ tat_status_t tat_set_trx_state( uint8_t new_state ){
  *
  *  \retval    TAT_SUCCESS          Sleep mode entered successfully.
  *  \retval    TAT_TIMED_OUT        The transition to TRX_OFF took too long.
+ *  \retval    TAT_WRONG_STATE      CLKM clocks the AVR (HAL_CLOCK_FROM_CLKM), 
+ *                                  and would stop in SLEEP.
  *
  *  \ingroup tat
  */
 tat_status_t tat_enter_sleep_mode( void ){
     
+#if defined( HAL_CLOCK_FROM_CLKM )
+    return TAT_WRONG_STATE;
+#endif
+    
     if (is_sleeping( ) == true) { return TAT_SUCCESS; }
 
+#if defined( RESIDENT_TX_FRAME )
+    tat_resident_length = 0; //The frame buffer is not relied on across SLEEP.
+#endif
+    
     tat_reset_state_machine( ); //Force the device into TRX_OFF.
     
     tat_status_t enter_sleep_status = TAT_TIMED_OUT;
@@ -777,6 +892,14 @@ void tat_reset_trx( void ){
     hal_set_slptr_low( );
     delay_us( TIME_RESET );    
     hal_set_rst_high( );
+    
+#if defined( RESIDENT_TX_FRAME )
+    tat_resident_length = 0;
+#endif
+    
+#if defined( HAL_CLOCK_FROM_CLKM )
+    hal_raise_cpu_clock( ); //The reset took CLKM back to 1 MHz.
+#endif
 }
 
 /*! \brief  This function will enable or disable automatic CRC during frame 
@@ -993,7 +1116,7 @@ tat_status_t tat_configure_csma( uint8_t seed0, uint8_t be_csma_seed1 ){
     uint8_t csma_retries      = ( be_csma_seed1 & 0x38 ) >> 3;
     uint8_t seed1             = ( be_csma_seed1 & 0x07 );
             
-    hal_subregister_write( SR_MAX_FRAME_RETRIES, 0 ); //AT86RF231 rev A errata.
+    hal_subregister_write( SR_MAX_FRAME_RETRIES, 0 ); //Set per frame by tat_send_data_with_retry.
     hal_subregister_write( SR_MAX_CSMA_RETRIES, csma_retries );
     hal_subregister_write( SR_MIN_BE, back_off_exponent );
     hal_register_write( RG_CSMA_SEED_0, seed0 );
@@ -1002,7 +1125,45 @@ tat_status_t tat_configure_csma( uint8_t seed0, uint8_t be_csma_seed1 ){
     return TAT_SUCCESS;
 }
 
-/*! \brief  This function uses the .
+/*! \brief  This function returns the version number read from the radio 
+ *          transceiver by tat_init.
+ *
+ *  \return VERSION_NUM of the connected AT86RF231. 2 is revision A, 3 is 
+ *          revision B.
+ *
+ *  \ingroup tat
+ */
+uint8_t tat_get_version_number( void ){
+    return tat_version_number;
+}
+
+/*! \brief  This function tells how frame retransmissions are done by 
+ *          tat_send_data_with_retry.
+ *
+ *  \retval true The retransmissions are done by the radio transceiver 
+ *               (MAX_FRAME_RETRIES).
+ *  \retval false The retransmissions are done in software (rev A).
+ *
+ *  \ingroup tat
+ */
+bool tat_uses_hw_frame_retries( void ){
+    return tat_hw_frame_retries;
+}
+
+/*! \brief  This function uses the TX_ARET mode to send a frame, and retries 
+ *          the transmission until it is acknowledged.
+ *
+ *          On revision B the retransmissions are done by the radio 
+ *          transceiver itself (MAX_FRAME_RETRIES), so the MCU only sees one 
+ *          TRX_END interrupt per call. On revision A each retry is started in 
+ *          software with a new SLP_TR pulse, and so are the retransmissions 
+ *          beyond the 15 the radio transceiver can do. A channel access 
+ *          failure ends the attempts of the radio transceiver, and is retried 
+ *          in software up to retries times, apart from the retransmissions.
+ *
+ *          With RESIDENT_TX_FRAME the frame stays in the frame buffer after 
+ *          the call, and the next call with a frame of the same length only 
+ *          writes the bytes that differ. Nothing is written to repeat a frame.
  *
  *  \note This function can only be executed after tat_configure_csma has been 
  *        called!
@@ -1011,7 +1172,8 @@ tat_status_t tat_configure_csma( uint8_t seed0, uint8_t be_csma_seed1 ){
  *  \param frame_length Length of frame to transmit.
  *  \param frame Pointer to the frame to transmit.
  *  \param retries Number of times to retry frame transmission (Zero means that 
- *                 the frame will be sent once.).
+ *                 the frame will be sent once.), and number of times a channel 
+ *                 access failure is retried.
  *  \retval TAT_SUCCESS if the frame was sent successfully within the defined 
  *                      number of retries.
  *  \retval TAT_CHANNEL_ACCESS_FAILURE if the channel was found to be busy on 
@@ -1019,71 +1181,597 @@ tat_status_t tat_configure_csma( uint8_t seed0, uint8_t be_csma_seed1 ){
  *  \retval TAT_NO_ACK if an IEEE 802.15.4 acknowledge was not received in time.
  *  \retval TAT_INVALID_ARGUMENT if the frame_length is too long.
  *  \retval TAT_WRONG_STATE if the radio transceiver is not in TX_ARET_ON.
+ *  \retval TAT_TIMED_OUT if TRX_END or TX_ARET_ON did not come in time. The 
+ *                      radio transceiver was taken back to TX_ARET_ON by 
+ *                      tat_recover, if possible, and the frame is lost.
  *
  *  \ingroup tat
  */
 __x tat_status_t tat_send_data_with_retry( uint8_t frame_length, uint8_t *frame, 
                                        uint8_t retries ){ 
     
-    tat_status_t task_status = TAT_CHANNEL_ACCESS_FAILURE;   
-    
+    tat_status_t task_status = TAT_CHANNEL_ACCESS_FAILURE;
+    uint8_t hw_retries = 0; //Retransmissions done by the radio transceiver per SLP_TR pulse.
+    uint8_t caf_retries = retries; //Channel access failures left to retry.
     
     /*Do sanity check on function parameters and current state.*/
     if ((frame_length > RF231_MAX_TX_FRAME_LENGTH) || 
         (frame_length < TAT_MIN_IEEE_FRAME_LENGTH)) { 
-  
         return TAT_INVALID_ARGUMENT; 
     }
     
-    if (tat_get_trx_state( ) != TX_ARET_ON) { 
-	return TAT_WRONG_STATE; }
+    if (tat_get_trx_state( ) != TX_ARET_ON) { return TAT_WRONG_STATE; }
+    
+    /*Let the radio transceiver do as many of the retries as it can. From 
+      here on, retries is what is left of the retransmissions.*/
+    if (tat_hw_frame_retries == true) {
+        
+        hw_retries = (retries > TAT_MAX_HW_FRAME_RETRIES) ? TAT_MAX_HW_FRAME_RETRIES : retries;
+        retries -= hw_retries;
+    }
+    
+    hal_subregister_write( SR_MAX_FRAME_RETRIES, hw_retries );
+    
+    uint32_t trx_end_timeout = tat_aret_timeout( hw_retries );
     
     hal_clear_trx_end_flag( );
+    tat_tx_statistics.frames++;
     
     /*Do initial frame transmission.*/
-    hal_set_slptr_high( );
-    hal_set_slptr_low( );
-    hal_frame_write( frame, frame_length ); //Then write data to the frame buffer.
+    tat_download_frame( frame_length, frame );
+    TRACE_EVENT( TRACE_TX, frame_length );
     
     bool retry = false; // Variable used to control the retry loop.
     
     /*Do retry if requested.*/
     do{
-        //Wait for TRX_END interrupt
-         while (hal_get_trx_end_flag( ) == 0) {;}
+        
+        //Wait for TRX_END interrupt, at most as long as the attempts can take.
+        if (tat_wait_for_trx_end( trx_end_timeout ) == false) {
+            
+            task_status = tat_timed_out( TX_ARET_ON );
+            break;
+        }
+        
         //Check status.
         uint8_t transaction_status = hal_subregister_read( SR_TRAC_STATUS );
+        TRACE_EVENT( TRACE_TRAC, transaction_status );
         
         //Check for failure.
-        if ((transaction_status != TAT_TRANSMISSION_SUCCESS)) {
-
+        if ((transaction_status != TRAC_SUCCESS) && 
+            (transaction_status != TRAC_SUCCESS_DATA_PENDING)) {
             
-            if (transaction_status == TAT_BUSY_CHANNEL) {
+            if (transaction_status == TRAC_CHANNEL_ACCESS_FAILURE) {
+                
+                //The frame is repeated as it was, with the same MAX_FRAME_RETRIES.
                 task_status = TAT_CHANNEL_ACCESS_FAILURE;
+                retry = (caf_retries > 0);
+                
+                if (retry == true) { caf_retries--; }
             } else {
+                
+                //All retransmissions done in silicon were used.
+                tat_tx_statistics.retries += hw_retries;
                 task_status = TAT_NO_ACK;
-            }
-            
-            if ((retries--) > 0) {
+                retry = (retries > 0);
                 
-                retry = true;
+                if (retry == true) {
+                    
+                    //The pulse sends one retransmission, the radio transceiver 
+                    //as many of the rest as it can.
+                    retries--;
+                    tat_tx_statistics.retries++;
+                    
+                    if (tat_hw_frame_retries == true) {
+                        
+                        hw_retries = (retries > TAT_MAX_HW_FRAME_RETRIES) ? TAT_MAX_HW_FRAME_RETRIES : retries;
+                        retries -= hw_retries;
+                        
+                        hal_subregister_write( SR_MAX_FRAME_RETRIES, hw_retries );
+                        trx_end_timeout = tat_aret_timeout( hw_retries );
+                    }
+                } // end: if (retry == true) ...
+            } // end: if (transaction_status == TRAC_CHANNEL_ACCESS_FAILURE) ...
+            
+            if (retry == true) {
                 
                 //Wait for the TRX to go back to TX_ARET_ON.
-                while (tat_get_trx_state() != TX_ARET_ON) {;}
-            
+                if (tat_wait_for_state( TX_ARET_ON, TAT_STATE_TIMEOUT ) != TX_ARET_ON) {
+                    
+                    task_status = tat_timed_out( TX_ARET_ON );
+                    break;
+                }
+                
                 hal_clear_trx_end_flag( );
                 hal_set_slptr_high( );
                 hal_set_slptr_low( );
-            } else {
-                retry = false;
-            }
+                TRACE_EVENT( TRACE_TX, frame_length );
+            } // end: if (retry == true) ...
         } else{
-
+            
             task_status = TAT_SUCCESS;
-            retry = false;            
-        } // end: if ((transaction_status != TAT_TRANSMISSION_SUCCESS)) ...
+            retry = false;
+        } // end: if ((transaction_status != TRAC_SUCCESS) ...
     } while (retry == true);
     
-    return task_status;                                       
+    /*Update the per frame accounting.*/
+    if (task_status == TAT_SUCCESS) {
+        tat_tx_statistics.acked++;
+    } else if (task_status == TAT_NO_ACK) {
+        tat_tx_statistics.no_ack++;
+    } else if (task_status == TAT_CHANNEL_ACCESS_FAILURE) {
+        tat_tx_statistics.channel_access_failures++;
+    } //Timeouts are in the recovery statistics.
+    
+    return task_status;
+}
+
+/*! \brief  This function reads the transmission counters kept by 
+ *          tat_send_data_with_retry.
+ *
+ *  \note   The radio transceiver does not report how many retransmissions 
+ *          were needed for an acknowledged frame. With hardware retries the 
+ *          retries counter therefore only includes the retransmissions of 
+ *          frames that were not acknowledged, plus any done in software.
+ *
+ *  \param  statistics Pointer to where the counters are copied.
+ *
+ *  \ingroup tat
+ */
+void tat_get_tx_statistics( tat_tx_statistics_t *statistics ){
+    *statistics = tat_tx_statistics;
+}
+
+/*! \brief  This function resets the transmission counters.
+ *
+ *  \ingroup tat
+ */
+void tat_reset_tx_statistics( void ){
+    
+    tat_tx_statistics.frames                  = 0;
+    tat_tx_statistics.acked                   = 0;
+    tat_tx_statistics.no_ack                  = 0;
+    tat_tx_statistics.channel_access_failures = 0;
+    tat_tx_statistics.retries                 = 0;
+    tat_tx_statistics.downloaded              = 0;
+}
+/*! \brief  This function sets the seed of the CSMA-CA random number 
+ *          generator, without changing the other CSMA-CA parameters.
+ *
+ *  \param  seed CSMA_SEED. Only the lower 11 bits are used.
+ *
+ *  \ingroup tat
+ */
+void tat_set_csma_seed( uint16_t seed ){
+    
+    hal_register_write( RG_CSMA_SEED_0, seed & 0xFF );
+    hal_subregister_write( SR_CSMA_SEED_1, (seed >> 8) & 0x07 );
+}
+
+/*! \brief  This function seeds the CSMA-CA random number generator from the 
+ *          radio transceiver's own noise source (RND_VALUE).
+ *
+ *          Nodes that are programmed with the same image would otherwise pick 
+ *          identical back-off periods and keep colliding. RND_VALUE is only 
+ *          updated in RX_ON, so the radio transceiver is taken through RX_ON 
+ *          and then returned to its original state.
+ *
+ *  \retval TAT_SUCCESS The CSMA seed was written.
+ *  \retval TAT_WRONG_STATE This function should not be called in the 
+ *                          SLEEP state.
+ *  \retval TAT_STATE_TRANSITION_FAILED RX_ON or the original state could not 
+ *                                      be reached.
+ *
+ *  \ingroup tat
+ */
+tat_status_t tat_randomize_csma_seed( void ){
+    
+    /*Check state.*/
+    if (is_sleeping( ) == true) { return TAT_WRONG_STATE; }
+    
+    uint8_t original_state = tat_get_trx_state( );
+    
+    if (tat_set_trx_state( RX_ON ) != TAT_SUCCESS) { return TAT_STATE_TRANSITION_FAILED; }
+    
+    /*Collect 12 random bits, two at a time. The value changes every 1 us.*/
+    uint16_t seed = 0;
+    
+    for (uint8_t i = 0; i < TAT_CSMA_SEED_LENGTH; i += 2) {
+        
+        delay_us( 1 );
+        seed = (seed << 2) | hal_subregister_read( SR_RND_VALUE );
+    }
+    
+    tat_set_csma_seed( seed );
+    
+    if (tat_set_trx_state( original_state ) != TAT_SUCCESS) { 
+        return TAT_STATE_TRANSITION_FAILED; 
+    }
+    
+    return TAT_SUCCESS;
+}
+
+/*! \brief  This function changes the parameters of one of the CSMA profiles.
+ *
+ *          The new parameters are used from the next call to 
+ *          tat_send_data_with_profile.
+ *
+ *  \param  profile One of the tat_csma_profile_id_t values.
+ *  \param  min_be Minimum back-off exponent, 0 to max_be.
+ *  \param  max_be Maximum back-off exponent, 3 to 8.
+ *  \param  csma_retries Number of extra CCA attempts before the channel access 
+ *                       fails, 0 to 5.
+ *  \param  frame_retries Number of retransmissions if no acknowledge is 
+ *                        received.
+ *
+ *  \retval TAT_SUCCESS The profile was changed.
+ *  \retval TAT_INVALID_ARGUMENT One or more of the arguments are out of range.
+ *
+ *  \ingroup tat
+ */
+tat_status_t tat_set_csma_profile( uint8_t profile, uint8_t min_be, uint8_t max_be,
+                                   uint8_t csma_retries, uint8_t frame_retries ){
+    
+    if ((profile >= TAT_CSMA_PROFILES) || (max_be < TAT_MIN_MAX_BE) || 
+        (max_be > TAT_MAX_MAX_BE) || (min_be > max_be) || 
+        (csma_retries > TAT_MAX_CSMA_RETRIES)) {
+        return TAT_INVALID_ARGUMENT;
+    }
+    
+    tat_csma_profiles[ profile ].min_be        = min_be;
+    tat_csma_profiles[ profile ].max_be        = max_be;
+    tat_csma_profiles[ profile ].csma_retries  = csma_retries;
+    tat_csma_profiles[ profile ].frame_retries = frame_retries;
+    
+    return TAT_SUCCESS;
+}
+
+/*! \brief  This function sends a frame with the CSMA-CA parameters of one of 
+ *          the CSMA profiles.
+ *
+ *          Latency critical frames can then use a short back-off, while bulk 
+ *          data backs off longer and leaves the channel to them. The access 
+ *          delay and the outcome are accounted per profile.
+ *
+ *  \note The radio transceiver must be in TX_ARET_ON.
+ *
+ *  \param profile One of the tat_csma_profile_id_t values.
+ *  \param frame_length Length of frame to transmit.
+ *  \param frame Pointer to the frame to transmit.
+ *
+ *  \retval TAT_SUCCESS if the frame was acknowledged.
+ *  \retval TAT_CHANNEL_ACCESS_FAILURE if the channel was found to be busy on 
+ *                      the last retry.
+ *  \retval TAT_NO_ACK if an IEEE 802.15.4 acknowledge was not received in time.
+ *  \retval TAT_INVALID_ARGUMENT if the profile or frame_length is out of range.
+ *  \retval TAT_WRONG_STATE if the radio transceiver is not in TX_ARET_ON.
+ *
+ *  \ingroup tat
+ */
+__x tat_status_t tat_send_data_with_profile( uint8_t profile, uint8_t frame_length, 
+                                         uint8_t *frame ){
+    
+    if (profile >= TAT_CSMA_PROFILES) { return TAT_INVALID_ARGUMENT; }
+    
+    tat_csma_profile_t *csma_profile = &tat_csma_profiles[ profile ];
+    
+    /*Both back-off exponents are in RG_CSMA_BE.*/
+    hal_register_write( RG_CSMA_BE, (csma_profile->max_be << 4) | csma_profile->min_be );
+    hal_subregister_write( SR_MAX_CSMA_RETRIES, csma_profile->csma_retries );
+    
+    uint32_t request_time = hal_get_system_time( );
+    tat_status_t send_status = tat_send_data_with_retry( frame_length, frame, 
+                                                         csma_profile->frame_retries );
+    uint32_t access_delay = HAL_ELAPSED_TIME( request_time );
+    
+    /*Account the transmission.*/
+    tat_csma_statistics_t *statistics = &tat_csma_statistics[ profile ];
+    
+    if ((send_status == TAT_SUCCESS) || (send_status == TAT_NO_ACK) || 
+        (send_status == TAT_CHANNEL_ACCESS_FAILURE)) {
+        
+        statistics->frames++;
+        statistics->total_delay += access_delay;
+        
+        if (access_delay > statistics->max_delay) { statistics->max_delay = access_delay; }
+        
+        if (send_status == TAT_NO_ACK) {
+            statistics->no_ack++;
+        } else if (send_status == TAT_CHANNEL_ACCESS_FAILURE) {
+            statistics->channel_access_failures++;
+        }
+    }
+    
+    return send_status;
+}
+
+/*! \brief  This function reads the counters of one CSMA profile.
+ *
+ *          The access delay is measured from the transmit request to TRX_END 
+ *          of the last attempt, so it includes the air time of the frame and 
+ *          the acknowledge. Divide total_delay by frames for the average.
+ *
+ *  \param  profile One of the tat_csma_profile_id_t values.
+ *  \param  statistics Pointer to where the counters are copied.
+ *
+ *  \retval TAT_SUCCESS The counters were copied.
+ *  \retval TAT_INVALID_ARGUMENT The profile is out of range.
+ *
+ *  \ingroup tat
+ */
+tat_status_t tat_get_csma_statistics( uint8_t profile, tat_csma_statistics_t *statistics ){
+    
+    if (profile >= TAT_CSMA_PROFILES) { return TAT_INVALID_ARGUMENT; }
+    
+    *statistics = tat_csma_statistics[ profile ];
+    
+    return TAT_SUCCESS;
+}
+
+/*! \brief  This function resets the counters of all CSMA profiles.
+ *
+ *  \ingroup tat
+ */
+void tat_reset_csma_statistics( void ){
+    
+    for (uint8_t i = 0; i < TAT_CSMA_PROFILES; i++) {
+        
+        tat_csma_statistics[ i ].frames                  = 0;
+        tat_csma_statistics[ i ].no_ack                  = 0;
+        tat_csma_statistics[ i ].channel_access_failures = 0;
+        tat_csma_statistics[ i ].total_delay             = 0;
+        tat_csma_statistics[ i ].max_delay               = 0;
+    }
+}
+
+/*! \brief  This function saves the configuration of the radio transceiver, 
+ *          so that tat_recover can write it back after a reset.
+ *
+ *  \note   Call it once the application has configured the radio 
+ *          transceiver, and again if it changes the configuration later.
+ *
+ *  \ingroup tat
+ */
+void tat_save_configuration( void ){
+    
+    for (uint8_t i = 0; i < sizeof( tat_configuration_registers ); i++) {
+        tat_configuration[ i ] = hal_register_read( tat_configuration_registers[ i ] );
+    }
+    
+    tat_configuration_saved = true;
+}
+
+/*! \brief  This function brings a radio transceiver that hangs back to 
+ *          new_state, with increasingly drastic steps until one works:
+ *
+ *          - FORCE_TRX_OFF, for a state machine that is stuck.
+ *          - FORCE_TRX_OFF, then the configuration saved by 
+ *            tat_save_configuration is written back, for registers that 
+ *            were corrupted.
+ *          - A hardware reset with tat_reset_trx, then the saved 
+ *            configuration is written back.
+ *
+ *          The step that succeeded and the time it took are recorded, see 
+ *          tat_get_recovery_statistics. It is called by the TAT when a wait 
+ *          reaches its deadline, and can be called by the application when it 
+ *          finds the radio transceiver unresponsive.
+ *
+ *  \note   Without tat_save_configuration the hardware reset leaves the 
+ *          radio transceiver with its reset values, except for IRQ_MASK.
+ *  \note   A frame that is received or sent during the recovery is lost.
+ *
+ *  \param  new_state State to leave the radio transceiver in, as for 
+ *                    tat_set_trx_state.
+ *
+ *  \retval TAT_SUCCESS The radio transceiver is in new_state.
+ *  \retval TAT_TIMED_OUT All the steps failed.
+ *
+ *  \ingroup tat
+ */
+tat_status_t tat_recover( uint8_t new_state ){
+    
+    uint32_t recovery_start = hal_get_system_time( );
+    tat_status_t recover_status = TAT_TIMED_OUT;
+    
+    for (uint8_t step = TAT_RECOVERY_FORCE_TRX_OFF; step < TAT_RECOVERY_STEPS; step++) {
+        
+        WATCHDOG_KICK( );
+        
+        if (step == TAT_RECOVERY_RESET) {
+            
+            tat_reset_trx( );
+            hal_subregister_write( SR_TRX_CMD, CMD_FORCE_TRX_OFF );
+            delay_us( TIME_P_ON_TO_TRX_OFF );
+            hal_register_write( RG_IRQ_MASK, RF231_SUPPORTED_INTERRUPT_MASK );
+        } else {
+            tat_reset_state_machine( );
+        }
+        
+        if ((step != TAT_RECOVERY_FORCE_TRX_OFF) && (tat_configuration_saved == true)) {
+            
+            for (uint8_t i = 0; i < sizeof( tat_configuration_registers ); i++) {
+                hal_register_write( tat_configuration_registers[ i ], tat_configuration[ i ] );
+            }
+        }
+        
+        hal_clear_trx_end_flag( ); //Of the operation that was aborted.
+        
+        if ((tat_get_trx_state( ) == TRX_OFF) && (tat_change_state( new_state ) == TAT_SUCCESS)) {
+            
+            tat_recovery_statistics.recovered[ step ]++;
+            recover_status = TAT_SUCCESS;
+            break;
+        }
+    } // end: for (uint8_t step ...
+    
+    if (recover_status != TAT_SUCCESS) { tat_recovery_statistics.failures++; }
+    
+    uint32_t recovery_time = HAL_ELAPSED_TIME( recovery_start );
+    
+    tat_recovery_statistics.last_time = recovery_time;
+    if (recovery_time > tat_recovery_statistics.max_time) { tat_recovery_statistics.max_time = recovery_time; }
+    
+    return recover_status;
+}
+
+/*! \brief  This function reads the counters kept by tat_recover.
+ *
+ *  \param  statistics Pointer to where the counters are copied.
+ *
+ *  \ingroup tat
+ */
+void tat_get_recovery_statistics( tat_recovery_statistics_t *statistics ){
+    *statistics = tat_recovery_statistics;
+}
+
+/*! \brief  This function resets the counters kept by tat_recover.
+ *
+ *  \ingroup tat
+ */
+void tat_reset_recovery_statistics( void ){
+    
+    tat_recovery_statistics.timeouts  = 0;
+    tat_recovery_statistics.failures  = 0;
+    tat_recovery_statistics.last_time = 0;
+    tat_recovery_statistics.max_time  = 0;
+    
+    for (uint8_t step = 0; step < TAT_RECOVERY_STEPS; step++) {
+        tat_recovery_statistics.recovered[ step ] = 0;
+    }
+}
+
+/*! \brief  Poll the state until it is state, or the deadline has passed.
+ *
+ *  \param  timeout Deadline in symbols.
+ *
+ *  \return The last state read.
+ */
+static uint8_t tat_wait_for_state( uint8_t state, uint32_t timeout ){
+    
+    uint32_t wait_start = hal_get_system_time( );
+    uint8_t reached_state = tat_get_trx_state( );
+    
+    while ((reached_state != state) && (HAL_ELAPSED_TIME( wait_start ) < timeout)) {
+        reached_state = tat_get_trx_state( );
+    }
+    
+    return reached_state;
+}
+
+/*! \brief  Wait for the TRX_END interrupt until the deadline has passed.
+ *
+ *          The deadline of a transmission can be longer than the watchdog 
+ *          timeout, so the watchdog is kicked while waiting.
+ *
+ *  \param  timeout Deadline in symbols.
+ *
+ *  \retval true TRX_END came.
+ *  \retval false The deadline passed.
+ */
+static bool tat_wait_for_trx_end( uint32_t timeout ){
+    
+    uint32_t wait_start = hal_get_system_time( );
+    
+    while (hal_get_trx_end_flag( ) == 0) {
+        
+        if (HAL_ELAPSED_TIME( wait_start ) > timeout) { return false; }
+        
+        WATCHDOG_KICK( );
+    }
+    
+    return true;
+}
+
+/*! \brief  Longest time from SLP_TR to TRX_END in TX_ARET: every CSMA-CA 
+ *          attempt with the longest back-off, the longest frame and the 
+ *          acknowledge wait, for the transmission and each retry done by the 
+ *          radio transceiver. Uses the CSMA-CA registers as they are set.
+ *
+ *  \return Deadline in symbols.
+ */
+static uint32_t tat_aret_timeout( uint8_t hw_retries ){
+    
+    uint8_t max_be = hal_subregister_read( SR_MAX_BE );
+    uint8_t csma_retries = hal_subregister_read( SR_MAX_CSMA_RETRIES );
+    
+    if (max_be > TAT_MAX_MAX_BE) { max_be = TAT_MAX_MAX_BE; }
+    if (csma_retries > TAT_MAX_CSMA_RETRIES) { csma_retries = 0; } //7: Sent without CSMA-CA.
+    
+    uint32_t attempt = (uint32_t)(csma_retries + 1) * ((((uint16_t)1 << max_be) - 1) * TAT_BACKOFF_PERIOD + TAT_CCA_DURATION) + 
+                       TAT_FRAME_DURATION + TAT_ACK_WAIT_DURATION;
+    
+    return attempt * (hw_retries + 1) + TAT_TRX_END_MARGIN;
+}
+
+/*! \brief  Count a wait that reached its deadline, and recover to state.
+ *
+ *  \return TAT_TIMED_OUT: the operation that waited is lost either way.
+ */
+static tat_status_t tat_timed_out( uint8_t state ){
+    
+    tat_recovery_statistics.timeouts++;
+    tat_recover( state );
+    
+    return TAT_TIMED_OUT;
+}
+
+/*! \brief  Put frame in the frame buffer and start its transmission with a 
+ *          SLP_TR pulse.
+ *
+ *          The frame is downloaded after the pulse, while the radio 
+ *          transceiver sends the SHR. With RESIDENT_TX_FRAME a frame of the 
+ *          same length as the one in the frame buffer is not downloaded again:
+ *          only the bytes that changed are written with hal_sram_write, before 
+ *          the pulse, so a repeated frame costs no SPI transfer at all.
+ */
+static void tat_download_frame( uint8_t frame_length, uint8_t *frame ){
+    
+#if defined( RESIDENT_TX_FRAME )
+    if ((frame_length == tat_resident_length) && (hal_get_frame_buffer_flag( ) == false)) {
+        
+        uint8_t i = 0;
+        
+        while (i < frame_length) {
+            
+            if (frame[ i ] == tat_resident_frame[ i ]) { i++; continue; }
+            
+            //Write over short runs of unchanged bytes instead of starting a new write.
+            uint8_t start = i;
+            uint8_t end = ++i;
+            
+            while ((i < frame_length) && ((uint8_t)(i - end) <= TAT_RESIDENT_MAX_GAP)) {
+                
+                if (frame[ i ] != tat_resident_frame[ i ]) { end = i + 1; }
+                i++;
+            }
+            
+            hal_sram_write( TAT_FRAME_BUFFER_PSDU + start, end - start, &frame[ start ] );
+            tat_tx_statistics.downloaded += TAT_SPI_HEADER_LENGTH + end - start;
+            
+            for (uint8_t j = start; j < end; j++) { tat_resident_frame[ j ] = frame[ j ]; }
+        }
+        
+        hal_set_slptr_high( );
+        hal_set_slptr_low( );
+        return;
+    }
+#endif
+    
+    hal_set_slptr_high( );
+    hal_set_slptr_low( );
+    hal_frame_write( frame, frame_length ); //Then write data to the frame buffer.
+    tat_tx_statistics.downloaded += TAT_SPI_HEADER_LENGTH + frame_length;
+    
+#if defined( RESIDENT_TX_FRAME )
+    if (frame_length <= TAT_RESIDENT_FRAME_SIZE) {
+        
+        for (uint8_t i = 0; i < frame_length; i++) { tat_resident_frame[ i ] = frame[ i ]; }
+        
+        tat_resident_length = frame_length;
+        hal_clear_frame_buffer_flag( ); //Set by hal_frame_write.
+    } else {
+        tat_resident_length = 0;
+    }
+#endif
 }
 /*EOF*/
@@ -0,0 +1,697 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "config_uart_extended.h"
+
+#include "compiler.h"
+#include "hal.h"
+#include "tat.h"
+#include "com.h"
+#include "entropy.h"
+#include "tsync.h"
+#include "tdma.h"
+
+#if defined( TDMA )
+#if !defined( TIME_SYNC )
+    #error "TDMA needs TIME_SYNC, the slots are in global time."
+#endif
+#if TDMA_DATA_PERIOD < (TDMA_MAX_SLOTS * TDMA_MIN_SLOT_LENGTH)
+    #error "TDMA_SUPERFRAME_LENGTH is too short for TDMA_MAX_SLOTS slots."
+#endif
+/*============================ MACROS ========================================*/
+#define TDMA_NO_OWN_SLOT         ( 0xFF )
+#define TDMA_NO_JOIN             ( 0xFFFF ) //!< tdma_join_offset of a superframe whose join period is skipped.
+#define TDMA_FREE_SLOT           ( 0xFFFF ) //!< Owner address of a free slot in the schedule.
+#define TDMA_MIN_LEAD            ( 4 ) //!< Symbols; hal_start_timer needs at least 2.
+#define TDMA_HALF_RANGE          ( HAL_SYMBOL_MASK >> 1 ) //!< Larger differences are negative.
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Owner of a slot, kept by the coordinator. */
+typedef struct{
+    uint16_t address;    //!< TDMA_FREE_SLOT if the slot is free.
+    uint16_t last_heard; //!< Superframe number. For a free slot, when it was freed.
+    uint16_t last_used;  //!< Superframe number, so that a slot is counted once.
+}tdma_member_t;
+/*============================ VARIABLES =====================================*/
+//Coordinator.
+static tdma_member_t tdma_members[ TDMA_MAX_SLOTS ]; //!< Indexed by slot, a slot keeps its owner.
+static uint8_t tdma_slot_count; //!< Slots of the current version.
+static uint8_t tdma_version; //!< Incremented each time the number of slots changes.
+static bool tdma_resize_pending; //!< A new number of slots was announced.
+static uint8_t tdma_next_slot_count; //!< Slots of the announced version.
+static uint16_t tdma_next_superframe; //!< Superframe number from which it is used.
+static bool tdma_started; //!< The first schedule was sent.
+static uint16_t tdma_superframe; //!< Number of the current superframe.
+static uint32_t tdma_superframe_start; //!< Global time.
+static tdma_coordinator_statistics_t tdma_coordinator_statistics;
+
+//Sender.
+static bool tdma_schedule_valid;
+static uint32_t tdma_schedule_start; //!< Global time of the superframe of the last schedule.
+static uint8_t tdma_schedule_slots; //!< Slots of its version.
+static uint8_t tdma_schedule_next_in; //!< Superframes until the announced version is used, 0 if none.
+static uint8_t tdma_schedule_next_slots; //!< Slots of the announced version.
+static uint8_t tdma_own_slot;
+static uint16_t tdma_join_offset; //!< Random offset into the join period, TDMA_NO_JOIN if it is skipped.
+static bool tdma_join_valid;
+static uint32_t tdma_join_superframe; //!< Global start of the superframe that tdma_join_offset was drawn for.
+static bool tdma_sent_valid;
+static uint32_t tdma_sent_superframe; //!< Global start of the superframe of the last frame sent.
+static tdma_sender_statistics_t tdma_sender_statistics;
+
+static uint8_t debug_tdma[] = "\r\nTDMA "; //!< Debug Text.
+/*============================ PROTOTYPES ====================================*/
+static bool tdma_is_coordinator( void );
+static bool tdma_slot_in_use( uint8_t slot );
+static uint8_t tdma_free_slot( void );
+static uint8_t tdma_slots_of( uint32_t superframe );
+static tdma_slot_t tdma_slot_type( uint32_t superframe );
+static uint16_t tdma_slot_length( uint8_t slots );
+static uint32_t tdma_window_start( tdma_slot_t slot, uint32_t superframe );
+static uint32_t tdma_superframe_of( uint32_t time );
+static void tdma_send_hex16( uint16_t value );
+static void tdma_send_hex32( uint32_t value );
+
+/*! \brief  Clear the schedule and the counters.
+ *
+ *          The coordinator is the root of the time synchronization
+ *          (TSYNC_ROOT_ADDRESS), every other node is a sender.
+ *
+ *  \ingroup tdma
+ */
+void tdma_init( void ){
+
+    tdma_superframe = 0;
+
+    for (uint8_t i = 0; i < TDMA_MAX_SLOTS; i++) {
+        tdma_members[ i ].address    = TDMA_FREE_SLOT;
+        tdma_members[ i ].last_heard = tdma_superframe - TDMA_SCHEDULE_TIMEOUT; //Free to take.
+        tdma_members[ i ].last_used  = 0;
+    }
+
+    tdma_slot_count = 0;
+    tdma_version = 0;
+    tdma_resize_pending = false;
+    tdma_next_slot_count = 0;
+    tdma_next_superframe = 0;
+    tdma_started = false;
+    memset( &tdma_coordinator_statistics, 0, sizeof( tdma_coordinator_statistics ) );
+
+    tdma_schedule_valid = false;
+    tdma_schedule_slots = 0;
+    tdma_schedule_next_in = 0;
+    tdma_schedule_next_slots = 0;
+    tdma_own_slot = TDMA_NO_OWN_SLOT;
+    tdma_join_offset = 0;
+    tdma_join_valid = false;
+    tdma_sent_valid = false;
+    memset( &tdma_sender_statistics, 0, sizeof( tdma_sender_statistics ) );
+    tdma_sender_statistics.slot = TDMA_NO_OWN_SLOT;
+}
+
+/*! \brief  Check if the coordinator must start the next superframe.
+ *
+ *  \ingroup tdma
+ */
+bool tdma_schedule_due( void ){
+
+    if (tdma_is_coordinator( ) == false) { return false; }
+    if (tdma_started == false) { return true; }
+
+    return ((tsync_get_global_time( ) - tdma_superframe_start) & HAL_SYMBOL_MASK) >= TDMA_SUPERFRAME_LENGTH;
+}
+
+/*! \brief  Start the next superframe and build its schedule.
+ *
+ *          Senders that were not heard for TDMA_LEAVE_SUPERFRAMES lose their
+ *          slot. The other slots keep their owners: a freed slot is left
+ *          empty, and given to a new sender after TDMA_SCHEDULE_TIMEOUT
+ *          superframes, when the old owner has stopped using it. When the
+ *          highest owned slot changes the number of slots, the new number is
+ *          announced as the next version, and used TDMA_RESIZE_NOTICE
+ *          superframes later. The superframes follow each other without a
+ *          gap, unless the coordinator was late by a whole superframe.
+ *
+ *  \param  frame Buffer of at least TDMA_MAX_SCHEDULE_LENGTH bytes.
+ *
+ *  \return Frame length including the FCS, 0 if this node is not the
+ *          coordinator.
+ *
+ *  \ingroup tdma
+ */
+uint8_t tdma_build_schedule( uint8_t *frame ){
+
+    if (tdma_is_coordinator( ) == false) { return 0; }
+
+    uint32_t now = tsync_get_global_time( );
+
+    if (tdma_started == true) {
+
+        uint32_t next = (tdma_superframe_start + TDMA_SUPERFRAME_LENGTH) & HAL_SYMBOL_MASK;
+
+        for (uint8_t i = 0; i < tdma_slot_count; i++) {
+            if (tdma_members[ i ].address != TDMA_FREE_SLOT) { tdma_coordinator_statistics.allocated++; }
+        }
+
+        tdma_superframe_start = (((now - next) & HAL_SYMBOL_MASK) < TDMA_SUPERFRAME_LENGTH) ? next : now;
+        tdma_superframe++;
+    } else {
+
+        tdma_superframe_start = now;
+        tdma_started = true;
+    }
+
+    //Free the slots of the senders that left. The others keep theirs.
+    uint8_t needed = 0; //Highest owned slot + 1.
+
+    for (uint8_t i = 0; i < TDMA_MAX_SLOTS; i++) {
+
+        tdma_member_t *member = &tdma_members[ i ];
+
+        if (member->address == TDMA_FREE_SLOT) { continue; }
+
+        //A sender waiting for its slot to be in the version may be backing off.
+        if ((i < tdma_slot_count) && ((uint16_t)(tdma_superframe - member->last_heard) >= TDMA_LEAVE_SUPERFRAMES)) {
+
+            member->address    = TDMA_FREE_SLOT;
+            member->last_heard = tdma_superframe;
+            tdma_coordinator_statistics.leaves++;
+        } else {
+            needed = i + 1;
+        }
+    }
+
+    //The announced version starts with this superframe.
+    if ((tdma_resize_pending == true) && (tdma_superframe == tdma_next_superframe)) {
+
+        tdma_slot_count = tdma_next_slot_count;
+        tdma_version++;
+        tdma_resize_pending = false;
+    }
+
+    //Slots are added and removed TDMA_SLOT_QUANTUM at a time, so that the number rarely changes.
+    uint8_t wanted = ((needed + TDMA_SLOT_QUANTUM - 1) / TDMA_SLOT_QUANTUM) * TDMA_SLOT_QUANTUM;
+
+    if ((tdma_resize_pending == false) && (wanted != tdma_slot_count)) {
+
+        bool in_use = false;
+
+        for (uint8_t i = 0; i < tdma_slot_count; i++) {
+            if (tdma_slot_in_use( i ) == true) { in_use = true; }
+        }
+
+        if (in_use == false) {
+
+            //No sender transmits in a slot yet, nobody needs the notice.
+            tdma_slot_count = wanted;
+            tdma_version++;
+        } else {
+
+            tdma_resize_pending = true;
+            tdma_next_slot_count = wanted;
+            tdma_next_superframe = tdma_superframe + TDMA_RESIZE_NOTICE;
+        }
+    }
+
+    uint8_t listed = tdma_slot_count;
+
+    if ((tdma_resize_pending == true) && (tdma_next_slot_count > listed)) { listed = tdma_next_slot_count; }
+    if (needed > listed) { listed = needed; }
+
+    tdma_coordinator_statistics.superframes++;
+    tdma_coordinator_statistics.slots = tdma_slot_count;
+    tdma_coordinator_statistics.slot_length = tdma_slot_length( tdma_slot_count );
+
+    frame[ 0 ]  = 0x41; //FCF: data frame, no acknowledge request, PAN ID compression.
+    frame[ 1 ]  = 0x88; //FCF: short addresses.
+    frame[ 2 ]  = (uint8_t)tdma_superframe;
+    frame[ 3 ]  = PAN_ID & 0xFF;
+    frame[ 4 ]  = (PAN_ID >> 8) & 0xFF;
+    frame[ 5 ]  = 0xFF;
+    frame[ 6 ]  = 0xFF;
+    frame[ 7 ]  = SHORT_ADDRESS & 0xFF;
+    frame[ 8 ]  = (SHORT_ADDRESS >> 8) & 0xFF;
+    frame[ 9 ]  = TDMA_DISPATCH;
+    frame[ 10 ] = (uint8_t)tdma_superframe;
+    frame[ 11 ] = tdma_superframe_start & 0xFF;
+    frame[ 12 ] = (tdma_superframe_start >> 8) & 0xFF;
+    frame[ 13 ] = (tdma_superframe_start >> 16) & 0xFF;
+    frame[ 14 ] = (tdma_superframe_start >> 24) & 0xFF;
+    frame[ 15 ] = tdma_version;
+    frame[ 16 ] = tdma_slot_count;
+    frame[ 17 ] = (tdma_resize_pending == true) ? (uint8_t)(tdma_next_superframe - tdma_superframe) : 0;
+    frame[ 18 ] = (tdma_resize_pending == true) ? tdma_next_slot_count : tdma_slot_count;
+    frame[ 19 ] = listed;
+
+    uint8_t *slot = &frame[ TDMA_SCHEDULE_HEADER_LENGTH ];
+
+    for (uint8_t i = 0; i < listed; i++) {
+        *slot++ = tdma_members[ i ].address & 0xFF;
+        *slot++ = (tdma_members[ i ].address >> 8) & 0xFF;
+    }
+
+    return TDMA_SCHEDULE_LENGTH( listed );
+}
+
+/*! \brief  Account a data frame received by the coordinator. A sender
+ *          without a slot gets one from the next schedule.
+ *
+ *  \param  frame Received frame, including the FCS.
+ *  \param  length Frame length.
+ *  \param  rx_start_time RX_START time of the frame (see
+ *                        tsync_get_rx_start_time).
+ *
+ *  \ingroup tdma
+ */
+void tdma_coordinator_heard( uint8_t *frame, uint8_t length, uint32_t rx_start_time ){
+
+    if ((tdma_is_coordinator( ) == false) || (tdma_started == false) || (length < TDMA_MAC_HEADER_LENGTH + 2)) { return; }
+
+    uint16_t source = frame[ 7 ] | ((uint16_t)frame[ 8 ] << 8);
+    uint32_t rx_time = tsync_local_to_global( (rx_start_time / HAL_US_PER_SYMBOL) & HAL_SYMBOL_MASK );
+    uint16_t superframe = tdma_superframe;
+
+    //Printing on the UART delays the frames, it may be from the superframe before.
+    if (((rx_time - tdma_superframe_start) & HAL_SYMBOL_MASK) > TDMA_HALF_RANGE) { superframe--; }
+
+    tdma_coordinator_statistics.frames++;
+
+    for (uint8_t i = 0; i < TDMA_MAX_SLOTS; i++) {
+
+        tdma_member_t *member = &tdma_members[ i ];
+
+        if (member->address != source) { continue; }
+
+        member->last_heard = tdma_superframe;
+
+        //A sender whose slot is not in the current version sends in the join period.
+        if ((member->last_used != superframe) && (i < tdma_slot_count)) {
+            member->last_used = superframe;
+            tdma_coordinator_statistics.used++;
+        }
+
+        return;
+    }
+
+    uint8_t free_slot = tdma_free_slot( );
+
+    if (free_slot != TDMA_NO_OWN_SLOT) {
+
+        tdma_member_t *member = &tdma_members[ free_slot ];
+
+        member->address    = source;
+        member->last_heard = tdma_superframe;
+        member->last_used  = superframe; //Sent in the join period, not in a slot.
+        tdma_coordinator_statistics.joins++;
+    }
+}
+
+/*! \brief  Check if a received frame is a schedule from the coordinator.
+ *
+ *  \ingroup tdma
+ */
+bool tdma_is_schedule( uint8_t *frame, uint8_t length ){
+
+    if ((length < TDMA_SCHEDULE_LENGTH( 0 )) || (frame[ TDMA_MAC_HEADER_LENGTH ] != TDMA_DISPATCH)) { return false; }
+    if ((frame[ 7 ] | ((uint16_t)frame[ 8 ] << 8)) != TSYNC_ROOT_ADDRESS) { return false; }
+
+    uint8_t listed = frame[ 19 ];
+
+    return (listed <= TDMA_MAX_SLOTS) && (frame[ 16 ] <= listed) && (frame[ 18 ] <= listed) &&
+           (length == TDMA_SCHEDULE_LENGTH( listed ));
+}
+
+/*! \brief  Take the slot of this sender from a schedule.
+ *
+ *  \param  frame Schedule, including the FCS (see tdma_is_schedule).
+ *  \param  length Frame length.
+ *
+ *  \ingroup tdma
+ */
+void tdma_receive_schedule( uint8_t *frame, uint8_t length ){
+
+    if (tdma_is_schedule( frame, length ) == false) { return; }
+
+    uint8_t listed = frame[ 19 ];
+    uint8_t *slot = &frame[ TDMA_SCHEDULE_HEADER_LENGTH ];
+
+    tdma_schedule_start      = frame[ 11 ] | ((uint32_t)frame[ 12 ] << 8) | ((uint32_t)frame[ 13 ] << 16) | ((uint32_t)frame[ 14 ] << 24);
+    tdma_schedule_slots      = frame[ 16 ];
+    tdma_schedule_next_in    = frame[ 17 ];
+    tdma_schedule_next_slots = frame[ 18 ];
+    tdma_own_slot            = TDMA_NO_OWN_SLOT;
+
+    for (uint8_t i = 0; i < listed; i++, slot += 2) {
+
+        if ((slot[ 0 ] | ((uint16_t)slot[ 1 ] << 8)) == SHORT_ADDRESS) {
+            tdma_own_slot = i;
+            break;
+        }
+    }
+
+    tdma_schedule_valid = true;
+
+    tdma_sender_statistics.schedules++;
+    tdma_sender_statistics.slot = tdma_own_slot;
+    tdma_sender_statistics.slot_length = tdma_slot_length( tdma_schedule_slots );
+}
+
+/*! \brief  Find the next transmit opportunity of this sender.
+ *
+ *          The last schedule is repeated for TDMA_SCHEDULE_TIMEOUT
+ *          superframes, so a lost schedule does not cost a slot. A version
+ *          that it announces is used from its first superframe on, and a
+ *          slot that is not in the version of a superframe is not used. For
+ *          the join period a random offset is drawn per superframe. A sender transmits
+ *          once per superframe, so after tdma_sent the next superframe is
+ *          used.
+ *
+ *  \param  start Local time (symbols) to wake up at, see tdma_wait_until.
+ *
+ *  \return The kind of opportunity, TDMA_NO_SLOT if there is none.
+ *
+ *  \ingroup tdma
+ */
+tdma_slot_t tdma_next_slot( uint32_t *start ){
+
+    uint32_t now = tsync_get_global_time( );
+    uint32_t superframe = tdma_superframe_of( now );
+
+    for (uint8_t pass = 0; pass < 2; pass++) {
+
+        tdma_slot_t slot = tdma_slot_type( superframe );
+
+        if (slot == TDMA_NO_SLOT) { return TDMA_NO_SLOT; }
+
+        uint32_t offset;
+
+        if (slot == TDMA_OWN_SLOT) {
+
+            offset = tdma_window_start( slot, superframe ) + TDMA_GUARD;
+        } else {
+
+            //Drawn once per superframe: tdma_wait_until returns for every frame received.
+            if ((tdma_join_valid == false) || (((tdma_join_superframe - superframe) & HAL_SYMBOL_MASK) > TDMA_HALF_RANGE)) {
+
+                uint16_t random = 0;
+
+                entropy_harvest( ); //Only the own slot refills the pool otherwise.
+                entropy_get_bytes( (uint8_t *)&random, sizeof( random ) );
+                tdma_join_offset = ((random >> 13) % TDMA_JOIN_SPREAD == 0) ? (random % (TDMA_JOIN_PERIOD - TDMA_TX_TIME)) : TDMA_NO_JOIN;
+                tdma_join_superframe = superframe;
+                tdma_join_valid = true;
+            }
+
+            //Skipped, or drawn for a later superframe, which skips this one.
+            offset = (superframe == tdma_join_superframe) ? tdma_join_offset : TDMA_NO_JOIN;
+            offset = (offset == TDMA_NO_JOIN) ? TDMA_SUPERFRAME_LENGTH : (tdma_window_start( slot, superframe ) + offset);
+        }
+
+        uint32_t target = superframe + offset;
+        uint32_t lead = (target - now) & HAL_SYMBOL_MASK;
+
+        if ((offset < TDMA_SUPERFRAME_LENGTH) && (lead <= TDMA_HALF_RANGE) && (lead >= TDMA_MIN_LEAD) &&
+            !(tdma_sent_valid && (superframe == tdma_sent_superframe))) {
+
+            *start = tsync_global_to_local( target & HAL_SYMBOL_MASK );
+
+            return slot;
+        }
+
+        superframe = (superframe + TDMA_SUPERFRAME_LENGTH) & HAL_SYMBOL_MASK;
+    }
+
+    return TDMA_NO_SLOT;
+}
+
+/*! \brief  Check if this sender may transmit now: the global time is in its
+ *          own slot, or in the join period if it has no slot, and it did not
+ *          transmit in this superframe yet.
+ *
+ *  \return The kind of opportunity, TDMA_NO_SLOT if it may not transmit.
+ *
+ *  \ingroup tdma
+ */
+tdma_slot_t tdma_current_slot( void ){
+
+    uint32_t now = tsync_get_global_time( );
+    uint32_t superframe = tdma_superframe_of( now );
+    tdma_slot_t slot = tdma_slot_type( superframe );
+
+    if (slot == TDMA_NO_SLOT) { return TDMA_NO_SLOT; }
+    if (tdma_sent_valid && (superframe == tdma_sent_superframe)) { return TDMA_NO_SLOT; }
+
+    //A join period is used only as drawn by tdma_next_slot.
+    if ((slot == TDMA_JOIN_SLOT) && 
+        ((tdma_join_valid == false) || (superframe != tdma_join_superframe) || (tdma_join_offset == TDMA_NO_JOIN))) {
+        return TDMA_NO_SLOT;
+    }
+
+    uint32_t position = (now - superframe) & HAL_SYMBOL_MASK;
+    uint32_t window   = tdma_window_start( slot, superframe );
+    uint32_t width    = ((slot == TDMA_OWN_SLOT) ? tdma_slot_length( tdma_slots_of( superframe ) ) : TDMA_JOIN_PERIOD) - TDMA_TX_TIME;
+
+    return ((position >= window) && (position <= window + width)) ? slot : TDMA_NO_SLOT;
+}
+
+/*! \brief  Keep the AVR in IDLE sleep until a local time from
+ *          tdma_next_slot, or until a frame is received. The caller reads the
+ *          rx_pool and calls tdma_next_slot again, so that the pool does not
+ *          overflow and drop the schedule while a sender waits for its slot.
+ *
+ *  \param  time Local time in symbols.
+ *
+ *  \ingroup tdma
+ */
+void tdma_wait_until( uint32_t time ){
+
+    uint32_t timeout = (time - hal_get_system_time( )) & HAL_SYMBOL_MASK;
+
+    if ((timeout < TDMA_MIN_LEAD) || (timeout > TDMA_HALF_RANGE)) {
+        tdma_sender_statistics.missed++;
+        return;
+    }
+
+    uint8_t trx_end = hal_get_trx_end_flag( );
+
+    hal_clear_timer_flag( );
+    hal_start_timer( timeout );
+
+    while ((hal_get_timer_flag( ) == 0) && (hal_get_trx_end_flag( ) == trx_end)) {
+
+        cli( );
+
+        if ((hal_get_timer_flag( ) == 0) && (hal_get_trx_end_flag( ) == trx_end)) {
+            avr_sleep_idle( ); //Returns with interrupts enabled.
+        }
+
+        sei( );
+    }
+}
+
+/*! \brief  Account a frame sent by this sender.
+ *
+ *  \param  slot Where it was sent, from tdma_current_slot.
+ *  \param  status Result of the transmission.
+ *
+ *  \ingroup tdma
+ */
+void tdma_sent( tdma_slot_t slot, tat_status_t status ){
+
+    tdma_sent_valid = true;
+    tdma_sent_superframe = tdma_superframe_of( tsync_get_global_time( ) );
+
+    if (slot == TDMA_JOIN_SLOT) {
+        tdma_sender_statistics.joins++;
+    } else if (status == TAT_SUCCESS) {
+        tdma_sender_statistics.sent++;
+    } else {
+        tdma_sender_statistics.failed++;
+    }
+}
+
+/*! \brief  Get the counters of the coordinator.
+ *
+ *  \ingroup tdma
+ */
+void tdma_get_coordinator_statistics( tdma_coordinator_statistics_t *statistics ){
+    *statistics = tdma_coordinator_statistics;
+}
+
+/*! \brief  Get the counters of this sender.
+ *
+ *  \ingroup tdma
+ */
+void tdma_get_sender_statistics( tdma_sender_statistics_t *statistics ){
+    *statistics = tdma_sender_statistics;
+}
+
+/*! \brief  Send the counters on the UART as hex, MSB first.
+ *
+ *          Coordinator: superframes, slots, slot length, allocated and used
+ *          slots (4 bytes each), frames (4 bytes), joins and leaves. The slot
+ *          utilisation is used / allocated, the throughput frames /
+ *          superframes per second.
+ *
+ *          Sender: schedules, own slot (FF if none), slot length, and the
+ *          frames sent, failed and sent in the join period, and the missed
+ *          opportunities.
+ *
+ *          All fields are 2 bytes unless noted, the number of slots and own
+ *          slot 1 byte.
+ *
+ *  \ingroup tdma
+ */
+void tdma_report( void ){
+
+    com_send_string( debug_tdma, sizeof( debug_tdma ) );
+
+    if (tdma_is_coordinator( )) {
+
+        tdma_coordinator_statistics_t *statistics = &tdma_coordinator_statistics;
+
+        tdma_send_hex16( statistics->superframes );
+        com_send_hex( statistics->slots );
+        tdma_send_hex16( statistics->slot_length );
+        tdma_send_hex32( statistics->allocated );
+        tdma_send_hex32( statistics->used );
+        tdma_send_hex32( statistics->frames );
+        tdma_send_hex16( statistics->joins );
+        tdma_send_hex16( statistics->leaves );
+    } else {
+
+        tdma_sender_statistics_t *statistics = &tdma_sender_statistics;
+
+        tdma_send_hex16( statistics->schedules );
+        com_send_hex( statistics->slot );
+        tdma_send_hex16( statistics->slot_length );
+        tdma_send_hex16( statistics->sent );
+        tdma_send_hex16( statistics->failed );
+        tdma_send_hex16( statistics->joins );
+        tdma_send_hex16( statistics->missed );
+    }
+}
+
+/*! \brief  Handle a command received on the UART. Must be called from the
+ *          main loop, with the result of com_get_command.
+ *
+ *  \param  command Command character. Only TDMA_COMMAND_REPORT is handled.
+ *
+ *  \retval true The report was sent.
+ *  \retval false The command is not a TDMA command.
+ *
+ *  \ingroup tdma
+ */
+bool tdma_command( uint8_t command ){
+
+    if (command != TDMA_COMMAND_REPORT) { return false; }
+
+    tdma_report( );
+
+    return true;
+}
+
+/*! \brief  The root of the time synchronization hands out the slots. */
+static bool tdma_is_coordinator( void ){
+    return (SHORT_ADDRESS == TSYNC_ROOT_ADDRESS);
+}
+
+/*! \brief  A slot has an owner, or lost it too recently to be given to
+ *          another sender: the old owner may still repeat an old schedule.
+ */
+static bool tdma_slot_in_use( uint8_t slot ){
+
+    tdma_member_t *member = &tdma_members[ slot ];
+
+    return (member->address != TDMA_FREE_SLOT) ||
+           ((uint16_t)(tdma_superframe - member->last_heard) < TDMA_SCHEDULE_TIMEOUT);
+}
+
+/*! \brief  Lowest slot that can be given to a new sender, TDMA_NO_OWN_SLOT
+ *          if there is none.
+ */
+static uint8_t tdma_free_slot( void ){
+
+    for (uint8_t i = 0; i < TDMA_MAX_SLOTS; i++) {
+        if (tdma_slot_in_use( i ) == false) { return i; }
+    }
+
+    return TDMA_NO_OWN_SLOT;
+}
+
+/*! \brief  Number of slots in a superframe (global start), from the last
+ *          schedule. 0 if the schedule is too old to be repeated for it.
+ */
+static uint8_t tdma_slots_of( uint32_t superframe ){
+
+    uint32_t superframes = ((superframe - tdma_schedule_start) & HAL_SYMBOL_MASK) / TDMA_SUPERFRAME_LENGTH;
+
+    if (superframes >= TDMA_SCHEDULE_TIMEOUT) { return 0; }
+
+    if ((tdma_schedule_next_in != 0) && (superframes >= tdma_schedule_next_in)) {
+        return tdma_schedule_next_slots;
+    }
+
+    return tdma_schedule_slots;
+}
+
+/*! \brief  Transmit opportunity of a sender in a superframe (global start),
+ *          without the time.
+ */
+static tdma_slot_t tdma_slot_type( uint32_t superframe ){
+
+    if ((tdma_is_coordinator( ) == true) || (tdma_schedule_valid == false) || (tsync_is_synchronized( ) == false)) {
+        return TDMA_NO_SLOT;
+    }
+
+    uint32_t superframes = ((superframe - tdma_schedule_start) & HAL_SYMBOL_MASK) / TDMA_SUPERFRAME_LENGTH;
+
+    if (superframes >= TDMA_SCHEDULE_TIMEOUT) { return TDMA_NO_SLOT; }
+
+    return (tdma_own_slot < tdma_slots_of( superframe )) ? TDMA_OWN_SLOT : TDMA_JOIN_SLOT;
+}
+
+/*! \brief  Symbols per slot when the data period has a number of slots. */
+static uint16_t tdma_slot_length( uint8_t slots ){
+    return TDMA_DATA_PERIOD / ((slots != 0) ? slots : 1);
+}
+
+/*! \brief  Start of the own slot or the join period in a superframe (global
+ *          start).
+ */
+static uint32_t tdma_window_start( tdma_slot_t slot, uint32_t superframe ){
+
+    if (slot == TDMA_OWN_SLOT) {
+        return TDMA_SCHEDULE_PERIOD + TDMA_JOIN_PERIOD + (uint32_t)tdma_own_slot * tdma_slot_length( tdma_slots_of( superframe ) );
+    }
+
+    return TDMA_SCHEDULE_PERIOD;
+}
+
+/*! \brief  Global start of the superframe that contains a global time, as
+ *          repeated from the last schedule.
+ */
+static uint32_t tdma_superframe_of( uint32_t time ){
+
+    uint32_t elapsed = (time - tdma_schedule_start) & HAL_SYMBOL_MASK;
+
+    if (elapsed > TDMA_HALF_RANGE) { return tdma_schedule_start; }
+
+    return (tdma_schedule_start + (elapsed / TDMA_SUPERFRAME_LENGTH) * TDMA_SUPERFRAME_LENGTH) & HAL_SYMBOL_MASK;
+}
+
+static void tdma_send_hex16( uint16_t value ){
+
+    com_send_hex( (value >> 8) & 0xFF );
+    com_send_hex( value & 0xFF );
+}
+
+static void tdma_send_hex32( uint32_t value ){
+
+    tdma_send_hex16( (uint16_t)(value >> 16) );
+    tdma_send_hex16( (uint16_t)value );
+}
+#endif /* defined( TDMA ) */
+/*EOF*/
@@ -0,0 +1,105 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config_uart_extended.h"
+
+#include "compiler.h"
+#include "tat.h"
+#include "com.h"
+#include "watchdog.h"
+
+#if defined( WATCHDOG )
+/*============================ MACROS ========================================*/
+/*============================ TYPEDEFS ======================================*/
+/*============================ VARIABLES =====================================*/
+static uint16_t watchdog_resets __attribute__(( section( ".noinit" ) )); //!< Kept over all resets but power-on and brown-out.
+
+static uint8_t debug_recovery[] = "\r\nRECOVERY "; //!< Debug Text.
+/*============================ PROTOTYPES ====================================*/
+
+/*! \brief  Count a reset by the watchdog, and start the watchdog. Must be
+ *          called first in main, before MCUCSR is cleared elsewhere.
+ *
+ *  \ingroup watchdog
+ */
+void watchdog_start( void ){
+
+    uint8_t reset_cause = MCUCSR;
+
+    MCUCSR = 0;
+
+    //RAM is not valid after these.
+    if ((reset_cause & ((1 << PORF) | (1 << BORF))) != 0) { watchdog_resets = 0; }
+
+    if ((reset_cause & (1 << WDRF)) != 0) { watchdog_resets++; }
+
+    wdt_enable( WATCHDOG_TIMEOUT );
+}
+
+/*! \brief  Resets by the watchdog since power-on.
+ *
+ *  \ingroup watchdog
+ */
+uint16_t watchdog_get_resets( void ){
+    return watchdog_resets;
+}
+
+/*! \brief  Send the recovery counters on the UART as hex: waits that timed
+ *          out, recoveries by FORCE_TRX_OFF, by rewriting the configuration
+ *          and by hardware reset, failed recoveries, watchdog resets (2 bytes
+ *          each), then the last and the longest time to recover in symbols (4
+ *          bytes each). All MSB first.
+ *
+ *  \ingroup watchdog
+ */
+void watchdog_report( void ){
+
+    tat_recovery_statistics_t statistics;
+
+    tat_get_recovery_statistics( &statistics );
+
+    com_send_string( debug_recovery, sizeof( debug_recovery ) );
+    com_send_hex( statistics.timeouts >> 8 );
+    com_send_hex( statistics.timeouts & 0xFF );
+
+    for (uint8_t step = 0; step < TAT_RECOVERY_STEPS; step++) {
+        com_send_hex( statistics.recovered[ step ] >> 8 );
+        com_send_hex( statistics.recovered[ step ] & 0xFF );
+    }
+
+    com_send_hex( statistics.failures >> 8 );
+    com_send_hex( statistics.failures & 0xFF );
+    com_send_hex( watchdog_resets >> 8 );
+    com_send_hex( watchdog_resets & 0xFF );
+    com_send_hex( (statistics.last_time >> 24) & 0xFF );
+    com_send_hex( (statistics.last_time >> 16) & 0xFF );
+    com_send_hex( (statistics.last_time >> 8) & 0xFF );
+    com_send_hex( statistics.last_time & 0xFF );
+    com_send_hex( (statistics.max_time >> 24) & 0xFF );
+    com_send_hex( (statistics.max_time >> 16) & 0xFF );
+    com_send_hex( (statistics.max_time >> 8) & 0xFF );
+    com_send_hex( statistics.max_time & 0xFF );
+}
+
+/*! \brief  Handle a command received on the UART. Must be called from the
+ *          main loop, with the result of com_get_command.
+ *
+ *  \param  command Command character. Only WATCHDOG_COMMAND_REPORT is
+ *                  handled.
+ *
+ *  \retval true The counters were sent.
+ *  \retval false The command is not a watchdog command.
+ *
+ *  \ingroup watchdog
+ */
+bool watchdog_command( uint8_t command ){
+
+    if (command != WATCHDOG_COMMAND_REPORT) { return false; }
+
+    watchdog_report( );
+
+    return true;
+}
+#endif
+/*EOF*/
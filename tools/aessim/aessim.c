@@ -0,0 +1,523 @@
+/*! \file aessim.c
+ *
+ *  \brief  Host stand-in for the AES engine of the AT86RF231, to run
+ *          umspreceive/aes_bench.c and sal.c without the hardware.
+ *
+ *          The model covers what sal.c uses of the SRAM window: AES_CON and
+ *          its mirror (a command with AES_REQUEST starts an operation),
+ *          AES_STATE_KEY (the key in KEY mode, the state otherwise), ECB
+ *          encryption and decryption, and CBC encryption chained on the
+ *          previous result. After an encryption the key space reads back the
+ *          last round key, which sal.c loads as the decryption key. During a
+ *          hal_trx_aes_wrrd burst each byte reads back the old content of its
+ *          address, so the previous result comes out as the next block goes
+ *          in.
+ *
+ *          Time is modeled, not measured: every SPI byte, every SPI
+ *          transaction and every delay_us adds cycles at 8 MHz, as in
+ *          hal_avr.c (SPI at F_CPU / 2). So the host cycle counts show how
+ *          the SPI traffic of sal.c changes, and can be compared with a run
+ *          on the target (AES_BENCHMARK, "A" on the UART). An access to the
+ *          AES registers while an operation is still running is counted as a
+ *          protocol violation.
+ *
+ *          Build: cc -std=gnu99 -O2 -Wall -DAES_BENCHMARK -DPROFILING -I.
+ *                 -I../../umspreceive/include -o aessim aessim.c
+ *                 ../../umspreceive/sal.c ../../umspreceive/aes_bench.c
+ *
+ *          Usage: aessim [-r] [-m max_cycles_per_block] [capture]
+ *
+ *          Without a capture the benchmark is run on the model. With a
+ *          capture of the UART of a node, the "AES" lines it sent are
+ *          printed the same way. -r prints the report lines as the node
+ *          sends them. The exit status is 1 if a known-answer test failed,
+ *          the protocol was violated, or a CBC block costs more than
+ *          max_cycles_per_block, for use in CI.
+ */
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "compiler.h"
+#include "hal.h"
+#include "com.h"
+#include "at86rf231.h"
+#include "sal.h"
+#include "aes_bench.h"
+/*============================ MACROS ========================================*/
+#define F_CPU_MHZ                ( 8 )
+#define CYCLES_PER_SPI_BYTE      ( 20 ) //!< 16 at F_CPU / 2, and the SPIF polling.
+#define CYCLES_PER_TRANSACTION   ( 40 ) //!< Call, critical region, SEL, command and address setup.
+#define CYCLES_PER_OPERATION     ( 24 * F_CPU_MHZ ) //!< Duration of one AES operation.
+
+#define AES_MODE_MASK            ( 0x70 )
+#define AES_DONE                 ( 0x01 ) //!< AES_ST: operation finished.
+#define AES_ERROR                ( 0x80 ) //!< AES_ST: unsupported operation.
+#define AES_ROUNDS               ( 10 )
+/*============================ TYPEDEFS ======================================*/
+/*============================ VARIABLES =====================================*/
+static uint8_t sbox[ 256 ];
+static uint8_t inverse_sbox[ 256 ];
+
+static uint8_t sram[ 256 ]; //!< SRAM window. AES_STATE_KEY holds the state.
+static uint8_t key[ AES_BLOCKSIZE ]; //!< Key register, as written in KEY mode.
+static uint8_t last_round_key[ AES_BLOCKSIZE ]; //!< Key space after an encryption.
+static uint8_t previous_result[ AES_BLOCKSIZE ]; //!< CBC chaining value.
+
+static uint32_t cycles; //!< Modeled CPU cycles, read by prof_get_cycles.
+static uint32_t busy_until; //!< End of the running AES operation.
+static unsigned operations;
+static unsigned violations;
+static unsigned errors;
+
+static bool raw_report;
+/*============================ PROTOTYPES ====================================*/
+
+/*! \brief  Multiply in GF(2^8). */
+static uint8_t gf_multiply( uint8_t a, uint8_t b ){
+
+    uint8_t product = 0;
+
+    while (b != 0) {
+
+        if (b & 1) { product ^= a; }
+
+        a = (uint8_t)((a << 1) ^ ((a & 0x80) ? 0x1B : 0x00));
+        b >>= 1;
+    }
+
+    return product;
+}
+
+/*! \brief  Build the S-boxes from the field inverse and the affine map, so
+ *          that the model shares no table with aes_sw.c.
+ */
+static void build_sbox( void ){
+
+    for (unsigned x = 0; x < 256; x++) {
+
+        uint8_t inverse = 0;
+
+        for (unsigned y = 1; (x != 0) && (y < 256); y++) {
+            if (gf_multiply( (uint8_t)x, (uint8_t)y ) == 1) { inverse = (uint8_t)y; break; }
+        }
+
+        uint8_t s = inverse;
+
+        for (unsigned i = 1; i < 5; i++) { s ^= (uint8_t)((inverse << i) | (inverse >> (8 - i))); }
+
+        s ^= 0x63;
+        sbox[ x ] = s;
+        inverse_sbox[ s ] = (uint8_t)x;
+    }
+}
+
+/*! \brief  Expand a key into all round keys. */
+static void expand_key( const uint8_t *cipher_key, uint8_t round_keys[ AES_ROUNDS + 1 ][ AES_BLOCKSIZE ] ){
+
+    uint8_t *w = &round_keys[ 0 ][ 0 ];
+    uint8_t rcon = 0x01;
+
+    memcpy( w, cipher_key, AES_BLOCKSIZE );
+
+    for (unsigned i = AES_BLOCKSIZE; i < (AES_ROUNDS + 1) * AES_BLOCKSIZE; i += 4) {
+
+        uint8_t t[ 4 ];
+
+        memcpy( t, &w[ i - 4 ], 4 );
+
+        if ((i % AES_BLOCKSIZE) == 0) {
+
+            uint8_t first = t[ 0 ];
+
+            t[ 0 ] = sbox[ t[ 1 ] ] ^ rcon;
+            t[ 1 ] = sbox[ t[ 2 ] ];
+            t[ 2 ] = sbox[ t[ 3 ] ];
+            t[ 3 ] = sbox[ first ];
+            rcon = gf_multiply( rcon, 2 );
+        }
+
+        for (unsigned j = 0; j < 4; j++) { w[ i + j ] = w[ i + j - AES_BLOCKSIZE ] ^ t[ j ]; }
+    }
+}
+
+/*! \brief  Recover the cipher key from the last round key, by running the
+ *          key schedule backwards.
+ */
+static void reverse_key( const uint8_t *last, uint8_t round_keys[ AES_ROUNDS + 1 ][ AES_BLOCKSIZE ] ){
+
+    uint8_t *w = &round_keys[ 0 ][ 0 ];
+    uint8_t rcon[ AES_ROUNDS ];
+
+    rcon[ 0 ] = 0x01;
+    for (unsigned i = 1; i < AES_ROUNDS; i++) { rcon[ i ] = gf_multiply( rcon[ i - 1 ], 2 ); }
+
+    memcpy( round_keys[ AES_ROUNDS ], last, AES_BLOCKSIZE );
+
+    for (unsigned i = (AES_ROUNDS + 1) * AES_BLOCKSIZE - 4; i >= AES_BLOCKSIZE; i -= 4) {
+
+        uint8_t t[ 4 ];
+
+        memcpy( t, &w[ i - 4 ], 4 );
+
+        if ((i % AES_BLOCKSIZE) == 0) {
+
+            uint8_t first = t[ 0 ];
+
+            t[ 0 ] = sbox[ t[ 1 ] ] ^ rcon[ i / AES_BLOCKSIZE - 1 ];
+            t[ 1 ] = sbox[ t[ 2 ] ];
+            t[ 2 ] = sbox[ t[ 3 ] ];
+            t[ 3 ] = sbox[ first ];
+        }
+
+        for (unsigned j = 0; j < 4; j++) { w[ i + j - AES_BLOCKSIZE ] = w[ i + j ] ^ t[ j ]; }
+    }
+}
+
+static void add_round_key( uint8_t *state, const uint8_t *round_key ){
+    for (unsigned i = 0; i < AES_BLOCKSIZE; i++) { state[ i ] ^= round_key[ i ]; }
+}
+
+/*! \brief  ShiftRows, or its inverse. The state is column major. */
+static void shift_rows( uint8_t *state, bool inverse ){
+
+    uint8_t copy[ AES_BLOCKSIZE ];
+
+    memcpy( copy, state, AES_BLOCKSIZE );
+
+    for (unsigned column = 0; column < 4; column++) {
+        for (unsigned row = 1; row < 4; row++) {
+
+            unsigned from = inverse ? (column + 4 - row) % 4 : (column + row) % 4;
+
+            state[ column * 4 + row ] = copy[ from * 4 + row ];
+        }
+    }
+}
+
+/*! \brief  MixColumns, or its inverse. */
+static void mix_columns( uint8_t *state, bool inverse ){
+
+    static const uint8_t forward[ 4 ] = { 2, 3, 1, 1 };
+    static const uint8_t backward[ 4 ] = { 14, 11, 13, 9 };
+    const uint8_t *m = inverse ? backward : forward;
+
+    for (unsigned c = 0; c < AES_BLOCKSIZE; c += 4) {
+
+        uint8_t a[ 4 ];
+
+        memcpy( a, &state[ c ], 4 );
+
+        for (unsigned row = 0; row < 4; row++) {
+            state[ c + row ] = gf_multiply( a[ row ], m[ 0 ] ) ^ gf_multiply( a[ (row + 1) % 4 ], m[ 1 ] ) ^
+                               gf_multiply( a[ (row + 2) % 4 ], m[ 2 ] ) ^ gf_multiply( a[ (row + 3) % 4 ], m[ 3 ] );
+        }
+    }
+}
+
+static void encrypt( uint8_t *state, uint8_t round_keys[ AES_ROUNDS + 1 ][ AES_BLOCKSIZE ] ){
+
+    add_round_key( state, round_keys[ 0 ] );
+
+    for (unsigned round = 1; round <= AES_ROUNDS; round++) {
+
+        for (unsigned i = 0; i < AES_BLOCKSIZE; i++) { state[ i ] = sbox[ state[ i ] ]; }
+
+        shift_rows( state, false );
+        if (round != AES_ROUNDS) { mix_columns( state, false ); }
+        add_round_key( state, round_keys[ round ] );
+    }
+}
+
+static void decrypt( uint8_t *state, uint8_t round_keys[ AES_ROUNDS + 1 ][ AES_BLOCKSIZE ] ){
+
+    for (unsigned round = AES_ROUNDS; round >= 1; round--) {
+
+        add_round_key( state, round_keys[ round ] );
+        if (round != AES_ROUNDS) { mix_columns( state, true ); }
+        shift_rows( state, true );
+
+        for (unsigned i = 0; i < AES_BLOCKSIZE; i++) { state[ i ] = inverse_sbox[ state[ i ] ]; }
+    }
+
+    add_round_key( state, round_keys[ 0 ] );
+}
+
+/*! \brief  Run the operation requested by an AES_CON command. */
+static void run_operation( uint8_t command ){
+
+    uint8_t round_keys[ AES_ROUNDS + 1 ][ AES_BLOCKSIZE ];
+    uint8_t *state = &sram[ AES_STATE_KEY ];
+    uint8_t mode = command & AES_MODE_MASK;
+    bool decryption = (command & AES_DIR_DECRYPT) != 0;
+
+    if ((mode == AES_MODE_KEY) || ((mode == AES_MODE_CBC) && decryption) ||
+        ((mode != AES_MODE_ECB) && (mode != AES_MODE_CBC))) {
+
+        sram[ AES_ST ] = AES_ERROR;
+        errors++;
+
+        return;
+    }
+
+    if (decryption) {
+
+        //The key register holds the last round key.
+        reverse_key( key, round_keys );
+        decrypt( state, round_keys );
+    } else {
+
+        expand_key( key, round_keys );
+
+        if (mode == AES_MODE_CBC) { add_round_key( state, previous_result ); }
+
+        encrypt( state, round_keys );
+        memcpy( last_round_key, round_keys[ AES_ROUNDS ], AES_BLOCKSIZE );
+    }
+
+    memcpy( previous_result, state, AES_BLOCKSIZE );
+
+    sram[ AES_ST ] = AES_DONE;
+    busy_until = cycles + CYCLES_PER_OPERATION;
+    operations++;
+}
+
+static bool key_mode( void ){
+    return (sram[ AES_CON ] & AES_MODE_MASK) == AES_MODE_KEY;
+}
+
+static bool is_aes_register( uint8_t address ){
+    return (address >= AES_ST) && (address <= RG_AES_CON_MIRROR);
+}
+
+/*! \brief  One byte of an SRAM access: returns the old content. */
+static uint8_t access_byte( uint8_t address, bool write, uint8_t value ){
+
+    cycles += CYCLES_PER_SPI_BYTE;
+
+    if (is_aes_register( address ) && ((int32_t)(cycles - busy_until) < 0)) { violations++; }
+
+    bool key_space = (address >= AES_STATE_KEY) && (address < (AES_STATE_KEY + AES_BLOCKSIZE)) && key_mode( );
+    uint8_t old = key_space ? last_round_key[ address - AES_STATE_KEY ] : sram[ address ];
+
+    if (write == false) { return old; }
+
+    if (key_space) {
+        key[ address - AES_STATE_KEY ] = value;
+    } else if ((address == AES_CON) || (address == RG_AES_CON_MIRROR)) {
+
+        sram[ AES_CON ] = value & ~AES_REQUEST;
+        sram[ RG_AES_CON_MIRROR ] = value & ~AES_REQUEST;
+
+        if (value & AES_REQUEST) { run_operation( value ); }
+    } else {
+        sram[ address ] = value;
+    }
+
+    return old;
+}
+
+void aessim_delay_us( uint16_t us ){
+    cycles += (uint32_t)us * F_CPU_MHZ;
+}
+
+void hal_sram_read( uint8_t address, uint8_t length, uint8_t *data ){
+
+    cycles += CYCLES_PER_TRANSACTION;
+
+    for (uint8_t i = 0; i < length; i++) { data[ i ] = access_byte( address + i, false, 0 ); }
+}
+
+void hal_sram_write( uint8_t address, uint8_t length, uint8_t *data ){
+
+    cycles += CYCLES_PER_TRANSACTION;
+
+    for (uint8_t i = 0; i < length; i++) { access_byte( address + i, true, data[ i ] ); }
+}
+
+void hal_trx_aes_wrrd( uint8_t addr, uint8_t *idata, uint8_t length ){
+
+    cycles += CYCLES_PER_TRANSACTION + CYCLES_PER_SPI_BYTE; //The extra byte that reads the last result.
+
+    for (uint8_t i = 0; i < length; i++) { idata[ i ] = access_byte( addr + i, true, idata[ i ] ); }
+}
+
+uint32_t prof_get_cycles( void ){
+    return cycles;
+}
+
+void com_send_string( uint8_t *data, uint8_t data_length ){
+    if (raw_report) { fwrite( data, 1, data_length - 1, stdout ); } //The length includes the terminator.
+}
+
+void com_send_hex( uint8_t nmbr ){
+    if (raw_report) { printf( "%02X", nmbr ); }
+}
+
+/*! \brief  Read the report lines of a node from a UART capture. */
+static bool read_capture( FILE *file, aes_bench_result_t *result ){
+
+    char line[ 256 ];
+    bool kat = false;
+
+    memset( result, 0, sizeof( *result ) );
+
+    while (fgets( line, sizeof( line ), file ) != NULL) {
+
+        char *text = strstr( line, "AES " );
+        unsigned kind, blocks;
+        unsigned long value;
+
+        if ((text == NULL) || (sscanf( text + 4, "%2x%2x%8lx", &kind, &blocks, &value ) != 3)) { continue; }
+
+        if ((kind >= AES_BENCH_ECB_ENCRYPT) && (kind <= AES_BENCH_CBC_ENCRYPT) &&
+            ((blocks < 1) || (blocks > AES_BENCH_MAX_BLOCKS))) {
+            continue;
+        }
+
+        switch (kind) {
+        case AES_BENCH_KEY_SETUP: result->key_setup = value; break;
+        case AES_BENCH_DECRYPT_KEY: result->decrypt_key = value; break;
+        case AES_BENCH_DIR_SWITCH: result->dir_switch = value; break;
+        case AES_BENCH_ECB_ENCRYPT: result->ecb_encrypt[ blocks - 1 ] = value; break;
+        case AES_BENCH_ECB_DECRYPT: result->ecb_decrypt[ blocks - 1 ] = value; break;
+        case AES_BENCH_CBC_ENCRYPT: result->cbc_encrypt[ blocks - 1 ] = value; break;
+        case AES_BENCH_KAT: result->failures = value; kat = true; break;
+        default: break;
+        }
+    }
+
+    return kat;
+}
+
+/*! \brief  Least squares line through the cycles of 1 to
+ *          AES_BENCH_MAX_BLOCKS blocks: fixed cost and cost per block.
+ */
+static void fit( const uint32_t *samples, double *fixed, double *per_block ){
+
+    double n = AES_BENCH_MAX_BLOCKS, sx = 0, sy = 0, sxx = 0, sxy = 0;
+
+    for (unsigned i = 0; i < AES_BENCH_MAX_BLOCKS; i++) {
+
+        double x = i + 1;
+
+        sx += x;
+        sy += samples[ i ];
+        sxx += x * x;
+        sxy += x * samples[ i ];
+    }
+
+    *per_block = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    *fixed = (sy - *per_block * sx) / n;
+}
+
+static void print_result( const aes_bench_result_t *result, double *cbc_per_block ){
+
+    static const char *const names[] = { "ecb encrypt", "ecb decrypt", "cbc encrypt" };
+    const uint32_t *series[] = { result->ecb_encrypt, result->ecb_decrypt, result->cbc_encrypt };
+
+    printf( "%-16s %10s %10s\n", "setup", "cycles", "us" );
+    printf( "%-16s %10u %10.1f\n", "key", (unsigned)result->key_setup, result->key_setup / (double)F_CPU_MHZ );
+    printf( "%-16s %10u %10.1f\n", "decryption key", (unsigned)result->decrypt_key, result->decrypt_key / (double)F_CPU_MHZ );
+    printf( "%-16s %10u %10.1f\n", "direction switch", (unsigned)result->dir_switch, result->dir_switch / (double)F_CPU_MHZ );
+
+    printf( "\n%-6s", "blocks" );
+    for (unsigned m = 0; m < 3; m++) { printf( " %12s", names[ m ] ); }
+    printf( "\n" );
+
+    for (unsigned i = 0; i < AES_BENCH_MAX_BLOCKS; i++) {
+
+        printf( "%-6u", i + 1 );
+        for (unsigned m = 0; m < 3; m++) { printf( " %12u", (unsigned)series[ m ][ i ] ); }
+        printf( "\n" );
+    }
+
+    printf( "\n%-12s %12s %12s %12s\n", "mode", "fixed", "per block", "bytes/s" );
+
+    for (unsigned m = 0; m < 3; m++) {
+
+        double fixed, per_block;
+
+        fit( series[ m ], &fixed, &per_block );
+
+        printf( "%-12s %12.1f %12.1f %12.0f\n", names[ m ], fixed, per_block,
+                (per_block > 0) ? AES_BLOCKSIZE * F_CPU_MHZ * 1e6 / per_block : 0.0 );
+
+        if (m == 2) { *cbc_per_block = per_block; }
+    }
+
+    printf( "\nknown-answer tests failed: %u\n", (unsigned)result->failures );
+}
+
+static void usage( const char *name ){
+
+    fprintf( stderr, "usage: %s [-r] [-m max_cycles_per_block] [capture]\n", name );
+    exit( 2 );
+}
+
+int main( int argc, char **argv ){
+
+    double max_per_block = 0;
+    int option;
+
+    while ((option = getopt( argc, argv, "rm:" )) != -1) {
+
+        switch (option) {
+        case 'r': raw_report = true; break;
+        case 'm': max_per_block = strtod( optarg, NULL ); break;
+        default: usage( argv[ 0 ] );
+        }
+    }
+
+    if (argc - optind > 1) { usage( argv[ 0 ] ); }
+
+    aes_bench_result_t result;
+
+    if (optind < argc) {
+
+        FILE *file = fopen( argv[ optind ], "r" );
+
+        if (file == NULL) {
+            perror( argv[ optind ] );
+            return 2;
+        }
+
+        if (read_capture( file, &result ) == false) {
+
+            fprintf( stderr, "%s: no complete AES report\n", argv[ optind ] );
+            return 2;
+        }
+
+        fclose( file );
+        raw_report = false;
+    } else {
+
+        build_sbox( );
+        aes_bench_run( &result );
+        aes_bench_report( &result );
+
+        if (raw_report) {
+            printf( "\n" );
+            return (result.failures != 0) || (violations != 0);
+        }
+
+        printf( "model: %u AES operations, %u errors, %u protocol violations\n\n", operations, errors, violations );
+    }
+
+    double cbc_per_block = 0;
+
+    print_result( &result, &cbc_per_block );
+
+    if ((max_per_block > 0) && (cbc_per_block > max_per_block)) {
+
+        printf( "cbc block cost %.1f exceeds %.1f cycles\n", cbc_per_block, max_per_block );
+        return 1;
+    }
+
+    return (result.failures != 0) || (violations != 0) || (errors != 0);
+}
+/*EOF*/
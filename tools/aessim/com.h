@@ -0,0 +1,14 @@
+/*! \file com.h
+ *
+ *  \brief  Host version of com.h for aessim: the UART is stdout.
+ */
+#ifndef COM_H
+#define COM_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+/*============================ PROTOTYPES ====================================*/
+void com_send_string( uint8_t *data, uint8_t data_length );
+void com_send_hex( uint8_t nmbr );
+#endif
+/*EOF*/
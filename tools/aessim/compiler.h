@@ -0,0 +1,25 @@
+/*! \file compiler.h
+ *
+ *  \brief  Host version of utils/compiler.h for aessim. Flash is ordinary
+ *          memory and there are no interrupts.
+ */
+#ifndef COMPILER_H
+#define COMPILER_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+/*============================ MACROS ========================================*/
+#define __x
+#define __z
+
+#define PROGMEM
+#define pgm_read_byte( address ) ( *(const uint8_t *)(address) )
+#define memcpy_P( destination, source, length ) memcpy( (destination), (source), (length) )
+
+#define AVR_ENTER_CRITICAL_REGION( ) {
+#define AVR_LEAVE_CRITICAL_REGION( ) }
+#define cli( )
+#define sei( )
+#endif
+/*EOF*/
@@ -0,0 +1,21 @@
+/*! \file hal.h
+ *
+ *  \brief  Host version of hal.h for aessim: the transceiver SRAM access
+ *          used by sal.c, implemented on the model in aessim.c.
+ */
+#ifndef HAL_H
+#define HAL_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+/*============================ MACROS ========================================*/
+#define delay_us( us ) aessim_delay_us( us )
+/*============================ PROTOTYPES ====================================*/
+void aessim_delay_us( uint16_t us );
+void hal_sram_read( uint8_t address, uint8_t length, uint8_t *data );
+void hal_sram_write( uint8_t address, uint8_t length, uint8_t *data );
+void hal_trx_aes_wrrd( uint8_t addr, uint8_t *idata, uint8_t length );
+#endif
+/*EOF*/
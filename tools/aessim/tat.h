@@ -0,0 +1,11 @@
+/*! \file tat.h
+ *
+ *  \brief  Host version of tat.h for aessim. sal.c includes it, but uses
+ *          nothing from it.
+ */
+#ifndef TAT_H
+#define TAT_H
+#include <stdint.h>
+#include <stdbool.h>
+#endif
+/*EOF*/
@@ -0,0 +1,715 @@
+/*! \file loganalyse.c
+ *
+ *  \brief  Multi-threaded analyser for the hex logs written by umspreceive.
+ *
+ *          Each received frame is logged as 36 hex digits (18 bytes, see the
+ *          main loop of umspreceive/main.c), starting with the start symbol
+ *          "0DB5" and ending with the end symbol "0CD5". With RX_LOG_METADATA
+ *          the receiver appends 10 more digits: LQI and the TRX_END time
+ *          stamp in symbols. The records are not separated, and debug text
+ *          may be mixed in, so the parser resynchronizes on the delimiters.
+ *
+ *          For every source address the following is reported:
+ *          - Received, unique, duplicate and lost frames. The frame counter
+ *            is carry * 255 + sequence number, unwrapped.
+ *          - Reordered frames and the reorder distance.
+ *          - The LQI distribution (with metadata).
+ *          - Inter-arrival time and its jitter (with metadata).
+ *
+ *          The log is memory mapped and cut in chunks that are parsed in
+ *          parallel. The records of each chunk are then merged in file order
+ *          by one thread, which also repairs the chunk boundaries, so the
+ *          report is identical to a single threaded run (-j 1) and to the
+ *          plain sequential reference parser (-r).
+ *
+ *          Build: cc -std=gnu99 -O2 -Wall -pthread -o loganalyse loganalyse.c -lm
+ *
+ *          Usage: loganalyse [-j threads] [-r] [-f auto|plain|meta] log...
+ */
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+/*============================ MACROS ========================================*/
+#define PLAIN_RECORD_DIGITS   ( 36 )
+#define META_RECORD_DIGITS    ( 46 )
+
+#define COUNTER_PERIOD        ( 256L * 255L ) //!< carry (8 bit) * 255 + seq (0 to 254).
+#define DUPLICATE_WINDOW      ( 4096 ) //!< Counters remembered for duplicate detection. Power of two.
+#define REORDER_BUCKETS       ( 16 ) //!< Reorder distance histogram, log2 buckets.
+
+#define US_PER_SYMBOL         ( 16 )
+#define SYMBOL_MASK           ( 0x7FFFFFFFUL ) //!< HAL_SYMBOL_MASK at 8 MHz.
+
+#define WINDOW_BYTE( c )      ( ((uint64_t)(c) & (DUPLICATE_WINDOW - 1)) >> 3 ) //!< Also right for negative counters.
+#define WINDOW_BIT( c )       ( 1 << ((uint64_t)(c) & 7) )
+
+#define CHUNK_SIZE            ( 8UL << 20 )
+#define MAX_THREADS           ( 64 )
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Record layout of the log. */
+typedef enum{
+    FORMAT_AUTO,
+    FORMAT_PLAIN,
+    FORMAT_META
+}log_format_t;
+
+/*! \brief  One parsed record. */
+typedef struct{
+    uint64_t start;      //!< Offset of the first digit in the file.
+    uint32_t time_stamp; //!< TRX_END time in symbols (metadata only).
+    uint16_t source;     //!< Source short address.
+    uint8_t sequence;
+    uint8_t carry;
+    uint8_t lqi;         //!< Metadata only.
+}record_t;
+
+/*! \brief  Records parsed from one chunk. */
+typedef struct{
+    record_t *records;
+    size_t count;
+    size_t capacity;
+    uint64_t exit;  //!< Where the parser stopped, at or after the chunk end.
+    bool ready;
+}chunk_result_t;
+
+/*! \brief  Statistics kept per source address. */
+typedef struct{
+    uint64_t received;
+    uint64_t duplicates;
+    uint64_t reordered;
+    uint64_t too_old;        //!< Older than the duplicate window; not counted as unique.
+    int64_t lowest;          //!< Lowest unwrapped counter.
+    int64_t highest;         //!< Highest unwrapped counter.
+    uint64_t unique;
+    uint64_t max_reorder;
+    uint64_t reorder_histogram[ REORDER_BUCKETS ];
+    uint8_t seen[ DUPLICATE_WINDOW / 8 ];
+
+    uint64_t lqi_histogram[ 256 ];
+
+    bool has_arrival;
+    uint32_t last_arrival;   //!< Symbols.
+    uint64_t intervals;
+    double interval_mean;    //!< Microseconds, running mean (Welford).
+    double interval_m2;
+    double interval_min;
+    double interval_max;
+    double jitter;           //!< RFC 3550 style smoothed |D(i-1,i)|, microseconds.
+    double last_interval;
+}source_statistics_t;
+
+/*! \brief  Work shared by the parser threads and the merger. */
+typedef struct{
+    const char *data;
+    uint64_t size;
+    log_format_t format;
+    uint64_t chunks;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint64_t next_chunk;      //!< Next chunk to hand to a parser.
+    uint64_t merged;          //!< Chunks consumed by the merger.
+    size_t slots;
+    chunk_result_t *results;  //!< Ring of slots, chunk k uses slot k % slots.
+}work_t;
+/*============================ VARIABLES =====================================*/
+static source_statistics_t *sources[ 65536 ];
+/*============================ PROTOTYPES ====================================*/
+
+static int hex_value( char c ){
+
+    if ((c >= '0') && (c <= '9')) { return c - '0'; }
+    if ((c >= 'A') && (c <= 'F')) { return c - 'A' + 10; }
+    if ((c >= 'a') && (c <= 'f')) { return c - 'a' + 10; }
+
+    return -1;
+}
+
+static int hex_byte( const char *p ){
+
+    int high = hex_value( p[ 0 ] );
+    int low = hex_value( p[ 1 ] );
+
+    return ((high < 0) || (low < 0)) ? -1 : ((high << 4) | low);
+}
+
+static size_t record_digits( log_format_t format ){
+    return (format == FORMAT_META) ? META_RECORD_DIGITS : PLAIN_RECORD_DIGITS;
+}
+
+/*! \brief  Try to parse a record at position. Only the bytes of the record
+ *          itself are looked at, so the result does not depend on where the
+ *          parser started.
+ *
+ *  \retval true A record was stored in record.
+ */
+static bool parse_at( const char *data, uint64_t size, uint64_t position,
+                      log_format_t format, record_t *record ){
+
+    size_t digits = record_digits( format );
+
+    if (size - position < digits) { return false; }
+
+    const char *p = data + position;
+
+    if ((p[ 0 ] != '0') || (p[ 1 ] != 'D') || (p[ 2 ] != 'B') || (p[ 3 ] != '5')) { return false; }
+    if ((p[ 32 ] != '0') || (p[ 33 ] != 'C') || (p[ 34 ] != 'D') || (p[ 35 ] != '5')) { return false; }
+
+    int bytes[ META_RECORD_DIGITS / 2 ];
+
+    for (size_t i = 0; i < digits / 2; i++) {
+
+        bytes[ i ] = hex_byte( p + 2 * i );
+
+        if (bytes[ i ] < 0) { return false; }
+    }
+
+    //Printed order: data[10], data[9], length, data[4], data[3], data[19],
+    //data[2], data[6], data[5], data[8], data[7], ...
+    record->start      = position;
+    record->carry      = (uint8_t)bytes[ 5 ];
+    record->sequence   = (uint8_t)bytes[ 6 ];
+    record->source     = (uint16_t)((bytes[ 9 ] << 8) | bytes[ 10 ]);
+    record->lqi        = 0;
+    record->time_stamp = 0;
+
+    if (format == FORMAT_META) {
+
+        record->lqi = (uint8_t)bytes[ 18 ];
+        record->time_stamp = ((uint32_t)bytes[ 19 ] << 24) | ((uint32_t)bytes[ 20 ] << 16) |
+                             ((uint32_t)bytes[ 21 ] << 8) | (uint32_t)bytes[ 22 ];
+    }
+
+    return true;
+}
+
+/*! \brief  Find out if the log carries the metadata trailer: the first plain
+ *          record is followed by 10 hex digits and the next start symbol.
+ */
+static log_format_t detect_format( const char *data, uint64_t size ){
+
+    record_t record;
+
+    for (uint64_t position = 0; position < size; position++) {
+
+        if (!parse_at( data, size, position, FORMAT_PLAIN, &record )) { continue; }
+
+        uint64_t next = position + META_RECORD_DIGITS;
+
+        if ((next + 4 <= size) && (memcmp( data + next, "0DB5", 4 ) == 0) &&
+            parse_at( data, size, position, FORMAT_META, &record )) {
+            return FORMAT_META;
+        }
+
+        return FORMAT_PLAIN;
+    }
+
+    return FORMAT_PLAIN;
+}
+
+static void result_append( chunk_result_t *result, const record_t *record ){
+
+    if (result->count == result->capacity) {
+
+        result->capacity = result->capacity ? 2 * result->capacity : 4096;
+        result->records = realloc( result->records, result->capacity * sizeof( record_t ) );
+
+        if (result->records == NULL) {
+            perror( "realloc" );
+            exit( 1 );
+        }
+    }
+
+    result->records[ result->count++ ] = *record;
+}
+
+/*! \brief  Greedy parse of [start, end): take a record where one is found,
+ *          otherwise skip one character. Records may end after end.
+ */
+static void parse_chunk( const work_t *work, uint64_t start, uint64_t end,
+                         chunk_result_t *result ){
+
+    size_t digits = record_digits( work->format );
+    uint64_t position = start;
+    record_t record;
+
+    result->count = 0;
+
+    while (position < end) {
+
+        if (parse_at( work->data, work->size, position, work->format, &record )) {
+            result_append( result, &record );
+            position += digits;
+        } else {
+            position++;
+        }
+    }
+
+    result->exit = position;
+}
+
+/*! \brief  Update the statistics of one source with the next record in file
+ *          order. This is the only place where statistics change, and it is
+ *          always called in file order.
+ */
+static void account( const record_t *record, bool metadata ){
+
+    source_statistics_t *s = sources[ record->source ];
+
+    if (s == NULL) {
+
+        s = calloc( 1, sizeof( *s ) );
+
+        if (s == NULL) {
+            perror( "calloc" );
+            exit( 1 );
+        }
+
+        sources[ record->source ] = s;
+    }
+
+    s->received++;
+
+    /*Unwrap the counter relative to the highest one seen.*/
+    int64_t counter = (int64_t)record->carry * 255 + record->sequence;
+    int64_t unwrapped;
+
+    if (s->received == 1) {
+
+        unwrapped = counter;
+        s->lowest = unwrapped;
+        s->highest = unwrapped - 1;
+    } else {
+
+        int64_t delta = (counter - (s->highest % COUNTER_PERIOD) + COUNTER_PERIOD) % COUNTER_PERIOD;
+
+        if (delta > COUNTER_PERIOD / 2) { delta -= COUNTER_PERIOD; }
+
+        unwrapped = s->highest + delta;
+    }
+
+    if (unwrapped > s->highest) {
+
+        //Forget the counters that leave the window.
+        for (int64_t c = s->highest + 1; (c <= unwrapped) && (c <= s->highest + DUPLICATE_WINDOW); c++) {
+            s->seen[ WINDOW_BYTE( c ) ] &= ~WINDOW_BIT( c );
+        }
+
+        s->highest = unwrapped;
+    }
+
+    if (unwrapped <= s->highest - DUPLICATE_WINDOW) {
+        s->too_old++;
+    } else if (s->seen[ WINDOW_BYTE( unwrapped ) ] & WINDOW_BIT( unwrapped )) {
+        s->duplicates++;
+    } else {
+
+        s->seen[ WINDOW_BYTE( unwrapped ) ] |= WINDOW_BIT( unwrapped );
+        s->unique++;
+
+        if (unwrapped < s->lowest) { s->lowest = unwrapped; }
+
+        if (unwrapped < s->highest) {
+
+            uint64_t distance = (uint64_t)(s->highest - unwrapped);
+            int bucket = 0;
+
+            while (((distance >> (bucket + 1)) != 0) && (bucket < REORDER_BUCKETS - 1)) { bucket++; }
+
+            s->reordered++;
+            s->reorder_histogram[ bucket ]++;
+
+            if (distance > s->max_reorder) { s->max_reorder = distance; }
+        }
+    }
+
+    if (!metadata) { return; }
+
+    s->lqi_histogram[ record->lqi ]++;
+
+    /*Inter-arrival time, in arrival order. A time stamp that goes backwards
+      (node reset, or lines mixed up in the log) restarts the measurement.*/
+    uint32_t elapsed = (record->time_stamp - s->last_arrival) & SYMBOL_MASK;
+
+    if (s->has_arrival && (elapsed <= (SYMBOL_MASK >> 1))) {
+
+        double interval = (double)elapsed * US_PER_SYMBOL;
+
+        s->intervals++;
+
+        double delta = interval - s->interval_mean;
+        s->interval_mean += delta / (double)s->intervals;
+        s->interval_m2 += delta * (interval - s->interval_mean);
+
+        if ((s->intervals == 1) || (interval < s->interval_min)) { s->interval_min = interval; }
+        if ((s->intervals == 1) || (interval > s->interval_max)) { s->interval_max = interval; }
+
+        if (s->intervals > 1) {
+            s->jitter += (fabs( interval - s->last_interval ) - s->jitter) / 16.0;
+        }
+
+        s->last_interval = interval;
+    }
+
+    s->has_arrival = true;
+    s->last_arrival = record->time_stamp;
+}
+
+/*! \brief  Parser thread: parse chunks in order of the shared counter, at most
+ *          slots chunks ahead of the merger.
+ */
+static void *parser_thread( void *argument ){
+
+    work_t *work = argument;
+
+    for (;;) {
+
+        pthread_mutex_lock( &work->lock );
+
+        while ((work->next_chunk < work->chunks) &&
+               (work->next_chunk >= work->merged + work->slots)) {
+            pthread_cond_wait( &work->changed, &work->lock );
+        }
+
+        if (work->next_chunk >= work->chunks) {
+            pthread_mutex_unlock( &work->lock );
+            return NULL;
+        }
+
+        uint64_t chunk = work->next_chunk++;
+        chunk_result_t *result = &work->results[ chunk % work->slots ];
+
+        pthread_mutex_unlock( &work->lock );
+
+        uint64_t start = chunk * CHUNK_SIZE;
+        uint64_t end = start + CHUNK_SIZE;
+
+        if (end > work->size) { end = work->size; }
+
+        parse_chunk( work, start, end, result );
+
+        pthread_mutex_lock( &work->lock );
+        result->ready = true;
+        pthread_cond_broadcast( &work->changed );
+        pthread_mutex_unlock( &work->lock );
+    }
+}
+
+/*! \brief  Account the records of one chunk, as if the whole file had been
+ *          parsed sequentially.
+ *
+ *          The parser of a chunk started at the chunk start, but a record of
+ *          the previous chunk may reach into it (entry > start). Then the
+ *          sequential parse is redone from entry until it meets a record the
+ *          chunk parser also found; from there both are identical.
+ *
+ *  \return Where the sequential parse leaves this chunk.
+ */
+static uint64_t merge_chunk( const work_t *work, uint64_t chunk, uint64_t entry,
+                             const chunk_result_t *result ){
+
+    bool metadata = (work->format == FORMAT_META);
+    uint64_t start = chunk * CHUNK_SIZE;
+    uint64_t end = start + CHUNK_SIZE;
+    size_t index = 0;
+
+    if (end > work->size) { end = work->size; }
+
+    if (entry > start) {
+
+        size_t digits = record_digits( work->format );
+        uint64_t position = entry;
+        record_t record;
+
+        for (;;) {
+
+            while ((index < result->count) && (result->records[ index ].start < position)) { index++; }
+
+            if ((index < result->count) && (result->records[ index ].start == position)) { break; }
+
+            if (position >= end) { return position; }
+
+            if (parse_at( work->data, work->size, position, work->format, &record )) {
+                account( &record, metadata );
+                position += digits;
+            } else {
+                position++;
+            }
+        }
+    }
+
+    for (; index < result->count; index++) {
+        account( &result->records[ index ], metadata );
+    }
+
+    return result->exit;
+}
+
+/*! \brief  Parse a whole file with threads, merging in file order. */
+static void analyse_parallel( work_t *work, int threads ){
+
+    pthread_t thread[ MAX_THREADS ];
+
+    work->chunks = (work->size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    work->next_chunk = 0;
+    work->merged = 0;
+    work->slots = 2 * (size_t)threads;
+    work->results = calloc( work->slots, sizeof( chunk_result_t ) );
+
+    if (work->results == NULL) {
+        perror( "calloc" );
+        exit( 1 );
+    }
+
+    pthread_mutex_init( &work->lock, NULL );
+    pthread_cond_init( &work->changed, NULL );
+
+    for (int i = 0; i < threads; i++) {
+        pthread_create( &thread[ i ], NULL, parser_thread, work );
+    }
+
+    uint64_t entry = 0;
+
+    for (uint64_t chunk = 0; chunk < work->chunks; chunk++) {
+
+        chunk_result_t *result = &work->results[ chunk % work->slots ];
+
+        pthread_mutex_lock( &work->lock );
+        while (!result->ready) { pthread_cond_wait( &work->changed, &work->lock ); }
+        pthread_mutex_unlock( &work->lock );
+
+        entry = merge_chunk( work, chunk, entry, result );
+
+        pthread_mutex_lock( &work->lock );
+        result->ready = false;
+        work->merged++;
+        pthread_cond_broadcast( &work->changed );
+        pthread_mutex_unlock( &work->lock );
+    }
+
+    for (int i = 0; i < threads; i++) {
+        pthread_join( thread[ i ], NULL );
+    }
+
+    for (size_t i = 0; i < work->slots; i++) {
+        free( work->results[ i ].records );
+    }
+
+    free( work->results );
+    pthread_cond_destroy( &work->changed );
+    pthread_mutex_destroy( &work->lock );
+}
+
+/*! \brief  Reference: one sequential pass over the whole file. */
+static void analyse_sequential( const work_t *work ){
+
+    size_t digits = record_digits( work->format );
+    bool metadata = (work->format == FORMAT_META);
+    uint64_t position = 0;
+    record_t record;
+
+    while (position < work->size) {
+
+        if (parse_at( work->data, work->size, position, work->format, &record )) {
+            account( &record, metadata );
+            position += digits;
+        } else {
+            position++;
+        }
+    }
+}
+
+/*! \brief  Print and free the statistics of all sources. */
+static void report( const char *name, log_format_t format ){
+
+    printf( "== %s (%s)\n", name, (format == FORMAT_META) ? "with LQI and time stamps" : "plain" );
+
+    for (uint32_t address = 0; address < 65536; address++) {
+
+        source_statistics_t *s = sources[ address ];
+
+        if (s == NULL) { continue; }
+
+        uint64_t expected = (uint64_t)(s->highest - s->lowest + 1);
+        uint64_t lost = (expected > s->unique) ? expected - s->unique : 0;
+
+        printf( "source 0x%04X\n", address );
+        printf( "  received %llu, unique %llu, duplicates %llu, too old %llu\n",
+                (unsigned long long)s->received, (unsigned long long)s->unique,
+                (unsigned long long)s->duplicates, (unsigned long long)s->too_old );
+        printf( "  counter %lld to %lld, lost %llu (%.3f %%)\n",
+                (long long)s->lowest, (long long)s->highest, (unsigned long long)lost,
+                expected ? 100.0 * (double)lost / (double)expected : 0.0 );
+        printf( "  reordered %llu, max distance %llu, distance histogram:",
+                (unsigned long long)s->reordered, (unsigned long long)s->max_reorder );
+
+        for (int i = 0; i < REORDER_BUCKETS; i++) {
+            if (s->reorder_histogram[ i ] != 0) {
+                printf( " [%llu..%llu]=%llu", 1ULL << i, (2ULL << i) - 1,
+                        (unsigned long long)s->reorder_histogram[ i ] );
+            }
+        }
+
+        printf( "\n" );
+
+        if (format == FORMAT_META) {
+
+            uint64_t count = 0;
+            uint64_t sum = 0;
+            int low = -1;
+            int high = 0;
+
+            for (int lqi = 0; lqi < 256; lqi++) {
+
+                if (s->lqi_histogram[ lqi ] == 0) { continue; }
+
+                if (low < 0) { low = lqi; }
+
+                high = lqi;
+                count += s->lqi_histogram[ lqi ];
+                sum += s->lqi_histogram[ lqi ] * (uint64_t)lqi;
+            }
+
+            if (count != 0) {
+
+                printf( "  lqi min %d, mean %.1f, max %d, histogram:", low, (double)sum / (double)count, high );
+
+                for (int bucket = 0; bucket < 256; bucket += 32) {
+
+                    uint64_t n = 0;
+
+                    for (int lqi = bucket; lqi < bucket + 32; lqi++) { n += s->lqi_histogram[ lqi ]; }
+
+                    printf( " %llu", (unsigned long long)n );
+                }
+
+                printf( "\n" );
+            }
+
+            if (s->intervals != 0) {
+
+                double deviation = (s->intervals > 1) ? sqrt( s->interval_m2 / (double)(s->intervals - 1) ) : 0.0;
+
+                printf( "  inter-arrival mean %.3f ms, std %.3f ms, min %.3f ms, max %.3f ms, jitter %.3f ms\n",
+                        s->interval_mean / 1000.0, deviation / 1000.0, s->interval_min / 1000.0,
+                        s->interval_max / 1000.0, s->jitter / 1000.0 );
+            }
+        }
+
+        free( s );
+        sources[ address ] = NULL;
+    }
+}
+
+static void usage( const char *name ){
+
+    fprintf( stderr, "usage: %s [-j threads] [-r] [-f auto|plain|meta] log...\n", name );
+    exit( 2 );
+}
+
+int main( int argc, char **argv ){
+
+    long threads = sysconf( _SC_NPROCESSORS_ONLN );
+    bool reference = false;
+    log_format_t format = FORMAT_AUTO;
+    int option;
+
+    while ((option = getopt( argc, argv, "j:rf:" )) != -1) {
+
+        switch (option) {
+        case 'j':
+            threads = strtol( optarg, NULL, 10 );
+            break;
+        case 'r':
+            reference = true;
+            break;
+        case 'f':
+            if (strcmp( optarg, "plain" ) == 0) {
+                format = FORMAT_PLAIN;
+            } else if (strcmp( optarg, "meta" ) == 0) {
+                format = FORMAT_META;
+            } else if (strcmp( optarg, "auto" ) == 0) {
+                format = FORMAT_AUTO;
+            } else {
+                usage( argv[ 0 ] );
+            }
+            break;
+        default:
+            usage( argv[ 0 ] );
+        }
+    }
+
+    if (optind >= argc) { usage( argv[ 0 ] ); }
+
+    if (threads < 1) { threads = 1; }
+    if (threads > MAX_THREADS) { threads = MAX_THREADS; }
+
+    int status = 0;
+
+    for (int i = optind; i < argc; i++) {
+
+        int fd = open( argv[ i ], O_RDONLY );
+        struct stat file_stat;
+
+        if ((fd < 0) || (fstat( fd, &file_stat ) != 0)) {
+
+            perror( argv[ i ] );
+            status = 1;
+
+            if (fd >= 0) { close( fd ); }
+
+            continue;
+        }
+
+        work_t work;
+
+        memset( &work, 0, sizeof( work ) );
+        work.size = (uint64_t)file_stat.st_size;
+        work.data = "";
+
+        if (work.size != 0) {
+
+            void *map = mmap( NULL, work.size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+            if (map == MAP_FAILED) {
+
+                perror( argv[ i ] );
+                status = 1;
+                close( fd );
+
+                continue;
+            }
+
+            madvise( map, work.size, MADV_SEQUENTIAL );
+            work.data = map;
+        }
+
+        work.format = (format == FORMAT_AUTO) ? detect_format( work.data, work.size ) : format;
+
+        if (reference) {
+            analyse_sequential( &work );
+        } else if (work.size != 0) {
+            analyse_parallel( &work, (int)threads );
+        }
+
+        report( argv[ i ], work.format );
+
+        if (work.size != 0) { munmap( (void *)work.data, work.size ); }
+
+        close( fd );
+    }
+
+    return status;
+}
+/*EOF*/
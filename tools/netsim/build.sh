@@ -0,0 +1,39 @@
+#!/bin/sh
+# Builds netsim, and the testsend and umspreceive images that it runs (see
+# netsim.c): the sources of each project Makefile but hal_avr.c and the Atmel
+# START drivers, with hal_sim.c and the headers of include/, as a shared
+# object whose main is netsim_main. The _tdma images are built with TIME_SYNC
+# and TDMA, for -m tdma.
+#
+# Usage: build.sh [output_directory]
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$HERE/../..
+OUT=${1:-.}
+CC=${CC:-cc}
+CFLAGS="-std=gnu99 -O2 -Wall -funsigned-char -funsigned-bitfields -fpack-struct -fshort-enums"
+
+image( ){
+    PROJECT=$ROOT/$1
+    IMAGE=$2
+    shift 2
+    SOURCES=
+    for OBJECT in $(sed -n 's/^OBJECTS *= *//p' "$PROJECT/default/Makefile"); do
+        SOURCE=${OBJECT%.o}.c
+        case $SOURCE in
+            hal_avr.c|atmel_start.c|driver_isr.c) ;;
+            *) [ -f "$PROJECT/$SOURCE" ] && SOURCES="$SOURCES $PROJECT/$SOURCE" ;;
+        esac
+    done
+    $CC $CFLAGS -fPIC -shared -Wl,-Bsymbolic -Dmain=netsim_main "$@" \
+        -I"$HERE/include" -I"$HERE" -I"$PROJECT" -I"$PROJECT/config" -I"$PROJECT/include" \
+        -I"$PROJECT/utils" -I"$PROJECT/utils/assembler" \
+        -o "$OUT/$IMAGE.so" $SOURCES "$HERE/hal_sim.c"
+}
+
+image testsend testsend
+image umspreceive umspreceive
+image testsend testsend_tdma -DTIME_SYNC -DTDMA
+image umspreceive umspreceive_tdma -DTIME_SYNC -DTDMA
+$CC -std=gnu99 -O2 -Wall -rdynamic -I"$HERE/include" -I"$HERE" -I"$ROOT/umspreceive/include" \
+    -o "$OUT/netsim" "$HERE/netsim.c" -ldl -lm
@@ -0,0 +1,801 @@
+/*! \file hal_sim.c
+ *
+ *  \brief  Host version of hal_avr.c for netsim.
+ *
+ *          The functions and the two ISRs do what they do in hal_avr.c, with
+ *          the same flags, callbacks and RX_FRAME_PROTECTION accounting. What
+ *          differs is below them:
+ *          - SPI: each transfer is netsim_spi, between HAL_SS_LOW and
+ *            HAL_SS_HIGH as on the AVR. netsim decodes the transaction for the
+ *            AT86RF231 model of the node (register file, frame buffer, SRAM)
+ *            and charges the SPI time.
+ *          - Timer1: the tick count is netsim_get_ticks, the input capture of
+ *            the IRQ line is netsim_get_capture_ticks, and the output compare
+ *            of the HAL timer is netsim_set_compare. All 32 bits are kept, so
+ *            there is no overflow ISR.
+ *          - The flag getters are busy-wait points (netsim_poll), since the
+ *            TAT polls them.
+ *
+ *          The AES engine of the SRAM window is not modeled: sal.c and
+ *          aes_bench.c run on tools/aessim instead.
+ */
+/*============================ INCLUDE =======================================*/
+#include <stdlib.h>
+#include <string.h>
+#include "config_uart_extended.h"
+#include "at86rf231.h"
+#include "compiler.h"
+#include "hal_avr.h"
+#include "hal.h"
+#include "trace.h"
+#include "netsim.h"
+/*============================ MACROS ========================================*/
+#define HAL_DUMMY_READ         ( 0x00 ) //!< Dummy value for the SPI.
+
+#define HAL_TRX_CMD_RW         ( 0xC0 ) //!< Register Write (short mode).
+#define HAL_TRX_CMD_RR         ( 0x80 ) //!< Register Read (short mode).
+#define HAL_TRX_CMD_FW         ( 0x60 ) //!< Frame Transmit Mode (long mode).
+#define HAL_TRX_CMD_FR         ( 0x20 ) //!< Frame Receive Mode (long mode).
+#define HAL_TRX_CMD_SW         ( 0x40 ) //!< SRAM Write.
+#define HAL_TRX_CMD_SR         ( 0x00 ) //!< SRAM Read.
+#define HAL_TRX_CMD_RADDRM     ( 0x7F ) //!< Register Address Mask.
+
+#define HAL_CALCULATED_CRC_OK   ( 0 ) //!< CRC calculated over the frame including the CRC field should be 0.
+
+#define HAL_RX_MAX_PROTECTION_TICKS ( 0x8000 ) //!< An RX_START up to this many Timer1 ticks before the release was during the protection.
+/*============================ TYPDEFS =======================================*/
+/*============================ VARIABLES =====================================*/
+static uint32_t volatile hal_capture_time; //!< Timer1 tick count at the rising edge of the last radio IRQ.
+
+/*Flag section.*/
+static uint8_t volatile hal_bat_low_flag; //!< BAT_LOW flag.
+static uint8_t volatile hal_trx_ur_flag; //!< TRX_UR flag.
+static uint8_t volatile hal_trx_end_flag; //!< TRX_END flag.
+static uint8_t volatile hal_rx_start_flag; //!< RX_START flag.
+static uint8_t volatile hal_unknown_isr_flag; //!< Error, unknown interrupt event signaled from the radio transceiver.
+static uint8_t volatile hal_pll_unlock_flag; //!< PLL_UNLOCK flag.
+static uint8_t volatile hal_pll_lock_flag;   //!< PLL_LOCK flag.
+static uint8_t volatile hal_timer_flag;      //!< HAL timer expiry flag.
+static bool volatile hal_frame_buffer_flag;  //!< Set when the frame buffer content may have changed.
+
+static uint32_t volatile hal_timer_expiry; //!< Timer1 tick count at which the armed HAL timer expires.
+
+#if defined( RX_FRAME_PROTECTION )
+static bool volatile hal_rx_protected; //!< True from the TRX_END of a received frame until it is read.
+static uint32_t hal_rx_release_time; //!< Timer1 tick count when the last protected frame was read or released.
+static hal_rx_protection_statistics_t hal_rx_protection_statistics; //!< Written by the TRX ISR.
+#endif
+
+/*Callbacks.*/
+static hal_rx_start_isr_event_handler_t rx_start_callback; //!< Called from the TRX ISR on RX_START.
+static hal_trx_end_isr_event_handler_t trx_end_callback; //!< Called from the TRX ISR on TRX_END.
+static hal_timer_isr_event_handler_t timer_callback; //!< Called from the compare ISR when the HAL timer expires.
+/*============================ PROTOTYPES ====================================*/
+static uint8_t hal_spi_transfer( uint8_t data );
+#if defined( RX_FRAME_PROTECTION )
+static void hal_rx_release( void );
+#endif
+/*============================ IMPLEMENTATION ================================*/
+
+/*! \brief  This function initializes the Hardware Abstraction Layer.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_init( void ){
+
+    hal_reset_flags( );
+
+    /*IO Specific Initialization.*/
+    DDR_SLP_TR |= (1 << SLP_TR); //Enable SLP_TR as output.
+    DDR_RST    |= (1 << RST);    //Enable RST as output.
+    HAL_DDR_DATA_LED |= (1 << DATA_LED);
+    HAL_DDR_NET_LED |= (1 << NET_LED);
+
+    /*SPI Specific Initialization.*/
+    HAL_DDR_SPI  |= (1 << HAL_DD_SS) | (1 << HAL_DD_SCK) | (1 << HAL_DD_MOSI);
+    HAL_PORT_SPI |= (1 << HAL_DD_SS) | (1 << HAL_DD_SCK); //Set SS and CLK high
+
+    /*TIMER1 Specific Initialization.*/
+    TCCR1B = HAL_TCCR1B_CONFIG;
+    hal_enable_trx_interrupt( ); //Enable interrupts from the radio transceiver.
+
+    SREG |= 0x80;
+}
+
+#if defined( HAL_CLOCK_FROM_CLKM )
+/*! \brief  The AVR runs at F_CPU from the start in netsim.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_raise_cpu_clock( void ){
+
+    hal_subregister_write( SR_CLKM_SHA_SEL, CLKM_SHA_DISABLE );
+    hal_subregister_write( SR_CLKM_CTRL, HAL_CLKM_CTRL );
+    hal_subregister_write( SR_CLKM_SHA_SEL, CLKM_SHA_ENABLE );
+}
+#endif
+
+/*! \brief  This function reset the interrupt flags and interrupt event handlers
+ *          (Callbacks) to their default value.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_reset_flags( void ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+
+    //Reset Flags.
+    hal_bat_low_flag     = 0;
+    hal_trx_ur_flag      = 0;
+    hal_trx_end_flag     = 0;
+    hal_rx_start_flag    = 0;
+    hal_unknown_isr_flag = 0;
+    hal_pll_unlock_flag  = 0;
+    hal_pll_lock_flag    = 0;
+    hal_timer_flag       = 0;
+    hal_frame_buffer_flag = true;
+
+    //Reset Associated Event Handlers.
+    rx_start_callback = NULL;
+    trx_end_callback  = NULL;
+    timer_callback    = NULL;
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  This function returns the current value of the BAT_LOW flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+uint8_t hal_get_bat_low_flag( void ){
+
+    netsim_poll( );
+    return hal_bat_low_flag;
+}
+
+/*! \brief  This function clears the BAT_LOW flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_bat_low_flag( void ){
+    hal_bat_low_flag = 0;
+}
+
+/*! \brief  This function returns the current value of the TRX_UR flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+uint8_t hal_get_trx_ur_flag( void ){
+
+    netsim_poll( );
+    return hal_trx_ur_flag;
+}
+
+/*! \brief  This function clears the TRX_UR flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_trx_ur_flag( void ){
+    hal_trx_ur_flag = 0;
+}
+
+/*! \brief  This function returns the current value of the TRX_END flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+uint8_t hal_get_trx_end_flag( void ){
+
+    netsim_poll( );
+    return hal_trx_end_flag;
+}
+
+/*! \brief  This function clears the TRX_END flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_trx_end_flag( void ){
+    hal_trx_end_flag = 0;
+}
+
+/*! \brief  This function returns the active TRX_END event handler.
+ *
+ *  \ingroup hal_avr_api
+ */
+hal_trx_end_isr_event_handler_t hal_get_trx_end_event_handler( void ){
+    return trx_end_callback;
+}
+
+/*! \brief  This function is used to set new TRX_END event handler, overriding
+ *          old handler reference.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_set_trx_end_event_handler( hal_trx_end_isr_event_handler_t trx_end_callback_handle ){
+    trx_end_callback = trx_end_callback_handle;
+}
+
+/*! \brief  Remove event handler reference.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_trx_end_event_handler( void ){
+    trx_end_callback = NULL;
+}
+
+/*! \brief  This function returns the current value of the RX_START flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+uint8_t hal_get_rx_start_flag( void ){
+
+    netsim_poll( );
+    return hal_rx_start_flag;
+}
+
+/*! \brief  This function clears the RX_START flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_rx_start_flag( void ){
+    hal_rx_start_flag = 0;
+}
+
+/*! \brief  This function returns the FRAME_BUFFER flag (see hal_avr.c).
+ *
+ *  \ingroup hal_avr_api
+ */
+bool hal_get_frame_buffer_flag( void ){
+    return hal_frame_buffer_flag;
+}
+
+/*! \brief  This function clears the FRAME_BUFFER flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_frame_buffer_flag( void ){
+    hal_frame_buffer_flag = false;
+}
+
+/*! \brief  This function returns the active RX_START event handler
+ *
+ *  \ingroup hal_avr_api
+ */
+hal_rx_start_isr_event_handler_t hal_get_rx_start_event_handler( void ){
+    return rx_start_callback;
+}
+
+/*! \brief  This function is used to set new RX_START event handler, overriding
+ *          old handler reference.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_set_rx_start_event_handler( hal_rx_start_isr_event_handler_t rx_start_callback_handle ){
+    rx_start_callback = rx_start_callback_handle;
+}
+
+/*! \brief  Remove event handler reference.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_rx_start_event_handler( void ){
+    rx_start_callback = NULL;
+}
+
+/*! \brief  This function returns the current value of the UNKNOWN_ISR flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+uint8_t hal_get_unknown_isr_flag( void ){
+
+    netsim_poll( );
+    return hal_unknown_isr_flag;
+}
+
+/*! \brief  This function clears the UNKNOWN_ISR flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_unknown_isr_flag( void ){
+    hal_unknown_isr_flag = 0;
+}
+
+/*! \brief  This function returns the current value of the PLL_UNLOCK flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+uint8_t hal_get_pll_unlock_flag( void ){
+
+    netsim_poll( );
+    return hal_pll_unlock_flag;
+}
+
+/*! \brief  This function clears the PLL_UNLOCK flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_pll_unlock_flag( void ){
+    hal_pll_unlock_flag = 0;
+}
+
+/*! \brief  This function returns the current value of the PLL_LOCK flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+uint8_t hal_get_pll_lock_flag( void ){
+
+    netsim_poll( );
+    return hal_pll_lock_flag;
+}
+
+/*! \brief  This function clears the PLL_LOCK flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_pll_lock_flag( void ){
+    hal_pll_lock_flag = 0;
+}
+
+/*! \brief  This function returns the current value of the TIMER flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+uint8_t hal_get_timer_flag( void ){
+
+    netsim_poll( );
+    return hal_timer_flag;
+}
+
+/*! \brief  This function clears the TIMER flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_timer_flag( void ){
+    hal_timer_flag = 0;
+}
+
+/*! \brief  This function is used to set new timer event handler, overriding
+ *          old handler reference.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_set_timer_event_handler( hal_timer_isr_event_handler_t timer_callback_handle ){
+    timer_callback = timer_callback_handle;
+}
+
+/*! \brief  Remove event handler reference.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_timer_event_handler( void ){
+    timer_callback = NULL;
+}
+
+/*! \brief  This function arms the one-shot HAL timer on the Timer1 compare.
+ *
+ *  \param  timeout Time until expiry in IEEE 802.15.4 symbols. Must be at
+ *                  least 2 symbols.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_start_timer( uint32_t timeout ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    hal_timer_expiry = netsim_get_ticks( ) + timeout * HAL_US_PER_SYMBOL;
+    netsim_set_compare( hal_timer_expiry );
+
+    HAL_CLEAR_COMPARE_FLAG( );
+    HAL_ENABLE_COMPARE_INTERRUPT( );
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  This function stops the HAL timer without signaling expiry.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_stop_timer( void ){
+    HAL_DISABLE_COMPARE_INTERRUPT( );
+}
+
+/*! \brief  This function reads data from one of the radio transceiver's registers.
+ *
+ *  \param  address Register address to read from.
+ *
+ *  \returns The actual value of the read register.
+ *
+ *  \ingroup hal_avr_api
+ */
+uint8_t hal_register_read( uint8_t address ){
+
+    //Add the register read command to the register address.
+    address &= HAL_TRX_CMD_RADDRM;
+    address |= HAL_TRX_CMD_RR;
+
+    uint8_t register_value = 0;
+
+    AVR_ENTER_CRITICAL_REGION( );
+
+    HAL_SS_LOW( );
+
+    hal_spi_transfer( address );
+    register_value = hal_spi_transfer( HAL_DUMMY_READ );
+
+    HAL_SS_HIGH( );
+
+    AVR_LEAVE_CRITICAL_REGION( );
+
+    return register_value;
+}
+
+/*! \brief  This function writes a new value to one of the radio transceiver's
+ *          registers.
+ *
+ *  \param  address Address of register to write.
+ *  \param  value   Value to write.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_register_write( uint8_t address, uint8_t value ){
+
+    //Add the Register Write command to the address.
+    address = HAL_TRX_CMD_RW | (HAL_TRX_CMD_RADDRM & address);
+
+    AVR_ENTER_CRITICAL_REGION( );
+
+    HAL_SS_LOW( );
+
+    hal_spi_transfer( address );
+    hal_spi_transfer( value );
+
+    HAL_SS_HIGH( );
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  This function sends one byte on the SPI and returns the byte
+ *          received.
+ *
+ *  \ingroup hal_avr_api
+ */
+static uint8_t hal_spi_transfer( uint8_t data ){
+
+    netsim_spi( &data, 1 );
+
+    return data;
+}
+
+/*! \brief  This function will upload a frame from the radio transceiver's frame
+ *          buffer, as hal_frame_read of hal_avr.c.
+ *
+ *  \param  rx_frame    Pointer to the data structure where the frame is stored.
+ *
+ *  \ingroup hal_avr_api
+ */
+__z void hal_frame_read( hal_rx_frame_t *rx_frame ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+
+    HAL_SS_LOW( );
+
+    /*Send frame read command, and read frame length.*/
+    hal_spi_transfer( HAL_TRX_CMD_FR );
+    uint8_t frame_length = hal_spi_transfer( HAL_DUMMY_READ );
+
+    /*Check for correct frame length.*/
+    if ((frame_length >= HAL_MIN_FRAME_LENGTH) && (frame_length <= HAL_MAX_FRAME_LENGTH)) {
+
+        rx_frame->length = frame_length; //Store frame length.
+
+        /*Upload frame buffer to data pointer, and the LQI that follows.*/
+        netsim_spi( rx_frame->data, frame_length );
+        rx_frame->lqi = hal_spi_transfer( HAL_DUMMY_READ );
+
+        HAL_SS_HIGH( );
+
+        /*Calculate CRC, and set crc field in hal_rx_frame_t accordingly.*/
+        uint16_t crc = 0;
+        uint8_t *rx_data = (rx_frame->data);
+
+        do {
+            crc = crc_ccitt_update( crc, *rx_data++ );
+        } while (--frame_length > 0);
+
+        rx_frame->crc = (crc == HAL_CALCULATED_CRC_OK);
+    } else {
+
+        HAL_SS_HIGH( );
+
+        rx_frame->length = 0;
+        rx_frame->lqi    = 0;
+        rx_frame->crc    = false;
+    }
+
+#if defined( RX_FRAME_PROTECTION )
+    hal_rx_release( ); //Reading the frame buffer ended the protection.
+#endif
+    TRACE_EVENT( (rx_frame->crc == true) ? TRACE_RX : TRACE_RX_CRC_ERROR, rx_frame->length );
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  This function will download a frame to the radio transceiver's frame
+ *          buffer.
+ *
+ *  \param  write_buffer    Pointer to data that is to be written to frame buffer.
+ *  \param  length          Length of data. The maximum length is 127 bytes.
+ *
+ *  \ingroup hal_avr_api
+ */
+__z void hal_frame_write( uint8_t *write_buffer, uint8_t length ){
+
+    static uint8_t frame[ HAL_MAX_FRAME_LENGTH ]; //The SPI returns a byte for each one sent.
+
+    length &= HAL_TRX_CMD_RADDRM; //Truncate length to maximum frame length.
+
+    AVR_ENTER_CRITICAL_REGION( );
+
+    HAL_SS_LOW( );
+
+    hal_spi_transfer( HAL_TRX_CMD_FW );
+    hal_spi_transfer( length );
+
+    if (length > 0) {
+
+        memcpy( frame, write_buffer, length );
+        netsim_spi( frame, length );
+    }
+
+    HAL_SS_HIGH( );
+
+    hal_frame_buffer_flag = true;
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief Read SRAM
+ *
+ * \param address Address in the TRX's SRAM where the read burst should start
+ * \param length Length of the read burst
+ * \param data Pointer to buffer where data is stored.
+ *
+ * \ingroup hal_avr_api
+ */
+__z void hal_sram_read( uint8_t address, uint8_t length, uint8_t *data ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    HAL_SS_LOW( );
+
+    hal_spi_transfer( HAL_TRX_CMD_SR );
+    hal_spi_transfer( address );
+    netsim_spi( data, length );
+
+    HAL_SS_HIGH( );
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief Write SRAM
+ *
+ * \param address Address in the TRX's SRAM where the write burst should start
+ * \param length  Length of the write burst
+ * \param data    Pointer to an array of bytes that should be written
+ *
+ * \ingroup hal_avr_api
+ */
+__z void hal_sram_write( uint8_t address, uint8_t length, uint8_t *data ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    HAL_SS_LOW( );
+
+    hal_spi_transfer( HAL_TRX_CMD_SW );
+    hal_spi_transfer( address );
+
+    for (uint8_t i = 0; i < length; i++) { hal_spi_transfer( data[ i ] ); }
+
+    HAL_SS_HIGH( );
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief Write and read SRAM, one byte behind (see hal_avr.c).
+ *
+ * \param addr    Address in the TRX's SRAM where the burst should start
+ * \param idata   Bytes to write, replaced by the bytes read
+ * \param length  Length of the burst
+ *
+ * \ingroup hal_avr_api
+ */
+__z void hal_trx_aes_wrrd(uint8_t addr, uint8_t *idata, uint8_t length)
+{
+    delay_us( 1 );
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    HAL_SS_LOW( );
+
+    hal_spi_transfer( HAL_TRX_CMD_SW );
+    hal_spi_transfer( addr );
+    hal_spi_transfer( idata[ 0 ] );
+
+    for (uint8_t i = 1; i < length; i++) { idata[ i - 1 ] = hal_spi_transfer( idata[ i ] ); }
+
+    idata[ length - 1 ] = hal_spi_transfer( HAL_DUMMY_READ );
+
+    HAL_SS_HIGH( );
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief This function returns the system time in symbols, as defined in the
+ *         IEEE 802.15.4 standard.
+ *
+ * \ingroup hal_avr_api
+ */
+uint32_t hal_get_system_time( void ){
+    return ((netsim_get_ticks( ) / HAL_US_PER_SYMBOL) & HAL_SYMBOL_MASK);
+}
+
+/*! \brief This function returns the time of the last radio transceiver
+ *         interrupt, in Timer1 ticks.
+ *
+ * \ingroup hal_avr_api
+ */
+uint32_t hal_get_capture_time( void ){
+    return hal_capture_time;
+}
+
+/*! \brief This function reads the counters of the frame buffer protection.
+ *
+ * \param statistics Pointer to where the counters are copied.
+ *
+ * \ingroup hal_avr_api
+ */
+void hal_get_rx_protection_statistics( hal_rx_protection_statistics_t *statistics ){
+
+#if defined( RX_FRAME_PROTECTION )
+    *statistics = hal_rx_protection_statistics;
+#else
+    statistics->lost     = 0;
+    statistics->released = 0;
+#endif
+}
+
+/*! \brief This function clears the counters of the frame buffer protection.
+ *
+ * \ingroup hal_avr_api
+ */
+void hal_clear_rx_protection_statistics( void ){
+
+#if defined( RX_FRAME_PROTECTION )
+    hal_rx_protection_statistics.lost     = 0;
+    hal_rx_protection_statistics.released = 0;
+#endif
+}
+
+#if defined( RX_FRAME_PROTECTION )
+/*! \brief Note that the protected frame was read or released, and when.
+ */
+static void hal_rx_release( void ){
+
+    hal_rx_release_time = netsim_get_ticks( );
+    hal_rx_protected = false;
+}
+#endif
+
+/*! \brief ISR for the radio IRQ line, triggered by the input capture.
+ */
+ISR( TIMER1_CAPT_vect ){
+
+    uint32_t isr_timestamp = netsim_get_capture_ticks( );
+    hal_capture_time = isr_timestamp;
+
+    /*Read Interrupt source.*/
+    HAL_SS_LOW( );
+
+    hal_spi_transfer( RG_IRQ_STATUS | HAL_TRX_CMD_RR );
+    uint8_t interrupt_source = hal_spi_transfer( HAL_DUMMY_READ );
+
+    HAL_SS_HIGH( );
+
+    isr_timestamp /= HAL_US_PER_SYMBOL;
+    isr_timestamp &= HAL_SYMBOL_MASK;
+
+    TRACE_EVENT_AT( TRACE_IRQ, interrupt_source, isr_timestamp );
+
+    /*Handle the incomming interrupt. Prioritized.*/
+    if ((interrupt_source & HAL_RX_START_MASK)) {
+
+        hal_rx_start_flag++; //Increment RX_START flag.
+        hal_frame_buffer_flag = true; //The frame is received into the frame buffer.
+
+#if defined( RX_FRAME_PROTECTION )
+        //It started before the previous frame was read: it is not stored, and
+        //no TRX_END follows.
+        if ((hal_rx_protected == true) ||
+            ((uint32_t)(hal_rx_release_time - hal_capture_time) < HAL_RX_MAX_PROTECTION_TICKS)) {
+            hal_rx_protection_statistics.lost++;
+        }
+#endif
+
+        if( rx_start_callback != NULL ){
+
+            /*Read Frame length and call rx_start callback.*/
+            HAL_SS_LOW( );
+
+            hal_spi_transfer( HAL_TRX_CMD_FR );
+            uint8_t frame_length = hal_spi_transfer( HAL_DUMMY_READ );
+
+            HAL_SS_HIGH( );
+
+            rx_start_callback( isr_timestamp, frame_length );
+        }
+    }
+
+    //The TRX_END of a frame that arrived while interrupts were disabled is
+    //read together with its RX_START. Lost, it would leave the frame protected.
+    if (interrupt_source & HAL_TRX_END_MASK) {
+
+        hal_trx_end_flag++; //Increment TRX_END flag.
+
+#if defined( RX_FRAME_PROTECTION )
+        hal_rx_protected = true; //Until hal_frame_read, if a frame was received.
+#endif
+
+        if( trx_end_callback != NULL ){
+            trx_end_callback( isr_timestamp );
+        }
+
+#if defined( RX_FRAME_PROTECTION )
+        //A received frame that the handler did not read must be released, or
+        //nothing more is received.
+        if (hal_rx_protected == true) {
+
+            uint8_t trx_state = hal_subregister_read( SR_TRX_STATUS );
+
+            if ((trx_state != TX_ARET_ON) && (trx_state != PLL_ON)) {
+
+                hal_subregister_write( SR_RX_SAFE_MODE, RX_SAFE_MODE_DISABLE );
+                hal_subregister_write( SR_RX_SAFE_MODE, RX_SAFE_MODE_ENABLE );
+                hal_rx_protection_statistics.released++;
+            }
+
+            hal_rx_release( );
+        } // end: if (hal_rx_protected == true) ...
+#endif
+    } else if (interrupt_source & HAL_TRX_UR_MASK) {
+        hal_trx_ur_flag++; //Increment TRX_UR flag.
+    } else if (interrupt_source & HAL_PLL_UNLOCK_MASK) {
+        hal_pll_unlock_flag++; //Increment PLL_UNLOCK flag.
+    } else if (interrupt_source & HAL_PLL_LOCK_MASK) {
+        hal_pll_lock_flag++; //Increment PLL_LOCK flag.
+    } else if (interrupt_source & HAL_BAT_LOW_MASK) {
+
+        //Disable BAT_LOW interrupt to prevent interrupt storm.
+        uint8_t trx_isr_mask = hal_register_read( RG_IRQ_MASK );
+        trx_isr_mask &= ~HAL_BAT_LOW_MASK;
+        hal_register_write( RG_IRQ_MASK, trx_isr_mask );
+        hal_bat_low_flag++; //Increment BAT_LOW flag.
+    } else if ((interrupt_source & HAL_RX_START_MASK) == 0) {
+        hal_unknown_isr_flag++;  //Increment UNKNOWN_ISR flag.
+    }
+}
+
+/*! \brief Timer Compare A ISR, the expiry of the HAL timer.
+ */
+ISR( TIMER1_COMPA_vect ){
+
+    HAL_DISABLE_COMPARE_INTERRUPT( ); //One-shot.
+    hal_timer_flag++; //Increment TIMER flag.
+
+    if( timer_callback != NULL ){
+        timer_callback( (hal_timer_expiry / HAL_US_PER_SYMBOL) & HAL_SYMBOL_MASK );
+    }
+}
+/*EOF*/
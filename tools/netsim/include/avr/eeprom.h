@@ -0,0 +1,17 @@
+/*! \file eeprom.h
+ *
+ *  \brief  Host version of avr/eeprom.h for netsim. Only declared: the EEPROM
+ *          is used by OTA, which netsim does not run.
+ */
+#ifndef AVR_EEPROM_H
+#define AVR_EEPROM_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stddef.h>
+/*============================ PROTOTYPES ====================================*/
+void eeprom_read_block( void *destination, const void *source, size_t length );
+void eeprom_write_block( const void *source, void *destination, size_t length );
+uint8_t eeprom_read_byte( const uint8_t *address );
+void eeprom_write_byte( uint8_t *address, uint8_t value );
+#endif
+/*EOF*/
@@ -0,0 +1,16 @@
+/*! \file interrupt.h
+ *
+ *  \brief  Host version of avr/interrupt.h for netsim. An ISR is a plain
+ *          function that netsim finds by the name of its vector, and the
+ *          global interrupt enable is the I flag of the SREG slot.
+ */
+#ifndef AVR_INTERRUPT_H
+#define AVR_INTERRUPT_H
+/*============================ INCLUDE =======================================*/
+#include <avr/io.h>
+/*============================ MACROS ========================================*/
+#define ISR( vector ) void vector( void ); void vector( void )
+#define sei( ) ( (void)( SREG |= ( 1 << SREG_I ) ) )
+#define cli( ) ( (void)( SREG &= (uint8_t)~( 1 << SREG_I ) ) )
+#endif
+/*EOF*/
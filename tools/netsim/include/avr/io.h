@@ -0,0 +1,121 @@
+/*! \file io.h
+ *
+ *  \brief  Host version of avr/io.h for netsim. Each I/O register of the
+ *          ATmega128 that the firmware uses is a 16-bit slot of the calling
+ *          node (netsim_io), at its data space address. netsim watches the
+ *          slots that have an effect outside the AVR: the SLP_TR and RST pins
+ *          on PORTB, the UART, and the interrupt enables.
+ */
+#ifndef AVR_IO_H
+#define AVR_IO_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include "netsim.h"
+/*============================ MACROS ========================================*/
+#define NETSIM_REGISTER( address ) ( *netsim_io( address ) )
+
+#define PINF        NETSIM_REGISTER( 0x20 )
+#define UBRR0L      NETSIM_REGISTER( 0x29 )
+#define UCSR0B      NETSIM_REGISTER( 0x2A )
+#define UCSR0A      NETSIM_REGISTER( 0x2B ) //!< Reading it waits for the UART.
+#define UDR0        NETSIM_REGISTER( 0x2C ) //!< A write is a character sent.
+#define SPCR        NETSIM_REGISTER( 0x2D )
+#define SPSR        NETSIM_REGISTER( 0x2E )
+#define SPDR        NETSIM_REGISTER( 0x2F )
+#define PIND        NETSIM_REGISTER( 0x30 )
+#define DDRD        NETSIM_REGISTER( 0x31 )
+#define PORTD       NETSIM_REGISTER( 0x32 )
+#define PINB        NETSIM_REGISTER( 0x38 ) //!< The pins read back PORTB.
+#define DDRB        NETSIM_REGISTER( 0x37 )
+#define PORTB       NETSIM_REGISTER( 0x38 )
+#define WDTCR       NETSIM_REGISTER( 0x41 )
+#define ICR1        NETSIM_REGISTER( 0x46 )
+#define OCR1A       NETSIM_REGISTER( 0x4A )
+#define TCNT1       NETSIM_REGISTER( 0x4C )
+#define TCCR1B      NETSIM_REGISTER( 0x4E )
+#define TCCR1A      NETSIM_REGISTER( 0x4F )
+#define TCNT0       NETSIM_REGISTER( 0x52 )
+#define TCCR0       NETSIM_REGISTER( 0x53 )
+#define MCUCSR      NETSIM_REGISTER( 0x54 )
+#define MCUCR       NETSIM_REGISTER( 0x55 )
+#define TIFR        NETSIM_REGISTER( 0x56 )
+#define TIMSK       NETSIM_REGISTER( 0x57 )
+#define XDIV        NETSIM_REGISTER( 0x5C )
+#define SREG        NETSIM_REGISTER( 0x5F )
+#define DDRF        NETSIM_REGISTER( 0x61 )
+#define PORTF       NETSIM_REGISTER( 0x62 )
+#define ETIFR       NETSIM_REGISTER( 0x7C )
+#define ETIMSK      NETSIM_REGISTER( 0x7D )
+#define TCNT3       NETSIM_REGISTER( 0x88 )
+#define TCCR3B      NETSIM_REGISTER( 0x8A )
+#define TCCR3A      NETSIM_REGISTER( 0x8B )
+#define UBRR0H      NETSIM_REGISTER( 0x90 )
+#define UCSR0C      NETSIM_REGISTER( 0x95 )
+
+#define NETSIM_ADDRESS_PORTB    ( 0x38 )
+#define NETSIM_ADDRESS_UCSR0A   ( 0x2B )
+#define NETSIM_ADDRESS_UDR0     ( 0x2C )
+#define NETSIM_ADDRESS_UBRR0L   ( 0x29 )
+#define NETSIM_ADDRESS_UBRR0H   ( 0x90 )
+#define NETSIM_ADDRESS_TIMSK    ( 0x57 )
+#define NETSIM_ADDRESS_SREG     ( 0x5F )
+
+/*SREG.*/
+#define SREG_I      ( 7 )
+
+/*SPI.*/
+#define SPIF        ( 7 )
+#define SPE         ( 6 )
+#define MSTR        ( 4 )
+#define SPI2X       ( 0 )
+
+/*Timer/Counter1 and Timer/Counter3.*/
+#define ICES1       ( 6 )
+#define CS12        ( 2 )
+#define CS11        ( 1 )
+#define CS10        ( 0 )
+#define TICIE1      ( 5 )
+#define OCIE1A      ( 4 )
+#define OCIE1B      ( 3 )
+#define TOIE1       ( 2 )
+#define ICF1        ( 5 )
+#define OCF1A       ( 4 )
+#define OCF1B       ( 3 )
+#define TOV1        ( 2 )
+#define CS32        ( 2 )
+#define CS31        ( 1 )
+#define CS30        ( 0 )
+#define TICIE3      ( 5 )
+#define TOIE3       ( 2 )
+#define TOV3        ( 2 )
+
+/*USART0.*/
+#define RXC0        ( 7 )
+#define TXC0        ( 6 )
+#define UDRE0       ( 5 )
+#define U2X0        ( 1 )
+#define RXCIE0      ( 7 )
+#define TXCIE0      ( 6 )
+#define UDRIE0      ( 5 )
+#define RXEN0       ( 4 )
+#define TXEN0       ( 3 )
+#define UCSZ01      ( 2 )
+#define UCSZ00      ( 1 )
+
+/*MCU control and status.*/
+#define SE          ( 5 )
+#define SM2         ( 4 )
+#define SM1         ( 3 )
+#define SM0         ( 2 )
+#define JTRF        ( 4 )
+#define WDRF        ( 3 )
+#define BORF        ( 2 )
+#define EXTRF       ( 1 )
+#define PORF        ( 0 )
+#define XDIVEN      ( 7 )
+
+#define _BV( bit )  ( 1 << (bit) )
+#define RAMEND      ( 0x10FF )
+#define E2END       ( 0x0FFF )
+#endif
+/*EOF*/
@@ -0,0 +1,18 @@
+/*! \file pgmspace.h
+ *
+ *  \brief  Host version of avr/pgmspace.h for netsim. Flash is ordinary 
+ *          memory.
+ */
+#ifndef AVR_PGMSPACE_H
+#define AVR_PGMSPACE_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <string.h>
+/*============================ MACROS ========================================*/
+#define PROGMEM
+#define PSTR( string )              ( string )
+#define pgm_read_byte( address )    ( *(const uint8_t *)(address) )
+#define pgm_read_word( address )    ( *(const uint16_t *)(address) )
+#define memcpy_P( destination, source, length ) memcpy( (destination), (source), (length) )
+#endif
+/*EOF*/
@@ -0,0 +1,21 @@
+/*! \file sleep.h
+ *
+ *  \brief  Host version of avr/sleep.h for netsim. The IDLE sleep lasts 
+ *          until the next interrupt of the node.
+ */
+#ifndef AVR_SLEEP_H
+#define AVR_SLEEP_H
+/*============================ INCLUDE =======================================*/
+#include "netsim.h"
+/*============================ MACROS ========================================*/
+#define SLEEP_MODE_IDLE         ( 0 )
+#define SLEEP_MODE_PWR_SAVE     ( 1 )
+#define SLEEP_MODE_PWR_DOWN     ( 2 )
+#define SLEEP_MODE_EXT_STANDBY  ( 3 )
+
+#define set_sleep_mode( mode )  ( (void)(mode) )
+#define sleep_enable( )
+#define sleep_disable( )
+#define sleep_cpu( )            ( netsim_sleep( ) )
+#endif
+/*EOF*/
@@ -0,0 +1,24 @@
+/*! \file wdt.h
+ *
+ *  \brief  Host version of avr/wdt.h for netsim. The watchdog never bites, 
+ *          and a watchdog reset is a busy-wait point.
+ */
+#ifndef AVR_WDT_H
+#define AVR_WDT_H
+/*============================ INCLUDE =======================================*/
+#include "netsim.h"
+/*============================ MACROS ========================================*/
+#define WDTO_15MS   ( 0 )
+#define WDTO_30MS   ( 1 )
+#define WDTO_60MS   ( 2 )
+#define WDTO_120MS  ( 3 )
+#define WDTO_250MS  ( 4 )
+#define WDTO_500MS  ( 5 )
+#define WDTO_1S     ( 6 )
+#define WDTO_2S     ( 7 )
+
+#define wdt_enable( timeout )   ( (void)(timeout) )
+#define wdt_disable( )
+#define wdt_reset( )            ( netsim_idle( ) )
+#endif
+/*EOF*/
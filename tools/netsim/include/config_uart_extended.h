@@ -0,0 +1,18 @@
+/*! \file config_uart_extended.h
+ *
+ *  \brief  config_uart_extended.h of the image, with one short address per 
+ *          sender: SHORT_ADDRESS_NODE1 for the first sender, plus one for 
+ *          each further one.
+ */
+#ifndef NETSIM_CONFIG_UART_EXTENDED_H
+#define NETSIM_CONFIG_UART_EXTENDED_H
+/*============================ INCLUDE =======================================*/
+#include_next "config_uart_extended.h"
+#include "netsim.h"
+/*============================ MACROS ========================================*/
+#if defined( NODE1 )
+#undef SHORT_ADDRESS
+#define SHORT_ADDRESS ( (uint16_t)( SHORT_ADDRESS_NODE1 + netsim_node( ) - 1 ) )
+#endif
+#endif
+/*EOF*/
@@ -0,0 +1,19 @@
+/*! \file crc16.h
+ *
+ *  \brief  Host version of util/crc16.h for netsim: the C equivalent of
+ *          _crc_ccitt_update from avr-libc.
+ */
+#ifndef UTIL_CRC16_H
+#define UTIL_CRC16_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+/*============================ IMPLEMENTATION ================================*/
+static inline uint16_t _crc_ccitt_update( uint16_t crc, uint8_t data ){
+    
+    data ^= (uint8_t)(crc & 0xFF);
+    data ^= (uint8_t)(data << 4);
+    
+    return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+#endif
+/*EOF*/
@@ -0,0 +1,15 @@
+/*! \file delay.h
+ *
+ *  \brief  Host version of util/delay.h for netsim. A delay is busy-waiting
+ *          in simulated time, and is extended by the ISRs that run 
+ *          meanwhile, as on the AVR.
+ */
+#ifndef UTIL_DELAY_H
+#define UTIL_DELAY_H
+/*============================ INCLUDE =======================================*/
+#include "netsim.h"
+/*============================ MACROS ========================================*/
+#define _delay_us( us ) ( netsim_delay_us( us ) )
+#define _delay_ms( ms ) ( netsim_delay_us( (ms) * 1000.0 ) )
+#endif
+/*EOF*/
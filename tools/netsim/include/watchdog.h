@@ -0,0 +1,16 @@
+/*! \file watchdog.h
+ *
+ *  \brief  watchdog.h of the image, with WATCHDOG_KICK as a busy-wait point 
+ *          of netsim also without WATCHDOG: the main loops and the waits of 
+ *          the TAT call it on each pass.
+ */
+#ifndef NETSIM_WATCHDOG_H
+#define NETSIM_WATCHDOG_H
+/*============================ INCLUDE =======================================*/
+#include_next "watchdog.h"
+#include "netsim.h"
+/*============================ MACROS ========================================*/
+#undef WATCHDOG_KICK
+#define WATCHDOG_KICK( ) netsim_idle( )
+#endif
+/*EOF*/
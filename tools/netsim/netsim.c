@@ -0,0 +1,1973 @@
+/*! \file netsim.c
+ *
+ *  \brief  Runs many testsend nodes and one umspreceive node on the host, on
+ *          a simulated AT86RF231 each and a shared radio channel.
+ *
+ *          The firmware is executed, not modeled: build.sh compiles the
+ *          sources of each project, with hal_sim.c instead of hal_avr.c and
+ *          the headers of include/ instead of avr-libc, into a shared object.
+ *          Every node loads its own copy, so each has its own static data,
+ *          and runs its main as a coroutine. The image reaches netsim through
+ *          the functions of netsim.h:
+ *          - I/O registers: a register file per node. The SLP_TR, RST and SS
+ *            pins of PORTB drive the transceiver, UDR0 is the UART, and
+ *            SREG and TIMSK gate the interrupts.
+ *          - SPI: decoded for the transceiver of the node: register, frame
+ *            buffer and SRAM accesses.
+ *          - Timer1: the tick count, the input capture of the IRQ line and the
+ *            output compare of the HAL timer, at F_CPU / 64 of the node's own
+ *            clock (-y sets the spread of the clock error).
+ *          - Busy-wait points: the UART (UDRE), the flag getters of the HAL,
+ *            WATCHDOG_KICK, _delay_us/_delay_ms and sleep_cpu charge their time
+ *            and let the other nodes run. A waiting node takes its interrupts
+ *            (TIMER1_CAPT_vect, TIMER1_COMPA_vect) when SREG and TIMSK allow.
+ *
+ *          The transceiver model: state machine with the PLL and transition
+ *          times, IRQ_STATUS and IRQ_MASK, RX_AACK with address filter and
+ *          automatic acknowledge, TX_ARET with unslotted CSMA-CA (MIN_BE,
+ *          MAX_BE, MAX_CSMA_RETRIES, CSMA_SEED), acknowledge wait and
+ *          MAX_FRAME_RETRIES, automatic FCS, RX_SAFE_MODE, PHY_RSSI with
+ *          RND_VALUE, and CCA on energy against CCA_ED_THRES. The AES engine is
+ *          not modeled (see tools/aessim).
+ *
+ *          The channel: log-distance path loss with per link shadowing, frame
+ *          and acknowledge air time, and capture: a frame is received if the
+ *          radio was free at its PHR and the SINR stays above the capture
+ *          threshold for the whole frame.
+ *
+ *          The period, jitter, CSMA profiles, rx_pool size and baud rate are
+ *          those the images were built with (config_uart_extended.h of each
+ *          project). The report counts per sender what its transceiver did
+ *          with the unicast frames, and what the receiver printed on its UART,
+ *          parsed from the UART output. The rx_pool depth is the number of
+ *          frames to the receiver that it uploaded (hal_frame_read) and has
+ *          not printed yet; "RX Buffer Overflow!" empties it. The loss leaves
+ *          out a frame acknowledged just before the end and not printed yet
+ *          (in flight). All times are in nanoseconds. The simulation is
+ *          deterministic for a given seed.
+ *
+ *          Build: build.sh [output_directory]
+ *
+ *          Usage: netsim [-n senders] [-t seconds] [-s seed] [-r radius_m]
+ *                        [-c capture_db] [-m csma|tdma] [-y clock_error_ppm]
+ *                        [-d image_directory] [-x] [-v]
+ *
+ *          -m tdma runs the images built with TIME_SYNC and TDMA. The images
+ *          are looked up in the directory of netsim unless -d is given. -x
+ *          runs both modes for 2 to 32 senders and prints one line per run:
+ *          the offered, acknowledged and printed frames per second, the loss,
+ *          collisions, channel access failures and, for TDMA, the slot
+ *          utilisation of the coordinator (tdma_get_coordinator_statistics).
+ *          -v prints the UART output of every node on stderr.
+ */
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <dlfcn.h>
+#include <avr/io.h>
+#include "at86rf231.h"
+#include "netsim.h"
+/*============================ MACROS ========================================*/
+#define US_PER_SYMBOL           ( 16 )
+#define US_PER_BYTE             ( 32 )
+#define PHY_OVERHEAD_BYTES      ( 6 ) //!< Preamble, SFD and PHR.
+#define UNIT_BACKOFF_US         ( 20 * US_PER_SYMBOL )
+#define CCA_US                  ( 8 * US_PER_SYMBOL )
+#define TURNAROUND_US           ( 12 * US_PER_SYMBOL )
+#define ACK_PSDU_LENGTH         ( 5 )
+#define ACK_WAIT_US             ( 54 * US_PER_SYMBOL ) //!< macAckWaitDuration.
+
+#define TX_POWER_DBM            ( 3.0 )
+#define SENSITIVITY_DBM         ( -101.0 )
+#define NOISE_FLOOR_DBM         ( -105.0 )
+#define PATH_LOSS_1M_DB         ( 40.0 )
+#define PATH_LOSS_EXPONENT      ( 3.0 )
+#define SHADOWING_DB            ( 4.0 )
+
+#define MAX_NODES               ( 257 ) //!< Receiver plus 256 senders.
+#define MAX_TRANSMISSIONS       ( 1024 ) //!< Recent transmissions kept for interference.
+#define RECEIVER                ( 0 )
+
+#define NS_PER_US               ( 1000ULL )
+#define F_CPU_HZ                ( 8000000.0 )
+#define NS_PER_TICK             ( 8000.0 ) //!< Timer1 at F_CPU / 64.
+#define SPI_BYTE_NS             ( 2125 ) //!< 17 cycles: the transfer at F_CPU / 2 and the poll of SPIF.
+#define SPI_CALL_NS             ( 500 )
+#define POLL_NS                 ( 1000 ) //!< One pass of a flag polling loop.
+#define TICKS_NS                ( 500 ) //!< Reading TCNT1 and the 32-bit tick count.
+#define IDLE_NS                 ( 64000 ) //!< Longest time WATCHDOG_KICK stands for in a polling loop.
+#define ISR_NS                  ( 5000 ) //!< Vector, prologue and epilogue of an ISR.
+#define STACK_SIZE              ( 256 * 1024 )
+
+#define PIN_SS                  ( 0 ) //!< PORTB pins, see hal_avr.h.
+#define PIN_RST                 ( 4 )
+#define PIN_SLP_TR              ( 5 )
+
+#define RADIO_VERSION_NUM       ( 3 ) //!< Later than AT86RF231_VERSION_NUM: the TAT uses the retries of TX_ARET.
+#define STATE_CHANGE_US         ( 1 )
+#define TX_START_US             ( 16 ) //!< SLP_TR or TX_START to the preamble, without CSMA-CA.
+#define NO_CSMA                 ( 7 ) //!< MAX_CSMA_RETRIES that sends at once.
+#define FCF_FRAME_TYPE_ACK      ( 2 )
+#define FCF_ACK_REQUEST         ( 0x20 )
+#define FCF_ADDRESS_SHORT       ( 2 )
+#define FCF_ADDRESS_LONG        ( 3 )
+#define BROADCAST               ( 0xFFFF )
+
+#define UART_RECORD_CHARACTERS  ( 36 ) //!< rx_log_frame: 18 bytes in hex.
+#define IN_FLIGHT_NS            ( 200000000ULL ) //!< A frame acknowledged this close to the end may not be printed yet.
+#define UART_LOST_CHARACTERS    ( 4 ) //!< The count after "RX LOST ".
+#define UART_TAIL               ( 16 )
+#define UART_LINE               ( 160 )
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Event types. */
+typedef enum{
+    EVENT_BOOT,         //!< The node is powered and starts its main.
+    EVENT_WAKE,         //!< A waiting node goes on.
+    EVENT_COMPARE,      //!< Timer1 output compare of a node.
+    EVENT_STATE,        //!< The transceiver reaches the target of a state change.
+    EVENT_CCA_START,    //!< TX_ARET: the back-off is over.
+    EVENT_CCA_END,
+    EVENT_CCA_REQUEST,  //!< CCA_REQUEST of PHY_CC_CCA is done.
+    EVENT_TX_START,
+    EVENT_PHR,          //!< The PHR is on air: listeners synchronize.
+    EVENT_TX_END,
+    EVENT_ACK_TIMEOUT,
+    EVENT_ACK_START     //!< RX_AACK: the acknowledge goes on air.
+}event_type_t;
+
+typedef struct{
+    uint64_t time;
+    uint64_t order;      //!< Tie break, keeps the run deterministic.
+    event_type_t type;
+    int node;
+    int transmission;    //!< Index for EVENT_PHR, EVENT_TX_END and EVENT_ACK_START.
+    uint32_t generation; //!< Events of an earlier generation of the node or transceiver are stale.
+}event_t;
+
+/*! \brief  One frame or acknowledge on air. */
+typedef struct{
+    uint64_t start;
+    uint64_t end;
+    int source;
+    int destination;     //!< Node, -1 if none or broadcast.
+    bool is_ack;
+    uint8_t length;      //!< PSDU, as sent: taken at the PHR.
+    uint8_t psdu[ 128 ];
+}transmission_t;
+
+/*! \brief  State of an AT86RF231. */
+typedef struct{
+    uint8_t reg[ 0x40 ];
+    uint8_t fb[ RF231_RAM_SIZE ]; //!< Frame buffer and SRAM: the PHR at 0, then the PSDU.
+    uint8_t lqi;
+    uint8_t state;       //!< TRX_STATUS.
+    uint8_t target;      //!< State at the end of the transition.
+    bool transition;
+    uint8_t deferred;    //!< Command received in a BUSY_* state, done when it ends.
+    uint32_t generation; //!< Incremented on every state change, so pending events go stale.
+    bool irq_line;
+    bool rx_protected;   //!< RX_SAFE_MODE: a received frame was not read yet.
+
+    uint8_t spi_command;
+    uint8_t spi_address;
+    int spi_index;
+
+    int rx;              //!< Transmission being received, -1 if none.
+    bool rx_stored;      //!< It goes to the frame buffer.
+
+    int attempt;         //!< TX_ARET: transmission of the current frame.
+    int nb;              //!< CSMA-CA back-offs for this attempt.
+    int be;
+    uint64_t aret_start;
+    uint64_t cca_start;
+    uint8_t tx_sequence;
+
+    uint64_t csma_rng;   //!< Back-off random numbers, seeded from CSMA_SEED.
+    uint64_t noise_rng;  //!< RND_VALUE.
+}radio_t;
+
+/*! \brief  A node: its image, AVR and transceiver, and counters. */
+typedef struct{
+    int id;
+    double x, y;
+    void *image;
+    int (*entry)( void );
+    void (*capture_vector)( void );
+    void (*compare_vector)( void );
+    ucontext_t context;
+    void *stack;
+
+    uint16_t io[ NETSIM_IO_SIZE ];
+    uint8_t portb;       //!< PORTB as last seen by the transceiver.
+    uint64_t boot;
+    double rate;         //!< Clock of the node: local time per simulated time.
+
+    bool waiting;
+    bool wake_on_interrupt;
+    uint32_t wake_generation;
+    bool in_isr;
+    bool capture_pending; //!< ICF1 with the IRQ line.
+    uint64_t capture_time;
+    bool compare_pending; //!< OCF1A.
+    uint32_t compare_generation;
+    int uart_polls;      //!< UCSR0A reads in a row that found UDRE0 clear.
+    uint64_t uart_free;  //!< The UART has sent everything written to UDR0.
+    char line[ UART_LINE ];
+    int line_length;
+
+    radio_t radio;
+
+    uint64_t offered;    //!< Unicast frames sent with TX_ARET, once however often tat repeats them.
+    uint64_t acknowledged;
+    uint64_t channel_access_failures;
+    uint64_t no_ack;
+    uint64_t transmissions;
+    uint64_t access_delay_total;
+    uint64_t printed;    //!< Frames the receiver printed on the UART.
+    uint64_t duplicates; //!< Printed again: the acknowledge was lost.
+    int last_sequence;
+    int aret_sequence;   //!< Sequence number of the last unicast frame, -1 if none.
+    uint8_t aret_trac;   //!< Its outcome so far.
+    uint64_t aret_end;   //!< End of its last attempt.
+}node_t;
+
+/*! \brief  Receiver counters. */
+typedef struct{
+    uint64_t collisions;
+    uint64_t protection_drops; //!< Not stored: the frame buffer was protected.
+    uint64_t overflows;
+    uint64_t uart_overruns;
+    uint64_t uart_busy;
+    uint16_t lost_reported; //!< Last "RX LOST" count printed.
+
+    int depth;
+    int depth_max;
+    uint64_t depth_changed;
+    double depth_integral;
+
+    char tail[ UART_TAIL ];
+    uint8_t record[ UART_RECORD_CHARACTERS ];
+    int run;             //!< Hex characters of the record so far.
+    int lost_characters;
+    uint16_t lost_value;
+}receiver_t;
+
+/*! \brief  tdma_coordinator_statistics_t of tdma.h. The images are built
+ *          with -fpack-struct.
+ */
+typedef struct __attribute__(( packed )){
+    uint16_t superframes;
+    uint8_t slots;
+    uint16_t slot_length;
+    uint32_t allocated;
+    uint32_t used;
+    uint32_t frames;
+    uint16_t joins;
+    uint16_t leaves;
+}tdma_statistics_t;
+
+/*! \brief  Simulation parameters. */
+typedef struct{
+    int senders;
+    double seconds;
+    uint64_t seed;
+    double radius;
+    double capture_db;
+    bool tdma;
+    double clock_error_ppm;
+    const char *directory;
+    bool sweep;
+    bool verbose;
+}config_t;
+/*============================ VARIABLES =====================================*/
+static config_t config = {
+    .senders = 10, .seconds = 600.0, .seed = 1, .radius = 10.0, .capture_db = 4.0,
+    .clock_error_ppm = 20.0,
+};
+
+static event_t *events;
+static size_t event_count;
+static size_t event_capacity;
+static uint64_t event_order;
+
+static transmission_t transmissions[ MAX_TRANSMISSIONS ];
+static int transmission_next;
+
+static node_t nodes[ MAX_NODES ];
+static receiver_t receiver;
+static tdma_statistics_t tdma_statistics;
+static double link_dbm[ MAX_NODES ][ MAX_NODES ]; //!< Received power, transmitter to listener.
+static uint64_t rng_state;
+
+static uint64_t now;
+static uint64_t end;
+static node_t *current; //!< Node whose image runs, NULL in the scheduler.
+static ucontext_t scheduler_context;
+
+/*! \brief  Reset values of the transceiver registers that are not 0. */
+static const uint8_t radio_reset_values[ 0x40 ] = {
+    [ RG_TRX_STATUS ] = TRX_OFF, [ RG_TRX_CTRL_0 ] = 0x19, [ RG_TRX_CTRL_1 ] = 0x20,
+    [ RG_PHY_CC_CCA ] = 0x2B, [ RG_CCA_THRES ] = 0xC7, [ RG_RX_CTRL ] = 0xB7,
+    [ RG_SFD_VALUE ] = 0xA7, [ RG_ANT_DIV ] = 0x03, [ RG_XOSC_CTRL ] = 0xF0,
+    [ RG_FTN_CTRL ] = 0x58, [ RG_PLL_CF ] = 0x57, [ RG_PLL_DCU ] = 0x20,
+    [ RG_PART_NUM ] = AT86RF231_PART_NUM, [ RG_VERSION_NUM ] = RADIO_VERSION_NUM,
+    [ RG_MAN_ID_0 ] = 0x1F, [ RG_SHORT_ADDR_0 ] = 0xFF, [ RG_SHORT_ADDR_1 ] = 0xFF,
+    [ RG_PAN_ID_0 ] = 0xFF, [ RG_PAN_ID_1 ] = 0xFF, [ RG_XAH_CTRL_0 ] = 0x38,
+    [ RG_CSMA_SEED_0 ] = 0xEA, [ RG_CSMA_SEED_1 ] = 0x42, [ RG_CSMA_BE ] = 0x53,
+};
+/*============================ PROTOTYPES ====================================*/
+static void radio_command( node_t *node, uint8_t command );
+static void radio_csma_start( node_t *node );
+
+/*! \brief  xorshift64*, so runs do not depend on the C library. */
+static uint64_t rng_step( uint64_t *state ){
+
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 2685821657736338717ULL;
+}
+
+static uint64_t rng_next( void ){
+    return rng_step( &rng_state );
+}
+
+static double rng_uniform( void ){
+    return (double)(rng_next( ) >> 11) / 9007199254740992.0;
+}
+
+static double rng_gauss( void ){
+
+    double u1 = rng_uniform( ) + 1e-12;
+    double u2 = rng_uniform( );
+
+    return sqrt( -2.0 * log( u1 ) ) * cos( 2.0 * M_PI * u2 );
+}
+
+static double dbm_to_mw( double dbm ){
+    return pow( 10.0, dbm / 10.0 );
+}
+
+/*! \brief  Air time of a PSDU. */
+static uint64_t air_time( int psdu_length ){
+    return (uint64_t)(PHY_OVERHEAD_BYTES + psdu_length) * US_PER_BYTE * NS_PER_US;
+}
+
+static uint16_t crc_ccitt( const uint8_t *data, int length ){
+
+    uint16_t crc = 0;
+
+    for (int i = 0; i < length; i++) {
+
+        crc ^= data[ i ];
+
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : (crc >> 1);
+        }
+    }
+
+    return crc;
+}
+
+/*============================ EVENT QUEUE ===================================*/
+
+static bool event_before( const event_t *a, const event_t *b ){
+    return (a->time < b->time) || ((a->time == b->time) && (a->order < b->order));
+}
+
+static void event_schedule( uint64_t time, event_type_t type, int node, int transmission, uint32_t generation ){
+
+    if (event_count == event_capacity) {
+
+        event_capacity = event_capacity ? 2 * event_capacity : 1024;
+        events = realloc( events, event_capacity * sizeof( event_t ) );
+
+        if (events == NULL) {
+            perror( "realloc" );
+            exit( 1 );
+        }
+    }
+
+    event_t event = { time, event_order++, type, node, transmission, generation };
+    size_t i = event_count++;
+
+    while ((i > 0) && event_before( &event, &events[ (i - 1) / 2 ] )) {
+        events[ i ] = events[ (i - 1) / 2 ];
+        i = (i - 1) / 2;
+    }
+
+    events[ i ] = event;
+}
+
+static event_t event_pop( void ){
+
+    event_t top = events[ 0 ];
+    event_t last = events[ --event_count ];
+    size_t i = 0;
+
+    for (;;) {
+
+        size_t child = 2 * i + 1;
+
+        if (child >= event_count) { break; }
+        if ((child + 1 < event_count) && event_before( &events[ child + 1 ], &events[ child ] )) { child++; }
+        if (!event_before( &events[ child ], &last )) { break; }
+
+        events[ i ] = events[ child ];
+        i = child;
+    }
+
+    events[ i ] = last;
+
+    return top;
+}
+
+/*============================ CHANNEL =======================================*/
+
+/*! \brief  Place the senders at random within the radius of the receiver and
+ *          draw the shadowing of every link.
+ */
+static void channel_init( void ){
+
+    double x[ MAX_NODES ] = { 0.0 };
+    double y[ MAX_NODES ] = { 0.0 };
+
+    for (int i = 1; i <= config.senders; i++) {
+
+        double r = config.radius * sqrt( rng_uniform( ) );
+        double a = 2.0 * M_PI * rng_uniform( );
+
+        x[ i ] = r * cos( a );
+        y[ i ] = r * sin( a );
+        nodes[ i ].x = x[ i ];
+        nodes[ i ].y = y[ i ];
+    }
+
+    for (int i = 0; i <= config.senders; i++) {
+
+        for (int j = i + 1; j <= config.senders; j++) {
+
+            double d = hypot( x[ i ] - x[ j ], y[ i ] - y[ j ] );
+
+            if (d < 1.0) { d = 1.0; }
+
+            double loss = PATH_LOSS_1M_DB + 10.0 * PATH_LOSS_EXPONENT * log10( d ) +
+                          SHADOWING_DB * rng_gauss( );
+
+            link_dbm[ i ][ j ] = TX_POWER_DBM - loss;
+            link_dbm[ j ][ i ] = TX_POWER_DBM - loss;
+        }
+    }
+}
+
+static int transmission_add( uint64_t start, uint64_t end, int source, int destination, bool is_ack ){
+
+    int index = transmission_next;
+
+    transmission_next = (transmission_next + 1) % MAX_TRANSMISSIONS;
+    transmissions[ index ] = (transmission_t){ start, end, source, destination, is_ack };
+
+    return index;
+}
+
+/*! \brief  Sum of the power, in mW, of all transmissions other than skip that
+ *          overlap [start, end] at the listener.
+ */
+static double interference_mw( int listener, uint64_t start, uint64_t end, int skip ){
+
+    double sum = 0.0;
+
+    for (int i = 0; i < MAX_TRANSMISSIONS; i++) {
+
+        const transmission_t *t = &transmissions[ i ];
+
+        if ((i == skip) || (t->end == 0) || (t->source == listener)) { continue; }
+        if ((t->start >= end) || (t->end <= start)) { continue; }
+
+        sum += dbm_to_mw( link_dbm[ t->source ][ listener ] );
+    }
+
+    return sum;
+}
+
+/*! \brief  Did the listener receive transmission index? */
+static bool transmission_received( int listener, int index ){
+
+    const transmission_t *t = &transmissions[ index ];
+    double signal = link_dbm[ t->source ][ listener ];
+
+    if (signal < SENSITIVITY_DBM) { return false; }
+
+    double noise = dbm_to_mw( NOISE_FLOOR_DBM ) + interference_mw( listener, t->start, t->end, index );
+
+    return (signal - 10.0 * log10( noise )) >= config.capture_db;
+}
+
+/*! \brief  Energy on the channel at the listener now, in dBm. */
+static double channel_dbm( int listener, uint64_t start ){
+
+    double noise = dbm_to_mw( NOISE_FLOOR_DBM ) + interference_mw( listener, start, now + 1, -1 );
+
+    return 10.0 * log10( noise );
+}
+
+/*============================ NODE ==========================================*/
+
+static int node_count( void ){
+    return config.senders + 1;
+}
+
+/*! \brief  Node with the short address, -1 if none. */
+static int node_by_short_address( uint16_t address ){
+
+    for (int i = 0; i < node_count( ); i++) {
+
+        const uint8_t *reg = nodes[ i ].radio.reg;
+
+        if ((reg[ RG_SHORT_ADDR_0 ] | (reg[ RG_SHORT_ADDR_1 ] << 8)) == address) { return i; }
+    }
+
+    return -1;
+}
+
+/*! \brief  Timer1 ticks of the node at the time. */
+static uint64_t node_ticks( const node_t *node, uint64_t time ){
+    return (uint64_t)((double)(time - node->boot) * node->rate / NS_PER_TICK);
+}
+
+static bool node_interrupt_ready( const node_t *node ){
+
+    if (node->in_isr || !(node->io[ NETSIM_ADDRESS_SREG ] & _BV( SREG_I ))) { return false; }
+
+    uint16_t timsk = node->io[ NETSIM_ADDRESS_TIMSK ];
+
+    return (node->capture_pending && (timsk & _BV( TICIE1 ))) ||
+           (node->compare_pending && (timsk & _BV( OCIE1A )));
+}
+
+/*! \brief  An interrupt flag of the node was set: a node that waits for one
+ *          goes on now.
+ */
+static void node_interrupt( node_t *node ){
+
+    if (!node->waiting || !node->wake_on_interrupt || !node_interrupt_ready( node )) { return; }
+
+    node->wake_on_interrupt = false;
+    event_schedule( now, EVENT_WAKE, node->id, -1, ++node->wake_generation );
+}
+
+/*! \brief  The current node waits until the time, or an interrupt if
+ *          on_interrupt. It runs on if no other event comes first.
+ */
+static void node_wait( uint64_t until, bool on_interrupt ){
+
+    node_t *node = current;
+
+    if (on_interrupt && node_interrupt_ready( node )) { return; }
+    if (until <= now) { return; }
+
+    if ((until < end) && ((event_count == 0) || (events[ 0 ].time > until))) {
+        now = until;
+        return;
+    }
+
+    node->waiting = true;
+    node->wake_on_interrupt = on_interrupt;
+    event_schedule( until, EVENT_WAKE, node->id, -1, ++node->wake_generation );
+
+    swapcontext( &node->context, &scheduler_context );
+
+    node->waiting = false;
+    node->wake_on_interrupt = false;
+}
+
+/*! \brief  Run the pending ISRs of the current node. The input capture has
+ *          the higher priority, as on the ATmega128.
+ */
+static void node_deliver( void ){
+
+    node_t *node = current;
+
+    while (node_interrupt_ready( node )) {
+
+        void (*vector)( void );
+
+        if (node->capture_pending && (node->io[ NETSIM_ADDRESS_TIMSK ] & _BV( TICIE1 ))) {
+            node->capture_pending = false;
+            vector = node->capture_vector;
+        } else {
+            node->compare_pending = false;
+            vector = node->compare_vector;
+        }
+
+        node->io[ NETSIM_ADDRESS_SREG ] &= (uint16_t)~_BV( SREG_I );
+        node->in_isr = true;
+        node_wait( now + ISR_NS, false );
+
+        vector( );
+
+        node->in_isr = false;
+        node->io[ NETSIM_ADDRESS_SREG ] |= _BV( SREG_I ); //reti.
+    }
+}
+
+/*! \brief  Time of one character on the UART of the node, 8-N-1. */
+static uint64_t node_uart_character( const node_t *node ){
+
+    uint16_t ubrr = ((node->io[ NETSIM_ADDRESS_UBRR0H ] & 0x0F) << 8) | (node->io[ NETSIM_ADDRESS_UBRR0L ] & 0xFF);
+    double divisor = (node->io[ NETSIM_ADDRESS_UCSR0A ] & _BV( U2X0 )) ? 8.0 : 16.0;
+
+    return (uint64_t)(10.0 * divisor * (ubrr + 1) * 1e9 / F_CPU_HZ);
+}
+
+/*============================ RECEIVER ======================================*/
+
+static void receiver_depth( int depth ){
+
+    receiver.depth_integral += (double)receiver.depth * (double)(now - receiver.depth_changed);
+    receiver.depth_changed = now;
+    receiver.depth = (depth > 0) ? depth : 0;
+
+    if (receiver.depth > receiver.depth_max) { receiver.depth_max = receiver.depth; }
+}
+
+static int hex_value( char c ){
+
+    if ((c >= '0') && (c <= '9')) { return c - '0'; }
+    if ((c >= 'A') && (c <= 'F')) { return c - 'A' + 10; }
+
+    return -1;
+}
+
+/*! \brief  A frame printed by rx_log_frame: the source address and the
+ *          sequence number are record bytes 9, 10 and 6.
+ */
+static void receiver_record( void ){
+
+    uint8_t byte[ UART_RECORD_CHARACTERS / 2 ];
+
+    for (int i = 0; i < UART_RECORD_CHARACTERS / 2; i++) {
+        byte[ i ] = (receiver.record[ 2 * i ] << 4) | receiver.record[ 2 * i + 1 ];
+    }
+
+    receiver_depth( receiver.depth - 1 );
+
+    int source = node_by_short_address( (byte[ 9 ] << 8) | byte[ 10 ] );
+
+    if (source <= RECEIVER) { return; }
+
+    if (nodes[ source ].last_sequence == byte[ 6 ]) {
+        nodes[ source ].duplicates++;
+    } else {
+        nodes[ source ].printed++;
+        nodes[ source ].last_sequence = byte[ 6 ];
+    }
+}
+
+/*! \brief  Parse the UART output of the receiver. */
+static void receiver_uart( char c ){
+
+    memmove( receiver.tail, receiver.tail + 1, UART_TAIL - 1 );
+    receiver.tail[ UART_TAIL - 1 ] = c;
+
+    if (receiver.lost_characters > 0) {
+
+        receiver.lost_value = (receiver.lost_value << 4) | (hex_value( c ) & 0x0F);
+
+        if (--receiver.lost_characters == 0) { receiver.lost_reported = receiver.lost_value; }
+
+        return;
+    }
+
+    if (memcmp( receiver.tail + UART_TAIL - 5, "LOST ", 5 ) == 0) {
+
+        receiver.lost_characters = UART_LOST_CHARACTERS;
+        receiver.lost_value = 0;
+    } else if (memcmp( receiver.tail + UART_TAIL - 8, "Overflow", 8 ) == 0) {
+
+        receiver.overflows++;
+        receiver_depth( 0 );
+    }
+
+    int value = hex_value( c );
+
+    if (value < 0) {
+        receiver.run = 0;
+        return;
+    }
+
+    receiver.record[ receiver.run++ ] = value;
+
+    if (receiver.run == UART_RECORD_CHARACTERS) {
+        receiver.run = 0;
+        receiver_record( );
+    }
+}
+
+/*============================ UART ==========================================*/
+
+/*! \brief  A character written to UDR0 goes out after the ones before it. */
+static void uart_send( node_t *node, uint8_t c ){
+
+    uint64_t character = node_uart_character( node );
+
+    if (node->uart_free > now + character) {
+
+        if (node->id == RECEIVER) { receiver.uart_overruns++; }
+
+        return; //UDR0 was not empty.
+    }
+
+    if (node->uart_free < now) { node->uart_free = now; }
+
+    node->uart_free += character;
+
+    if (node->id == RECEIVER) {
+        receiver.uart_busy += character;
+        receiver_uart( (char)c );
+    }
+
+    if (config.verbose) {
+
+        if ((c == '\r') || (c == '\n') || (node->line_length == UART_LINE - 1)) {
+
+            if (node->line_length > 0) {
+                node->line[ node->line_length ] = '\0';
+                fprintf( stderr, "%12.6f %3d %s\n", (double)now / 1e9, node->id, node->line );
+                node->line_length = 0;
+            }
+        } else if ((c >= ' ') && (c < 0x7F)) {
+            node->line[ node->line_length++ ] = (char)c;
+        }
+    }
+}
+
+/*============================ TRANSCEIVER ===================================*/
+
+static uint8_t radio_field( const radio_t *radio, uint8_t address, uint8_t mask, uint8_t position ){
+    return (radio->reg[ address ] & mask) >> position;
+}
+
+static bool radio_busy( const radio_t *radio ){
+
+    return (radio->state == BUSY_RX) || (radio->state == BUSY_TX) ||
+           (radio->state == BUSY_RX_AACK) || (radio->state == BUSY_TX_ARET);
+}
+
+/*! \brief  The IRQ line follows IRQ_STATUS and IRQ_MASK. Its rising edge is
+ *          the input capture of Timer1.
+ */
+static void radio_irq_update( node_t *node ){
+
+    radio_t *radio = &node->radio;
+    bool line = (radio->reg[ RG_IRQ_STATUS ] & radio->reg[ RG_IRQ_MASK ]) != 0;
+
+    if (line && !radio->irq_line) {
+        node->capture_time = now;
+        node->capture_pending = true;
+        node_interrupt( node );
+    }
+
+    radio->irq_line = line;
+}
+
+static void radio_irq( node_t *node, uint8_t irq ){
+
+    node->radio.reg[ RG_IRQ_STATUS ] |= irq & node->radio.reg[ RG_IRQ_MASK ];
+    radio_irq_update( node );
+}
+
+/*! \brief  The back-off sequence depends on the 11 bits of CSMA_SEED only, so
+ *          nodes with the same seed back off alike.
+ */
+static void radio_seed( radio_t *radio ){
+
+    uint64_t seed = ((radio->reg[ RG_CSMA_SEED_1 ] & 0x07) << 8) | radio->reg[ RG_CSMA_SEED_0 ];
+
+    radio->csma_rng = (seed + 1) * 0x9E3779B97F4A7C15ULL;
+}
+
+static void radio_reset( node_t *node ){
+
+    radio_t *radio = &node->radio;
+    uint32_t generation = radio->generation + 1;
+    uint64_t noise_rng = radio->noise_rng;
+
+    memset( radio, 0, sizeof( radio_t ) );
+    memcpy( radio->reg, radio_reset_values, sizeof( radio->reg ) );
+
+    radio->state = TRX_OFF;
+    radio->generation = generation;
+    radio->rx = -1;
+    radio->noise_rng = noise_rng;
+    radio_seed( radio );
+}
+
+/*! \brief  Start a state change that takes us microseconds. */
+static void radio_go( node_t *node, uint8_t target, uint64_t us ){
+
+    radio_t *radio = &node->radio;
+
+    radio->transition = true;
+    radio->target = target;
+    event_schedule( now + us * NS_PER_US, EVENT_STATE, node->id, -1, ++radio->generation );
+}
+
+/*! \brief  Back from a BUSY_* state, then do the command that came meanwhile. */
+static void radio_idle( node_t *node, uint8_t state ){
+
+    radio_t *radio = &node->radio;
+
+    radio->state = state;
+    radio->rx = -1;
+    radio->generation++;
+
+    if (radio->deferred != CMD_NOP) {
+
+        uint8_t command = radio->deferred;
+
+        radio->deferred = CMD_NOP;
+        radio_command( node, command );
+    }
+}
+
+/*! \brief  End of TX_ARET: TRAC_STATUS, TRX_END and TX_ARET_ON. Counted for
+ *          unicast frames with an acknowledge request. A frame that tat sends
+ *          again (the same sequence number) is counted once, with the outcome
+ *          of its last attempt.
+ */
+static void radio_aret_end( node_t *node, uint8_t trac ){
+
+    radio_t *radio = &node->radio;
+    uint16_t fcf = radio->fb[ 1 ] | (radio->fb[ 2 ] << 8);
+    uint16_t destination = radio->fb[ 6 ] | (radio->fb[ 7 ] << 8);
+
+    if ((fcf & FCF_ACK_REQUEST) && (((fcf >> 10) & 3) == FCF_ADDRESS_SHORT) && (destination != BROADCAST)) {
+
+        node->access_delay_total += now - radio->aret_start;
+
+        if (node->aret_sequence == radio->fb[ 3 ]) {
+
+            if (node->aret_trac == TRAC_SUCCESS) {
+                node->acknowledged--;
+            } else if (node->aret_trac == TRAC_CHANNEL_ACCESS_FAILURE) {
+                node->channel_access_failures--;
+            } else {
+                node->no_ack--;
+            }
+        } else {
+            node->offered++;
+        }
+
+        node->aret_sequence = radio->fb[ 3 ];
+        node->aret_trac = trac;
+        node->aret_end = now;
+
+        if (trac == TRAC_SUCCESS) {
+            node->acknowledged++;
+        } else if (trac == TRAC_CHANNEL_ACCESS_FAILURE) {
+            node->channel_access_failures++;
+        } else {
+            node->no_ack++;
+        }
+    }
+
+    radio->reg[ RG_TRX_STATE ] = (radio->reg[ RG_TRX_STATE ] & 0x1F) | (trac << 5);
+    radio_irq( node, TRX_IRQ_TRX_END );
+    radio_idle( node, TX_ARET_ON );
+}
+
+static void radio_backoff( node_t *node ){
+
+    radio_t *radio = &node->radio;
+    uint64_t periods = (rng_step( &radio->csma_rng ) >> 32) % (1u << radio->be);
+
+    event_schedule( now + periods * UNIT_BACKOFF_US * NS_PER_US, EVENT_CCA_START, node->id, -1, radio->generation );
+}
+
+/*! \brief  One attempt of TX_ARET: unslotted CSMA-CA, or none if
+ *          MAX_CSMA_RETRIES is 7.
+ */
+static void radio_csma_start( node_t *node ){
+
+    radio_t *radio = &node->radio;
+
+    radio->nb = 0;
+    radio->be = radio_field( radio, SR_MIN_BE );
+
+    if (radio_field( radio, SR_MAX_CSMA_RETRIES ) == NO_CSMA) {
+        event_schedule( now + TX_START_US * NS_PER_US, EVENT_TX_START, node->id, -1, radio->generation );
+    } else {
+        radio_backoff( node );
+    }
+}
+
+static void radio_aret_start( node_t *node ){
+
+    radio_t *radio = &node->radio;
+
+    radio->state = BUSY_TX_ARET;
+    radio->generation++;
+    radio->attempt = 0;
+    radio->aret_start = now;
+    radio_csma_start( node );
+}
+
+static void radio_tx_start( node_t *node ){
+
+    radio_t *radio = &node->radio;
+
+    radio->state = BUSY_TX;
+    radio->generation++;
+    event_schedule( now + TX_START_US * NS_PER_US, EVENT_TX_START, node->id, -1, radio->generation );
+}
+
+static void radio_command( node_t *node, uint8_t command ){
+
+    radio_t *radio = &node->radio;
+
+    switch (command) {
+    case CMD_FORCE_TRX_OFF:
+        radio->deferred = CMD_NOP;
+        radio->rx = -1;
+        radio_go( node, TRX_OFF, STATE_CHANGE_US );
+        break;
+
+    case CMD_FORCE_PLL_ON:
+        if ((radio->state == TRX_OFF) || (radio->state == TRX_SLEEP)) { break; }
+
+        radio->deferred = CMD_NOP;
+        radio->rx = -1;
+        radio_go( node, PLL_ON, STATE_CHANGE_US );
+        break;
+
+    case CMD_TX_START:
+        if (radio->transition) { break; }
+        if (radio->state == PLL_ON) {
+            radio_tx_start( node );
+        } else if (radio->state == TX_ARET_ON) {
+            radio_aret_start( node );
+        }
+        break;
+
+    case CMD_TRX_OFF:
+    case CMD_PLL_ON:
+    case CMD_RX_ON:
+    case CMD_RX_AACK_ON:
+    case CMD_TX_ARET_ON:
+        if (radio_busy( radio )) {
+            radio->deferred = command;
+            break;
+        }
+
+        if ((radio->state == TRX_SLEEP) || ((radio->state == command) && !radio->transition)) { break; }
+
+        radio_go( node, command, ((radio->state == TRX_OFF) && (command != CMD_TRX_OFF)) ?
+                                 PLL_LOCK_TIME_US : STATE_CHANGE_US );
+        break;
+
+    default:
+        break;
+    }
+}
+
+/*! \brief  SLP_TR: sleep from TRX_OFF, or send from PLL_ON and TX_ARET_ON. */
+static void radio_slp_tr( node_t *node, bool high ){
+
+    radio_t *radio = &node->radio;
+
+    if (!high) {
+        if (radio->state == TRX_SLEEP) { radio_go( node, TRX_OFF, SLEEP_TO_TRX_OFF_US ); }
+        return;
+    }
+
+    if (radio->transition) { return; }
+
+    if (radio->state == TRX_OFF) {
+        radio->state = TRX_SLEEP;
+        radio->generation++;
+    } else if (radio->state == PLL_ON) {
+        radio_tx_start( node );
+    } else if (radio->state == TX_ARET_ON) {
+        radio_aret_start( node );
+    }
+}
+
+/*! \brief  A listener at the PHR: a free receiver synchronizes, and stores
+ *          the frame unless the frame buffer is protected.
+ */
+static void radio_rx_start( node_t *node, int index ){
+
+    radio_t *radio = &node->radio;
+    const transmission_t *t = &transmissions[ index ];
+
+    if (link_dbm[ t->source ][ node->id ] < SENSITIVITY_DBM) { return; }
+
+    if (radio->transition || ((radio->state != RX_ON) && (radio->state != RX_AACK_ON))) {
+
+        if ((node->id == RECEIVER) && !t->is_ack && (t->destination == RECEIVER)) { receiver.collisions++; }
+
+        return;
+    }
+
+    radio->state = (radio->state == RX_ON) ? BUSY_RX : BUSY_RX_AACK;
+    radio->generation++;
+    radio->rx = index;
+    radio->rx_stored = !radio->rx_protected;
+
+    if (radio->rx_stored) { radio->fb[ 0 ] = t->length; }
+
+    radio_irq( node, TRX_IRQ_RX_START );
+}
+
+/*! \brief  RX_AACK frame filter, for a PAN ID and short or long address. */
+static bool radio_aack_accept( const radio_t *radio, const transmission_t *t ){
+
+    uint16_t fcf = t->psdu[ 0 ] | (t->psdu[ 1 ] << 8);
+    uint16_t pan = t->psdu[ 3 ] | (t->psdu[ 4 ] << 8);
+    uint16_t own_pan = radio->reg[ RG_PAN_ID_0 ] | (radio->reg[ RG_PAN_ID_1 ] << 8);
+
+    if ((fcf & 7) == FCF_FRAME_TYPE_ACK) { return false; }
+    if (radio_field( radio, SR_AACK_PROM_MODE )) { return true; }
+
+    switch ((fcf >> 10) & 3) {
+    case FCF_ADDRESS_SHORT: {
+
+        uint16_t address = t->psdu[ 5 ] | (t->psdu[ 6 ] << 8);
+        uint16_t own = radio->reg[ RG_SHORT_ADDR_0 ] | (radio->reg[ RG_SHORT_ADDR_1 ] << 8);
+
+        return ((pan == own_pan) || (pan == BROADCAST)) && ((address == own) || (address == BROADCAST));
+    }
+
+    case FCF_ADDRESS_LONG:
+        return ((pan == own_pan) || (pan == BROADCAST)) &&
+               (memcmp( &t->psdu[ 5 ], &radio->reg[ RG_IEEE_ADDR_0 ], 8 ) == 0);
+
+    default:
+        return ((fcf & 7) == 0) || radio_field( radio, SR_AACK_I_AM_COORD ); //Beacons, or to the coordinator.
+    }
+}
+
+/*! \brief  A listener at the end of the frame it synchronized to. */
+static void radio_rx_end( node_t *node, int index ){
+
+    radio_t *radio = &node->radio;
+    const transmission_t *t = &transmissions[ index ];
+    uint8_t base = (radio->state == BUSY_RX) ? RX_ON : RX_AACK_ON;
+    bool received = transmission_received( node->id, index );
+    bool to_receiver = (node->id == RECEIVER) && !t->is_ack && (t->destination == RECEIVER);
+
+    if (!radio->rx_stored) {
+
+        if (to_receiver) { receiver.protection_drops++; }
+
+        radio_idle( node, base );
+        return;
+    }
+
+    memcpy( &radio->fb[ 1 ], t->psdu, t->length );
+
+    if (!received) {
+
+        radio->fb[ 1 + (rng_step( &radio->noise_rng ) % t->length) ] ^= 0x5A;
+
+        if (to_receiver) { receiver.collisions++; }
+    }
+
+    radio->lqi = received ? 0xFF : 0x00;
+    radio->reg[ RG_PHY_RSSI ] = received ? 0x80 : 0x00;
+
+    if ((base == RX_AACK_ON) && (!received || !radio_aack_accept( radio, t ))) {
+        radio_idle( node, base );
+        return;
+    }
+
+    if (radio_field( radio, SR_RX_SAFE_MODE )) { radio->rx_protected = true; }
+
+    radio_irq( node, TRX_IRQ_TRX_END );
+
+    uint16_t destination = t->psdu[ 5 ] | (t->psdu[ 6 ] << 8);
+
+    if ((base == RX_AACK_ON) && (t->psdu[ 0 ] & FCF_ACK_REQUEST) && (destination != BROADCAST) &&
+        !radio_field( radio, SR_AACK_DIS_ACK )) {
+
+        radio->rx = -1;
+        event_schedule( now + TURNAROUND_US * NS_PER_US, EVENT_ACK_START, node->id, index, radio->generation );
+        return;
+    }
+
+    radio_idle( node, base );
+}
+
+/*! \brief  The frame buffer goes on air: the PSDU at the PHR, with the FCS if
+ *          TX_AUTO_CRC_ON.
+ */
+static void radio_transmit( node_t *node ){
+
+    radio_t *radio = &node->radio;
+    uint8_t length = radio->fb[ 0 ] & 0x7F;
+    int index = transmission_add( now, now + air_time( length ), node->id, -1, false );
+
+    event_schedule( now + PHY_OVERHEAD_BYTES * US_PER_BYTE * NS_PER_US, EVENT_PHR, node->id, index, radio->generation );
+    event_schedule( transmissions[ index ].end, EVENT_TX_END, node->id, index, radio->generation );
+}
+
+static void radio_phr( node_t *node, int index, bool current_generation ){
+
+    radio_t *radio = &node->radio;
+    transmission_t *t = &transmissions[ index ];
+
+    if (!t->is_ack) {
+
+        t->length = radio->fb[ 0 ] & 0x7F;
+        memcpy( t->psdu, &radio->fb[ 1 ], t->length );
+
+        if (radio_field( radio, SR_TX_AUTO_CRC_ON ) && (t->length >= 2)) {
+
+            uint16_t crc = crc_ccitt( t->psdu, t->length - 2 );
+
+            t->psdu[ t->length - 2 ] = crc & 0xFF;
+            t->psdu[ t->length - 1 ] = crc >> 8;
+        }
+
+        uint16_t destination = t->psdu[ 5 ] | (t->psdu[ 6 ] << 8);
+
+        t->destination = (destination == BROADCAST) ? -1 : node_by_short_address( destination );
+        radio->tx_sequence = t->psdu[ 2 ];
+
+        if (current_generation && (radio->state == BUSY_TX_ARET) && (t->psdu[ 0 ] & FCF_ACK_REQUEST)) {
+            node->transmissions++;
+        }
+    }
+
+    for (int i = 0; i < node_count( ); i++) {
+        if (i != node->id) { radio_rx_start( &nodes[ i ], index ); }
+    }
+}
+
+static void radio_tx_end( node_t *node, int index, bool current_generation ){
+
+    radio_t *radio = &node->radio;
+    const transmission_t *t = &transmissions[ index ];
+
+    for (int i = 0; i < node_count( ); i++) {
+        if ((i != node->id) && (nodes[ i ].radio.rx == index)) { radio_rx_end( &nodes[ i ], index ); }
+    }
+
+    //The acknowledge of the frame a TX_ARET waits for.
+    if (t->is_ack && (t->destination >= 0)) {
+
+        node_t *sender = &nodes[ t->destination ];
+
+        if ((sender->radio.state == BUSY_TX_ARET) && (t->psdu[ 2 ] == sender->radio.tx_sequence) && transmission_received( sender->id, index )) {
+            radio_aret_end( sender, TRAC_SUCCESS );
+        }
+    }
+
+    if (!current_generation) { return; }
+
+    if (t->is_ack) {
+        radio_idle( node, RX_AACK_ON );
+    } else if (radio->state == BUSY_TX) {
+        radio_irq( node, TRX_IRQ_TRX_END );
+        radio_idle( node, PLL_ON );
+    } else if (radio->state == BUSY_TX_ARET) {
+
+        uint16_t destination = t->psdu[ 5 ] | (t->psdu[ 6 ] << 8);
+
+        if ((t->psdu[ 0 ] & FCF_ACK_REQUEST) && (destination != BROADCAST)) {
+            event_schedule( now + ACK_WAIT_US * NS_PER_US, EVENT_ACK_TIMEOUT, node->id, -1, radio->generation );
+        } else {
+            radio_aret_end( node, TRAC_SUCCESS );
+        }
+    }
+}
+
+static void radio_ack_timeout( node_t *node ){
+
+    radio_t *radio = &node->radio;
+
+    if (++radio->attempt > radio_field( radio, SR_MAX_FRAME_RETRIES )) {
+        radio_aret_end( node, TRAC_NO_ACK );
+    } else {
+        radio_csma_start( node );
+    }
+}
+
+static void radio_ack_start( node_t *node, int frame ){
+
+    const transmission_t *t = &transmissions[ frame ];
+    int index = transmission_add( now, now + air_time( ACK_PSDU_LENGTH ), node->id, t->source, true );
+    transmission_t *ack = &transmissions[ index ];
+    uint16_t crc;
+
+    ack->length = ACK_PSDU_LENGTH;
+    ack->psdu[ 0 ] = FCF_FRAME_TYPE_ACK;
+    ack->psdu[ 1 ] = 0;
+    ack->psdu[ 2 ] = t->psdu[ 2 ];
+    crc = crc_ccitt( ack->psdu, 3 );
+    ack->psdu[ 3 ] = crc & 0xFF;
+    ack->psdu[ 4 ] = crc >> 8;
+
+    event_schedule( now + PHY_OVERHEAD_BYTES * US_PER_BYTE * NS_PER_US, EVENT_PHR, node->id, index, node->radio.generation );
+    event_schedule( ack->end, EVENT_TX_END, node->id, index, node->radio.generation );
+}
+
+static void radio_cca_end( node_t *node ){
+
+    radio_t *radio = &node->radio;
+    double threshold = RSSI_BASE_VAL + 2.0 * radio_field( radio, SR_CCA_ED_THRES );
+
+    if (channel_dbm( node->id, radio->cca_start ) < threshold) {
+        event_schedule( now + TURNAROUND_US * NS_PER_US, EVENT_TX_START, node->id, -1, radio->generation );
+        return;
+    }
+
+    if (++radio->nb > radio_field( radio, SR_MAX_CSMA_RETRIES )) {
+        radio_aret_end( node, TRAC_CHANNEL_ACCESS_FAILURE );
+        return;
+    }
+
+    radio->be++;
+
+    if (radio->be > radio_field( radio, SR_MAX_BE )) { radio->be = radio_field( radio, SR_MAX_BE ); }
+
+    radio_backoff( node );
+}
+
+/*! \brief  RSSI or ED level of the channel now, in steps above RSSI_BASE_VAL. */
+static uint8_t radio_level( const node_t *node, int step, int maximum ){
+
+    int level = (int)floor( (channel_dbm( node->id, now ) - RSSI_BASE_VAL) / step );
+
+    return (level < 0) ? 0 : ((level > maximum) ? maximum : level);
+}
+
+static uint8_t radio_register_read( node_t *node, uint8_t address ){
+
+    radio_t *radio = &node->radio;
+
+    switch (address) {
+    case RG_TRX_STATUS:
+        return (radio->reg[ RG_TRX_STATUS ] & 0xC0) | (radio->transition ? STATE_TRANSITION_IN_PROGRESS : radio->state);
+
+    case RG_PHY_RSSI:
+        return (radio->reg[ RG_PHY_RSSI ] & 0x80) | ((rng_step( &radio->noise_rng ) >> 62) << 5) |
+               radio_level( node, 3, 28 );
+
+    case RG_PHY_ED_LEVEL:
+        return radio_level( node, 1, 0x54 );
+
+    case RG_IRQ_STATUS: {
+
+        uint8_t status = radio->reg[ RG_IRQ_STATUS ];
+
+        radio->reg[ RG_IRQ_STATUS ] = 0;
+        radio_irq_update( node );
+
+        return status;
+    }
+
+    default:
+        return radio->reg[ address ];
+    }
+}
+
+static void radio_register_write( node_t *node, uint8_t address, uint8_t value ){
+
+    radio_t *radio = &node->radio;
+
+    switch (address) {
+    case RG_TRX_STATUS:
+    case RG_PHY_RSSI:
+    case RG_PHY_ED_LEVEL: //The ED level is measured when read.
+    case RG_IRQ_STATUS:
+    case RG_PART_NUM:
+    case RG_VERSION_NUM:
+    case RG_MAN_ID_0:
+    case RG_MAN_ID_1:
+        break;
+
+    case RG_TRX_STATE:
+        radio->reg[ RG_TRX_STATE ] = (radio->reg[ RG_TRX_STATE ] & 0xE0) | (value & 0x1F);
+        radio_command( node, value & 0x1F );
+        break;
+
+    case RG_PHY_CC_CCA:
+        radio->reg[ RG_PHY_CC_CCA ] = value & 0x7F;
+
+        if (value & 0x80) {
+            radio->reg[ RG_TRX_STATUS ] &= 0x3F;
+            radio->cca_start = now;
+            event_schedule( now + CCA_US * NS_PER_US, EVENT_CCA_REQUEST, node->id, -1, radio->generation );
+        }
+        break;
+
+    case RG_TRX_CTRL_2:
+        if (!(value & 0x80)) { radio->rx_protected = false; }
+
+        radio->reg[ address ] = value;
+        break;
+
+    case RG_CSMA_SEED_0:
+    case RG_CSMA_SEED_1:
+        radio->reg[ address ] = value;
+        radio_seed( radio );
+        break;
+
+    case RG_IRQ_MASK:
+        radio->reg[ address ] = value;
+        radio_irq_update( node );
+        break;
+
+    default:
+        radio->reg[ address ] = value;
+        break;
+    }
+}
+
+/*! \brief  One byte of an SPI transaction of the node. */
+static uint8_t radio_spi( node_t *node, uint8_t data ){
+
+    radio_t *radio = &node->radio;
+    int index = radio->spi_index++;
+    uint8_t command = radio->spi_command;
+
+    if (index == 0) {
+        radio->spi_command = data;
+        return 0; //PHY_STATUS, SPI_CMD_MODE_DEFAULT.
+    }
+
+    if (command & 0x80) {
+
+        if (index != 1) { return 0; }
+
+        if (command & 0x40) {
+            radio_register_write( node, command & 0x3F, data );
+            return 0;
+        }
+
+        return radio_register_read( node, command & 0x3F );
+    }
+
+    switch (command & 0x60) {
+    case 0x20: { //Frame read: PHR, PSDU, LQI.
+
+        uint8_t length = radio->fb[ 0 ] & 0x7F;
+
+        if (index == 1) { return length; }
+        //Only the frames to the receiver are printed, not beacons or broadcasts.
+        if ((index == length + 1) && (node->id == RECEIVER) &&
+            ((radio->fb[ 6 ] | (radio->fb[ 7 ] << 8)) == (radio->reg[ RG_SHORT_ADDR_0 ] | (radio->reg[ RG_SHORT_ADDR_1 ] << 8)))) {
+            receiver_depth( receiver.depth + 1 );
+        }
+        if (index <= length + 1) { return radio->fb[ index - 1 ]; }
+
+        return (index == length + 2) ? radio->lqi : 0;
+    }
+
+    case 0x60: //Frame write: PHR, PSDU.
+        if (index < RF231_RAM_SIZE + 1) { radio->fb[ index - 1 ] = data; }
+        return 0;
+
+    default: //SRAM read or write.
+        if (index == 1) {
+            radio->spi_address = data;
+            return 0;
+        }
+
+        if (radio->spi_address >= RF231_RAM_SIZE) { return 0; } //AES registers.
+
+        if (command & 0x40) {
+            radio->fb[ radio->spi_address++ ] = data;
+            return 0;
+        }
+
+        return radio->fb[ radio->spi_address++ ];
+    }
+}
+
+/*! \brief  Apply what the image wrote since it last called netsim: the pins
+ *          of PORTB and UDR0.
+ */
+static void node_commit( node_t *node ){
+
+    uint8_t portb = node->io[ NETSIM_ADDRESS_PORTB ];
+    uint8_t changed = portb ^ node->portb;
+
+    node->portb = portb;
+
+    if (changed & _BV( PIN_SS )) {
+
+        radio_t *radio = &node->radio;
+
+        if (!(portb & _BV( PIN_SS ))) {
+            radio->spi_index = 0;
+            radio->spi_command = 0;
+        } else if ((radio->spi_index > 0) && (((radio->spi_command & 0xE0) == 0x20) || ((radio->spi_command & 0xE0) == 0x60))) {
+            radio->rx_protected = false; //A frame buffer access ends the protection.
+        }
+    }
+
+    if ((changed & _BV( PIN_RST )) && !(portb & _BV( PIN_RST ))) { radio_reset( node ); }
+    if (changed & _BV( PIN_SLP_TR )) { radio_slp_tr( node, (portb & _BV( PIN_SLP_TR )) != 0 ); }
+
+    if (node->io[ NETSIM_ADDRESS_UDR0 ] != NETSIM_NO_WRITE) {
+        uart_send( node, node->io[ NETSIM_ADDRESS_UDR0 ] );
+        node->io[ NETSIM_ADDRESS_UDR0 ] = NETSIM_NO_WRITE;
+    }
+}
+
+/*============================ NETSIM.H ======================================*/
+
+uint8_t netsim_node( void ){
+    return current->id;
+}
+
+/*! \brief  The I/O register slot. Reading UCSR0A twice in a row with UDRE0
+ *          clear is a wait for the UART.
+ */
+volatile uint16_t *netsim_io( uint8_t address ){
+
+    node_t *node = current;
+
+    node_commit( node );
+
+    if (address != NETSIM_ADDRESS_UCSR0A) {
+        node->uart_polls = 0;
+        return &node->io[ address ];
+    }
+
+    for (;;) {
+
+        uint64_t character = node_uart_character( node );
+
+        if (node->uart_free <= now + character) {
+            node->io[ address ] |= _BV( UDRE0 );
+            node->uart_polls = 0;
+            break;
+        }
+
+        node->io[ address ] &= (uint16_t)~_BV( UDRE0 );
+
+        if (node->uart_polls++ == 0) { break; }
+
+        node_wait( node->uart_free - character, true );
+        node_deliver( );
+    }
+
+    return &node->io[ address ];
+}
+
+void netsim_spi( uint8_t *data, uint8_t length ){
+
+    node_t *node = current;
+
+    node_commit( node );
+    node->uart_polls = 0;
+
+    for (uint8_t i = 0; i < length; i++) { data[ i ] = radio_spi( node, data[ i ] ); }
+
+    node_wait( now + SPI_CALL_NS + (uint64_t)length * SPI_BYTE_NS, false );
+}
+
+uint32_t netsim_get_ticks( void ){
+
+    node_commit( current );
+    current->uart_polls = 0;
+    node_deliver( );
+    node_wait( now + TICKS_NS, false );
+
+    return (uint32_t)node_ticks( current, now );
+}
+
+uint32_t netsim_get_capture_ticks( void ){
+    return (uint32_t)node_ticks( current, current->capture_time );
+}
+
+/*! \brief  Arm the output compare for the tick count. A count that has
+ *          passed matches at once.
+ */
+void netsim_set_compare( uint32_t ticks ){
+
+    node_t *node = current;
+    uint64_t ticks_now = node_ticks( node, now );
+    int32_t ahead = (int32_t)(ticks - (uint32_t)ticks_now);
+    uint64_t time = now;
+
+    if (ahead > 0) { time = node->boot + (uint64_t)ceil( (double)(ticks_now + ahead) * NS_PER_TICK / node->rate ); }
+
+    node->compare_pending = false;
+    event_schedule( time, EVENT_COMPARE, node->id, -1, ++node->compare_generation );
+}
+
+/*! \brief  A delay loop: interrupts lengthen it by the time of their ISRs. */
+void netsim_delay_us( double us ){
+
+    node_t *node = current;
+
+    node_commit( node );
+    node->uart_polls = 0;
+
+    uint64_t until = now + (uint64_t)(us * NS_PER_US / node->rate);
+
+    for (;;) {
+
+        node_wait( until, true );
+
+        if (!node_interrupt_ready( node )) { break; }
+
+        uint64_t started = now;
+
+        node_deliver( );
+        until += now - started;
+    }
+}
+
+void netsim_poll( void ){
+
+    node_commit( current );
+    current->uart_polls = 0;
+    node_deliver( );
+    node_wait( now + POLL_NS, true );
+    node_deliver( );
+}
+
+void netsim_idle( void ){
+
+    node_commit( current );
+    current->uart_polls = 0;
+
+    if (current->in_isr) {
+        node_wait( now + POLL_NS, false );
+        return;
+    }
+
+    node_deliver( );
+    node_wait( now + IDLE_NS, true );
+    node_deliver( );
+}
+
+void netsim_sleep( void ){
+
+    node_commit( current );
+    current->uart_polls = 0;
+    node_wait( end, true );
+    node_deliver( );
+}
+
+/*============================ SIMULATION ====================================*/
+
+static void node_entry( void ){
+
+    current->entry( );
+
+    for (;;) { node_wait( end, false ); } //main returned: the AVR is stopped.
+}
+
+/*! \brief  Load a private copy of the image: dlopen shares a file that is
+ *          opened twice.
+ */
+static void node_load( node_t *node, const char *image ){
+
+    char path[ 4096 ];
+    char copy[] = "/tmp/netsim-XXXXXX";
+
+    snprintf( path, sizeof( path ), "%s/%s.so", config.directory, image );
+
+    FILE *in = fopen( path, "rb" );
+    int descriptor = mkstemp( copy );
+
+    if ((in == NULL) || (descriptor < 0)) {
+        fprintf( stderr, "netsim: cannot copy %s, see build.sh\n", path );
+        exit( 1 );
+    }
+
+    FILE *out = fdopen( descriptor, "wb" );
+    char buffer[ 65536 ];
+    size_t length;
+
+    while ((length = fread( buffer, 1, sizeof( buffer ), in )) > 0) { fwrite( buffer, 1, length, out ); }
+
+    fclose( in );
+    fclose( out );
+
+    node->image = dlopen( copy, RTLD_NOW | RTLD_LOCAL );
+    unlink( copy );
+
+    if (node->image == NULL) {
+        fprintf( stderr, "netsim: %s\n", dlerror( ) );
+        exit( 1 );
+    }
+
+    node->entry = (int (*)( void ))dlsym( node->image, "netsim_main" );
+    node->capture_vector = (void (*)( void ))dlsym( node->image, "TIMER1_CAPT_vect" );
+    node->compare_vector = (void (*)( void ))dlsym( node->image, "TIMER1_COMPA_vect" );
+
+    if ((node->entry == NULL) || (node->capture_vector == NULL) || (node->compare_vector == NULL)) {
+        fprintf( stderr, "netsim: %s is not a netsim image\n", path );
+        exit( 1 );
+    }
+
+    node->stack = malloc( STACK_SIZE );
+
+    if (node->stack == NULL) {
+        perror( "malloc" );
+        exit( 1 );
+    }
+
+    getcontext( &node->context );
+    node->context.uc_stack.ss_sp = node->stack;
+    node->context.uc_stack.ss_size = STACK_SIZE;
+    node->context.uc_link = NULL;
+    makecontext( &node->context, node_entry, 0 );
+}
+
+static void node_unload( node_t *node ){
+
+    dlclose( node->image );
+    free( node->stack );
+}
+
+static void simulate( void ){
+
+    event_count = 0;
+    event_order = 0;
+    transmission_next = 0;
+    now = 0;
+    end = (uint64_t)(config.seconds * 1e9);
+    rng_state = config.seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    memset( transmissions, 0, sizeof( transmissions ) );
+    memset( nodes, 0, sizeof( nodes ) );
+    memset( &receiver, 0, sizeof( receiver ) );
+    memset( &tdma_statistics, 0, sizeof( tdma_statistics ) );
+
+    channel_init( );
+
+    for (int i = 0; i < node_count( ); i++) {
+
+        node_t *node = &nodes[ i ];
+
+        node->id = i;
+        node->last_sequence = -1;
+        node->aret_sequence = -1;
+        node->io[ NETSIM_ADDRESS_UDR0 ] = NETSIM_NO_WRITE;
+        node->io[ NETSIM_ADDRESS_UCSR0A ] = _BV( UDRE0 );
+        node->radio.noise_rng = rng_next( ) | 1;
+        node->rate = 1.0 + config.clock_error_ppm * 1e-6 * (2.0 * rng_uniform( ) - 1.0);
+        node->boot = (i == RECEIVER) ? 0 : (uint64_t)(rng_uniform( ) * 1e9);
+        radio_reset( node );
+
+        if (i == RECEIVER) {
+            node_load( node, config.tdma ? "umspreceive_tdma" : "umspreceive" );
+        } else {
+            node_load( node, config.tdma ? "testsend_tdma" : "testsend" );
+        }
+
+        event_schedule( node->boot, EVENT_BOOT, i, -1, 0 );
+    }
+
+    while (event_count > 0) {
+
+        event_t event = event_pop( );
+
+        if (event.time >= end) { break; }
+
+        node_t *node = &nodes[ event.node ];
+        bool current_generation = (event.generation == node->radio.generation);
+
+        now = event.time;
+
+        switch (event.type) {
+        case EVENT_BOOT:
+            current = node;
+            swapcontext( &scheduler_context, &node->context );
+            current = NULL;
+            break;
+
+        case EVENT_WAKE:
+            if (!node->waiting || (event.generation != node->wake_generation)) { break; }
+
+            current = node;
+            swapcontext( &scheduler_context, &node->context );
+            current = NULL;
+            break;
+
+        case EVENT_COMPARE:
+            if (event.generation != node->compare_generation) { break; }
+
+            node->compare_pending = true;
+            node_interrupt( node );
+            break;
+
+        case EVENT_STATE:
+            if (!current_generation) { break; }
+
+            node->radio.transition = false;
+
+            if ((node->radio.state == TRX_OFF) && (node->radio.target != TRX_OFF)) {
+                node->radio.state = node->radio.target;
+                radio_irq( node, TRX_IRQ_PLL_LOCK );
+            } else {
+                node->radio.state = node->radio.target;
+            }
+            break;
+
+        case EVENT_CCA_START:
+            if (!current_generation) { break; }
+
+            node->radio.cca_start = now;
+            event_schedule( now + CCA_US * NS_PER_US, EVENT_CCA_END, event.node, -1, event.generation );
+            break;
+
+        case EVENT_CCA_END:
+            if (current_generation) { radio_cca_end( node ); }
+            break;
+
+        case EVENT_CCA_REQUEST: {
+
+            radio_t *radio = &node->radio;
+            double threshold = RSSI_BASE_VAL + 2.0 * radio_field( radio, SR_CCA_ED_THRES );
+            bool idle = channel_dbm( event.node, radio->cca_start ) < threshold;
+
+            radio->reg[ RG_TRX_STATUS ] = (radio->reg[ RG_TRX_STATUS ] & 0x3F) | 0x80 | (idle ? 0x40 : 0);
+            radio_irq( node, TRX_IRQ_CCA_ED_READY );
+            break;
+        }
+
+        case EVENT_TX_START:
+            if (current_generation) { radio_transmit( node ); }
+            break;
+
+        case EVENT_PHR:
+            radio_phr( node, event.transmission, current_generation );
+            break;
+
+        case EVENT_TX_END:
+            radio_tx_end( node, event.transmission, current_generation );
+            break;
+
+        case EVENT_ACK_TIMEOUT:
+            if (current_generation) { radio_ack_timeout( node ); }
+            break;
+
+        case EVENT_ACK_START:
+            if (current_generation) { radio_ack_start( node, event.transmission ); }
+            break;
+        }
+    }
+
+    now = end;
+    receiver_depth( receiver.depth );
+
+    if (config.tdma) {
+
+        void (*statistics)( tdma_statistics_t * ) =
+            (void (*)( tdma_statistics_t * ))dlsym( nodes[ RECEIVER ].image, "tdma_get_coordinator_statistics" );
+
+        if (statistics != NULL) {
+            current = &nodes[ RECEIVER ];
+            statistics( &tdma_statistics );
+            current = NULL;
+        }
+    }
+}
+
+static void unload( void ){
+
+    for (int i = 0; i < node_count( ); i++) { node_unload( &nodes[ i ] ); }
+}
+
+static double utilisation( void ){
+    return tdma_statistics.allocated ? 100.0 * (double)tdma_statistics.used / (double)tdma_statistics.allocated : 0.0;
+}
+
+/*! \brief  The frames of a sender that its loss is computed on: the offered
+ *          ones, but the last one if it was acknowledged less than
+ *          IN_FLIGHT_NS before the end and is not printed yet.
+ */
+static uint64_t expected( const node_t *node ){
+
+    bool in_flight = (node->aret_sequence >= 0) && (node->aret_trac == TRAC_SUCCESS) &&
+                     (node->aret_sequence != node->last_sequence) && (end - node->aret_end < IN_FLIGHT_NS);
+
+    return node->offered - (in_flight ? 1 : 0);
+}
+
+static void report( double wall_seconds ){
+
+    uint64_t total_offered = 0;
+    uint64_t total_expected = 0;
+    uint64_t total_printed = 0;
+
+    printf( "%d senders, %s, %.0f s simulated in %.2f s (%.0fx real time)\n",
+            config.senders, config.tdma ? "tdma" : "csma", config.seconds, wall_seconds,
+            (wall_seconds > 0.0) ? config.seconds / wall_seconds : 0.0 );
+    printf( "images in %s, clock error +-%.0f ppm, capture %.1f dB, radius %.1f m, seed %llu\n\n",
+            config.directory, config.clock_error_ppm, config.capture_db, config.radius,
+            (unsigned long long)config.seed );
+    printf( "node   dist_m  rssi  offered    acked  caf  noack  tx/frame  printed  dup  loss%%  thr/s  delay_ms\n" );
+
+    for (int i = 1; i <= config.senders; i++) {
+
+        node_t *s = &nodes[ i ];
+        uint64_t finished = s->acknowledged + s->channel_access_failures + s->no_ack;
+        uint64_t frames = expected( s );
+        double loss = frames ? 100.0 * ((double)frames - (double)s->printed) / (double)frames : 0.0;
+
+        total_offered += s->offered;
+        total_expected += frames;
+        total_printed += s->printed;
+
+        printf( "%4d %8.1f %5.0f %8llu %8llu %4llu %6llu %9.2f %8llu %4llu %6.2f %6.3f %9.2f\n",
+                i, hypot( s->x, s->y ), link_dbm[ i ][ RECEIVER ],
+                (unsigned long long)s->offered, (unsigned long long)s->acknowledged,
+                (unsigned long long)s->channel_access_failures, (unsigned long long)s->no_ack,
+                s->offered ? (double)s->transmissions / (double)s->offered : 0.0,
+                (unsigned long long)s->printed, (unsigned long long)s->duplicates, loss,
+                (double)s->printed / config.seconds,
+                finished ? (double)s->access_delay_total / (double)finished / 1e6 : 0.0 );
+    }
+
+    printf( "\nreceiver: printed %llu of %llu (%.2f %% lost, %llu in flight), %llu collisions, "
+            "%llu frames not stored (protection), %llu pool overflows, RX LOST %u\n",
+            (unsigned long long)total_printed, (unsigned long long)total_expected,
+            total_expected ? 100.0 * ((double)total_expected - (double)total_printed) / (double)total_expected : 0.0,
+            (unsigned long long)(total_offered - total_expected),
+            (unsigned long long)receiver.collisions, (unsigned long long)receiver.protection_drops,
+            (unsigned long long)receiver.overflows, receiver.lost_reported );
+    printf( "receiver: pool depth mean %.2f max %d, uart busy %.1f %%, %llu uart overruns\n",
+            receiver.depth_integral / (double)end, receiver.depth_max,
+            100.0 * (double)receiver.uart_busy / (double)end, (unsigned long long)receiver.uart_overruns );
+
+    if (config.tdma) {
+        printf( "receiver: %u superframes, %u slots of %.1f ms, utilisation %.2f %% (%u of %u), %u joins, %u leaves\n",
+                tdma_statistics.superframes, tdma_statistics.slots,
+                tdma_statistics.slot_length * US_PER_SYMBOL / 1000.0, utilisation( ),
+                tdma_statistics.used, tdma_statistics.allocated,
+                tdma_statistics.joins, tdma_statistics.leaves );
+    }
+}
+
+/*! \brief  One summary line per mode and number of senders. */
+static void sweep( void ){
+
+    static const int counts[] = { 2, 4, 8, 12, 16, 24, 32 };
+
+    printf( "%.0f s per run, images in %s, seed %llu\n\n", config.seconds, config.directory,
+            (unsigned long long)config.seed );
+    printf( "mode  senders  offered/s  acked/s  printed/s  loss%%  collisions   caf  tx/frame  slot_util%%\n" );
+
+    for (int mode = 0; mode < 2; mode++) {
+
+        config.tdma = (mode == 1);
+
+        for (size_t c = 0; c < sizeof( counts ) / sizeof( counts[ 0 ] ); c++) {
+
+            config.senders = counts[ c ];
+            simulate( );
+
+            uint64_t offered = 0, frames = 0, acked = 0, printed = 0, caf = 0, tx = 0;
+
+            for (int i = 1; i <= config.senders; i++) {
+                offered += nodes[ i ].offered;
+                frames  += expected( &nodes[ i ] );
+                acked   += nodes[ i ].acknowledged;
+                printed += nodes[ i ].printed;
+                caf     += nodes[ i ].channel_access_failures;
+                tx      += nodes[ i ].transmissions;
+            }
+
+            printf( "%-4s %8d %10.2f %8.2f %10.2f %6.2f %11llu %5llu %9.2f",
+                    config.tdma ? "tdma" : "csma", config.senders,
+                    (double)offered / config.seconds, (double)acked / config.seconds,
+                    (double)printed / config.seconds,
+                    frames ? 100.0 * ((double)frames - (double)printed) / (double)frames : 0.0,
+                    (unsigned long long)receiver.collisions, (unsigned long long)caf,
+                    offered ? (double)tx / (double)offered : 0.0 );
+
+            if (config.tdma) {
+                printf( " %10.2f\n", utilisation( ) );
+            } else {
+                printf( " %10s\n", "-" );
+            }
+
+            fflush( stdout );
+            unload( );
+        }
+    }
+}
+
+static void usage( const char *name ){
+
+    fprintf( stderr, "Usage: %s [-n senders] [-t seconds] [-s seed] [-r radius_m] [-c capture_db]\n"
+                     "       [-m csma|tdma] [-y clock_error_ppm] [-d image_directory] [-x] [-v]\n", name );
+    exit( 1 );
+}
+
+int main( int argc, char **argv ){
+
+    int option;
+    static char directory[ 4096 ] = ".";
+    const char *slash = strrchr( argv[ 0 ], '/' );
+
+    if (slash != NULL) { snprintf( directory, sizeof( directory ), "%.*s", (int)(slash - argv[ 0 ]), argv[ 0 ] ); }
+
+    config.directory = directory;
+
+    while ((option = getopt( argc, argv, "n:t:s:r:c:m:y:d:xv" )) != -1) {
+
+        switch (option) {
+        case 'n': config.senders = atoi( optarg ); break;
+        case 't': config.seconds = atof( optarg ); break;
+        case 's': config.seed = strtoull( optarg, NULL, 10 ); break;
+        case 'r': config.radius = atof( optarg ); break;
+        case 'c': config.capture_db = atof( optarg ); break;
+        case 'm':
+            if (strcmp( optarg, "tdma" ) == 0) {
+                config.tdma = true;
+            } else if (strcmp( optarg, "csma" ) == 0) {
+                config.tdma = false;
+            } else {
+                usage( argv[ 0 ] );
+            }
+            break;
+        case 'y': config.clock_error_ppm = atof( optarg ); break;
+        case 'd': config.directory = optarg; break;
+        case 'x': config.sweep = true; break;
+        case 'v': config.verbose = true; break;
+        default: usage( argv[ 0 ] );
+        }
+    }
+
+    if ((config.senders < 1) || (config.senders >= MAX_NODES) || (config.seconds <= 0.0) ||
+        (config.clock_error_ppm < 0.0) || (config.clock_error_ppm >= 1000.0)) {
+        usage( argv[ 0 ] );
+    }
+
+    if (config.sweep) {
+        sweep( );
+        free( events );
+        return 0;
+    }
+
+    clock_t started = clock( );
+
+    simulate( );
+    report( (double)(clock( ) - started) / CLOCKS_PER_SEC );
+    unload( );
+    free( events );
+
+    return 0;
+}
+/*EOF*/
@@ -0,0 +1,33 @@
+/*! \file netsim.h
+ *
+ *  \brief  Interface between netsim and the firmware images that it runs.
+ *
+ *          The images are testsend and umspreceive, built for the host by
+ *          build.sh: hal_sim.c replaces hal_avr.c, and the headers in
+ *          include/ replace avr-libc. Each node runs its own copy of an image
+ *          as a coroutine. The functions below are exported by netsim and
+ *          act on the node that calls them: they advance its simulated time,
+ *          run its pending interrupt service routines, and switch to the
+ *          other nodes while it waits.
+ */
+#ifndef NETSIM_H
+#define NETSIM_H
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+/*============================ MACROS ========================================*/
+#define NETSIM_IO_SIZE          ( 0x100 ) //!< Data space addresses of the I/O registers of the ATmega128.
+#define NETSIM_NO_WRITE         ( 0x100 ) //!< Content of a write-only register slot until the image writes it.
+/*============================ TYPEDEFS ======================================*/
+/*============================ PROTOTYPES ====================================*/
+uint8_t netsim_node( void );
+volatile uint16_t *netsim_io( uint8_t address );
+void netsim_spi( uint8_t *data, uint8_t length );
+uint32_t netsim_get_ticks( void );
+uint32_t netsim_get_capture_ticks( void );
+void netsim_set_compare( uint32_t ticks );
+void netsim_delay_us( double us );
+void netsim_poll( void );
+void netsim_idle( void );
+void netsim_sleep( void );
+#endif
+/*EOF*/
@@ -0,0 +1,269 @@
+/*! \file profdump.c
+ *
+ *  \brief  Host tool that requests and prints the profiling table of a node
+ *          built with PROFILING (see include/prof.h in testsend and
+ *          umspreceive).
+ *
+ *          If the input is a tty it is put in raw mode, the dump command is
+ *          sent, and the tool waits up to two seconds for the record. The
+ *          sender only polls the UART once per transmission, so the answer
+ *          can take about a second. Otherwise the input is searched for the
+ *          first valid record, e.g. a capture of the serial port.
+ *
+ *          Build: cc -std=gnu99 -O2 -Wall -o profdump profdump.c
+ *
+ *          Usage: profdump [-b baud] [-z] [input]
+ *
+ *          -z clears the table on the node after the dump. The baud rate
+ *          defaults to 9600.
+ */
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+/*============================ MACROS ========================================*/
+#define PROF_SYNC_0              ( 0xA5 )
+#define PROF_SYNC_1              ( 0x50 )
+#define PROF_HEADER_SIZE         ( 5 ) //!< Regions, timer kHz and overhead.
+#define PROF_REGION_RECORD_SIZE  ( 20 )
+#define PROF_MAX_REGIONS         ( 32 )
+#define TIMEOUT_US               ( 2000000 )
+/*============================ TYPEDEFS ======================================*/
+/*============================ VARIABLES =====================================*/
+
+/*! \brief  Region names in prof_region_id_t order. */
+static const char *const region_names[] = {
+    "trx_isr", "frame_read", "frame_write", "uart_rx_isr", "uart_udre_isr",
+    "uart_send", "state_transition",
+};
+/*============================ PROTOTYPES ====================================*/
+
+/*! \brief  Same checksum as crc_ccitt_update on the AVR (CRC-16/KERMIT). */
+static uint16_t crc_ccitt_update( uint16_t crc, uint8_t data ){
+
+    data ^= (uint8_t)(crc & 0xFF);
+    data ^= (uint8_t)(data << 4);
+
+    return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^
+            ((uint16_t)data << 3));
+}
+
+static uint32_t get_u32( const uint8_t *p ){
+    return (uint32_t)p[ 0 ] | ((uint32_t)p[ 1 ] << 8) | ((uint32_t)p[ 2 ] << 16) | ((uint32_t)p[ 3 ] << 24);
+}
+
+/*! \brief  Put a serial port in raw mode at the requested baud rate. */
+static int configure_tty( int fd, long baud ){
+
+    static const struct { long baud; speed_t speed; } speeds[] = {
+        { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+        { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 },
+        { 500000, B500000 },
+    };
+
+    struct termios tio;
+
+    if (tcgetattr( fd, &tio ) != 0) { return -1; }
+
+    cfmakeraw( &tio );
+
+    for (size_t i = 0; i < sizeof( speeds ) / sizeof( speeds[ 0 ] ); i++) {
+
+        if (speeds[ i ].baud == baud) {
+
+            cfsetispeed( &tio, speeds[ i ].speed );
+            cfsetospeed( &tio, speeds[ i ].speed );
+
+            return tcsetattr( fd, TCSANOW, &tio );
+        }
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+/*! \brief  Read with a timeout on ttys.
+ *
+ *  \return Bytes read, 0 at end of input or timeout, -1 on error.
+ */
+static ssize_t read_some( int fd, uint8_t *buffer, size_t size, bool tty ){
+
+    if (tty) {
+
+        fd_set set;
+        struct timeval timeout = { TIMEOUT_US / 1000000, TIMEOUT_US % 1000000 };
+
+        FD_ZERO( &set );
+        FD_SET( fd, &set );
+
+        int ready = select( fd + 1, &set, NULL, NULL, &timeout );
+
+        if (ready <= 0) { return ready; }
+    }
+
+    return read( fd, buffer, size );
+}
+
+/*! \brief  Look for a complete record with a valid checksum.
+ *
+ *  \return Offset of the record, or -1 if there is none yet.
+ */
+static long find_record( const uint8_t *buffer, size_t length ){
+
+    for (size_t i = 0; i + 2 + PROF_HEADER_SIZE <= length; i++) {
+
+        if ((buffer[ i ] != PROF_SYNC_0) || (buffer[ i + 1 ] != PROF_SYNC_1)) { continue; }
+
+        uint8_t regions = buffer[ i + 2 ];
+
+        if ((regions == 0) || (regions > PROF_MAX_REGIONS)) { continue; }
+
+        size_t body = PROF_HEADER_SIZE + (size_t)regions * PROF_REGION_RECORD_SIZE;
+
+        if (i + 2 + body + 2 > length) { continue; }
+
+        uint16_t crc = 0;
+
+        for (size_t j = 0; j < body; j++) { crc = crc_ccitt_update( crc, buffer[ i + 2 + j ] ); }
+
+        if (crc == (buffer[ i + 2 + body ] | (buffer[ i + 3 + body ] << 8))) { return (long)i; }
+    }
+
+    return -1;
+}
+
+static void print_record( const uint8_t *record ){
+
+    uint8_t regions = record[ 2 ];
+    double khz = (double)(record[ 3 ] | (record[ 4 ] << 8));
+    unsigned overhead = record[ 5 ] | (record[ 6 ] << 8);
+
+    printf( "timer %.0f kHz, %u cycles overhead subtracted per sample\n\n", khz, overhead );
+    printf( "%-18s %10s %10s %10s %10s %12s\n", "region", "count", "min_us", "mean_us", "max_us", "total_ms" );
+
+    for (uint8_t r = 0; r < regions; r++) {
+
+        const uint8_t *p = record + 2 + PROF_HEADER_SIZE + r * PROF_REGION_RECORD_SIZE;
+        uint32_t count = get_u32( p );
+        uint32_t min = get_u32( p + 4 );
+        uint32_t max = get_u32( p + 8 );
+        uint64_t total = get_u32( p + 12 ) | ((uint64_t)get_u32( p + 16 ) << 32);
+        char name[ 16 ];
+        const char *label = name;
+
+        if (r < sizeof( region_names ) / sizeof( region_names[ 0 ] )) {
+            label = region_names[ r ];
+        } else {
+            snprintf( name, sizeof( name ), "region_%u", r );
+        }
+
+        if (count == 0) {
+            printf( "%-18s %10u %10s %10s %10s %12s\n", label, 0u, "-", "-", "-", "-" );
+            continue;
+        }
+
+        printf( "%-18s %10u %10.1f %10.1f %10.1f %12.3f\n", label, count,
+                min * 1000.0 / khz, (double)total / count * 1000.0 / khz,
+                max * 1000.0 / khz, (double)total / khz );
+    }
+}
+
+static void usage( const char *name ){
+
+    fprintf( stderr, "usage: %s [-b baud] [-z] [input]\n", name );
+    exit( 2 );
+}
+
+int main( int argc, char **argv ){
+
+    long baud = 9600;
+    bool clear = false;
+    int option;
+
+    while ((option = getopt( argc, argv, "b:z" )) != -1) {
+
+        switch (option) {
+        case 'b': baud = strtol( optarg, NULL, 10 ); break;
+        case 'z': clear = true; break;
+        default: usage( argv[ 0 ] );
+        }
+    }
+
+    if (argc - optind > 1) { usage( argv[ 0 ] ); }
+
+    int fd = STDIN_FILENO;
+
+    if (optind < argc) {
+
+        fd = open( argv[ optind ], O_RDWR | O_NOCTTY );
+
+        if (fd < 0) {
+            perror( argv[ optind ] );
+            return 1;
+        }
+    }
+
+    bool tty = isatty( fd );
+
+    if (tty) {
+
+        if (configure_tty( fd, baud ) != 0) {
+            perror( "configure tty" );
+            return 1;
+        }
+
+        tcflush( fd, TCIOFLUSH );
+
+        const char *command = clear ? "Z\r" : "P\r";
+
+        if (write( fd, command, 2 ) != 2) {
+            perror( "write" );
+            return 1;
+        }
+    }
+
+    static uint8_t buffer[ 1 << 16 ];
+    size_t used = 0;
+
+    for (;;) {
+
+        long offset = find_record( buffer, used );
+
+        if (offset >= 0) {
+            print_record( buffer + offset );
+            return 0;
+        }
+
+        //Keep the tail that may hold the start of a record.
+        if (used == sizeof( buffer )) {
+
+            size_t keep = 2 + PROF_HEADER_SIZE + PROF_MAX_REGIONS * PROF_REGION_RECORD_SIZE + 2;
+
+            memmove( buffer, buffer + used - keep, keep );
+            used = keep;
+        }
+
+        ssize_t n = read_some( fd, buffer + used, sizeof( buffer ) - used, tty );
+
+        if (n < 0) {
+            perror( "read" );
+            return 1;
+        }
+
+        if (n == 0) { break; }
+
+        used += (size_t)n;
+    }
+
+    fprintf( stderr, "no profiling record found\n" );
+
+    return 1;
+}
+/*EOF*/
@@ -0,0 +1,576 @@
+/*! \file sniffer2pcap.c
+ *
+ *  \brief  Host tool that converts the serial output of umspreceive into a
+ *          pcap file for Wireshark.
+ *
+ *          Two input formats are understood:
+ *          - The binary capture records of the SNIFFER build (see
+ *            umspreceive/include/sniffer.h). These carry the full PSDU with
+ *            FCS, the SFD timestamp, LQI and ED.
+ *          - The hex dump of the normal receiver build: 18 reordered bytes
+ *            per frame, 36 hex digits, without FCS. The FCF (0x61 0x88) and
+ *            the data length byte (3) are not printed, and are filled in
+ *            from the fixed frame layout used by testsend.
+ *
+ *          The output uses LINKTYPE_IEEE802_15_4_TAP (283), so the LQI, the
+ *          RSS (from ED), the channel and the FCS type travel with each
+ *          packet. The input is processed as a stream with a fixed size
+ *          buffer, so a file, a FIFO or the serial port itself can be used,
+ *          and the output can be piped into "wireshark -k -i -".
+ *
+ *          Build: cc -std=gnu99 -O2 -Wall -o sniffer2pcap sniffer2pcap.c
+ *
+ *          Usage: sniffer2pcap [-f auto|binary|hex] [-b baud] [-c channel]
+ *                              [-o out.pcap] [input]
+ *
+ *          The input defaults to stdin and the output to stdout. If the input
+ *          is a tty it is put in raw mode at the given baud rate (default
+ *          500000, the SNIFFER_UBRR default at 8 MHz).
+ */
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+/*============================ MACROS ========================================*/
+#define SNIFFER_SYNC_0            ( 0xA5 ) //!< Must match sniffer.h.
+#define SNIFFER_SYNC_1            ( 0x5A ) //!< Must match sniffer.h.
+#define SNIFFER_RECORD_OVERHEAD   ( 9 ) //!< Must match sniffer.h.
+#define SNIFFER_FLAG_CRC_OK       ( 0x01 )
+#define SNIFFER_FLAG_DROPPED      ( 0x02 )
+#define SNIFFER_FLAG_BAD_LENGTH   ( 0x04 )
+
+#define MAX_PSDU_LENGTH           ( 127 )
+#define RECORD_MAX_LENGTH         ( 3 + SNIFFER_RECORD_OVERHEAD + MAX_PSDU_LENGTH + 2 )
+
+#define HEX_RECORD_DIGITS         ( 36 ) //!< 18 bytes per frame in the hex dump.
+#define HEX_FRAME_LENGTH          ( 20 ) //!< PSDU bytes (without FCS) described by the hex dump.
+
+#define US_PER_SYMBOL             ( 16 )
+#define SYMBOL_MASK               ( 0x7FFFFFFFUL ) //!< HAL_SYMBOL_MASK at 8 MHz.
+#define RSSI_BASE_VAL             ( -91 ) //!< AT86RF231: RSSI in dBm = RSSI_BASE_VAL + ED.
+
+#define LINKTYPE_IEEE802_15_4_TAP ( 283 )
+#define TAP_FCS_NONE              ( 0 )
+#define TAP_FCS_16                ( 1 )
+
+#define READ_CHUNK_SIZE           ( 4096 )
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Input formats. */
+typedef enum{
+    FORMAT_AUTO,
+    FORMAT_BINARY,
+    FORMAT_HEX
+}input_format_t;
+
+/*! \brief  One frame ready to be written. */
+typedef struct{
+    uint8_t psdu[ MAX_PSDU_LENGTH ];
+    uint8_t length;      //!< Bytes in psdu.
+    bool has_fcs;        //!< The last two bytes of psdu are the FCS.
+    bool has_radio_info; //!< lqi and ed are valid.
+    uint8_t lqi;
+    uint8_t ed;
+    uint64_t time_us;    //!< Capture time, microseconds since the epoch.
+}frame_t;
+
+/*! \brief  Binary record parser. Holds at most one record. */
+typedef struct{
+    uint8_t buffer[ RECORD_MAX_LENGTH ];
+    size_t used;
+}binary_parser_t;
+
+/*! \brief  Hex dump parser. Holds at most one record of hex digits. */
+typedef struct{
+    char digits[ HEX_RECORD_DIGITS ];
+    size_t used;
+}hex_parser_t;
+
+/*! \brief  Maps device timestamps (symbols) to host time. */
+typedef struct{
+    bool anchored;
+    uint64_t anchor_us;     //!< Host time of the first record.
+    uint32_t last_symbols;  //!< Last device timestamp.
+    uint64_t elapsed_us;    //!< Unwrapped device time since the first record.
+}clock_map_t;
+
+/*! \brief  Counters printed on exit. */
+typedef struct{
+    unsigned long frames;
+    unsigned long crc_errors;
+    unsigned long bad_length;
+    unsigned long dropped;      //!< Frames the sniffer reported as lost.
+    unsigned long resync_bytes; //!< Input bytes skipped to find the next record.
+}statistics_t;
+/*============================ VARIABLES =====================================*/
+static FILE *pcap_out;
+static bool pcap_flush_each;
+static uint16_t channel = 11;
+static clock_map_t clock_map;
+static statistics_t statistics;
+/*============================ PROTOTYPES ====================================*/
+
+/*! \brief  Current host time in microseconds. */
+static uint64_t host_time_us( void ){
+
+    struct timeval now;
+
+    gettimeofday( &now, NULL );
+
+    return (uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_usec;
+}
+
+/*! \brief  Same checksum as crc_ccitt_update on the AVR (CRC-16/KERMIT). */
+static uint16_t crc_ccitt_update( uint16_t crc, uint8_t data ){
+
+    data ^= (uint8_t)(crc & 0xFF);
+    data ^= (uint8_t)(data << 4);
+
+    return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^
+            ((uint16_t)data << 3));
+}
+
+static void put_u16( uint8_t *p, uint16_t value ){
+
+    p[ 0 ] = value & 0xFF;
+    p[ 1 ] = value >> 8;
+}
+
+static void put_u32( uint8_t *p, uint32_t value ){
+
+    put_u16( p, value & 0xFFFF );
+    put_u16( p + 2, value >> 16 );
+}
+
+/*! \brief  Write the pcap global header. */
+static void pcap_write_header( void ){
+
+    uint8_t header[ 24 ];
+
+    put_u32( header, 0xA1B2C3D4 ); //Microsecond timestamps.
+    put_u16( header + 4, 2 );
+    put_u16( header + 6, 4 );
+    put_u32( header + 8, 0 );
+    put_u32( header + 12, 0 );
+    put_u32( header + 16, 65535 );
+    put_u32( header + 20, LINKTYPE_IEEE802_15_4_TAP );
+
+    fwrite( header, 1, sizeof( header ), pcap_out );
+    fflush( pcap_out );
+}
+
+/*! \brief  Append one TAP TLV, padded to a multiple of four bytes.
+ *
+ *  \return Number of bytes written to tlv.
+ */
+static size_t tap_tlv( uint8_t *tlv, uint16_t type, const void *value, uint16_t length ){
+
+    size_t padded = (length + 3) & ~3U;
+
+    put_u16( tlv, type );
+    put_u16( tlv + 2, length );
+    memset( tlv + 4, 0, padded );
+    memcpy( tlv + 4, value, length );
+
+    return 4 + padded;
+}
+
+/*! \brief  Write one frame as a pcap record with an IEEE 802.15.4 TAP header. */
+static void pcap_write_frame( const frame_t *frame ){
+
+    uint8_t tap[ 64 ];
+    size_t tap_length = 4;
+
+    uint8_t fcs_type = frame->has_fcs ? TAP_FCS_16 : TAP_FCS_NONE;
+    tap_length += tap_tlv( tap + tap_length, 0, &fcs_type, 1 );
+
+    uint8_t channel_assignment[ 3 ];
+    put_u16( channel_assignment, channel );
+    channel_assignment[ 2 ] = 0; //Channel page 0.
+    tap_length += tap_tlv( tap + tap_length, 3, channel_assignment, 3 );
+
+    if (frame->has_radio_info) {
+
+        float rss = (float)(RSSI_BASE_VAL + frame->ed);
+        uint8_t rss_le[ 4 ];
+        uint32_t rss_bits;
+
+        memcpy( &rss_bits, &rss, sizeof( rss_bits ) );
+        put_u32( rss_le, rss_bits );
+
+        tap_length += tap_tlv( tap + tap_length, 1, rss_le, 4 );
+        tap_length += tap_tlv( tap + tap_length, 10, &frame->lqi, 1 );
+    }
+
+    tap[ 0 ] = 0; //Version.
+    tap[ 1 ] = 0;
+    put_u16( tap + 2, (uint16_t)tap_length );
+
+    uint8_t record[ 16 ];
+    uint32_t captured = (uint32_t)(tap_length + frame->length);
+
+    put_u32( record, (uint32_t)(frame->time_us / 1000000ULL) );
+    put_u32( record + 4, (uint32_t)(frame->time_us % 1000000ULL) );
+    put_u32( record + 8, captured );
+    put_u32( record + 12, captured );
+
+    fwrite( record, 1, sizeof( record ), pcap_out );
+    fwrite( tap, 1, tap_length, pcap_out );
+    fwrite( frame->psdu, 1, frame->length, pcap_out );
+
+    if (pcap_flush_each) { fflush( pcap_out ); }
+
+    statistics.frames++;
+}
+
+/*! \brief  Convert a device timestamp to host time. The first record is
+ *          anchored to the host clock, and later ones follow the device clock
+ *          so the spacing between frames is exact.
+ */
+static uint64_t clock_map_convert( uint32_t symbols ){
+
+    if (!clock_map.anchored) {
+
+        clock_map.anchored     = true;
+        clock_map.anchor_us    = host_time_us( );
+        clock_map.last_symbols = symbols;
+        clock_map.elapsed_us   = 0;
+    }
+
+    uint32_t delta = (symbols - clock_map.last_symbols) & SYMBOL_MASK;
+
+    clock_map.last_symbols = symbols;
+    clock_map.elapsed_us  += (uint64_t)delta * US_PER_SYMBOL;
+
+    return clock_map.anchor_us + clock_map.elapsed_us;
+}
+
+/*! \brief  Decode a complete, checksum verified binary record. */
+static void binary_record( const uint8_t *body, uint8_t body_length ){
+
+    uint8_t flags       = body[ 0 ];
+    uint8_t dropped     = body[ 1 ];
+    uint32_t timestamp  = (uint32_t)body[ 2 ] | ((uint32_t)body[ 3 ] << 8) |
+                          ((uint32_t)body[ 4 ] << 16) | ((uint32_t)body[ 5 ] << 24);
+    uint8_t psdu_length = body[ 8 ];
+
+    if (psdu_length != body_length - SNIFFER_RECORD_OVERHEAD) { return; }
+
+    statistics.dropped += dropped;
+
+    if (flags & SNIFFER_FLAG_BAD_LENGTH) {
+        statistics.bad_length++;
+        return;
+    }
+
+    if (!(flags & SNIFFER_FLAG_CRC_OK)) { statistics.crc_errors++; }
+
+    frame_t frame;
+
+    memcpy( frame.psdu, body + SNIFFER_RECORD_OVERHEAD, psdu_length );
+    frame.length         = psdu_length;
+    frame.has_fcs        = true; //Wireshark flags the bad ones.
+    frame.has_radio_info = true;
+    frame.lqi            = body[ 6 ];
+    frame.ed             = body[ 7 ];
+    frame.time_us        = clock_map_convert( timestamp );
+
+    pcap_write_frame( &frame );
+}
+
+/*! \brief  Feed one byte to the binary parser. Records with a wrong length or
+ *          checksum are skipped one byte at a time until the next sync.
+ */
+static void binary_feed( binary_parser_t *parser, uint8_t byte ){
+
+    parser->buffer[ parser->used++ ] = byte;
+
+    for (;;) {
+
+        size_t skip = 0;
+
+        if ((parser->used >= 1) && (parser->buffer[ 0 ] != SNIFFER_SYNC_0)) {
+            skip = 1;
+        } else if ((parser->used >= 2) && (parser->buffer[ 1 ] != SNIFFER_SYNC_1)) {
+            skip = 1;
+        } else if (parser->used >= 3) {
+
+            uint8_t body_length = parser->buffer[ 2 ];
+            size_t total = 3 + body_length + 2;
+
+            if ((body_length < SNIFFER_RECORD_OVERHEAD) ||
+                (body_length > SNIFFER_RECORD_OVERHEAD + MAX_PSDU_LENGTH)) {
+                skip = 1;
+            } else if (parser->used < total) {
+                return;
+            } else {
+
+                uint16_t crc = 0;
+
+                for (size_t i = 2; i < (size_t)(3 + body_length); i++) {
+                    crc = crc_ccitt_update( crc, parser->buffer[ i ] );
+                }
+
+                uint16_t received = parser->buffer[ 3 + body_length ] |
+                                    (parser->buffer[ 4 + body_length ] << 8);
+
+                if (crc == received) {
+                    binary_record( parser->buffer + 3, body_length );
+                    skip = total;
+                } else {
+                    skip = 1;
+                }
+            }
+        } else {
+            return;
+        }
+
+        if (skip == 1) { statistics.resync_bytes++; }
+
+        parser->used -= skip;
+        memmove( parser->buffer, parser->buffer + skip, parser->used );
+
+        if (parser->used == 0) { return; }
+    }
+}
+
+static uint8_t hex_value( char digit ){
+    return isdigit( (unsigned char)digit ) ? digit - '0' : toupper( (unsigned char)digit ) - 'A' + 10;
+}
+
+/*! \brief  Decode one 36 digit hex dump record. The receiver prints
+ *          data[10], data[9], length, data[4], data[3], data[19], data[2],
+ *          data[6], data[5], data[8], data[7], data[12], data[13], data[14],
+ *          data[16], data[15], data[18], data[17].
+ */
+static void hex_record( const char *digits ){
+
+    static const int8_t order[ 18 ] = { 10, 9, -1, 4, 3, 19, 2, 6, 5, 8, 7,
+                                        12, 13, 14, 16, 15, 18, 17 };
+    uint8_t bytes[ 18 ];
+
+    for (int i = 0; i < 18; i++) {
+        bytes[ i ] = (hex_value( digits[ 2 * i ] ) << 4) | hex_value( digits[ 2 * i + 1 ] );
+    }
+
+    frame_t frame;
+
+    memset( frame.psdu, 0, sizeof( frame.psdu ) );
+    frame.psdu[ 0 ]  = 0x61; //FCF of testsend's data frames, not printed.
+    frame.psdu[ 1 ]  = 0x88;
+    frame.psdu[ 11 ] = 3;    //Data length, not printed.
+
+    for (int i = 0; i < 18; i++) {
+        if (order[ i ] >= 0) { frame.psdu[ order[ i ] ] = bytes[ i ]; }
+    }
+
+    //The printed length includes the FCS, which is not printed.
+    uint8_t length = (bytes[ 2 ] >= 2) ? bytes[ 2 ] - 2 : 0;
+
+    frame.length         = (length < HEX_FRAME_LENGTH) ? length : HEX_FRAME_LENGTH;
+    frame.has_fcs        = false;
+    frame.has_radio_info = false;
+    frame.time_us        = host_time_us( );
+
+    pcap_write_frame( &frame );
+}
+
+/*! \brief  Feed one character to the hex dump parser. A record starts with
+ *          the start symbol "0DB5" and ends with the end symbol "0CD5"; any
+ *          other alignment is skipped one digit at a time.
+ */
+static void hex_feed( hex_parser_t *parser, char c ){
+
+    if (!isxdigit( (unsigned char)c )) { return; }
+
+    parser->digits[ parser->used++ ] = (char)toupper( (unsigned char)c );
+
+    while (parser->used > 0) {
+
+        size_t check = (parser->used < 4) ? parser->used : 4;
+
+        if (strncmp( parser->digits, "0DB5", check ) != 0) {
+            statistics.resync_bytes++;
+        } else if (parser->used < HEX_RECORD_DIGITS) {
+            return;
+        } else if (strncmp( parser->digits + HEX_RECORD_DIGITS - 4, "0CD5", 4 ) == 0) {
+            hex_record( parser->digits );
+            parser->used = 0;
+            return;
+        } else {
+            statistics.resync_bytes++;
+        }
+
+        parser->used--;
+        memmove( parser->digits, parser->digits + 1, parser->used );
+    }
+}
+
+/*! \brief  Put a serial port in raw mode at the requested baud rate. */
+static int configure_tty( int fd, long baud ){
+
+    static const struct { long baud; speed_t speed; } speeds[] = {
+        { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+        { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 },
+        { 500000, B500000 }, { 921600, B921600 }, { 1000000, B1000000 },
+    };
+
+    struct termios tio;
+
+    if (tcgetattr( fd, &tio ) != 0) { return -1; }
+
+    cfmakeraw( &tio );
+
+    for (size_t i = 0; i < sizeof( speeds ) / sizeof( speeds[ 0 ] ); i++) {
+
+        if (speeds[ i ].baud == baud) {
+
+            cfsetispeed( &tio, speeds[ i ].speed );
+            cfsetospeed( &tio, speeds[ i ].speed );
+
+            return tcsetattr( fd, TCSANOW, &tio );
+        }
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+/*! \brief  Guess the format from the first chunk: the hex dump is printable. */
+static input_format_t detect_format( const uint8_t *data, size_t length ){
+
+    for (size_t i = 0; i < length; i++) {
+        if (!isprint( data[ i ] ) && !isspace( data[ i ] )) { return FORMAT_BINARY; }
+    }
+
+    return FORMAT_HEX;
+}
+
+static void usage( const char *name ){
+
+    fprintf( stderr, "usage: %s [-f auto|binary|hex] [-b baud] [-c channel] "
+                     "[-o out.pcap] [input]\n", name );
+    exit( 2 );
+}
+
+int main( int argc, char **argv ){
+
+    input_format_t format = FORMAT_AUTO;
+    long baud = 500000;
+    const char *output_name = NULL;
+    int option;
+
+    while ((option = getopt( argc, argv, "f:b:c:o:" )) != -1) {
+
+        switch (option) {
+        case 'f':
+            if (strcmp( optarg, "binary" ) == 0) {
+                format = FORMAT_BINARY;
+            } else if (strcmp( optarg, "hex" ) == 0) {
+                format = FORMAT_HEX;
+            } else if (strcmp( optarg, "auto" ) == 0) {
+                format = FORMAT_AUTO;
+            } else {
+                usage( argv[ 0 ] );
+            }
+            break;
+        case 'b':
+            baud = strtol( optarg, NULL, 10 );
+            break;
+        case 'c':
+            channel = (uint16_t)strtoul( optarg, NULL, 10 );
+            break;
+        case 'o':
+            output_name = optarg;
+            break;
+        default:
+            usage( argv[ 0 ] );
+        }
+    }
+
+    if (argc - optind > 1) { usage( argv[ 0 ] ); }
+
+    int fd = STDIN_FILENO;
+
+    if (optind < argc) {
+
+        fd = open( argv[ optind ], O_RDONLY | O_NOCTTY );
+
+        if (fd < 0) {
+            perror( argv[ optind ] );
+            return 1;
+        }
+    }
+
+    if (isatty( fd ) && (configure_tty( fd, baud ) != 0)) {
+        perror( "serial port" );
+        return 1;
+    }
+
+    pcap_out = stdout;
+
+    if (output_name != NULL) {
+
+        pcap_out = fopen( output_name, "wb" );
+
+        if (pcap_out == NULL) {
+            perror( output_name );
+            return 1;
+        }
+    }
+
+    //Flush every packet unless writing to a regular file, so a live reader
+    //sees each frame as soon as it is captured.
+    struct stat out_stat;
+
+    pcap_flush_each = (fstat( fileno( pcap_out ), &out_stat ) != 0) ||
+                      !S_ISREG( out_stat.st_mode );
+
+    pcap_write_header( );
+
+    static binary_parser_t binary_parser;
+    static hex_parser_t hex_parser;
+    uint8_t chunk[ READ_CHUNK_SIZE ];
+    ssize_t length;
+
+    while ((length = read( fd, chunk, sizeof( chunk ) )) != 0) {
+
+        if (length < 0) {
+
+            if (errno == EINTR) { continue; }
+
+            perror( "read" );
+            break;
+        }
+
+        if (format == FORMAT_AUTO) { format = detect_format( chunk, (size_t)length ); }
+
+        for (ssize_t i = 0; i < length; i++) {
+
+            if (format == FORMAT_BINARY) {
+                binary_feed( &binary_parser, chunk[ i ] );
+            } else {
+                hex_feed( &hex_parser, (char)chunk[ i ] );
+            }
+        }
+    }
+
+    fflush( pcap_out );
+
+    fprintf( stderr, "%lu frames, %lu with bad FCS, %lu with bad PHR, "
+                     "%lu lost on the node, %lu bytes skipped\n",
+             statistics.frames, statistics.crc_errors, statistics.bad_length,
+             statistics.dropped, statistics.resync_bytes );
+
+    return 0;
+}
+/*EOF*/
@@ -0,0 +1,395 @@
+/*! \file tracedump.c
+ *
+ *  \brief  Host tool that decodes the event trace of a node built with TRACE
+ *          (see include/trace.h in testsend and umspreceive) into a timeline.
+ *
+ *          If the input is a tty it is put in raw mode and, unless -w is
+ *          given, the dump command is sent. With -w the tool keeps reading
+ *          and prints every dump, e.g. the ones caused by a pool overflow or
+ *          a failed transmission. Other input, such as a capture of the
+ *          serial port, is searched for all valid records.
+ *
+ *          Each line shows the time since the first event in the record, the
+ *          time since the previous event, the event and its decoded argument.
+ *
+ *          Build: cc -std=gnu99 -O2 -Wall -o tracedump tracedump.c
+ *
+ *          Usage: tracedump [-b baud] [-w] [input]
+ */
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+/*============================ MACROS ========================================*/
+#define TRACE_SYNC_0             ( 0xA5 )
+#define TRACE_SYNC_1             ( 0x54 )
+#define TRACE_HEADER_SIZE        ( 6 ) //!< Count, flags, reason and time MSB.
+#define TRACE_MAX_EVENTS         ( 256 )
+#define TRACE_FLAG_WRAPPED       ( 0x01 )
+#define TRACE_FLAG_TRIGGERED     ( 0x02 )
+#define US_PER_SYMBOL            ( 16 )
+#define SYMBOL_MASK              ( 0x7FFFFFFFUL )
+#define TIMEOUT_US               ( 3000000 )
+#define MAX_RECORD               ( 2 + TRACE_HEADER_SIZE + 4 * TRACE_MAX_EVENTS + 2 )
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Event types, in trace_event_id_t order. */
+enum{
+    TRACE_TIME = 0, TRACE_IRQ, TRACE_STATE, TRACE_TX, TRACE_TRAC, TRACE_RX,
+    TRACE_RX_CRC_ERROR, TRACE_POOL, TRACE_POOL_OVERFLOW, TRACE_TRIGGER, TRACE_MARK
+};
+/*============================ VARIABLES =====================================*/
+static const char *const event_names[] = {
+    "time", "irq", "state", "tx", "trac", "rx", "rx_crc_error", "pool",
+    "pool_overflow", "trigger", "mark",
+};
+
+static const char *const irq_names[ 8 ] = {
+    "PLL_LOCK", "PLL_UNLOCK", "RX_START", "TRX_END", "CCA_ED_READY", "AMI", "TRX_UR", "BAT_LOW",
+};
+
+static const char *const trigger_names[] = { "none", "pool_overflow", "tx_failed" };
+/*============================ PROTOTYPES ====================================*/
+
+/*! \brief  Same checksum as crc_ccitt_update on the AVR (CRC-16/KERMIT). */
+static uint16_t crc_ccitt_update( uint16_t crc, uint8_t data ){
+
+    data ^= (uint8_t)(crc & 0xFF);
+    data ^= (uint8_t)(data << 4);
+
+    return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^
+            ((uint16_t)data << 3));
+}
+
+static const char *state_name( uint8_t state ){
+
+    switch (state) {
+    case 0:  return "P_ON";
+    case 1:  return "BUSY_RX";
+    case 2:  return "BUSY_TX";
+    case 6:  return "RX_ON";
+    case 8:  return "TRX_OFF";
+    case 9:  return "PLL_ON";
+    case 15: return "SLEEP";
+    case 17: return "BUSY_RX_AACK";
+    case 18: return "BUSY_TX_ARET";
+    case 22: return "RX_AACK_ON";
+    case 25: return "TX_ARET_ON";
+    case 28: return "RX_ON_NOCLK";
+    case 29: return "RX_AACK_ON_NOCLK";
+    case 30: return "BUSY_RX_AACK_NOCLK";
+    case 31: return "STATE_TRANSITION";
+    default: return "?";
+    }
+}
+
+static const char *trac_name( uint8_t trac ){
+
+    switch (trac) {
+    case 0:  return "SUCCESS";
+    case 1:  return "SUCCESS_DATA_PENDING";
+    case 2:  return "WAIT_FOR_ACK";
+    case 3:  return "CHANNEL_ACCESS_FAILURE";
+    case 5:  return "NO_ACK";
+    case 7:  return "INVALID";
+    default: return "?";
+    }
+}
+
+/*! \brief  Render the argument of an event. */
+static void describe( uint8_t event, uint8_t arg, char *text, size_t size ){
+
+    switch (event) {
+    case TRACE_IRQ: {
+
+        size_t used = 0;
+
+        text[ 0 ] = '\0';
+
+        for (int bit = 0; bit < 8; bit++) {
+            if ((arg & (1 << bit)) && (used < size)) {
+                used += (size_t)snprintf( text + used, size - used, "%s%s", used ? "|" : "", irq_names[ bit ] );
+            }
+        }
+
+        if (arg == 0) { snprintf( text, size, "none" ); }
+        break;
+    }
+    case TRACE_STATE:
+        snprintf( text, size, "%s (%u)", state_name( arg ), arg );
+        break;
+    case TRACE_TRAC:
+        snprintf( text, size, "%s (%u)", trac_name( arg ), arg );
+        break;
+    case TRACE_TX:
+    case TRACE_RX:
+    case TRACE_RX_CRC_ERROR:
+        snprintf( text, size, "length %u", arg );
+        break;
+    case TRACE_POOL:
+    case TRACE_POOL_OVERFLOW:
+        snprintf( text, size, "used %u", arg );
+        break;
+    case TRACE_TRIGGER:
+        snprintf( text, size, "%s", (arg < sizeof( trigger_names ) / sizeof( trigger_names[ 0 ] )) ?
+                  trigger_names[ arg ] : "user" );
+        break;
+    default:
+        snprintf( text, size, "%u", arg );
+        break;
+    }
+}
+
+/*! \brief  Print one record as a timeline. */
+static void print_record( const uint8_t *record ){
+
+    uint16_t count = record[ 2 ] | (record[ 3 ] << 8);
+    uint8_t flags = record[ 4 ];
+    uint8_t reason = record[ 5 ];
+    uint32_t msb = record[ 6 ] | (record[ 7 ] << 8);
+    const uint8_t *p = record + 2 + TRACE_HEADER_SIZE;
+    bool first = true;
+    uint32_t start = 0;
+    uint32_t previous = 0;
+
+    printf( "trace: %u events%s%s", count,
+            (flags & TRACE_FLAG_WRAPPED) ? ", wrapped" : "",
+            (flags & TRACE_FLAG_TRIGGERED) ? ", triggered by " : "" );
+
+    if (flags & TRACE_FLAG_TRIGGERED) {
+        printf( "%s", (reason < sizeof( trigger_names ) / sizeof( trigger_names[ 0 ] )) ?
+                trigger_names[ reason ] : "user" );
+    }
+
+    printf( "\n%12s %10s  %-14s %s\n", "time_ms", "delta_us", "event", "argument" );
+
+    for (uint16_t i = 0; i < count; i++, p += 4) {
+
+        uint8_t event = p[ 0 ];
+        uint8_t arg = p[ 1 ];
+        uint16_t lsb = p[ 2 ] | (p[ 3 ] << 8);
+
+        if (event == TRACE_TIME) {
+            msb = lsb;
+            continue;
+        }
+
+        uint32_t time = (msb << 16) | lsb;
+
+        if (first) {
+            start = time;
+            previous = time;
+            first = false;
+        }
+
+        char text[ 96 ];
+        const char *name = (event < sizeof( event_names ) / sizeof( event_names[ 0 ] )) ? event_names[ event ] : "?";
+
+        describe( event, arg, text, sizeof( text ) );
+
+        //An event from an interrupt may be stamped just before the one logged before it.
+        long delta = (long)((time - previous) & SYMBOL_MASK);
+
+        if (delta > (long)(SYMBOL_MASK / 2)) { delta -= (long)SYMBOL_MASK + 1; }
+
+        printf( "%12.3f %10ld  %-14s %s\n",
+                (double)((time - start) & SYMBOL_MASK) * US_PER_SYMBOL / 1000.0,
+                delta * US_PER_SYMBOL, name, text );
+
+        previous = time;
+    }
+
+    printf( "\n" );
+    fflush( stdout );
+}
+
+/*! \brief  Put a serial port in raw mode at the requested baud rate. */
+static int configure_tty( int fd, long baud ){
+
+    static const struct { long baud; speed_t speed; } speeds[] = {
+        { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+        { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 },
+        { 500000, B500000 },
+    };
+
+    struct termios tio;
+
+    if (tcgetattr( fd, &tio ) != 0) { return -1; }
+
+    cfmakeraw( &tio );
+
+    for (size_t i = 0; i < sizeof( speeds ) / sizeof( speeds[ 0 ] ); i++) {
+
+        if (speeds[ i ].baud == baud) {
+
+            cfsetispeed( &tio, speeds[ i ].speed );
+            cfsetospeed( &tio, speeds[ i ].speed );
+
+            return tcsetattr( fd, TCSANOW, &tio );
+        }
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+/*! \brief  Read, with a timeout on ttys unless waiting forever.
+ *
+ *  \return Bytes read, 0 at end of input or timeout, -1 on error.
+ */
+static ssize_t read_some( int fd, uint8_t *buffer, size_t size, bool timeout ){
+
+    if (timeout) {
+
+        fd_set set;
+        struct timeval limit = { TIMEOUT_US / 1000000, TIMEOUT_US % 1000000 };
+
+        FD_ZERO( &set );
+        FD_SET( fd, &set );
+
+        int ready = select( fd + 1, &set, NULL, NULL, &limit );
+
+        if (ready <= 0) { return ready; }
+    }
+
+    return read( fd, buffer, size );
+}
+
+/*! \brief  Print every complete record in the buffer.
+ *
+ *  \return Number of bytes consumed.
+ */
+static size_t parse( const uint8_t *buffer, size_t length, unsigned *records ){
+
+    size_t i = 0;
+
+    while (i + 2 + TRACE_HEADER_SIZE <= length) {
+
+        if ((buffer[ i ] != TRACE_SYNC_0) || (buffer[ i + 1 ] != TRACE_SYNC_1)) {
+            i++;
+            continue;
+        }
+
+        uint16_t count = buffer[ i + 2 ] | (buffer[ i + 3 ] << 8);
+
+        if (count > TRACE_MAX_EVENTS) {
+            i++;
+            continue;
+        }
+
+        size_t body = TRACE_HEADER_SIZE + 4 * (size_t)count;
+
+        if (i + 2 + body + 2 > length) { break; } //Wait for the rest.
+
+        uint16_t crc = 0;
+
+        for (size_t j = 0; j < body; j++) { crc = crc_ccitt_update( crc, buffer[ i + 2 + j ] ); }
+
+        if (crc != (buffer[ i + 2 + body ] | (buffer[ i + 3 + body ] << 8))) {
+            i++;
+            continue;
+        }
+
+        print_record( buffer + i );
+        (*records)++;
+        i += 2 + body + 2;
+    }
+
+    return i;
+}
+
+static void usage( const char *name ){
+
+    fprintf( stderr, "usage: %s [-b baud] [-w] [input]\n", name );
+    exit( 2 );
+}
+
+int main( int argc, char **argv ){
+
+    long baud = 9600;
+    bool wait = false;
+    int option;
+
+    while ((option = getopt( argc, argv, "b:w" )) != -1) {
+
+        switch (option) {
+        case 'b': baud = strtol( optarg, NULL, 10 ); break;
+        case 'w': wait = true; break;
+        default: usage( argv[ 0 ] );
+        }
+    }
+
+    if (argc - optind > 1) { usage( argv[ 0 ] ); }
+
+    int fd = STDIN_FILENO;
+
+    if (optind < argc) {
+
+        fd = open( argv[ optind ], O_RDWR | O_NOCTTY );
+
+        if (fd < 0) {
+            perror( argv[ optind ] );
+            return 1;
+        }
+    }
+
+    bool tty = isatty( fd );
+
+    if (tty) {
+
+        if (configure_tty( fd, baud ) != 0) {
+            perror( "configure tty" );
+            return 1;
+        }
+
+        tcflush( fd, TCIOFLUSH );
+
+        if (!wait && (write( fd, "T\r", 2 ) != 2)) {
+            perror( "write" );
+            return 1;
+        }
+    }
+
+    static uint8_t buffer[ 4 * MAX_RECORD ];
+    size_t used = 0;
+    unsigned records = 0;
+
+    for (;;) {
+
+        ssize_t n = read_some( fd, buffer + used, sizeof( buffer ) - used, tty && !wait );
+
+        if (n < 0) {
+            perror( "read" );
+            return 1;
+        }
+
+        if (n == 0) { break; }
+
+        used += (size_t)n;
+
+        size_t consumed = parse( buffer, used, &records );
+
+        //Never keep more than one record's worth of unmatched input.
+        if (used - consumed > MAX_RECORD) { consumed = used - MAX_RECORD; }
+
+        memmove( buffer, buffer + consumed, used - consumed );
+        used -= consumed;
+
+        if (tty && !wait && (records > 0)) { break; }
+    }
+
+    if (records == 0) {
+        fprintf( stderr, "no trace record found\n" );
+        return 1;
+    }
+
+    return 0;
+}
+/*EOF*/
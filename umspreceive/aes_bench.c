@@ -0,0 +1,274 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config_uart_extended.h"
+#include "at86rf231.h"
+
+#include "compiler.h"
+#include "hal.h"
+#include "com.h"
+#include "prof.h"
+#include "sal.h"
+#include "aes_bench.h"
+
+#if defined( AES_BENCHMARK )
+#if !defined( PROFILING )
+    #error "AES_BENCHMARK needs PROFILING, the cycles are counted with prof_get_cycles."
+#endif
+/*============================ MACROS ========================================*/
+#define AES_BENCH_VECTORS        ( 4 ) //!< Blocks in the ECB vectors; longer chains repeat them.
+/*============================ TYPEDEFS ======================================*/
+/*============================ VARIABLES =====================================*/
+
+/*! \name   Known-answer tests from NIST SP 800-38A, F.1.1 (ECB-AES128) and
+ *          F.2.1 (CBC-AES128). The CBC blocks 5 to 8 continue the chain with
+ *          the 4 plaintext blocks again.
+ *  @{
+ */
+static const uint8_t aes_bench_key_vector[ AES_KEYSIZE ] PROGMEM = {
+    0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C
+};
+
+static const uint8_t aes_bench_iv[ AES_BLOCKSIZE ] PROGMEM = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F
+};
+
+static const uint8_t aes_bench_plain[ AES_BENCH_VECTORS ][ AES_BLOCKSIZE ] PROGMEM = {
+    { 0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96, 0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A },
+    { 0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C, 0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51 },
+    { 0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11, 0xE5, 0xFB, 0xC1, 0x19, 0x1A, 0x0A, 0x52, 0xEF },
+    { 0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B, 0x17, 0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10 }
+};
+
+static const uint8_t aes_bench_ecb[ AES_BENCH_VECTORS ][ AES_BLOCKSIZE ] PROGMEM = {
+    { 0x3A, 0xD7, 0x7B, 0xB4, 0x0D, 0x7A, 0x36, 0x60, 0xA8, 0x9E, 0xCA, 0xF3, 0x24, 0x66, 0xEF, 0x97 },
+    { 0xF5, 0xD3, 0xD5, 0x85, 0x03, 0xB9, 0x69, 0x9D, 0xE7, 0x85, 0x89, 0x5A, 0x96, 0xFD, 0xBA, 0xAF },
+    { 0x43, 0xB1, 0xCD, 0x7F, 0x59, 0x8E, 0xCE, 0x23, 0x88, 0x1B, 0x00, 0xE3, 0xED, 0x03, 0x06, 0x88 },
+    { 0x7B, 0x0C, 0x78, 0x5E, 0x27, 0xE8, 0xAD, 0x3F, 0x82, 0x23, 0x20, 0x71, 0x04, 0x72, 0x5D, 0xD4 }
+};
+
+static const uint8_t aes_bench_cbc[ AES_BENCH_MAX_BLOCKS ][ AES_BLOCKSIZE ] PROGMEM = {
+    { 0x76, 0x49, 0xAB, 0xAC, 0x81, 0x19, 0xB2, 0x46, 0xCE, 0xE9, 0x8E, 0x9B, 0x12, 0xE9, 0x19, 0x7D },
+    { 0x50, 0x86, 0xCB, 0x9B, 0x50, 0x72, 0x19, 0xEE, 0x95, 0xDB, 0x11, 0x3A, 0x91, 0x76, 0x78, 0xB2 },
+    { 0x73, 0xBE, 0xD6, 0xB8, 0xE3, 0xC1, 0x74, 0x3B, 0x71, 0x16, 0xE6, 0x9E, 0x22, 0x22, 0x95, 0x16 },
+    { 0x3F, 0xF1, 0xCA, 0xA1, 0x68, 0x1F, 0xAC, 0x09, 0x12, 0x0E, 0xCA, 0x30, 0x75, 0x86, 0xE1, 0xA7 },
+    { 0x1F, 0x55, 0x12, 0xB4, 0xE7, 0x73, 0xA5, 0x91, 0xE3, 0x38, 0x01, 0x09, 0xA5, 0x5E, 0x8B, 0x75 },
+    { 0xD0, 0xCE, 0x36, 0x6B, 0xFF, 0x52, 0x44, 0xE8, 0xDD, 0x3B, 0xAD, 0xA4, 0x59, 0x09, 0x05, 0x34 },
+    { 0xBE, 0x69, 0xF5, 0x10, 0x6B, 0x17, 0x10, 0x3B, 0x3C, 0xD1, 0x67, 0x26, 0xE8, 0x62, 0x50, 0x8C },
+    { 0x83, 0xE3, 0xC0, 0x6B, 0xA3, 0xF9, 0x13, 0xF7, 0x28, 0x47, 0x22, 0xAD, 0x4E, 0x85, 0xDD, 0x41 }
+};
+//! @}
+
+static uint8_t aes_bench_key[ AES_KEYSIZE ]; //!< aes_bench_key_vector, in RAM for sal.c.
+static uint8_t aes_bench_input[ AES_BENCH_MAX_BLOCKS ][ AES_BLOCKSIZE ]; //!< Blocks written to the engine.
+static uint8_t aes_bench_output[ AES_BENCH_MAX_BLOCKS ][ AES_BLOCKSIZE ]; //!< Blocks read back.
+
+static uint8_t debug_aes_bench[] = AES_BENCH_TEXT; //!< Debug Text.
+/*============================ PROTOTYPES ====================================*/
+static uint32_t aes_bench_measure( aes_bench_kind_t kind, uint8_t blocks );
+static void aes_bench_once( aes_bench_kind_t kind, uint8_t blocks );
+static void aes_bench_chain( uint8_t mode, uint8_t dir, uint8_t blocks );
+static void aes_bench_load( const uint8_t *vectors, uint8_t count );
+static bool aes_bench_check( const uint8_t *vectors, uint8_t count, uint8_t blocks );
+static void aes_bench_send( aes_bench_kind_t kind, uint8_t blocks, uint32_t value );
+
+/*! \brief  Measure sal.c and the AES engine, and check the results against
+ *          the known-answer tests.
+ *
+ *          The times include the SPI transfers and the 24 us wait of
+ *          sal_aes_wrrd; the input blocks are in RAM before the timer starts.
+ *          The key of sal.c is replaced by the test key, so users of sal.c
+ *          must load their key again (ccm.c does for every frame).
+ *
+ *  \param  result Where the results are stored.
+ *
+ *  \ingroup aes_bench
+ */
+void aes_bench_run( aes_bench_result_t *result ){
+
+    memcpy_P( aes_bench_key, aes_bench_key_vector, AES_KEYSIZE );
+
+    result->failures = 0;
+
+    result->key_setup   = aes_bench_measure( AES_BENCH_KEY_SETUP, 0 );
+    result->decrypt_key = aes_bench_measure( AES_BENCH_DECRYPT_KEY, 0 );
+
+    //Start from encryption, so that every run switches both ways.
+    sal_aes_setup( NULL, AES_MODE_ECB, AES_DIR_ENCRYPT );
+    result->dir_switch = aes_bench_measure( AES_BENCH_DIR_SWITCH, 0 );
+
+    for (uint8_t blocks = 1; blocks <= AES_BENCH_MAX_BLOCKS; blocks++) {
+
+        aes_bench_load( &aes_bench_plain[ 0 ][ 0 ], AES_BENCH_VECTORS );
+        result->ecb_encrypt[ blocks - 1 ] = aes_bench_measure( AES_BENCH_ECB_ENCRYPT, blocks );
+        if (aes_bench_check( &aes_bench_ecb[ 0 ][ 0 ], AES_BENCH_VECTORS, blocks ) == false) { result->failures++; }
+
+        aes_bench_load( &aes_bench_ecb[ 0 ][ 0 ], AES_BENCH_VECTORS );
+        result->ecb_decrypt[ blocks - 1 ] = aes_bench_measure( AES_BENCH_ECB_DECRYPT, blocks );
+        if (aes_bench_check( &aes_bench_plain[ 0 ][ 0 ], AES_BENCH_VECTORS, blocks ) == false) { result->failures++; }
+
+        //The engine has no IV: the first block is XORed here and encrypted in ECB mode.
+        aes_bench_load( &aes_bench_plain[ 0 ][ 0 ], AES_BENCH_VECTORS );
+        for (uint8_t i = 0; i < AES_BLOCKSIZE; i++) { aes_bench_input[ 0 ][ i ] ^= pgm_read_byte( &aes_bench_iv[ i ] ); }
+        result->cbc_encrypt[ blocks - 1 ] = aes_bench_measure( AES_BENCH_CBC_ENCRYPT, blocks );
+        if (aes_bench_check( &aes_bench_cbc[ 0 ][ 0 ], AES_BENCH_MAX_BLOCKS, blocks ) == false) { result->failures++; }
+    }
+}
+
+/*! \brief  Send the results on the UART, in the format described in
+ *          aes_bench.h.
+ *
+ *  \param  result Results of aes_bench_run.
+ *
+ *  \ingroup aes_bench
+ */
+void aes_bench_report( aes_bench_result_t *result ){
+
+    aes_bench_send( AES_BENCH_KEY_SETUP, 0, result->key_setup );
+    aes_bench_send( AES_BENCH_DECRYPT_KEY, 0, result->decrypt_key );
+    aes_bench_send( AES_BENCH_DIR_SWITCH, 0, result->dir_switch );
+
+    for (uint8_t blocks = 1; blocks <= AES_BENCH_MAX_BLOCKS; blocks++) {
+
+        aes_bench_send( AES_BENCH_ECB_ENCRYPT, blocks, result->ecb_encrypt[ blocks - 1 ] );
+        aes_bench_send( AES_BENCH_ECB_DECRYPT, blocks, result->ecb_decrypt[ blocks - 1 ] );
+        aes_bench_send( AES_BENCH_CBC_ENCRYPT, blocks, result->cbc_encrypt[ blocks - 1 ] );
+    }
+
+    aes_bench_send( AES_BENCH_KAT, 0, result->failures );
+}
+
+/*! \brief  Handle a command received on the UART. Must be called from the
+ *          main loop, with the result of com_get_command.
+ *
+ *  \param  command Command character. Only AES_BENCH_COMMAND is handled.
+ *
+ *  \retval true The benchmark was run.
+ *  \retval false The command is not an AES benchmark command.
+ *
+ *  \ingroup aes_bench
+ */
+bool aes_bench_command( uint8_t command ){
+
+    static aes_bench_result_t result;
+
+    if (command != AES_BENCH_COMMAND) { return false; }
+
+    aes_bench_run( &result );
+    aes_bench_report( &result );
+
+    return true;
+}
+
+/*! \brief  Run one measurement AES_BENCH_REPEAT times.
+ *
+ *  \return Shortest run in cycles.
+ */
+static uint32_t aes_bench_measure( aes_bench_kind_t kind, uint8_t blocks ){
+
+    uint32_t shortest = UINT32_MAX;
+
+    for (uint8_t n = 0; n < AES_BENCH_REPEAT; n++) {
+
+        uint32_t start = prof_get_cycles( );
+
+        aes_bench_once( kind, blocks );
+
+        uint32_t cycles = prof_get_cycles( ) - start;
+
+        if (cycles < shortest) { shortest = cycles; }
+    }
+
+    return shortest;
+}
+
+/*! \brief  The operations that are timed for each kind. */
+static void aes_bench_once( aes_bench_kind_t kind, uint8_t blocks ){
+
+    switch (kind) {
+    case AES_BENCH_KEY_SETUP:
+        sal_aes_setup( aes_bench_key, AES_MODE_ECB, AES_DIR_ENCRYPT );
+        break;
+
+    case AES_BENCH_DECRYPT_KEY:
+        sal_aes_setup( aes_bench_key, AES_MODE_ECB, AES_DIR_DECRYPT );
+        break;
+
+    case AES_BENCH_DIR_SWITCH:
+        sal_aes_setup( NULL, AES_MODE_ECB, AES_DIR_DECRYPT );
+        sal_aes_setup( NULL, AES_MODE_ECB, AES_DIR_ENCRYPT );
+        break;
+
+    case AES_BENCH_ECB_DECRYPT:
+        aes_bench_chain( AES_MODE_ECB, AES_DIR_DECRYPT, blocks );
+        break;
+
+    case AES_BENCH_CBC_ENCRYPT:
+        aes_bench_chain( AES_MODE_CBC, AES_DIR_ENCRYPT, blocks );
+        break;
+
+    default:
+        aes_bench_chain( AES_MODE_ECB, AES_DIR_ENCRYPT, blocks );
+        break;
+    }
+}
+
+/*! \brief  Run aes_bench_input through the engine into aes_bench_output.
+ *
+ *          Each sal_aes_wrrd reads back the result of the block before, so
+ *          the last one is fetched with sal_aes_read. In CBC mode the first
+ *          block is done in ECB mode, and the engine chains the rest.
+ */
+static void aes_bench_chain( uint8_t mode, uint8_t dir, uint8_t blocks ){
+
+    sal_aes_setup( NULL, AES_MODE_ECB, dir );
+    sal_aes_wrrd( aes_bench_input[ 0 ], NULL );
+
+    if (mode == AES_MODE_CBC) { sal_aes_setup( NULL, AES_MODE_CBC, dir ); }
+
+    for (uint8_t i = 1; i < blocks; i++) { sal_aes_wrrd( aes_bench_input[ i ], aes_bench_output[ i - 1 ] ); }
+
+    sal_aes_read( aes_bench_output[ blocks - 1 ] );
+}
+
+/*! \brief  Fill aes_bench_input with vectors from flash, repeated. */
+static void aes_bench_load( const uint8_t *vectors, uint8_t count ){
+
+    for (uint8_t i = 0; i < AES_BENCH_MAX_BLOCKS; i++) {
+        memcpy_P( aes_bench_input[ i ], vectors + (i % count) * AES_BLOCKSIZE, AES_BLOCKSIZE );
+    }
+}
+
+/*! \brief  Compare the first blocks of aes_bench_output with vectors from
+ *          flash, repeated.
+ */
+static bool aes_bench_check( const uint8_t *vectors, uint8_t count, uint8_t blocks ){
+
+    for (uint8_t i = 0; i < blocks; i++) {
+
+        const uint8_t *expected = vectors + (i % count) * AES_BLOCKSIZE;
+
+        for (uint8_t j = 0; j < AES_BLOCKSIZE; j++) {
+            if (aes_bench_output[ i ][ j ] != pgm_read_byte( &expected[ j ] )) { return false; }
+        }
+    }
+
+    return true;
+}
+
+/*! \brief  Send one line of the report. */
+static void aes_bench_send( aes_bench_kind_t kind, uint8_t blocks, uint32_t value ){
+
+    com_send_string( debug_aes_bench, sizeof( debug_aes_bench ) );
+    com_send_hex( kind );
+    com_send_hex( blocks );
+    com_send_hex( (value >> 24) & 0xFF );
+    com_send_hex( (value >> 16) & 0xFF );
+    com_send_hex( (value >> 8) & 0xFF );
+    com_send_hex( value & 0xFF );
+}
+#endif /* defined( AES_BENCHMARK ) */
+/*EOF*/
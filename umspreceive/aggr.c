@@ -0,0 +1,168 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "config_uart_extended.h"
+
+#include "compiler.h"
+#include "hal.h"
+#include "tat.h"
+#include "aggr.h"
+
+#if defined( AGGREGATION )
+/*============================ MACROS ========================================*/
+#define AGGR_PAYLOAD_OFFSET      ( AGGR_MAC_HEADER_LENGTH + AGGR_HEADER_LENGTH )
+/*============================ TYPEDEFS ======================================*/
+/*============================ VARIABLES =====================================*/
+static uint8_t aggr_frame[ RF231_MAX_TX_FRAME_LENGTH ]; //!< Aggregate being filled.
+static uint8_t aggr_used; //!< Bytes of messages in aggr_frame, length bytes included.
+static uint8_t aggr_count; //!< Messages in aggr_frame.
+static uint8_t aggr_sequence_number; //!< MAC sequence number of the aggregates.
+static uint32_t aggr_first_time; //!< System time when the first message was added.
+/*============================ PROTOTYPES ====================================*/
+
+/*! \brief  Start with an empty aggregate.
+ *
+ *  \param  dest_address Short address of the receiver.
+ *
+ *  \ingroup aggr
+ */
+void aggr_init( uint16_t dest_address ){
+
+    aggr_frame[ 0 ] = 0x61; //FCF: data frame, acknowledge request, PAN ID compression.
+    aggr_frame[ 1 ] = 0x88; //FCF: short addresses.
+    aggr_frame[ 3 ] = PAN_ID & 0xFF;
+    aggr_frame[ 4 ] = (PAN_ID >> 8) & 0xFF;
+    aggr_frame[ 5 ] = dest_address & 0xFF;
+    aggr_frame[ 6 ] = (dest_address >> 8) & 0xFF;
+    aggr_frame[ 7 ] = SHORT_ADDRESS & 0xFF;
+    aggr_frame[ 8 ] = (SHORT_ADDRESS >> 8) & 0xFF;
+    aggr_frame[ 9 ] = AGGR_DISPATCH;
+
+    aggr_used  = 0;
+    aggr_count = 0;
+}
+
+/*! \brief  Add a message to the aggregate.
+ *
+ *  \param  message Message bytes.
+ *  \param  length Message length, 1 to AGGR_MAX_MESSAGE_LENGTH.
+ *
+ *  \retval TAT_SUCCESS The message was added.
+ *  \retval TAT_BUSY_STATE The message does not fit; send the aggregate
+ *                         with aggr_take first.
+ *  \retval TAT_INVALID_ARGUMENT The length is out of bounds.
+ *
+ *  \ingroup aggr
+ */
+tat_status_t aggr_add( uint8_t *message, uint8_t length ){
+
+    if ((length == 0) || (length > AGGR_MAX_MESSAGE_LENGTH)) { return TAT_INVALID_ARGUMENT; }
+
+    if ((aggr_used + 1 + length) > AGGR_MAX_PAYLOAD) { return TAT_BUSY_STATE; }
+
+    if (aggr_count == 0) { aggr_first_time = hal_get_system_time( ); }
+
+    aggr_frame[ AGGR_PAYLOAD_OFFSET + aggr_used ] = length;
+    memcpy( &aggr_frame[ AGGR_PAYLOAD_OFFSET + aggr_used + 1 ], message, length );
+
+    aggr_used += 1 + length;
+    aggr_count++;
+
+    return TAT_SUCCESS;
+}
+
+/*! \brief  Check if the aggregate should be sent: it holds AGGR_BYTE_BUDGET
+ *          bytes, or the oldest message waited AGGR_MAX_DELAY symbols.
+ *
+ *  \ingroup aggr
+ */
+bool aggr_ready( void ){
+
+    if (aggr_count == 0) { return false; }
+
+    return (aggr_used >= AGGR_BYTE_BUDGET) || (HAL_ELAPSED_TIME( aggr_first_time ) >= AGGR_MAX_DELAY);
+}
+
+/*! \brief  Close the aggregate for transmission, and start a new one.
+ *
+ *          The frame stays valid until the next aggr_add, so it must be sent
+ *          before more messages are added.
+ *
+ *  \param  frame Where the pointer to the frame is stored.
+ *
+ *  \return Frame length including the FCS, or 0 if the aggregate is empty.
+ *
+ *  \ingroup aggr
+ */
+uint8_t aggr_take( uint8_t **frame ){
+
+    if (aggr_count == 0) { return 0; }
+
+    uint8_t length = AGGR_PAYLOAD_OFFSET + aggr_used + 2;
+
+    aggr_frame[ 2 ]  = aggr_sequence_number++;
+    aggr_frame[ 10 ] = aggr_count;
+    *frame = aggr_frame;
+
+    aggr_used  = 0;
+    aggr_count = 0;
+
+    return length;
+}
+
+/*! \brief  Check if a received frame is an aggregate.
+ *
+ *  \param  frame Received frame, including the FCS.
+ *  \param  length Frame length.
+ *
+ *  \ingroup aggr
+ */
+bool aggr_is_aggregate( uint8_t *frame, uint8_t length ){
+    return (length >= (AGGR_PAYLOAD_OFFSET + 2)) && (frame[ AGGR_MAC_HEADER_LENGTH ] == AGGR_DISPATCH);
+}
+
+/*! \brief  Get the next message of a received aggregate.
+ *
+ *  \param  frame Received aggregate, including the FCS.
+ *  \param  length Frame length.
+ *  \param  position Read position. Must be 0 for the first message; it is
+ *                   updated for the next call.
+ *  \param  message Where the pointer to the message is stored.
+ *
+ *  \return Message length, or 0 after the last message or if the aggregate
+ *          is malformed.
+ *
+ *  \ingroup aggr
+ */
+uint8_t aggr_next_message( uint8_t *frame, uint8_t length, uint8_t *position, uint8_t **message ){
+
+    if (*position == 0) {
+
+        if (aggr_is_aggregate( frame, length ) == false) { return 0; }
+
+        *position = AGGR_PAYLOAD_OFFSET;
+    }
+
+    uint8_t end = length - 2; //The FCS.
+
+    if (*position >= end) { return 0; }
+
+    uint8_t message_length = frame[ *position ];
+
+    //A message that runs into the FCS ends the aggregate.
+    if ((message_length == 0) || (message_length > (end - *position - 1))) {
+
+        *position = end;
+
+        return 0;
+    }
+
+    *message = &frame[ *position + 1 ];
+    *position += 1 + message_length;
+
+    return message_length;
+}
+#endif /* defined( AGGREGATION ) */
+/*EOF*/
@@ -0,0 +1,405 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config_uart_extended.h"
+
+#include "compiler.h"
+#include "hal.h"
+#include "tat.h"
+#include "frag.h"
+
+#if defined( FRAGMENTATION )
+/*============================ MACROS ========================================*/
+#define FRAG_BLOCKS              ( (FRAG_MAX_DATAGRAM_SIZE + FRAG_BLOCK_SIZE - 1) / FRAG_BLOCK_SIZE )
+#define FRAG_BITMAP_SIZE         ( (FRAG_BLOCKS + 7) / 8 )
+
+#if (FRAG_MAX_DATAGRAM_SIZE == 0) || (FRAG_MAX_DATAGRAM_SIZE > 0x7FFF)
+    #error "FRAG_MAX_DATAGRAM_SIZE is out of range."
+#endif
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  State of a reassembly buffer. */
+typedef enum{
+    FRAG_BUFFER_FREE = 0,
+    FRAG_BUFFER_ASSEMBLING,     //!< Waiting for fragments.
+    FRAG_BUFFER_DONE            //!< Streamed; kept to recognize late duplicates.
+}frag_buffer_state_t;
+
+/*! \brief  One datagram being reassembled. */
+typedef struct{
+    uint8_t state;                          //!< frag_buffer_state_t.
+    uint8_t tag;
+    uint16_t source;                        //!< Short address of the sender.
+    uint16_t size;                          //!< Datagram size in bytes.
+    uint16_t streamed;                      //!< Bytes already sent on the UART.
+    uint32_t last_heard;                    //!< Time of the last new fragment.
+    uint8_t blocks[ FRAG_BITMAP_SIZE ];     //!< One bit per FRAG_BLOCK_SIZE bytes received.
+    uint8_t data[ FRAG_MAX_DATAGRAM_SIZE ];
+}frag_buffer_t;
+/*============================ VARIABLES =====================================*/
+static uint8_t *frag_tx_data; //!< Datagram being sent, owned by the caller.
+static uint16_t frag_tx_size; //!< Size of the datagram being sent.
+static uint16_t frag_tx_offset; //!< Offset of the fragment being sent.
+static uint16_t frag_tx_dest_address; //!< Receiver of the datagram.
+static uint8_t frag_tx_tag; //!< Tag of the datagram being sent.
+static uint8_t frag_tx_sequence_number; //!< MAC sequence number of the fragments.
+static uint8_t frag_tx_chunk; //!< Data length of the fragment being sent.
+static uint8_t frag_tx_attempts; //!< Failed transmissions of the fragment.
+static bool frag_tx_busy; //!< A datagram is being sent.
+
+static frag_buffer_t frag_buffers[ FRAG_REASSEMBLY_BUFFERS ]; //!< Reassembly buffers.
+static frag_statistics_t frag_statistics; //!< Counters.
+/*============================ PROTOTYPES ====================================*/
+static frag_buffer_t *frag_find_buffer( uint16_t source, uint8_t tag, uint16_t size );
+static uint16_t frag_contiguous( frag_buffer_t *buffer );
+static void frag_stream( frag_buffer_t *buffer, uint16_t end );
+static void frag_send_byte( uint8_t value, uint16_t *crc );
+
+/*! \brief  Start sending a datagram.
+ *
+ *          The data is not copied, so it must stay unchanged until
+ *          frag_sender_busy returns false.
+ *
+ *  \param  dest_address Short address of the receiver.
+ *  \param  data Datagram.
+ *  \param  size Datagram size, 1 to FRAG_MAX_DATAGRAM_SIZE bytes.
+ *
+ *  \retval TAT_SUCCESS The datagram will be sent.
+ *  \retval TAT_BUSY_STATE The previous datagram is still being sent.
+ *  \retval TAT_INVALID_ARGUMENT The size is out of bounds.
+ *
+ *  \ingroup frag
+ */
+tat_status_t frag_sender_start( uint16_t dest_address, uint8_t *data, uint16_t size ){
+
+    if (frag_tx_busy == true) { return TAT_BUSY_STATE; }
+
+    if ((size == 0) || (size > FRAG_MAX_DATAGRAM_SIZE)) { return TAT_INVALID_ARGUMENT; }
+
+    frag_tx_data         = data;
+    frag_tx_size         = size;
+    frag_tx_offset       = 0;
+    frag_tx_dest_address = dest_address;
+    frag_tx_attempts     = 0;
+    frag_tx_tag++;
+    frag_tx_busy         = true;
+
+    return TAT_SUCCESS;
+}
+
+/*! \brief  Check if a datagram is being sent.
+ *
+ *  \ingroup frag
+ */
+bool frag_sender_busy( void ){
+    return frag_tx_busy;
+}
+
+/*! \brief  Build the next fragment of the datagram.
+ *
+ *          The caller transmits the frame in TX_ARET_ON and reports the
+ *          result with frag_sender_sent. The same fragment is built again
+ *          until it is sent.
+ *
+ *  \param  frame Buffer of at least FRAG_MAX_FRAME_LENGTH bytes.
+ *
+ *  \return Frame length including the FCS, or 0 if no datagram is being
+ *          sent.
+ *
+ *  \ingroup frag
+ */
+uint8_t frag_sender_next( uint8_t *frame ){
+
+    if (frag_tx_busy == false) { return 0; }
+
+    uint16_t left = frag_tx_size - frag_tx_offset;
+
+    frag_tx_chunk = (left > FRAG_MAX_PAYLOAD) ? FRAG_MAX_PAYLOAD : (uint8_t)left;
+
+    frame[ 0 ]  = 0x61; //FCF: data frame, acknowledge request, PAN ID compression.
+    frame[ 1 ]  = 0x88; //FCF: short addresses.
+    frame[ 2 ]  = frag_tx_sequence_number;
+    frame[ 3 ]  = PAN_ID & 0xFF;
+    frame[ 4 ]  = (PAN_ID >> 8) & 0xFF;
+    frame[ 5 ]  = frag_tx_dest_address & 0xFF;
+    frame[ 6 ]  = (frag_tx_dest_address >> 8) & 0xFF;
+    frame[ 7 ]  = SHORT_ADDRESS & 0xFF;
+    frame[ 8 ]  = (SHORT_ADDRESS >> 8) & 0xFF;
+    frame[ 9 ]  = FRAG_DISPATCH;
+    frame[ 10 ] = frag_tx_size & 0xFF;
+    frame[ 11 ] = frag_tx_size >> 8;
+    frame[ 12 ] = frag_tx_tag;
+    frame[ 13 ] = frag_tx_offset & 0xFF;
+    frame[ 14 ] = frag_tx_offset >> 8;
+
+    memcpy( &frame[ FRAG_MAC_HEADER_LENGTH + FRAG_HEADER_LENGTH ], &frag_tx_data[ frag_tx_offset ], frag_tx_chunk );
+
+    return FRAG_MAC_HEADER_LENGTH + FRAG_HEADER_LENGTH + frag_tx_chunk + 2;
+}
+
+/*! \brief  Report the result of transmitting the fragment from
+ *          frag_sender_next.
+ *
+ *          After FRAG_MAX_ATTEMPTS failures in a row the datagram is given
+ *          up; the receiver drops it after FRAG_REASSEMBLY_TIMEOUT.
+ *
+ *  \param  status Result of the transmission.
+ *
+ *  \ingroup frag
+ */
+void frag_sender_sent( tat_status_t status ){
+
+    if (frag_tx_busy == false) { return; }
+
+    frag_statistics.fragments_sent++;
+    frag_tx_sequence_number++;
+
+    if (status == TAT_SUCCESS) {
+
+        frag_tx_offset += frag_tx_chunk;
+        frag_tx_attempts = 0;
+
+        if (frag_tx_offset >= frag_tx_size) {
+
+            frag_tx_busy = false;
+            frag_statistics.datagrams_sent++;
+        }
+    } else if (++frag_tx_attempts >= FRAG_MAX_ATTEMPTS) {
+
+        frag_tx_busy = false;
+        frag_statistics.datagrams_aborted++;
+    }
+}
+
+/*! \brief  Free all reassembly buffers.
+ *
+ *  \ingroup frag
+ */
+void frag_receiver_init( void ){
+
+    for (uint8_t i = 0; i < FRAG_REASSEMBLY_BUFFERS; i++) { frag_buffers[ i ].state = FRAG_BUFFER_FREE; }
+}
+
+/*! \brief  Store a received fragment in its reassembly buffer.
+ *
+ *          Must be called from the main loop, after the frame left the
+ *          rx_pool. The data is sent on the UART by frag_receiver_poll.
+ *
+ *  \param  frame Received frame, including the FCS.
+ *  \param  length Frame length.
+ *
+ *  \return What was done with the frame, see frag_accept_t.
+ *
+ *  \ingroup frag
+ */
+frag_accept_t frag_receiver_accept( uint8_t *frame, uint8_t length ){
+
+    if ((length <= (FRAG_MAC_HEADER_LENGTH + FRAG_HEADER_LENGTH + 2)) || (frame[ FRAG_MAC_HEADER_LENGTH ] != FRAG_DISPATCH)) {
+        return FRAG_NOT_FRAGMENT;
+    }
+
+    uint16_t source      = frame[ 7 ] | ((uint16_t)frame[ 8 ] << 8);
+    uint16_t size        = frame[ 10 ] | ((uint16_t)frame[ 11 ] << 8);
+    uint8_t tag          = frame[ 12 ];
+    uint16_t offset      = frame[ 13 ] | ((uint16_t)frame[ 14 ] << 8);
+    uint8_t data_length  = length - FRAG_MAC_HEADER_LENGTH - FRAG_HEADER_LENGTH - 2;
+    uint16_t end         = offset + data_length;
+
+    //Only the last fragment may end inside a block.
+    if ((size == 0) || (size > FRAG_MAX_DATAGRAM_SIZE) || (end > size) ||
+        ((offset % FRAG_BLOCK_SIZE) != 0) || (((data_length % FRAG_BLOCK_SIZE) != 0) && (end != size))) {
+
+        frag_statistics.fragments_dropped++;
+
+        return FRAG_DROPPED;
+    }
+
+    frag_buffer_t *buffer = frag_find_buffer( source, tag, size );
+
+    if (buffer == NULL) {
+
+        frag_statistics.fragments_dropped++;
+
+        return FRAG_DROPPED;
+    }
+
+    if (buffer->state == FRAG_BUFFER_DONE) { return FRAG_DUPLICATE; }
+
+    bool new_data = false;
+
+    for (uint16_t block = offset / FRAG_BLOCK_SIZE; (block * FRAG_BLOCK_SIZE) < end; block++) {
+
+        uint8_t mask = 1 << (block & 7);
+
+        if ((buffer->blocks[ block >> 3 ] & mask) == 0) {
+
+            buffer->blocks[ block >> 3 ] |= mask;
+            new_data = true;
+        }
+    }
+
+    if (new_data == false) { return FRAG_DUPLICATE; }
+
+    memcpy( &buffer->data[ offset ], &frame[ FRAG_MAC_HEADER_LENGTH + FRAG_HEADER_LENGTH ], data_length );
+    buffer->last_heard = hal_get_system_time( );
+
+    return FRAG_ACCEPTED;
+}
+
+/*! \brief  Send the reassembled data that became contiguous on the UART,
+ *          and drop the datagrams that timed out. Must be called from the
+ *          main loop.
+ *
+ *          The UART is slower than the radio, so the caller should let the
+ *          rx_pool drain first.
+ *
+ *  \retval true Data was sent on the UART.
+ *  \retval false Nothing to send.
+ *
+ *  \ingroup frag
+ */
+bool frag_receiver_poll( void ){
+
+    bool streamed = false;
+
+    for (uint8_t i = 0; i < FRAG_REASSEMBLY_BUFFERS; i++) {
+
+        frag_buffer_t *buffer = &frag_buffers[ i ];
+
+        if (buffer->state != FRAG_BUFFER_ASSEMBLING) { continue; }
+
+        uint16_t end = frag_contiguous( buffer );
+
+        if (end > buffer->streamed) {
+
+            frag_stream( buffer, end );
+            streamed = true;
+
+            if (buffer->streamed == buffer->size) {
+
+                buffer->state = FRAG_BUFFER_DONE;
+                frag_statistics.datagrams_received++;
+            }
+        } else if (HAL_ELAPSED_TIME( buffer->last_heard ) > FRAG_REASSEMBLY_TIMEOUT) {
+
+            buffer->state = FRAG_BUFFER_FREE;
+            frag_statistics.datagrams_timed_out++;
+        }
+    }
+
+    return streamed;
+}
+
+/*! \brief  Read the fragmentation counters.
+ *
+ *  \param  statistics Pointer to where the counters are copied.
+ *
+ *  \ingroup frag
+ */
+void frag_get_statistics( frag_statistics_t *statistics ){
+    *statistics = frag_statistics;
+}
+
+/*! \brief  Find the buffer of a datagram, or take one for it.
+ *
+ *          A free buffer is taken first, then one that is done, then one
+ *          that timed out.
+ *
+ *  \return The buffer, or NULL if all are in use.
+ */
+static frag_buffer_t *frag_find_buffer( uint16_t source, uint8_t tag, uint16_t size ){
+
+    frag_buffer_t *spare = NULL;
+
+    for (uint8_t i = 0; i < FRAG_REASSEMBLY_BUFFERS; i++) {
+
+        frag_buffer_t *buffer = &frag_buffers[ i ];
+
+        if ((buffer->state != FRAG_BUFFER_FREE) &&
+            (buffer->source == source) && (buffer->tag == tag) && (buffer->size == size)) {
+            return buffer;
+        }
+
+        if (buffer->state == FRAG_BUFFER_FREE) {
+            spare = buffer;
+        } else if ((spare == NULL) || (spare->state == FRAG_BUFFER_ASSEMBLING)) {
+
+            if ((buffer->state == FRAG_BUFFER_DONE) ||
+                (HAL_ELAPSED_TIME( buffer->last_heard ) > FRAG_REASSEMBLY_TIMEOUT)) {
+                spare = buffer;
+            }
+        }
+    }
+
+    if (spare == NULL) { return NULL; }
+
+    if (spare->state == FRAG_BUFFER_ASSEMBLING) { frag_statistics.datagrams_timed_out++; }
+
+    spare->state    = FRAG_BUFFER_ASSEMBLING;
+    spare->source   = source;
+    spare->tag      = tag;
+    spare->size     = size;
+    spare->streamed = 0;
+    memset( spare->blocks, 0, sizeof( spare->blocks ) );
+
+    return spare;
+}
+
+/*! \brief  Bytes received without a gap from the start of the datagram. */
+static uint16_t frag_contiguous( frag_buffer_t *buffer ){
+
+    uint16_t block = buffer->streamed / FRAG_BLOCK_SIZE;
+    uint16_t blocks = (buffer->size + FRAG_BLOCK_SIZE - 1) / FRAG_BLOCK_SIZE;
+
+    while ((block < blocks) && ((buffer->blocks[ block >> 3 ] & (1 << (block & 7))) != 0)) { block++; }
+
+    uint16_t end = block * FRAG_BLOCK_SIZE;
+
+    return (end > buffer->size) ? buffer->size : end;
+}
+
+/*! \brief  Send the data from the last streamed byte up to end in one
+ *          record, in the format described in frag.h.
+ */
+static void frag_stream( frag_buffer_t *buffer, uint16_t end ){
+
+    uint16_t crc = 0;
+    uint16_t length = end - buffer->streamed;
+
+    frag_send_byte( FRAG_SYNC_0, NULL );
+    frag_send_byte( FRAG_SYNC_1, NULL );
+    frag_send_byte( buffer->source & 0xFF, &crc );
+    frag_send_byte( buffer->source >> 8, &crc );
+    frag_send_byte( buffer->tag, &crc );
+    frag_send_byte( buffer->size & 0xFF, &crc );
+    frag_send_byte( buffer->size >> 8, &crc );
+    frag_send_byte( buffer->streamed & 0xFF, &crc );
+    frag_send_byte( buffer->streamed >> 8, &crc );
+    frag_send_byte( length & 0xFF, &crc );
+    frag_send_byte( length >> 8, &crc );
+
+    for (uint16_t i = buffer->streamed; i < end; i++) { frag_send_byte( buffer->data[ i ], &crc ); }
+
+    frag_send_byte( crc & 0xFF, NULL );
+    frag_send_byte( crc >> 8, NULL );
+
+    buffer->streamed = end;
+}
+
+/*! \brief  Send one byte on the UART and add it to the checksum.
+ *
+ *  \param  value Byte to send.
+ *  \param  crc Running checksum, or NULL if the byte is not covered.
+ */
+static void frag_send_byte( uint8_t value, uint16_t *crc ){
+
+    for(; !(UCSR0A & (1 << UDRE0));) {;}
+    UDR0 = value;
+
+    if (crc != NULL) { *crc = crc_ccitt_update( *crc, value ); }
+}
+#endif /* defined( FRAGMENTATION ) */
+/*EOF*/
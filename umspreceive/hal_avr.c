@@ -1,10 +1,16 @@
 /*============================ INCLUDE =======================================*/
 #include <stdlib.h>
+#include "config_uart_extended.h"
 #include "at86rf231.h"
 #include "compiler.h"
 #include "hal_avr.h"
 #include "hal.h"
+#include "prof.h"
+#include "trace.h"
 /*============================ MACROS ========================================*/
+#if defined( HAL_CLOCK_FROM_CLKM ) && !defined( HAL_CLKM_CTRL )
+    #error "HAL_CLOCK_FROM_CLKM needs F_CPU = 8 or 16 MHz, the CLKM rates that suit the AVR."
+#endif
 
 /*
  * Macros defined for the radio transceiver's access modes.
@@ -26,6 +32,8 @@
 #define SPI_DUMMY_VALUE                 (0x00)
 
 #define HAL_CALCULATED_CRC_OK   ( 0 ) //!< CRC calculated over the frame including the CRC field should be 0.
+
+#define HAL_RX_MAX_PROTECTION_TICKS ( 0x8000 ) //!< An RX_START up to this many Timer1 ticks before the release was during the protection.
 /*============================ TYPDEFS =======================================*/
 /*============================ VARIABLES =====================================*/
 /*! \brief This is a file internal variable that contains the 16 MSB of the 
@@ -41,6 +49,13 @@
  */
 static uint16_t hal_system_time = 0;
 
+/*! \brief Timer1 tick count (32-bit) at the rising edge of the last radio IRQ,
+ *         from the input capture register.
+ *
+ *  \see hal_get_capture_time
+ */
+static uint32_t volatile hal_capture_time;
+
 /*Flag section.*/
 static uint8_t volatile hal_bat_low_flag; //!< BAT_LOW flag.
 static uint8_t volatile hal_trx_ur_flag; //!< TRX_UR flag.
@@ -49,6 +64,28 @@ static uint8_t volatile hal_rx_start_flag; //!< RX_START falg;
 static uint8_t volatile hal_unknown_isr_flag; //!< Error, unknown interrupt event signaled from the radio transceiver.
 static uint8_t volatile hal_pll_unlock_flag; //!< PLL_UNLOCK flag.
 static uint8_t volatile hal_pll_lock_flag;   //!< PLL_LOCK flag.
+static uint8_t volatile hal_timer_flag;      //!< HAL timer expiry flag.
+static bool volatile hal_frame_buffer_flag;  //!< Set when the frame buffer content may have changed.
+
+/*! \brief 16 MSB of the Timer1 tick count at which the armed HAL timer expires. 
+ *         The 16 LSB are held by OCR1A.
+ *
+ *  \see hal_start_timer
+ */
+static uint16_t volatile hal_timer_msb;
+
+#if defined( RX_FRAME_PROTECTION )
+/*! \brief True from the TRX_END of a received frame until it is read: the
+ *         radio transceiver drops frames meanwhile (RX_SAFE_MODE).
+ */
+static bool volatile hal_rx_protected;
+
+/*! \brief Timer1 tick count (32-bit) when the last protected frame was read or
+ *         released. An RX_START captured before it was a frame that got lost.
+ */
+static uint32_t hal_rx_release_time;
+static hal_rx_protection_statistics_t hal_rx_protection_statistics; //!< Written by the TRX ISR.
+#endif
 
 /*Callbacks.*/
 
@@ -77,7 +114,24 @@ static hal_rx_start_isr_event_handler_t rx_start_callback;
  *  \see hal_set_trx_end_event_handler
  */
 static hal_trx_end_isr_event_handler_t trx_end_callback;
+
+/*! \brief This function is called when the HAL timer expires.
+ *
+ *         The function takes the expiry timestamp in IEEE 802.15.4 symbols as 
+ *         parameter. It is called in the interrupt domain, so it must be kept 
+ *         short and not be blocking!
+ *
+ *  \see hal_set_timer_event_handler
+ */
+static hal_timer_isr_event_handler_t timer_callback;
 /*============================ PROTOTYPES ====================================*/
+static uint8_t hal_spi_transfer( uint8_t data );
+static void hal_spi_write_block( uint8_t *data, uint8_t length );
+static void hal_spi_read_block( uint8_t *data, uint8_t length );
+static void hal_spi_exchange_block( uint8_t *tx_data, uint8_t *rx_data, uint8_t length );
+#if defined( RX_FRAME_PROTECTION )
+static void hal_rx_release( void );
+#endif
 /*============================ IMPLEMENTATION ================================*/
 
 /*! \brief  This function initializes the Hardware Abstraction Layer.
@@ -101,7 +155,7 @@ void hal_init( void ){
     HAL_DDR_SPI  |= (1 << HAL_DD_SS) | (1 << HAL_DD_SCK) | (1 << HAL_DD_MOSI);
     HAL_PORT_SPI |= (1 << HAL_DD_SS) | (1 << HAL_DD_SCK); //Set SS and CLK high
     SPCR         = (1 << SPE) | (1 << MSTR); //Enable SPI module and master operation.
-    SPSR         = (1 << SPI2X); //Enable doubled SPI speed in master mode.
+    SPSR         = (1 << SPI2X); //Enable doubled SPI speed in master mode: F_CPU / 2, 8 MHz at most.
 
     /*TIMER1 Specific Initialization.*/    
     TCCR1B = HAL_TCCR1B_CONFIG;       //Set clock prescaler  
@@ -112,6 +166,43 @@ void hal_init( void ){
 	SREG |= 0x80;
 }
 
+#if defined( HAL_CLOCK_FROM_CLKM )
+/*! \brief  This function raises CLKM, and with it the AVR that runs from it, 
+ *          from the 1 MHz reset value of the radio transceiver to F_CPU.
+ *
+ *          CLKM_SHA_SEL is cleared, so that the new rate applies at once: a 
+ *          rate change after SLEEP never takes place, since the AVR stops with
+ *          CLKM. Meanwhile the system clock prescaler divides CLKM by 
+ *          HAL_XDIV_CLKM_SWITCH, so that a short CLKM pulse while the radio 
+ *          transceiver changes its divider cannot violate the timing of the 
+ *          AVR core. CLKM_SHA_SEL is set again afterwards: a later write of 
+ *          CLKM_CTRL then waits for a SLEEP cycle instead of changing the clock 
+ *          under the running AVR.
+ *
+ *  \note   A reset of the radio transceiver takes CLKM back to 1 MHz, so
+ *          tat_reset_trx calls this function after each reset. Until then
+ *          delays and timers run slow, which is safe.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_raise_cpu_clock( void ){
+    
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+    
+    XDIV = 0; //XDIV6..0 can only be changed while XDIVEN is zero.
+    XDIV = (1 << XDIVEN) | (129 - HAL_XDIV_CLKM_SWITCH);
+    
+    hal_subregister_write( SR_CLKM_SHA_SEL, CLKM_SHA_DISABLE );
+    hal_subregister_write( SR_CLKM_CTRL, HAL_CLKM_CTRL );
+    hal_subregister_write( SR_CLKM_SHA_SEL, CLKM_SHA_ENABLE );
+    
+    XDIV = 0; //Run at F_CPU.
+    
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+#endif
+
 /*! \brief  This function reset the interrupt flags and interrupt event handlers 
  *          (Callbacks) to their default value.
  *
@@ -129,10 +220,13 @@ void hal_reset_flags( void ){
     hal_unknown_isr_flag = 0;
     hal_pll_unlock_flag  = 0;
     hal_pll_lock_flag    = 0;
+    hal_timer_flag       = 0;
+    hal_frame_buffer_flag = true;
     
     //Reset Associated Event Handlers.
     rx_start_callback = NULL;
     trx_end_callback  = NULL;
+    timer_callback    = NULL;
     
     AVR_LEAVE_CRITICAL_REGION( );
 }
@@ -261,6 +355,30 @@ void hal_clear_rx_start_flag( void ){
     AVR_LEAVE_CRITICAL_REGION( );
 }
 
+/*! \brief  This function returns the FRAME_BUFFER flag.
+ *
+ *  The flag is set each time the content of the frame buffer may have changed:
+ *  a frame was received (RX_START), hal_frame_write was called or the flags
+ *  were reset. The TAT clears it when it keeps a copy of the frame buffer 
+ *  (RESIDENT_TX_FRAME), and the copy is valid as long as the flag stays clear.
+ *
+ *  \ingroup hal_avr_api
+ */
+bool hal_get_frame_buffer_flag( void ){
+    return hal_frame_buffer_flag;
+}
+
+/*! \brief  This function clears the FRAME_BUFFER flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_frame_buffer_flag( void ){
+    
+    AVR_ENTER_CRITICAL_REGION( );
+    hal_frame_buffer_flag = false;
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
 /*! \brief  This function returns the active RX_START event handler
  *
  *  \return Current RX_START event handler registered.
@@ -362,6 +480,97 @@ void hal_clear_pll_lock_flag( void ){
     AVR_LEAVE_CRITICAL_REGION( );
 }
 
+/*! \brief  This function returns the current value of the TIMER flag.
+ *
+ *  The TIMER flag is incremented each time the timer started with 
+ *  hal_start_timer expires. This way it is possible for the end user to poll 
+ *  the flag for the timeout.
+ *
+ *  \ingroup hal_avr_api
+ */
+uint8_t hal_get_timer_flag( void ){
+    return hal_timer_flag;
+}
+
+/*! \brief  This function clears the TIMER flag.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_timer_flag( void ){
+    
+    AVR_ENTER_CRITICAL_REGION( );
+    hal_timer_flag = 0;
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  This function is used to set new timer event handler, overriding 
+ *          old handler reference.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_set_timer_event_handler( hal_timer_isr_event_handler_t timer_callback_handle ){
+    
+    AVR_ENTER_CRITICAL_REGION( );
+    timer_callback = timer_callback_handle;
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  Remove event handler reference.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_clear_timer_event_handler( void ){
+    
+    AVR_ENTER_CRITICAL_REGION( );
+    timer_callback = NULL;
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  This function arms the one-shot HAL timer.
+ *
+ *          The timer is built on the Timer1 output compare unit A, so it runs 
+ *          from the same time base as hal_get_system_time and keeps running in
+ *          the IDLE sleep mode. When the timer expires the TIMER flag is 
+ *          incremented and the timer event handler (if any) is called. Arming 
+ *          the timer again restarts it.
+ *
+ *  \param  timeout Time until expiry in IEEE 802.15.4 symbols. Must be at 
+ *                  least 2 symbols.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_start_timer( uint32_t timeout ){
+    
+    uint32_t expiry = timeout * HAL_US_PER_SYMBOL; //Convert to Timer1 ticks.
+    
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( ); //The Timer1 MSB and LSB must be sampled atomically.
+    
+    uint16_t msb = hal_system_time;
+    uint16_t lsb = TCNT1;
+    
+    //Account for an overflow that is pending, but not yet handled.
+    if (((TIFR & (1 << TOV1)) != 0) && (lsb < 0x8000)) { msb++; }
+    
+    expiry += (((uint32_t)msb) << 16) | lsb;
+    
+    hal_timer_msb = (uint16_t)(expiry >> 16);
+    OCR1A = (uint16_t)(expiry & 0xFFFF);
+    
+    HAL_CLEAR_COMPARE_FLAG( );
+    HAL_ENABLE_COMPARE_INTERRUPT( );
+    
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  This function stops the HAL timer without signaling expiry.
+ *
+ *  \ingroup hal_avr_api
+ */
+void hal_stop_timer( void ){
+    HAL_DISABLE_COMPARE_INTERRUPT( );
+}
+
 /*! \brief  This function reads data from one of the radio transceiver's registers.
  *
  *  \param  address Register address to read from. See datasheet for register 
@@ -434,58 +643,235 @@ void hal_register_write( uint8_t address, uint8_t value ){
     AVR_LEAVE_CRITICAL_REGION( );
 }
 
-/*! \brief  This function reads the value of a specific subregister.
- *
- *  \see Look at the at86rf231.h file for register and subregister 
- *       definitions.
+/*
+ * SPI block transfer kernels, shared by the frame and SRAM accesses.
  *
- *  \param  address  Main register's address.
- *  \param  mask  Bit mask of the subregister.
- *  \param  position   Bit position of the subregister
- *  \retval Value of the read subregister.
+ * They are called with SS low, after hal_spi_transfer (no transfer running,
+ * SPIF clear), and with at least one byte to transfer. With GCC they are 
+ * cycle-counted: a byte is written to SPDR every HAL_SPI_BYTE_CYCLES cycles,
+ * without polling SPIF, and the loads, stores and the loop count are done 
+ * while the previous byte is shifted. A received byte is read after the next
+ * transfer is started, from the receive buffer that holds it until the next 
+ * byte is complete. Only the last byte is waited for, and SPIF is cleared by
+ * reading SPSR and SPDR after it. Interrupts are disabled in the kernels: a 
+ * delay between starting a byte and reading the previous one would lose it.
+ * The other compilers use the polled C loops.
+ */
+
+/*! \brief  CPU cycles between two writes to SPDR in the kernels. The SPI 
+ *          shifts a byte in 16 cycles at F_CPU / 2 (SPI2X, set in hal_init), 
+ *          one more is left so that SPDR is never written before the shift
+ *          ends (WCOL).
+ */
+#define HAL_SPI_BYTE_CYCLES ( 17 )
+
+/*! \brief  This function sends one byte on the SPI and returns the byte 
+ *          received.
  *
  *  \ingroup hal_avr_api
  */
-uint8_t hal_subregister_read( uint8_t address, uint8_t mask, uint8_t position ){
+static uint8_t hal_spi_transfer( uint8_t data ){
     
-    //Read current register value and mask out subregister.
-    uint8_t register_value = hal_register_read( address );
-    register_value &= mask;
-    register_value >>= position; //Align subregister value.
+    SPDR = data;
+    while ((SPSR & (1 << SPIF)) == 0) {;}
     
-    return register_value;
+    return SPDR;
 }
 
-/*! \brief  This function writes a new value to one of the radio transceiver's 
- *          subregisters.
+#if defined( __GNUC__ )
+/*! \brief  nop instructions, as many as the constant operand count.
+ */
+#define HAL_SPI_DELAY( count ) ".rept " count "\n\tnop\n\t.endr\n\t"
+
+/*! \brief  This kernel sends length bytes from data, and ignores the bytes
+ *          received.
+ *
+ *          The loop takes ld (2), the delay, out (1), dec (1) and brne (2).
  *
- *  \see Look at the at86rf231.h file for register and subregister 
- *       definitions.
+ *  \ingroup hal_avr_api
+ */
+static void hal_spi_write_block( uint8_t *data, uint8_t length ){
+    
+    uint8_t byte;
+    uint8_t sreg;
+    
+    __asm__ __volatile__ (
+        "in   %[sreg], __SREG__"               "\n\t"
+        "cli"                                  "\n\t"
+        "ld   %[byte], Z+"                     "\n\t"
+        "out  %[spdr], %[byte]"                "\n\t" //First byte.
+        "dec  %[length]"                       "\n\t"
+        "breq 2f"                              "\n\t"
+        HAL_SPI_DELAY( "%[entry]" )                   //The entry is 1 cycle shorter than the loop.
+        "1:"                                   "\n\t"
+        "ld   %[byte], Z+"                     "\n\t"
+        HAL_SPI_DELAY( "%[delay]" )
+        "out  %[spdr], %[byte]"                "\n\t"
+        "dec  %[length]"                       "\n\t"
+        "brne 1b"                              "\n\t"
+        "2:"                                   "\n\t"
+        HAL_SPI_DELAY( "%[tail]" )                    //Until the last byte is shifted.
+        "in   %[byte], %[spsr]"                "\n\t" //Clear SPIF.
+        "in   %[byte], %[spdr]"                "\n\t"
+        "out  __SREG__, %[sreg]"               "\n\t"
+        : [data] "+z" (data), [length] "+r" (length), [byte] "=&r" (byte), [sreg] "=&r" (sreg)
+        : [spdr] "I" (_SFR_IO_ADDR( SPDR )), [spsr] "I" (_SFR_IO_ADDR( SPSR )),
+          [entry] "n" (1), [delay] "n" (HAL_SPI_BYTE_CYCLES - 6), [tail] "n" (HAL_SPI_BYTE_CYCLES - 2)
+        : "memory"
+    );
+}
+
+/*! \brief  This kernel receives length bytes to data, sending HAL_DUMMY_READ.
  *
- *  \param  address  Main register's address.
- *  \param  mask  Bit mask of the subregister.
- *  \param  position  Bit position of the subregister
- *  \param  value  Value to write into the subregister.
+ *          The loop takes the delay, out (1), in (1), st (2), dec (1) and 
+ *          brne (2).
  *
  *  \ingroup hal_avr_api
  */
-void hal_subregister_write( uint8_t address, uint8_t mask, uint8_t position, 
-                            uint8_t value ){
+static void hal_spi_read_block( uint8_t *data, uint8_t length ){
+    
+    uint8_t byte;
+    uint8_t sreg;
+    
+    __asm__ __volatile__ (
+        "in   %[sreg], __SREG__"               "\n\t"
+        "cli"                                  "\n\t"
+        "out  %[spdr], %[dummy]"               "\n\t" //First byte.
+        "dec  %[length]"                       "\n\t"
+        "breq 2f"                              "\n\t"
+        HAL_SPI_DELAY( "%[entry]" )                   //The entry is 4 cycles shorter than the loop.
+        "1:"                                   "\n\t"
+        HAL_SPI_DELAY( "%[delay]" )
+        "out  %[spdr], %[dummy]"               "\n\t" //Next byte.
+        "in   %[byte], %[spdr]"                "\n\t" //Previous byte, from the receive buffer.
+        "st   X+, %[byte]"                     "\n\t"
+        "dec  %[length]"                       "\n\t"
+        "brne 1b"                              "\n\t"
+        "2:"                                   "\n\t"
+        HAL_SPI_DELAY( "%[tail]" )                    //Until the last byte is shifted.
+        "in   %[byte], %[spsr]"                "\n\t" //Clear SPIF.
+        "in   %[byte], %[spdr]"                "\n\t"
+        "st   X, %[byte]"                      "\n\t"
+        "out  __SREG__, %[sreg]"               "\n\t"
+        : [data] "+x" (data), [length] "+r" (length), [byte] "=&r" (byte), [sreg] "=&r" (sreg)
+        : [dummy] "r" ((uint8_t)HAL_DUMMY_READ), [spdr] "I" (_SFR_IO_ADDR( SPDR )), [spsr] "I" (_SFR_IO_ADDR( SPSR )),
+          [entry] "n" (4), [delay] "n" (HAL_SPI_BYTE_CYCLES - 7), [tail] "n" (HAL_SPI_BYTE_CYCLES - 3)
+        : "memory"
+    );
+}
+
+/*! \brief  This kernel sends length bytes from tx_data, and stores the byte 
+ *          received with each of them to rx_data. rx_data may be tx_data - 1,
+ *          for the SRAM accesses that return each byte one byte later.
+ *
+ *          The loop takes ld (2), the delay, out (1), in (1), st (2), dec (1)
+ *          and brne (2).
+ *
+ *  \ingroup hal_avr_api
+ */
+static void hal_spi_exchange_block( uint8_t *tx_data, uint8_t *rx_data, uint8_t length ){
+    
+    uint8_t byte;
+    uint8_t sreg;
+    
+    __asm__ __volatile__ (
+        "in   %[sreg], __SREG__"               "\n\t"
+        "cli"                                  "\n\t"
+        "ld   %[byte], Z+"                     "\n\t"
+        "out  %[spdr], %[byte]"                "\n\t" //First byte.
+        "dec  %[length]"                       "\n\t"
+        "breq 2f"                              "\n\t"
+        HAL_SPI_DELAY( "%[entry]" )                   //The entry is 4 cycles shorter than the loop.
+        "1:"                                   "\n\t"
+        "ld   %[byte], Z+"                     "\n\t"
+        HAL_SPI_DELAY( "%[delay]" )
+        "out  %[spdr], %[byte]"                "\n\t" //Next byte.
+        "in   %[byte], %[spdr]"                "\n\t" //Previous byte, from the receive buffer.
+        "st   X+, %[byte]"                     "\n\t"
+        "dec  %[length]"                       "\n\t"
+        "brne 1b"                              "\n\t"
+        "2:"                                   "\n\t"
+        HAL_SPI_DELAY( "%[tail]" )                    //Until the last byte is shifted.
+        "in   %[byte], %[spsr]"                "\n\t" //Clear SPIF.
+        "in   %[byte], %[spdr]"                "\n\t"
+        "st   X, %[byte]"                      "\n\t"
+        "out  __SREG__, %[sreg]"               "\n\t"
+        : [tx_data] "+z" (tx_data), [rx_data] "+x" (rx_data), [length] "+r" (length), 
+          [byte] "=&r" (byte), [sreg] "=&r" (sreg)
+        : [spdr] "I" (_SFR_IO_ADDR( SPDR )), [spsr] "I" (_SFR_IO_ADDR( SPSR )),
+          [entry] "n" (4), [delay] "n" (HAL_SPI_BYTE_CYCLES - 9), [tail] "n" (HAL_SPI_BYTE_CYCLES - 3)
+        : "memory"
+    );
+}
+#else
+
+/*! \brief  This kernel sends length bytes from data, and ignores the bytes
+ *          received.
+ *
+ *  \ingroup hal_avr_api
+ */
+static void hal_spi_write_block( uint8_t *data, uint8_t length ){
     
-    //Read current register value and mask area outside the subregister.
-    uint8_t register_value = hal_register_read( address );
-    register_value &= ~mask;
+    SPDR = *data++;
     
-    //Start preparing the new subregister value. shift in place and mask.
-    value <<= position;
-    value &= mask;
+    while (--length > 0) {
+        
+        uint8_t const next = *data++; //Loaded while the previous byte is sent.
+        
+        while ((SPSR & (1 << SPIF)) == 0) {;}
+        SPDR = next;
+    }
     
-    value |= register_value; //Set the new subregister value.
+    while ((SPSR & (1 << SPIF)) == 0) {;}
+}
 
-    //Write the modified register value.
-    hal_register_write( address, value );
+/*! \brief  This kernel receives length bytes to data, sending HAL_DUMMY_READ.
+ *
+ *  \ingroup hal_avr_api
+ */
+static void hal_spi_read_block( uint8_t *data, uint8_t length ){
+    
+    SPDR = HAL_DUMMY_READ;
+    
+    while (--length > 0) {
+        
+        while ((SPSR & (1 << SPIF)) == 0) {;}
+        
+        uint8_t const received = SPDR;
+        SPDR = HAL_DUMMY_READ;
+        *data++ = received; //Stored while the next byte is received.
+    }
+    
+    while ((SPSR & (1 << SPIF)) == 0) {;}
+    *data = SPDR;
 }
 
+/*! \brief  This kernel sends length bytes from tx_data, and stores the byte 
+ *          received with each of them to rx_data. rx_data may be tx_data - 1,
+ *          for the SRAM accesses that return each byte one byte later.
+ *
+ *  \ingroup hal_avr_api
+ */
+static void hal_spi_exchange_block( uint8_t *tx_data, uint8_t *rx_data, uint8_t length ){
+    
+    SPDR = *tx_data++;
+    
+    while (--length > 0) {
+        
+        uint8_t const next = *tx_data++;
+        
+        while ((SPSR & (1 << SPIF)) == 0) {;}
+        
+        uint8_t const received = SPDR;
+        SPDR = next;
+        *rx_data++ = received;
+    }
+    
+    while ((SPSR & (1 << SPIF)) == 0) {;}
+    *rx_data = SPDR;
+}
+#endif
+
 /*! \brief  This function will upload a frame from the radio transceiver's frame 
  *          buffer.
  *          
@@ -493,57 +879,44 @@ void hal_subregister_write( uint8_t address, uint8_t mask, uint8_t position,
  *          is out of the defined bounds. Then the frame length, lqi value and crc
  *          be set to zero. This is done to indicate an error.
  *
+ *          The CRC is calculated over the uploaded frame after the upload, so 
+ *          that it does not slow down the SPI kernel.
+ *
  *  \param  rx_frame    Pointer to the data structure where the frame is stored.
  *
  *  \ingroup hal_avr_api
  */
 __z void hal_frame_read( hal_rx_frame_t *rx_frame ){
+    PROF_ENTER( PROF_FRAME_READ );
      DDRF |= 1<<3;
      PORTF &= ~(1<<3);
     AVR_ENTER_CRITICAL_REGION( );
     
     HAL_SS_LOW( );
     
-    /*Send frame read command.*/
-    SPDR = HAL_TRX_CMD_FR;
-    while ((SPSR & (1 << SPIF)) == 0) {;}
-    uint8_t frame_length = SPDR;
-    
-    /*Read frame length.*/    
-    SPDR = frame_length;
-    while ((SPSR & (1 << SPIF)) == 0) {;}
-    frame_length = SPDR;
+    /*Send frame read command, and read frame length.*/
+    hal_spi_transfer( HAL_TRX_CMD_FR );
+    uint8_t frame_length = hal_spi_transfer( HAL_DUMMY_READ );
     
     /*Check for correct frame length.*/
     if ((frame_length >= HAL_MIN_FRAME_LENGTH) && (frame_length <= HAL_MAX_FRAME_LENGTH)) {
         
+        rx_frame->length = frame_length; //Store frame length.
+        
+        /*Upload frame buffer to data pointer, and the LQI that follows.*/
+        hal_spi_read_block( rx_frame->data, frame_length );
+        rx_frame->lqi = hal_spi_transfer( HAL_DUMMY_READ );
+        
+        HAL_SS_HIGH( );
+        
+        /*Calculate CRC, and set crc field in hal_rx_frame_t accordingly.*/
         uint16_t crc = 0;
         uint8_t *rx_data = (rx_frame->data);
         
-        rx_frame->length = frame_length; //Store frame length.
-        
-        /*Upload frame buffer to data pointer. Calculate CRC.*/
-        SPDR = frame_length;
-        while ((SPSR & (1 << SPIF)) == 0) {;}
-            
         do {
-            
-            uint8_t const tempData = SPDR;
-            SPDR = tempData; // Any data will do, and tempData is readily available. Saving cycles.
-            
-            *rx_data++ = tempData;      
-            
-            crc = crc_ccitt_update( crc, tempData );
-            
-            while ((SPSR & (1 << SPIF)) == 0) {;}
+            crc = crc_ccitt_update( crc, *rx_data++ );
         } while (--frame_length > 0);
         
-        /*Read LQI value for this frame.*/
-        rx_frame->lqi = SPDR;
-        
-        HAL_SS_HIGH( );
-        
-        /*Check calculated crc, and set crc field in hal_rx_frame_t accordingly.*/
         if (crc == HAL_CALCULATED_CRC_OK) {
             rx_frame->crc = true; 
         } else { rx_frame->crc = false; }
@@ -556,7 +929,13 @@ __z void hal_frame_read( hal_rx_frame_t *rx_frame ){
         rx_frame->crc    = false;    
     }
     
+#if defined( RX_FRAME_PROTECTION )
+    hal_rx_release( ); //Reading the frame buffer ended the protection.
+#endif
+    TRACE_EVENT( (rx_frame->crc == true) ? TRACE_RX : TRACE_RX_CRC_ERROR, rx_frame->length );
+    
     AVR_LEAVE_CRITICAL_REGION( );
+    PROF_LEAVE( PROF_FRAME_READ );
 }
 
 /*! \brief  This function will download a frame to the radio transceiver's frame 
@@ -569,6 +948,7 @@ __z void hal_frame_read( hal_rx_frame_t *rx_frame ){
  */
 __z void hal_frame_write( uint8_t *write_buffer, uint8_t length ){
     
+    PROF_ENTER( PROF_FRAME_WRITE );
     length &= HAL_TRX_CMD_RADDRM; //Truncate length to maximum frame length.
     
     AVR_ENTER_CRITICAL_REGION( );
@@ -576,28 +956,18 @@ __z void hal_frame_write( uint8_t *write_buffer, uint8_t length ){
     HAL_SS_LOW( ); //Initiate the SPI transaction.
     
     /*SEND FRAME WRITE COMMAND AND FRAME LENGTH.*/
-    SPDR = HAL_TRX_CMD_FW;
-    while ((SPSR & (1 << SPIF)) == 0) {;}
-    uint8_t dummy_read = SPDR;
-        
-    SPDR = length;
-    while ((SPSR & (1 << SPIF)) == 0) {;}
-    dummy_read = SPDR;
+    hal_spi_transfer( HAL_TRX_CMD_FW );
+    hal_spi_transfer( length );
     
     //Download to the Frame Buffer.
-    do {
-        
-        SPDR = *write_buffer++;
-        --length;
-        
-        while ((SPSR & (1 << SPIF)) == 0) {;}
-        
-        dummy_read = SPDR;
-    } while (length > 0);
+    if (length > 0) { hal_spi_write_block( write_buffer, length ); }
     
     HAL_SS_HIGH( ); //Terminate SPI transaction.
     
+    hal_frame_buffer_flag = true;
+    
     AVR_LEAVE_CRITICAL_REGION( );
+    PROF_LEAVE( PROF_FRAME_WRITE );
 }
 
 /*! \brief Read SRAM
@@ -613,26 +983,16 @@ __z void hal_frame_write( uint8_t *write_buffer, uint8_t length ){
 __z void hal_sram_read( uint8_t address, uint8_t length, uint8_t *data ){
     
     AVR_ENTER_CRITICAL_REGION( );
+    cli( ); //The TRX ISR uses the SPI too; sal.c calls this from the main loop.
     
     HAL_SS_LOW( ); //Initiate the SPI transaction.
     
-    /*Send SRAM read command.*/
-    SPDR = HAL_TRX_CMD_SR;
-    while ((SPSR & (1 << SPIF)) == 0) {;}
-    uint8_t dummy_read = SPDR;
-    
-    /*Send address where to start reading.*/    
-    SPDR = address;
-    while ((SPSR & (1 << SPIF)) == 0) {;}
-    dummy_read = SPDR;
+    /*Send SRAM read command, and the address where to start reading.*/
+    hal_spi_transfer( HAL_TRX_CMD_SR );
+    hal_spi_transfer( address );
     
     /*Upload the chosen memory area.*/
-    do {
-        
-        SPDR = HAL_DUMMY_READ;
-        while ((SPSR & (1 << SPIF)) == 0) {;}
-        *data++ = SPDR;
-    } while (--length > 0);
+    hal_spi_read_block( data, length );
 
     HAL_SS_HIGH( );
     
@@ -652,69 +1012,56 @@ __z void hal_sram_read( uint8_t address, uint8_t length, uint8_t *data ){
 __z void hal_sram_write( uint8_t address, uint8_t length, uint8_t *data ){
     
     AVR_ENTER_CRITICAL_REGION( );
+    cli( ); //The TRX ISR uses the SPI too; sal.c calls this from the main loop.
         
     HAL_SS_LOW( );
     
-    /*Send SRAM write command.*/
-    SPDR = HAL_TRX_CMD_SW;
-    while ((SPSR & (1 << SPIF)) == 0) {;}
-    uint8_t dummy_read = SPDR;
+    /*Send SRAM write command, and the address where to start writing to.*/
+    hal_spi_transfer( HAL_TRX_CMD_SW );
+    hal_spi_transfer( address );
     
-    /*Send address where to start writing to.*/
-    SPDR = address;
-    while ((SPSR & (1 << SPIF)) == 0) {;}
-    dummy_read = SPDR;
-    
-    /*Upload the chosen memory area.*/
-    do {
-        
-        SPDR = *data++;
-        while ((SPSR & (1 << SPIF)) == 0) {;}
-        dummy_read = SPDR;
-    } while (--length > 0);
+    /*Download the chosen memory area.*/
+    hal_spi_write_block( data, length );
     
     HAL_SS_HIGH( );
     
     AVR_LEAVE_CRITICAL_REGION( );
 }
 
+/*! \brief Write and read SRAM
+ *
+ * This function writes length bytes to the SRAM of the radio transceiver, 
+ * and replaces them with the bytes that the radio transceiver returns during 
+ * the write: each is the content of the previous address, as used by the AES
+ * engine (sal.c).
+ *
+ * \param addr    Address in the TRX's SRAM where the burst should start
+ * \param idata   Bytes to write, replaced by the bytes read
+ * \param length  Length of the burst
+ *
+ * \ingroup hal_avr_api
+ */
 __z void hal_trx_aes_wrrd(uint8_t addr, uint8_t *idata, uint8_t length)
 {
-    uint8_t *odata;
-
     delay_us(1);
 
     AVR_ENTER_CRITICAL_REGION();
+    cli( ); //The TRX ISR uses the SPI too.
     /* Start SPI transaction by pulling SEL low */
     HAL_SS_LOW();
 
-    /* Send the command byte */
-    SPDR = HAL_TRX_CMD_SW;
-    while ((SPSR & (1 << SPIF)) == 0) {;}
-
-    /* write SRAM start address */
-    SPDR = addr;
-    while ((SPSR & (1 << SPIF)) == 0) {;}
-
-    /* now transfer data */
-    odata = idata;
+    /* Send the command byte, and the SRAM start address */
+    hal_spi_transfer( HAL_TRX_CMD_SW );
+    hal_spi_transfer( addr );
 
     /* write data byte 0 - the obtained value in SPDR is meaningless */
-    SPDR = *idata++;
-    while ((SPSR & (1 << SPIF)) == 0) {;}
+    hal_spi_transfer( idata[ 0 ] );
 
-    /* process data bytes 1...length-1: write and read */
-    while (--length)
-    {
-        SPDR = *idata++;
-        while ((SPSR & (1 << SPIF)) == 0) {;}
-        *odata++ = SPDR;
-    }
+    /* process data bytes 1...length-1: write and read, one byte behind */
+    if (length > 1) { hal_spi_exchange_block( idata + 1, idata, length - 1 ); }
 
     /* to get the last data byte, write some dummy byte */
-    SPDR = SPI_DUMMY_VALUE;
-    while ((SPSR & (1 << SPIF)) == 0) {;}
-    *odata++ = SPDR;
+    idata[ length - 1 ] = hal_spi_transfer( SPI_DUMMY_VALUE );
 
     /* Stop the SPI transaction by setting SEL high */
     HAL_SS_HIGH();
@@ -745,6 +1092,96 @@ uint32_t hal_get_system_time( void ){
     return ((system_time / HAL_US_PER_SYMBOL) & HAL_SYMBOL_MASK);
 }
 
+/*! \brief This function returns the time of the last radio transceiver
+ *         interrupt, as captured by Timer1 on the rising edge of the IRQ line.
+ *
+ *         The resolution is one Timer1 tick (1 / HAL_US_PER_SYMBOL symbol),
+ *         and the latency of the ISR is not included. After a transmission
+ *         this is the TRX_END of the frame, until the next interrupt.
+ *
+ * \returns Timer1 ticks, wrapping after 2^32 ticks.
+ *
+ * \ingroup hal_avr_api
+ */
+uint32_t hal_get_capture_time( void ){
+    
+    uint32_t capture_time;
+    
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( ); //Written by the TRX ISR.
+    
+    capture_time = hal_capture_time;
+    
+    AVR_LEAVE_CRITICAL_REGION( );
+    
+    return capture_time;
+}
+
+/*! \brief This function reads the counters of the frame buffer protection.
+ *
+ *         With RX_FRAME_PROTECTION the radio transceiver keeps a received 
+ *         frame in the frame buffer until hal_frame_read has uploaded it 
+ *         (RX_SAFE_MODE), instead of overwriting it with the next one. A frame 
+ *         that arrives meanwhile is dropped, and is counted as lost here. 
+ *         Without RX_FRAME_PROTECTION the counters stay 0.
+ *
+ * \param statistics Pointer to where the counters are copied.
+ *
+ * \ingroup hal_avr_api
+ */
+void hal_get_rx_protection_statistics( hal_rx_protection_statistics_t *statistics ){
+    
+#if defined( RX_FRAME_PROTECTION )
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( ); //Written by the TRX ISR.
+    
+    *statistics = hal_rx_protection_statistics;
+    
+    AVR_LEAVE_CRITICAL_REGION( );
+#else
+    statistics->lost     = 0;
+    statistics->released = 0;
+#endif
+}
+
+/*! \brief This function clears the counters of the frame buffer protection.
+ *
+ * \ingroup hal_avr_api
+ */
+void hal_clear_rx_protection_statistics( void ){
+    
+#if defined( RX_FRAME_PROTECTION )
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( ); //Written by the TRX ISR.
+    
+    hal_rx_protection_statistics.lost     = 0;
+    hal_rx_protection_statistics.released = 0;
+    
+    AVR_LEAVE_CRITICAL_REGION( );
+#endif
+}
+
+#if defined( RX_FRAME_PROTECTION )
+/*! \brief Note that the protected frame was read or released, and when.
+ */
+static void hal_rx_release( void ){
+    
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( ); //The time must be read atomically.
+    
+    uint16_t ticks = TCNT1;
+    uint16_t msb = hal_system_time;
+    
+    //The overflow ISR may be pending.
+    if (((TIFR & (1 << TOV1)) != 0) && (ticks < 0x8000)) { msb++; }
+    
+    hal_rx_release_time = ((uint32_t)msb << 16) | ticks;
+    hal_rx_protected = false;
+    
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+#endif
+
 //This #if compile switch is used to provide a "standard" function body for the 
 //doxygen documentation.
 #if defined( DOXYGEN )
@@ -756,13 +1193,21 @@ void TIMER1_CAPT_vect( void );
 #else  /* !DOXYGEN */
 ISR( TIMER1_CAPT_vect ){
     
-    /*The following code reads the current system time. This is done by first 
-      reading the hal_system_time and then adding the 16 LSB directly from the
-      TCNT1 register.
+    PROF_ENTER( PROF_TRX_ISR );
+    
+    /*The time stamp is the input capture of the IRQ edge, so it does not 
+      depend on the interrupt latency. The 16 MSB are the hal_system_time.
      */
-    uint32_t isr_timestamp = hal_system_time;
+    uint16_t capture = ICR1;
+    uint16_t msb = hal_system_time;
+    
+    //The overflow ISR has lower priority. Check if it is pending.
+    if (((TIFR & (1 << TOV1)) != 0) && (capture < 0x8000)) { msb++; }
+    
+    uint32_t isr_timestamp = msb;
     isr_timestamp <<= 16;
-    isr_timestamp |= TCNT1; 
+    isr_timestamp |= capture; 
+    hal_capture_time = isr_timestamp;
     
     /*Read Interrupt source.*/
     HAL_SS_LOW( );
@@ -785,11 +1230,23 @@ ISR( TIMER1_CAPT_vect ){
     interrupt_source = SPDR; //The interrupt source is read.
 
     HAL_SS_HIGH( );
+    
+    TRACE_EVENT_AT( TRACE_IRQ, interrupt_source, isr_timestamp );
 
     /*Handle the incomming interrupt. Prioritized.*/
     if ((interrupt_source & HAL_RX_START_MASK)) {
         
         hal_rx_start_flag++; //Increment RX_START flag.
+        hal_frame_buffer_flag = true; //The frame is received into the frame buffer.
+        
+#if defined( RX_FRAME_PROTECTION )
+        //It started before the previous frame was read: it is not stored, and
+        //no TRX_END follows.
+        if ((hal_rx_protected == true) || 
+            ((uint32_t)(hal_rx_release_time - hal_capture_time) < HAL_RX_MAX_PROTECTION_TICKS)) {
+            hal_rx_protection_statistics.lost++;
+        }
+#endif
         
         if( rx_start_callback != NULL ){
             
@@ -808,13 +1265,39 @@ ISR( TIMER1_CAPT_vect ){
             
             rx_start_callback( isr_timestamp, frame_length );
         }
-    } else if (interrupt_source & HAL_TRX_END_MASK) {
+    }
+    
+    //The TRX_END of a frame that arrived while interrupts were disabled is
+    //read together with its RX_START. Lost, it would leave the frame protected.
+    if (interrupt_source & HAL_TRX_END_MASK) {
         
         hal_trx_end_flag++; //Increment TRX_END flag.
         
+#if defined( RX_FRAME_PROTECTION )
+        hal_rx_protected = true; //Until hal_frame_read, if a frame was received.
+#endif
+        
         if( trx_end_callback != NULL ){
             trx_end_callback( isr_timestamp );
         }
+        
+#if defined( RX_FRAME_PROTECTION )
+        //A received frame that the handler did not read (rx_pool full, or no
+        //handler) must be released, or nothing more is received.
+        if (hal_rx_protected == true) {
+            
+            uint8_t trx_state = hal_subregister_read( SR_TRX_STATUS );
+            
+            if ((trx_state != TX_ARET_ON) && (trx_state != PLL_ON)) {
+                
+                hal_subregister_write( SR_RX_SAFE_MODE, RX_SAFE_MODE_DISABLE );
+                hal_subregister_write( SR_RX_SAFE_MODE, RX_SAFE_MODE_ENABLE );
+                hal_rx_protection_statistics.released++;
+            }
+            
+            hal_rx_release( );
+        } // end: if (hal_rx_protected == true) ...
+#endif
     } else if (interrupt_source & HAL_TRX_UR_MASK) {
         hal_trx_ur_flag++; //Increment TRX_UR flag.    
     } else if (interrupt_source & HAL_PLL_UNLOCK_MASK) {
@@ -830,9 +1313,11 @@ ISR( TIMER1_CAPT_vect ){
         trx_isr_mask &= ~HAL_BAT_LOW_MASK;
         hal_register_write( RG_IRQ_MASK, trx_isr_mask );
         hal_bat_low_flag++; //Increment BAT_LOW flag.
-    } else {
+    } else if ((interrupt_source & HAL_RX_START_MASK) == 0) {
         hal_unknown_isr_flag++;  //Increment UNKNOWN_ISR flag.
     } 
+    
+    PROF_LEAVE( PROF_TRX_ISR );
 }
 #   endif /* defined(DOXYGEN) */
 
@@ -848,4 +1333,36 @@ ISR( TIMER1_OVF_vect ){
     hal_system_time++;
 }
 #endif
+
+//This #if compile switch is used to provide a "standard" function body for the 
+//doxygen documentation.
+#if defined( DOXYGEN )
+/*! \brief Timer Compare A ISR
+ * This is the interrupt service routine for the HAL timer. The compare match 
+ * happens once per Timer1 period, so the 16 MSB decide if the timer expired.
+ */
+void TIMER1_COMPA_vect( void );
+#else  /* !DOXYGEN */
+ISR( TIMER1_COMPA_vect ){
+    
+    uint16_t msb = hal_system_time;
+    
+    //The overflow ISR has lower priority. Check if it is pending.
+    if (((TIFR & (1 << TOV1)) != 0) && (OCR1A < 0x8000)) { msb++; }
+    
+    if (msb != hal_timer_msb) { return; }
+    
+    HAL_DISABLE_COMPARE_INTERRUPT( ); //One-shot.
+    hal_timer_flag++; //Increment TIMER flag.
+    
+    if( timer_callback != NULL ){
+        
+        uint32_t isr_timestamp = msb;
+        isr_timestamp <<= 16;
+        isr_timestamp |= OCR1A;
+        
+        timer_callback( (isr_timestamp / HAL_US_PER_SYMBOL) & HAL_SYMBOL_MASK );
+    }
+}
+#endif
 /*EOF*/
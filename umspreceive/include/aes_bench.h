@@ -0,0 +1,82 @@
+#ifndef AES_BENCH_H
+#define AES_BENCH_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Command that runs aes_bench_run and aes_bench_report, the first
+ *          character of a line on the UART (see com_get_command).
+ *
+ *  \ingroup aes_bench
+ */
+#define AES_BENCH_COMMAND        ( 'A' )
+
+/*! \brief  Longest chain of blocks measured. Chains of 1 to
+ *          AES_BENCH_MAX_BLOCKS blocks are run.
+ *
+ *  \ingroup aes_bench
+ */
+#define AES_BENCH_MAX_BLOCKS     ( 8 )
+
+/*! \brief  Each measurement is repeated this many times and the shortest run
+ *          is kept, which leaves out the runs that were interrupted.
+ *
+ *  \ingroup aes_bench
+ */
+#ifndef AES_BENCH_REPEAT
+#define AES_BENCH_REPEAT         ( 16 )
+#endif
+
+/*! \name   Report format.
+ *
+ *          aes_bench_report sends one line per measurement: AES_BENCH_TEXT
+ *          followed by the kind (aes_bench_kind_t), the number of blocks and
+ *          the value (4 bytes, MSB first) as hex. The value is in CPU cycles
+ *          (prof_get_cycles), except for AES_BENCH_KAT where it is the number
+ *          of known-answer tests that failed.
+ *
+ *  \ingroup aes_bench
+ *  @{
+ */
+#define AES_BENCH_TEXT           "\r\nAES "
+//! @}
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Measurement kinds.
+ *
+ *  \ingroup aes_bench
+ */
+typedef enum{
+    AES_BENCH_KEY_SETUP = 0,    //!< sal_aes_setup with a new key, encryption.
+    AES_BENCH_DECRYPT_KEY,      //!< sal_aes_setup with a new key, decryption. The decryption key is derived.
+    AES_BENCH_DIR_SWITCH,       //!< sal_aes_setup without a key, to decryption and back to encryption.
+    AES_BENCH_ECB_ENCRYPT,      //!< Chained sal_aes_wrrd and the final sal_aes_read, per number of blocks.
+    AES_BENCH_ECB_DECRYPT,      //!< As AES_BENCH_ECB_ENCRYPT, decryption.
+    AES_BENCH_CBC_ENCRYPT,      //!< First block in ECB with the IV, the others in CBC.
+    AES_BENCH_KAT               //!< Known-answer tests that failed.
+}aes_bench_kind_t;
+
+/*! \brief  Results of aes_bench_run. Times are the shortest of
+ *          AES_BENCH_REPEAT runs, in CPU cycles. Index n of the block arrays
+ *          is a chain of n + 1 blocks.
+ *
+ *  \ingroup aes_bench
+ */
+typedef struct{
+    uint32_t key_setup;                                 //!< AES_BENCH_KEY_SETUP.
+    uint32_t decrypt_key;                               //!< AES_BENCH_DECRYPT_KEY.
+    uint32_t dir_switch;                                //!< AES_BENCH_DIR_SWITCH.
+    uint32_t ecb_encrypt[ AES_BENCH_MAX_BLOCKS ];       //!< AES_BENCH_ECB_ENCRYPT.
+    uint32_t ecb_decrypt[ AES_BENCH_MAX_BLOCKS ];       //!< AES_BENCH_ECB_DECRYPT.
+    uint32_t cbc_encrypt[ AES_BENCH_MAX_BLOCKS ];       //!< AES_BENCH_CBC_ENCRYPT.
+    uint8_t failures;                                   //!< Known-answer tests that failed.
+}aes_bench_result_t;
+/*============================ PROTOTYPES ====================================*/
+void aes_bench_run( aes_bench_result_t *result );
+void aes_bench_report( aes_bench_result_t *result );
+bool aes_bench_command( uint8_t command );
+#endif
+/*EOF*/
@@ -0,0 +1,16 @@
+#ifndef AES_SW_H
+#define AES_SW_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+/*============================ MACROS ========================================*/
+#define AES_SW_BLOCK_SIZE        ( 16 )
+#define AES_SW_KEY_SIZE          ( 16 )
+/*============================ TYPEDEFS ======================================*/
+/*============================ PROTOTYPES ====================================*/
+void aes_sw_setup( uint8_t *key );
+void aes_sw_encrypt( uint8_t *input, uint8_t *output );
+#endif
+/*EOF*/
@@ -0,0 +1,140 @@
+#ifndef ARQ_H
+#define ARQ_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "tat.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Frames the sender may have in flight. Must be a power of two, at
+ *          most 32 (the width of the SACK bitmap).
+ *
+ *  \ingroup arq
+ */
+#ifndef ARQ_WINDOW_SIZE
+#define ARQ_WINDOW_SIZE          ( 8 )
+#endif
+
+/*! \brief  Largest frame kept for retransmission, including the FCS.
+ *
+ *  \ingroup arq
+ */
+#ifndef ARQ_MAX_FRAME_LENGTH
+#define ARQ_MAX_FRAME_LENGTH     ( 32 )
+#endif
+
+/*! \brief  Default retransmission timeout in symbols (300 ms). The receiver
+ *          acknowledges once a frame has left its rx_pool, which can take
+ *          RX_POOL_SIZE UART records.
+ *
+ *  \ingroup arq
+ */
+#ifndef ARQ_RTO
+#define ARQ_RTO                  ( 18750 )
+#endif
+
+/*! \brief  Transmissions of one frame before the sender gives up on it.
+ *
+ *  \ingroup arq
+ */
+#ifndef ARQ_MAX_TRANSMISSIONS
+#define ARQ_MAX_TRANSMISSIONS    ( 8 )
+#endif
+
+/*! \brief  The receiver sends a SACK after this many new frames, after
+ *          ARQ_ACK_DELAY symbols, or at once for a duplicate or a gap.
+ *
+ *  \ingroup arq
+ */
+#ifndef ARQ_ACK_EVERY
+#define ARQ_ACK_EVERY            ( ARQ_WINDOW_SIZE / 2 )
+#endif
+#ifndef ARQ_ACK_DELAY
+#define ARQ_ACK_DELAY            ( 3125 ) //!< 50 ms.
+#endif
+
+/*! \brief  Senders tracked by the receiver. The least recently heard one is
+ *          replaced.
+ *
+ *  \ingroup arq
+ */
+#ifndef ARQ_RX_PEERS
+#define ARQ_RX_PEERS             ( 4 )
+#endif
+
+/*! \name   Sequence numbers.
+ *
+ *          The ARQ sequence number is the frame counter of the existing data
+ *          frame: carry * 255 + seq, with seq (0 to 254) in the MAC sequence
+ *          number byte and carry in the byte after the payload.
+ *
+ *  \ingroup arq
+ *  @{
+ */
+#define ARQ_SEQ_MODULUS          ( 255UL * 256UL )
+#define ARQ_SEQ_OFFSET           ( 2 )  //!< MAC sequence number.
+#define ARQ_CARRY_OFFSET         ( 19 ) //!< Carry byte.
+#define ARQ_SOURCE_OFFSET        ( 7 )  //!< Source short address.
+#define ARQ_MIN_DATA_LENGTH      ( ARQ_CARRY_OFFSET + 1 + 2 )
+//! @}
+
+/*! \name   SACK trailer.
+ *
+ *          Added at the end of the MAC payload of any frame to the sender,
+ *          all fields LSB first:
+ *          - Cumulative acknowledge (2 bytes): the next sequence number the
+ *            receiver expects. Everything before it was received.
+ *          - Bitmap (4 bytes): bit i set if sequence number cumulative + 1 + i
+ *            was received.
+ *          - ARQ_SACK_MAGIC_0, ARQ_SACK_MAGIC_1.
+ *
+ *  \ingroup arq
+ *  @{
+ */
+#define ARQ_SACK_LENGTH          ( 8 )
+#define ARQ_SACK_MAGIC_0         ( 0xC5 )
+#define ARQ_SACK_MAGIC_1         ( 0x5A )
+#define ARQ_SACK_FRAME_LENGTH    ( 9 + ARQ_SACK_LENGTH + 2 ) //!< Standalone SACK frame, with FCS.
+//! @}
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Sender counters.
+ *
+ *  \ingroup arq
+ */
+typedef struct{
+    uint16_t queued;          //!< Frames accepted by arq_sender_queue.
+    uint16_t delivered;       //!< Frames acknowledged by the receiver.
+    uint16_t transmissions;   //!< Frames put on air, first and repeated.
+    uint16_t timeouts;        //!< Retransmissions after ARQ_RTO.
+    uint16_t failed;          //!< Frames given up after ARQ_MAX_TRANSMISSIONS.
+    uint16_t sacks;           //!< Valid SACKs received.
+}arq_sender_statistics_t;
+
+/*! \brief  Result of arq_receiver_accept.
+ *
+ *  \ingroup arq
+ */
+typedef enum{
+    ARQ_NEW = 0,        //!< First copy; deliver it.
+    ARQ_DUPLICATE,      //!< Already delivered; drop it.
+    ARQ_NOT_ARQ         //!< Too short to carry a sequence number.
+}arq_accept_t;
+/*============================ PROTOTYPES ====================================*/
+void arq_sender_init( uint16_t peer_address, uint32_t rto );
+bool arq_sender_window_open( void );
+tat_status_t arq_sender_queue( uint8_t *frame, uint8_t length, uint16_t *sequence_number );
+uint8_t arq_sender_next( uint8_t **frame );
+void arq_sender_sent( tat_status_t status );
+bool arq_sender_receive( uint8_t *frame, uint8_t length );
+uint8_t arq_sender_in_flight( void );
+void arq_sender_get_statistics( arq_sender_statistics_t *statistics );
+
+void arq_receiver_init( void );
+arq_accept_t arq_receiver_accept( uint8_t *frame, uint8_t length );
+uint8_t arq_receiver_build_sack( uint8_t *frame );
+uint8_t arq_append_sack( uint8_t *frame, uint8_t length, uint16_t peer_address );
+#endif
+/*EOF*/
@@ -0,0 +1,70 @@
+#ifndef CCM_H
+#define CCM_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "tat.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Command that runs ccm_benchmark, the first character of a line on
+ *          the UART (see com_get_command).
+ *
+ *  \ingroup ccm
+ */
+#define CCM_COMMAND_BENCHMARK    ( 'C' )
+
+/*! \brief  Frames secured with each AES implementation by ccm_benchmark.
+ *
+ *  \ingroup ccm
+ */
+#ifndef CCM_BENCHMARK_FRAMES
+#define CCM_BENCHMARK_FRAMES     ( 32 )
+#endif
+
+/*! \name   Secured frame format (IEEE 802.15.4-2006, security level 5,
+ *          ENC-MIC-32).
+ *
+ *          The security enabled bit and frame version 1 are set in the FCF.
+ *          The 9 byte MAC header is followed by the auxiliary security header:
+ *          security control (CCM_SECURITY_LEVEL, key identifier mode 0) and
+ *          the frame counter (4 bytes, LSB first). Then come the encrypted
+ *          payload, the 4 byte MIC and the FCS.
+ *
+ *          The nonce is the source address (8 bytes, MSB first), the frame
+ *          counter (MSB first) and the security level. Short addresses are
+ *          used here, so the source address is 0x0000, the PAN ID and the
+ *          short address. The MAC header and the auxiliary security header
+ *          are authenticated.
+ *
+ *  \ingroup ccm
+ *  @{
+ */
+#define CCM_SECURITY_LEVEL       ( 0x05 )
+#define CCM_MAC_HEADER_LENGTH    ( 9 )
+#define CCM_AUX_HEADER_LENGTH    ( 5 )
+#define CCM_MIC_LENGTH           ( 4 )
+#define CCM_OVERHEAD             ( CCM_AUX_HEADER_LENGTH + CCM_MIC_LENGTH )
+#define CCM_FCF_SECURITY         ( 0x08 ) //!< Security enabled, first FCF byte.
+#define CCM_FCF_VERSION_2006     ( 0x10 ) //!< Frame version 1, second FCF byte.
+//! @}
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  AES implementation used by CCM*.
+ *
+ *  \ingroup ccm
+ */
+typedef enum{
+    CCM_AES_SOFTWARE = 0,   //!< aes_sw.c.
+    CCM_AES_HARDWARE        //!< The AES engine of the transceiver, through sal.c.
+}ccm_aes_t;
+/*============================ PROTOTYPES ====================================*/
+void ccm_init( uint8_t *key );
+void ccm_set_aes( ccm_aes_t aes );
+uint8_t ccm_secure( uint8_t *frame, uint8_t length, uint8_t *secured );
+tat_status_t ccm_unsecure( uint8_t *frame, uint8_t *length );
+void ccm_benchmark( void );
+bool ccm_command( uint8_t command );
+#endif
+/*EOF*/
@@ -102,6 +102,11 @@
 
 #define watchdog_reset( ) (__watchdog_reset( ))
 
+/** Enter the IDLE sleep mode with interrupts enabled. Call with interrupts 
+    disabled after checking the wake-up condition, so that no event is lost.*/
+#define avr_sleep_idle( ) do { MCUCR = ( MCUCR & ~( ( 1 << SM2 ) | ( 1 << SM1 ) | ( 1 << SM0 ) ) ) | ( 1 << SE ); \
+                               __enable_interrupt( ); __sleep( ); MCUCR &= ~( 1 << SE ); } while (0)
+
 #define INLINE PRAGMA( inline=forced ) static
 
 #elif defined( __GNUC__ )
@@ -109,16 +114,24 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 # include <avr/pgmspace.h>
+#include <avr/sleep.h>
 
 #include <util/crc16.h>
 #include <util/delay.h>
+#include <avr/wdt.h>
 
 #define delay_us( us )   (_delay_us( us ))
 #define delay_ms( ms )   (_delay_ms( ms ))
+#define watchdog_reset( ) (wdt_reset( ))
 
-#define INLINE static inline
+#define INLINE static inline __attribute__(( always_inline )) //!< Forced, as for IAR.
 #define crc_ccitt_update( crc, data ) _crc_ccitt_update( crc, data )
 
+/** Enter the IDLE sleep mode with interrupts enabled. Call with interrupts 
+    disabled after checking the wake-up condition, so that no event is lost.*/
+#define avr_sleep_idle( ) do { set_sleep_mode( SLEEP_MODE_IDLE ); sleep_enable( ); \
+                               sei( ); sleep_cpu( ); sleep_disable( ); } while (0)
+
 #define __x 
 #define __z 
 
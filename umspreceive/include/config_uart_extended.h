@@ -30,6 +30,122 @@
 //#define STK541
 #define RZ502
 
+/*Low-power listening: the receiver samples the channel every LPL_CHECK_INTERVAL
+  and the sender strobes its frames for as long. Program both nodes alike.*/
+//#define LOW_POWER_LISTENING
+#define LPL_CHECK_INTERVAL ( 6250 ) //!< Symbols between two channel samples (100 ms).
+#define LPL_AWAKE_TIME     ( 1250 ) //!< Symbols to stay awake after channel activity (20 ms).
+
+/*Clock the AVR from the CLKM output of the radio transceiver instead of a
+  crystal (fuses CKSEL = 0000, external clock), at F_CPU = 8 or 16 MHz (see
+  config/clock_config.h). The AVR starts at the 1 MHz reset value of CLKM,
+  tat_reset_trx raises it with hal_raise_cpu_clock. Timer1, the UART and the
+  SPI (F_CPU / 2) follow F_CPU. Cannot be used with LOW_POWER_LISTENING, the
+  AVR stops with CLKM while the radio sleeps.*/
+//#define HAL_CLOCK_FROM_CLKM
+
+/*Frame buffer protection (RX_SAFE_MODE): a received frame stays in the frame
+  buffer until it is uploaded, instead of being overwritten by the next frame
+  while the upload runs. A frame that arrives meanwhile is dropped without an
+  acknowledge, and counted (hal_get_rx_protection_statistics).*/
+#define RX_FRAME_PROTECTION
+
+/*Keep the last transmitted frame resident in the frame buffer: a frame of the
+  same length is sent by writing only the bytes that changed (the sequence
+  number and the carry of testsend), a repeated frame by writing nothing. For
+  frames up to TAT_RESIDENT_FRAME_SIZE bytes. See tat_send_data_with_retry.*/
+//#define RESIDENT_TX_FRAME
+
+/*Append LQI and the TRX_END time stamp (symbols) to each hex record, 10 more
+  hex digits. Used by tools/loganalyse for LQI and inter-arrival statistics.*/
+//#define RX_LOG_METADATA
+
+/*Sniffer build: receive every frame in RX_ON (also with bad CRC) and stream
+  timestamped binary records on the UART at 500 kbaud. See sniffer.h.*/
+//#define SNIFFER
+
+/*Print the counters of each CSMA profile (see tat_send_data_with_profile) on
+  the UART once per 255 transmitted frames.*/
+//#define CSMA_STATISTICS
+
+/*Time the hot paths (TRX ISR, frame upload/download, UART, state transitions)
+  with Timer3. Send "P" on the UART to dump the table, "Z" to dump and clear.
+  See prof.h for the format.*/
+//#define PROFILING
+
+/*Record radio events (IRQs, state changes, TRAC_STATUS, rx_pool depth) in a
+  RAM ring. The ring is dumped in binary on a pool overflow or failed
+  transmission, or when "T" is sent on the UART. Decode with tools/tracedump.*/
+//#define TRACE
+
+/*Reliable delivery: the sender keeps up to ARQ_WINDOW_SIZE frames in flight
+  and repeats them until the receiver reports them in a selective
+  acknowledge (SACK). The receiver drops duplicates. See arq.h.*/
+//#define ARQ
+
+/*Datagrams larger than one frame: the sender splits them into fragments, the
+  receiver reassembles them and streams the data on the UART in binary
+  records. Cannot be used with ARQ. See frag.h.*/
+//#define FRAGMENTATION
+
+/*Pack the small records (sequence number, carry and the 3 data bytes) of
+  testsend into one frame, up to AGGR_BYTE_BUDGET bytes or AGGR_MAX_DELAY.
+  The receiver logs each record as if it came in its own frame. Cannot be
+  used with ARQ or FRAGMENTATION on the sender. See aggr.h.*/
+//#define AGGREGATION
+
+#define AGGR_RECORD_LENGTH ( 5 ) //!< Length of one aggregated record.
+
+/*Encrypt and authenticate the payload with AES-CCM* (IEEE 802.15.4-2006,
+  ENC-MIC-32) on the AES engine of the transceiver. Both nodes must share
+  SECURITY_KEY; the receiver drops frames that fail the MIC check. Cannot be
+  used with ARQ, FRAGMENTATION or AGGREGATION on the sender. See ccm.h.*/
+//#define SECURITY
+
+#define SECURITY_KEY { 0xC0, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, \
+                       0xC8, 0xC9, 0xCA, 0xCB, 0xCC, 0xCD, 0xCE, 0xCF } //!< AES-128 key of the network.
+
+/*Measure sal.c and the AES engine: key setup, direction switches and chains
+  of 1 to 8 ECB and CBC blocks, checked against known-answer tests. Send "A"
+  on the UART to run it. Needs PROFILING. See aes_bench.h and tools/aessim.*/
+//#define AES_BENCHMARK
+
+/*Synchronize the clocks of the nodes to the root (TSYNC_ROOT_ADDRESS) with
+  beacons that carry the time of the previous beacon. Send "S" on the UART for
+  the estimate and the errors measured against the neighbours. Cannot be used
+  with LOW_POWER_LISTENING, nor with ARQ, FRAGMENTATION or AGGREGATION on the
+  sender. See tsync.h.*/
+//#define TIME_SYNC
+
+#define TSYNC_ROOT_ADDRESS ( SHORT_ADDRESS_NODE2 ) //!< Node that defines the global time.
+
+/*Scheduled access instead of CSMA-CA: the receiver (TSYNC_ROOT_ADDRESS) hands
+  out one slot per sender in each superframe, and the senders transmit only in
+  their slot. Needs TIME_SYNC. Send "M" on the UART for the slot counters. See
+  tdma.h, and the -m option of tools/netsim.*/
+//#define TDMA
+
+/*Over-the-air update: "U" on the UART sends the application of this node to
+  DEST_ADDRESS, which must run the same application with OTA and have
+  bootloader/ota_boot.c in its boot section (fuses BOOTSZ = 00 and BOOTRST).
+  The image must fit OTA_IMAGE_MAX. See ota.h.*/
+//#define OTA
+
+/*Counters per sender, keyed by the short source address: frames, lost and
+  duplicate sequence numbers, average LQI and bytes, for up to PEER_MAX_PEERS
+  senders (the least recently heard one is dropped for a new one). Send "N" on
+  the UART for the table. See peer.h.*/
+//#define PEER_TABLE
+#define PEER_REPORT_INTERVAL ( 625000 ) //!< Symbols between two reports of the senders heard since the last one (10 s), 0 for "N" only.
+
+/*AVR watchdog, restarted by the main loop and by the bounded waits of the
+  radio driver: the node resets if it hangs anywhere else. A radio transceiver
+  that misses a deadline is recovered by tat_recover in any case. Send "R" on
+  the UART for the recovery counters. Dumps over the UART that take longer than
+  WATCHDOG_TIMEOUT (about 1900 characters at 9600 baud) reset the node too.
+  See watchdog.h.*/
+//#define WATCHDOG
+
 #define COM_RX_BUFFER_SIZE ( 118 ) //DO NOT ALTER!!!
 #define RX_POOL_SIZE       ( 4 ) //MUST BE GREATER THAN ZERO.
 #endif
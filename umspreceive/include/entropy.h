@@ -0,0 +1,35 @@
+#ifndef ENTROPY_H
+#define ENTROPY_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Number of random bytes kept in the pool.
+ *
+ *  \ingroup entropy
+ */
+#ifndef ENTROPY_POOL_SIZE
+#define ENTROPY_POOL_SIZE      ( 16 )
+#endif
+
+/*! \brief  Largest number of bytes added to the pool by one call to 
+ *          entropy_harvest. Each byte takes four RND_VALUE reads.
+ *
+ *  \ingroup entropy
+ */
+#ifndef ENTROPY_HARVEST_BYTES
+#define ENTROPY_HARVEST_BYTES  ( 4 )
+#endif
+/*============================ TYPEDEFS ======================================*/
+/*============================ PROTOTYPES ====================================*/
+void entropy_init( void );
+void entropy_harvest( void );
+uint8_t entropy_available( void );
+bool entropy_get_byte( uint8_t *value );
+uint8_t entropy_get_bytes( uint8_t *buffer, uint8_t length );
+bool entropy_seed_csma( void );
+#endif
+/*EOF*/
@@ -150,39 +150,61 @@
  *  to ensure that the hal_get_system_time function returns the system time in 
  *  symbols (16 us ticks).
  *
+ *  They are derived from F_CPU: HAL_TIMER1_PRESCALER is the smallest prescaler
+ *  that gives a whole power of two Timer1 ticks per symbol, so that the 
+ *  conversions below are exact. HAL_US_PER_SYMBOL is that number of ticks,
+ *  e.g. 2 at 8 MHz and 4 at 16 MHz (prescaler 64).
+ *
  *  \ingroup hal_avr_board
  */
+#define HAL_SYMBOL_RATE ( 62500 ) //!< Symbols per second.
+
+#if ( F_CPU % ( 64 * HAL_SYMBOL_RATE ) == 0 )
+    #define HAL_TIMER1_PRESCALER ( 64 )
+    #define HAL_TCCR1B_CLOCK_SELECT ( ( 1 << CS11 ) | ( 1 << CS10 ) )
+#elif ( F_CPU % ( 8 * HAL_SYMBOL_RATE ) == 0 )
+    #define HAL_TIMER1_PRESCALER ( 8 )
+    #define HAL_TCCR1B_CLOCK_SELECT ( 1 << CS11 )
+#else
+    #error "Clock speed not supported, Timer1 cannot count whole ticks per symbol."
+#endif
 
+#define HAL_TCCR1B_CONFIG ( ( 1 << ICES1 ) | HAL_TCCR1B_CLOCK_SELECT )
+#define HAL_US_PER_SYMBOL ( F_CPU / HAL_TIMER1_PRESCALER / HAL_SYMBOL_RATE )
+#define HAL_SYMBOL_MASK   ( 0xFFFFffffUL / HAL_US_PER_SYMBOL )
+
+#if ( HAL_US_PER_SYMBOL & ( HAL_US_PER_SYMBOL - 1 ) )
+    #error "Clock speed not supported, HAL_SYMBOL_MASK needs a power of two ticks per symbol."
+#endif
+
+/*! \brief CLKM_CTRL setting that clocks the AVR at F_CPU when HAL_CLOCK_FROM_CLKM
+ *         is defined (see hal_raise_cpu_clock).
+ *
+ *  \ingroup hal_avr_board
+ */
 #if ( F_CPU == 16000000UL )
-    #define HAL_TCCR1B_CONFIG ( ( 1 << ICES1 ) | ( 1 << CS12 ) )
-    #define HAL_US_PER_SYMBOL ( 1 )
-    #define HAL_SYMBOL_MASK   ( 0xFFFFffff )
+    #define HAL_CLKM_CTRL ( CLKM_16MHZ )
 #elif ( F_CPU == 8000000UL )
-    #define HAL_TCCR1B_CONFIG ( ( 1 << ICES1 ) | ( 1 << CS11 ) | ( 1 << CS10 ) )
-    #define HAL_US_PER_SYMBOL ( 2 )
-    #define HAL_SYMBOL_MASK   ( 0x7FFFffff )
-#elif ( F_CPU == 7372800UL )
-    #define HAL_TCCR1B_CONFIG ( ( 1 << ICES1 ) | ( 1 << CS11 ) | ( 1 << CS10 ) )
-    #define HAL_US_PER_SYMBOL ( 2 )
-    #define HAL_SYMBOL_MASK   ( 0x7FFFffff )
-#elif ( F_CPU == 4000000UL )
-    #define HAL_TCCR1B_CONFIG ( ( 1 << ICES1 ) | ( 1 << CS11 ) | ( 1 << CS10 ) )
-    #define HAL_US_PER_SYMBOL ( 1 )
-    #define HAL_SYMBOL_MASK   ( 0xFFFFffff )
-#elif ( F_CPU == 1000000UL )
-    #define HAL_TCCR1B_CONFIG ( ( 1 << ICES1 ) | ( 1 << CS11 ) )
-    #define HAL_US_PER_SYMBOL ( 2 )
-    #define HAL_SYMBOL_MASK   ( 0x7FFFffff )
-#else
-    #error "Clock speed not supported."
+    #define HAL_CLKM_CTRL ( CLKM_8MHZ )
 #endif
 
+/*! \brief Division of CLKM by the system clock prescaler (XDIV) while CLKM is
+ *         switched from 1 MHz to HAL_CLKM_CTRL.
+ *
+ *  \ingroup hal_avr_board
+ */
+#define HAL_XDIV_CLKM_SWITCH ( 16 )
+
 #define HAL_ENABLE_INPUT_CAPTURE_INTERRUPT( ) ( TIMSK |= ( 1 << TICIE1 ) )//uploaded by wjy
 #define HAL_DISABLE_INPUT_CAPTURE_INTERRUPT( ) ( TIMSK &= ~( 1 << TICIE1 ) )// uploaded by wjy
 
 #define HAL_ENABLE_OVERFLOW_INTERRUPT( ) ( TIMSK |= ( 1 << TOIE1 ) )// uploaded by wjy
 #define HAL_DISABLE_OVERFLOW_INTERRUPT( ) ( TIMSK &= ~( 1 << TOIE1 ) )// uploaded by wjy
 
+#define HAL_ENABLE_COMPARE_INTERRUPT( ) ( TIMSK |= ( 1 << OCIE1A ) ) //!< Timer1 compare A drives the HAL timer.
+#define HAL_DISABLE_COMPARE_INTERRUPT( ) ( TIMSK &= ~( 1 << OCIE1A ) )
+#define HAL_CLEAR_COMPARE_FLAG( ) ( TIFR = ( 1 << OCF1A ) )
+
 /*! \brief  Enable the interrupt from the radio transceiver.
  *
  *  \ingroup hal_avr_api
@@ -0,0 +1,70 @@
+#ifndef LPL_H
+#define LPL_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "tat.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Default time between two channel samples in IEEE 802.15.4 symbols
+ *          (16 us). The sender strobes for this long, so it is also the
+ *          worst case wake-up latency.
+ *
+ *  \ingroup lpl
+ */
+#ifndef LPL_CHECK_INTERVAL
+#define LPL_CHECK_INTERVAL   ( 6250 ) //!< 100 ms.
+#endif
+
+/*! \brief  Default time the receiver stays in RX_AACK_ON after energy was
+ *          detected or a frame was received, in symbols.
+ *
+ *  \ingroup lpl
+ */
+#ifndef LPL_AWAKE_TIME
+#define LPL_AWAKE_TIME       ( 1250 ) //!< 20 ms.
+#endif
+
+/*! \brief  Length of one channel sample in symbols. It must be longer than the
+ *          gap between two strobes (ACK wait plus back-off).
+ *
+ *  \ingroup lpl
+ */
+#ifndef LPL_SAMPLE_TIME
+#define LPL_SAMPLE_TIME      ( 160 ) //!< 2.56 ms.
+#endif
+
+/*! \brief  ED level (0 to 84) above which the channel is considered busy.
+ *
+ *  \ingroup lpl
+ */
+#ifndef LPL_ED_THRESHOLD
+#define LPL_ED_THRESHOLD     ( 10 )
+#endif
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Counters kept by the low-power listening module. All times are in
+ *          IEEE 802.15.4 symbols.
+ *
+ *  \ingroup lpl
+ */
+typedef struct{
+    uint32_t wakeups;      //!< Number of channel samples taken.
+    uint32_t busy_wakeups; //!< Samples where energy above LPL_ED_THRESHOLD was found.
+    uint32_t frames;       //!< Frames received while awake.
+    uint32_t awake_time;   //!< Accumulated time the transceiver was not sleeping.
+    uint32_t strobes;      //!< Frames transmitted by lpl_send_data (including the successful one).
+} lpl_statistics_t;
+/*============================ PROTOTYPES ====================================*/
+void lpl_init( void );
+tat_status_t lpl_configure( uint32_t check_interval, uint32_t awake_time );
+void lpl_listen( void );
+void lpl_frame_received( void );
+tat_status_t lpl_send_data( uint8_t frame_length, uint8_t *frame );
+void lpl_get_statistics( lpl_statistics_t *statistics );
+uint32_t lpl_get_awake_time_per_frame( void );
+void lpl_reset_statistics( void );
+#endif
+/*EOF*/
@@ -0,0 +1,80 @@
+#ifndef PEER_H
+#define PEER_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "hal.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Command that sends the whole table, the first character of a line
+ *          on the UART (see com_get_command).
+ *
+ *  \ingroup peer
+ */
+#define PEER_COMMAND_REPORT      ( 'N' )
+
+/*! \name   Table size. The table is open addressed with linear probing, so it
+ *          is kept at most 3/4 full: the least recently heard sender is
+ *          evicted for a new one beyond PEER_MAX_PEERS.
+ *
+ *  \ingroup peer
+ *  @{
+ */
+#ifndef PEER_TABLE_BITS
+#define PEER_TABLE_BITS          ( 5 )
+#endif
+#define PEER_TABLE_SIZE          ( 1 << PEER_TABLE_BITS )
+#define PEER_MAX_PEERS           ( PEER_TABLE_SIZE - PEER_TABLE_SIZE / 4 )
+//! @}
+
+/*! \name   Sequence numbers.
+ *
+ *          Frames in the testsend format (PEER_RECORD_LENGTH bytes, start
+ *          symbol 0x0DB5) count with the sequence number, which wraps from
+ *          254 to 0, and the carry in byte 19. Other frames count with the
+ *          sequence number of the MAC header alone.
+ *
+ *  \ingroup peer
+ *  @{
+ */
+#define PEER_RECORD_LENGTH       ( 22 )
+#define PEER_RECORD_MODULO       ( 255UL * 256 )
+#define PEER_SEQUENCE_MODULO     ( 256UL )
+#define PEER_MAX_REORDER         ( 16 ) //!< A frame further back restarts the count, e.g. after a reset of the sender.
+//! @}
+
+/*! \brief  Weight of a new LQI in the average, as a shift: 1/8.
+ *
+ *  \ingroup peer
+ */
+#define PEER_LQI_SHIFT           ( 3 )
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Counters of one sender.
+ *
+ *  \ingroup peer
+ */
+typedef struct{
+    uint16_t address;       //!< Short source address.
+    uint8_t sequence;       //!< Sequence number of the last frame in order.
+    uint8_t carry;          //!< Carry of the last frame in order, 0 for other frames.
+    uint16_t frames;        //!< Frames received.
+    uint16_t lost;          //!< Sequence numbers skipped.
+    uint16_t duplicates;    //!< Frames at or shortly before the last sequence number.
+    uint16_t restarts;      //!< Frames that restarted the count.
+    uint16_t lqi;           //!< Average LQI, 8.8 fixed point.
+    uint32_t last_seen;     //!< TRX_END time stamp of the last frame, in symbols.
+    uint32_t bytes;         //!< PSDU bytes received, with the FCS.
+}peer_statistics_t;
+/*============================ PROTOTYPES ====================================*/
+void peer_init( void );
+void peer_update( hal_rx_frame_t *frame, uint32_t time_stamp );
+bool peer_get( uint16_t address, peer_statistics_t *statistics );
+uint8_t peer_count( void );
+void peer_report( bool all );
+void peer_poll( void );
+bool peer_command( uint8_t command );
+#endif
+/*EOF*/
@@ -0,0 +1,73 @@
+#ifndef SNIFFER_H
+#define SNIFFER_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "tat.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  UBRR0 value used for the capture stream. The USART runs in double 
+ *          speed mode, so the baud rate is F_CPU / (8 * (SNIFFER_UBRR + 1)): 
+ *          500 kbaud at 8 and 16 MHz, without baud rate error. This is about twice the byte rate of a fully 
+ *          loaded 250 kb/s channel.
+ *
+ *  \ingroup sniffer
+ */
+#ifndef SNIFFER_UBRR
+#define SNIFFER_UBRR              ( F_CPU / 4000000 - 1 )
+#endif
+
+/*! \brief  Size of the UART transmit ring buffer. Must be a power of two. 
+ *          Holds three maximum length records.
+ *
+ *  \ingroup sniffer
+ */
+#ifndef SNIFFER_TX_BUFFER_SIZE
+#define SNIFFER_TX_BUFFER_SIZE    ( 512 )
+#endif
+
+/*! \name   Capture record format.
+ *
+ *          Each captured frame is sent as one record, all multi-byte fields 
+ *          LSB first:
+ *          - SNIFFER_SYNC_0, SNIFFER_SYNC_1
+ *          - Record length: number of bytes from flags up to, but not 
+ *            including, the checksum (SNIFFER_RECORD_OVERHEAD + PSDU length).
+ *          - Flags: SNIFFER_FLAG_*.
+ *          - Dropped: records lost because the ring buffer was full since the 
+ *            previous record (saturates at 255).
+ *          - Timestamp (4 bytes): System time at RX_START (SFD) in symbols.
+ *          - LQI.
+ *          - ED level measured during the frame (0 to 84).
+ *          - PSDU length, followed by the PSDU including the FCS.
+ *          - Checksum (2 bytes): crc_ccitt_update (CRC-16/KERMIT) over record 
+ *            length up to the last PSDU byte, initial value 0.
+ *
+ *  \ingroup sniffer
+ *  @{
+ */
+#define SNIFFER_SYNC_0            ( 0xA5 )
+#define SNIFFER_SYNC_1            ( 0x5A )
+#define SNIFFER_RECORD_OVERHEAD   ( 9 ) //!< Flags, dropped, timestamp, LQI, ED and PSDU length.
+#define SNIFFER_FLAG_CRC_OK       ( 0x01 ) //!< The FCS of the frame was correct.
+#define SNIFFER_FLAG_DROPPED      ( 0x02 ) //!< Records were lost before this one.
+#define SNIFFER_FLAG_BAD_LENGTH   ( 0x04 ) //!< Invalid PHR; no PSDU is included.
+//! @}
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  Counters kept by the sniffer.
+ *
+ *  \ingroup sniffer
+ */
+typedef struct{
+    uint16_t frames;       //!< Frames captured and queued.
+    uint16_t crc_errors;   //!< Frames queued with SNIFFER_FLAG_CRC_OK cleared.
+    uint16_t dropped;      //!< Frames lost because the ring buffer was full.
+} sniffer_statistics_t;
+/*============================ PROTOTYPES ====================================*/
+tat_status_t sniffer_init( void );
+void sniffer_get_statistics( sniffer_statistics_t *statistics );
+#endif
+/*EOF*/
@@ -0,0 +1,96 @@
+#ifndef TSYNC_H
+#define TSYNC_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "tat.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Command that runs tsync_report, the first character of a line on
+ *          the UART (see com_get_command).
+ *
+ *  \ingroup tsync
+ */
+#define TSYNC_COMMAND_REPORT     ( 'S' )
+
+/*! \name   Tuning.
+ *
+ *  \ingroup tsync
+ *  @{
+ */
+#ifndef TSYNC_BEACON_INTERVAL
+#define TSYNC_BEACON_INTERVAL    ( 62500 ) //!< Symbols between two beacons of a node (1 s).
+#endif
+#define TSYNC_SAMPLES            ( 8 ) //!< Samples in the regression.
+#define TSYNC_MIN_SAMPLES        ( 3 ) //!< Samples before a node is synchronized and sends beacons.
+#define TSYNC_MAX_ERROR          ( 125 ) //!< Ticks (1 ms) a sample may be off the estimate.
+#define TSYNC_MAX_OUTLIERS       ( 3 ) //!< Outliers in a row that restart the regression.
+#define TSYNC_PARENT_TIMEOUT     ( 4 * TSYNC_BEACON_INTERVAL ) //!< Symbols without a beacon of the parent.
+#define TSYNC_NEIGHBOURS         ( 4 ) //!< Nodes whose beacons are tracked.
+//! @}
+
+/*! \name   Beacon format.
+ *
+ *          Broadcast data frame without acknowledge request, so TRX_END comes
+ *          right after the last byte on air: FCF, sequence number, PAN ID,
+ *          0xFFFF, source address, then TSYNC_DISPATCH, the beacon number,
+ *          the hop count (0 at the root), the root address (2 bytes), the
+ *          global time of the previous beacon of this node (4 bytes, Timer1
+ *          ticks), a flag telling if that time is valid, and the FCS. All
+ *          fields LSB first.
+ *
+ *          The reference point of a frame is the end of the PHR: the RX_START
+ *          capture at the receiver, and the TRX_END capture minus the PSDU air
+ *          time at the sender. The time of a beacon is only known after it
+ *          was sent, so it is carried by the next one.
+ *
+ *  \ingroup tsync
+ *  @{
+ */
+#define TSYNC_DISPATCH           ( 0xF7 )
+#define TSYNC_MAC_HEADER_LENGTH  ( 9 )
+#define TSYNC_BEACON_LENGTH      ( TSYNC_MAC_HEADER_LENGTH + 10 + 2 )
+#define TSYNC_BROADCAST          ( 0xFFFF )
+//! @}
+
+/*! \brief  Microseconds per Timer1 tick.
+ *
+ *  \ingroup tsync
+ */
+#define TSYNC_US_PER_TICK        ( 16 / HAL_US_PER_SYMBOL )
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  State of the local clock estimate.
+ *
+ *  \ingroup tsync
+ */
+typedef struct{
+    bool synchronized;  //!< The estimate is usable: root, or TSYNC_MIN_SAMPLES samples.
+    uint8_t hop;        //!< 0 at the root, parent hop + 1 otherwise. 0xFF if not synchronized.
+    uint16_t parent;    //!< Address of the node the samples come from.
+    uint8_t samples;    //!< Samples in the regression.
+    int16_t skew_ppm;   //!< Global clock rate relative to the local one, in ppm.
+    int16_t error_us;   //!< Last sample minus the estimate before it, in us.
+    uint16_t max_error_us; //!< Largest absolute error_us since the last restart.
+    uint16_t restarts;  //!< Times the regression was cleared.
+}tsync_status_t;
+/*============================ PROTOTYPES ====================================*/
+void tsync_init( void );
+void tsync_rx_start( uint32_t isr_timestamp, uint8_t frame_length );
+uint32_t tsync_get_rx_start_time( void );
+bool tsync_is_beacon( uint8_t *frame, uint8_t length );
+void tsync_receive( uint8_t *frame, uint8_t length, uint32_t rx_start_time );
+bool tsync_beacon_due( void );
+uint8_t tsync_build_beacon( uint8_t *frame );
+void tsync_beacon_sent( tat_status_t status );
+bool tsync_is_synchronized( void );
+uint32_t tsync_local_to_global( uint32_t local_time );
+uint32_t tsync_global_to_local( uint32_t global_time );
+uint32_t tsync_get_global_time( void );
+void tsync_get_status( tsync_status_t *status );
+void tsync_report( void );
+bool tsync_command( uint8_t command );
+#endif
+/*EOF*/
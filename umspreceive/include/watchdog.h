@@ -0,0 +1,42 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+/*============================ INCLUDE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+/*============================ MACROS ========================================*/
+
+/*! \brief  Command that runs watchdog_report, the first character of a line
+ *          on the UART (see com_get_command).
+ *
+ *  \ingroup watchdog
+ */
+#define WATCHDOG_COMMAND_REPORT  ( 'R' )
+
+/*! \brief  Watchdog timeout, one of the WDTO_* values of avr/wdt.h.
+ *
+ *  \ingroup watchdog
+ */
+#ifndef WATCHDOG_TIMEOUT
+#define WATCHDOG_TIMEOUT         ( WDTO_2S )
+#endif
+
+/*! \brief  Restart the watchdog. Called once per pass of the main loop and
+ *          in the bounded waits of the TAT. Empty without WATCHDOG.
+ *
+ *  \ingroup watchdog
+ */
+#if defined( WATCHDOG )
+#define WATCHDOG_KICK( )         watchdog_reset( )
+#else
+#define WATCHDOG_KICK( )
+#endif
+/*============================ TYPEDEFS ======================================*/
+/*============================ PROTOTYPES ====================================*/
+void watchdog_start( void );
+uint16_t watchdog_get_resets( void );
+void watchdog_report( void );
+bool watchdog_command( uint8_t command );
+#endif
+/*EOF*/
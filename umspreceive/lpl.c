@@ -0,0 +1,284 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config_uart_extended.h"
+#include "at86rf231.h"
+
+#include "compiler.h"
+#include "hal.h"
+#include "tat.h"
+#include "lpl.h"
+/*============================ MACROS ========================================*/
+/*============================ TYPEDEFS ======================================*/
+/*============================ VARIABLES =====================================*/
+static uint32_t lpl_check_interval; //!< Time between two channel samples in symbols.
+static uint32_t lpl_awake_time; //!< Time to stay awake after the last channel activity in symbols.
+
+static bool lpl_awake; //!< True while the receive window is open (RX_AACK_ON).
+static uint32_t lpl_awake_start; //!< System time when the transceiver was last woken.
+static uint32_t lpl_last_activity; //!< System time of the last busy sample or received frame.
+
+static uint8_t volatile lpl_rx_events; //!< Incremented from the TRX_END handler for each received frame.
+static uint8_t lpl_rx_events_seen; //!< Value of lpl_rx_events when last checked.
+
+static lpl_statistics_t lpl_statistics; //!< Duty cycle statistics.
+/*============================ PROTOTYPES ====================================*/
+static bool lpl_channel_busy( void );
+static void lpl_sleep( void );
+static void lpl_wait_for_check_interval( void );
+
+/*! \brief  Initialize the low-power listening module with the default duty
+ *          cycle (LPL_CHECK_INTERVAL and LPL_AWAKE_TIME).
+ *
+ *          The receive window is initially open, so the caller must have put
+ *          the radio transceiver in RX_AACK_ON.
+ *
+ *  \ingroup lpl
+ */
+void lpl_init( void ){
+
+    lpl_check_interval = LPL_CHECK_INTERVAL;
+    lpl_awake_time     = LPL_AWAKE_TIME;
+
+    lpl_awake          = true;
+    lpl_awake_start    = hal_get_system_time( );
+    lpl_last_activity  = lpl_awake_start;
+
+    lpl_rx_events      = 0;
+    lpl_rx_events_seen = 0;
+
+    lpl_reset_statistics( );
+}
+
+/*! \brief  Change the duty cycle.
+ *
+ *          A longer check interval saves energy on the receiver, but increases
+ *          the latency and the number of strobes needed by the sender. Both
+ *          nodes must use the same check interval.
+ *
+ *  \param  check_interval Time between two channel samples in symbols.
+ *  \param  awake_time Time to stay in RX_AACK_ON after the last channel
+ *                     activity in symbols.
+ *
+ *  \retval TAT_SUCCESS The new duty cycle is used from the next sample.
+ *  \retval TAT_INVALID_ARGUMENT The check interval is shorter than two channel
+ *                               samples, or the awake time is zero.
+ *
+ *  \ingroup lpl
+ */
+tat_status_t lpl_configure( uint32_t check_interval, uint32_t awake_time ){
+
+    if ((check_interval < (2 * LPL_SAMPLE_TIME)) || (awake_time == 0)) {
+        return TAT_INVALID_ARGUMENT;
+    }
+
+    lpl_check_interval = check_interval;
+    lpl_awake_time     = awake_time;
+
+    return TAT_SUCCESS;
+}
+
+/*! \brief  Run the receiver side of the low-power listening protocol. Must be
+ *          called from the main loop.
+ *
+ *          While the receive window is open the function returns immediately.
+ *          When the channel has been quiet for the awake time, the radio
+ *          transceiver and the AVR are put to sleep until the next check
+ *          interval. The channel is then sampled with ED scans, and if energy
+ *          is found the receive window is opened again in RX_AACK_ON.
+ *
+ *  \ingroup lpl
+ */
+void lpl_listen( void ){
+
+    /*Register frames received since the last call.*/
+    uint8_t rx_events = lpl_rx_events;
+
+    if (rx_events != lpl_rx_events_seen) {
+
+        lpl_statistics.frames += (uint8_t)(rx_events - lpl_rx_events_seen);
+        lpl_rx_events_seen = rx_events;
+        lpl_last_activity = hal_get_system_time( );
+    }
+
+    if (lpl_awake == true) {
+
+        //Keep the window open while a frame is received or acknowledged.
+        uint8_t trx_state = tat_get_trx_state( );
+
+        if ((trx_state == BUSY_RX_AACK) || (trx_state == BUSY_RX)) { return; }
+
+        if (HAL_ELAPSED_TIME( lpl_last_activity ) < lpl_awake_time) { return; }
+
+        lpl_sleep( );
+        lpl_awake = false;
+    }
+
+    lpl_wait_for_check_interval( );
+
+    /*Wake up and sample the channel.*/
+    lpl_awake_start = hal_get_system_time( );
+    lpl_statistics.wakeups++;
+
+    if (tat_leave_sleep_mode( ) != TAT_SUCCESS) {
+        lpl_sleep( );
+    } else if (tat_set_trx_state( RX_ON ) != TAT_SUCCESS) {
+        lpl_sleep( );
+    } else if (lpl_channel_busy( ) == false) {
+        lpl_sleep( );
+    } else {
+
+        lpl_statistics.busy_wakeups++;
+
+        if (tat_set_trx_state( RX_AACK_ON ) == TAT_SUCCESS) {
+
+            lpl_awake = true;
+            lpl_last_activity = hal_get_system_time( );
+        } else {
+            lpl_sleep( );
+        } // end: if (tat_set_trx_state( RX_AACK_ON ) == TAT_SUCCESS) ...
+    } // end: if (tat_leave_sleep_mode( ) != TAT_SUCCESS) ...
+}
+
+/*! \brief  Notify the module that a frame was received. Intended to be called
+ *          from the TRX_END event handler, so it is kept short.
+ *
+ *  \ingroup lpl
+ */
+void lpl_frame_received( void ){
+    lpl_rx_events++;
+}
+
+/*! \brief  Send a frame to a receiver that uses low-power listening.
+ *
+ *          The frame is repeated (strobed) until it is acknowledged, or for
+ *          one full check interval plus one channel sample. This guarantees
+ *          that the receiver samples the channel while a strobe is on air.
+ *
+ *  \note   The radio transceiver must be in TX_ARET_ON. The strobes use the
+ *          CSMA settings from tat_configure_csma.
+ *
+ *  \param frame_length Length of frame to transmit.
+ *  \param frame Pointer to the frame to transmit.
+ *
+ *  \retval TAT_SUCCESS The frame was acknowledged.
+ *  \retval TAT_NO_ACK No strobe was acknowledged.
+ *  \retval TAT_CHANNEL_ACCESS_FAILURE The channel was busy on the last strobe.
+ *  \retval TAT_INVALID_ARGUMENT The frame_length is out of bounds.
+ *  \retval TAT_WRONG_STATE The radio transceiver never reached TX_ARET_ON.
+ *
+ *  \ingroup lpl
+ */
+tat_status_t lpl_send_data( uint8_t frame_length, uint8_t *frame ){
+
+    tat_status_t strobe_status = TAT_WRONG_STATE;
+    uint32_t strobe_start = hal_get_system_time( );
+
+    do {
+
+        //Wait for the transceiver to return to TX_ARET_ON after the previous strobe.
+        if (tat_get_trx_state( ) != TX_ARET_ON) { continue; }
+
+        strobe_status = tat_send_data_with_retry( frame_length, frame, 0 );
+        lpl_statistics.strobes++;
+
+        if ((strobe_status == TAT_SUCCESS) || (strobe_status == TAT_INVALID_ARGUMENT)) {
+            break;
+        }
+    } while (HAL_ELAPSED_TIME( strobe_start ) < (lpl_check_interval + LPL_SAMPLE_TIME));
+
+    return strobe_status;
+}
+
+/*! \brief  Read the duty cycle counters.
+ *
+ *  \param  statistics Pointer to where the counters are copied.
+ *
+ *  \ingroup lpl
+ */
+void lpl_get_statistics( lpl_statistics_t *statistics ){
+    *statistics = lpl_statistics;
+}
+
+/*! \brief  Average time the transceiver was awake per received frame.
+ *
+ *          This is the figure to trade battery life against latency with: a
+ *          shorter check interval gives lower latency, but more awake time per
+ *          frame at low traffic.
+ *
+ *  \return Awake time per frame in symbols, or 0 if no frame was received.
+ *
+ *  \ingroup lpl
+ */
+uint32_t lpl_get_awake_time_per_frame( void ){
+
+    if (lpl_statistics.frames == 0) { return 0; }
+
+    return lpl_statistics.awake_time / lpl_statistics.frames;
+}
+
+/*! \brief  Reset the duty cycle counters.
+ *
+ *  \ingroup lpl
+ */
+void lpl_reset_statistics( void ){
+
+    lpl_statistics.wakeups      = 0;
+    lpl_statistics.busy_wakeups = 0;
+    lpl_statistics.frames       = 0;
+    lpl_statistics.awake_time   = 0;
+    lpl_statistics.strobes      = 0;
+}
+
+/*! \brief  Sample the channel with back to back ED scans for LPL_SAMPLE_TIME.
+ *
+ *  \retval true Energy above LPL_ED_THRESHOLD was detected.
+ *  \retval false The channel was quiet.
+ */
+static bool lpl_channel_busy( void ){
+
+    uint32_t sample_start = hal_get_system_time( );
+
+    do {
+
+        uint8_t ed_level = 0;
+
+        if (tat_do_ed_scan( &ed_level ) != TAT_SUCCESS) { return false; }
+
+        if (ed_level > LPL_ED_THRESHOLD) { return true; }
+    } while (HAL_ELAPSED_TIME( sample_start ) < LPL_SAMPLE_TIME);
+
+    return false;
+}
+
+/*! \brief  Put the radio transceiver to sleep and account the awake time.
+ */
+static void lpl_sleep( void ){
+
+    tat_enter_sleep_mode( );
+    lpl_statistics.awake_time += HAL_ELAPSED_TIME( lpl_awake_start );
+}
+
+/*! \brief  Keep the AVR in IDLE sleep until the check interval has passed.
+ *
+ *          Other interrupts (UART) may wake the AVR, so the TIMER flag is used
+ *          to decide when to continue.
+ */
+static void lpl_wait_for_check_interval( void ){
+
+    hal_clear_timer_flag( );
+    hal_start_timer( lpl_check_interval );
+
+    while (hal_get_timer_flag( ) == 0) {
+
+        cli( );
+
+        if (hal_get_timer_flag( ) == 0) {
+            avr_sleep_idle( ); //Returns with interrupts enabled.
+        }
+
+        sei( );
+    }
+}
+/*EOF*/
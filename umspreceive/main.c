@@ -1,6 +1,7 @@
 /*============================ INCLDUE =======================================*/
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <clock_config.h>
 #include "config_uart_extended.h" /* See this file for all project options. */
 #include "compiler.h"
@@ -9,7 +10,30 @@
 #include "tat.h"
 #include "com.h"
 #include "hal_avr.h"
+#include "lpl.h"
+#include "entropy.h"
+#include "sniffer.h"
+#include "prof.h"
+#include "trace.h"
+#include "arq.h"
+#include "frag.h"
+#include "aggr.h"
+#include "ccm.h"
+#include "aes_bench.h"
+#include "tsync.h"
+#include "tdma.h"
+#include "ota.h"
+#include "peer.h"
+#include "watchdog.h"
 /*============================ MACROS ========================================*/
+#if defined( HAL_CLOCK_FROM_CLKM )
+#if defined( LOW_POWER_LISTENING )
+    #error "HAL_CLOCK_FROM_CLKM cannot be used with LOW_POWER_LISTENING, the AVR stops with CLKM while the radio sleeps."
+#endif
+#define TRX_CLKM_SPEED ( HAL_CLKM_CTRL ) //!< CLKM clocks the AVR, see hal_raise_cpu_clock.
+#else
+#define TRX_CLKM_SPEED ( CLKM_NO_CLOCK )
+#endif
 /*============================ TYPEDEFS ======================================*/
 /*============================ VARIABLES =====================================*/
 
@@ -22,12 +46,21 @@ static hal_rx_frame_t	*rx_pool_tail;                    /* !< Pointer to next ha
 static uint8_t		rx_pool_items_free;                     /* !< Number of free items (hal_rx_frame_t) in the pool. */
 static uint8_t		rx_pool_items_used;                   /* !< Number of used items. */
 static bool		rx_pool_overflow_flag;                      /* !< Flag that is used to signal a pool overflow. */
+#if defined( RX_LOG_METADATA ) || defined( PEER_TABLE )
+static uint32_t		rx_pool_time_stamp[RX_POOL_SIZE];          /* !< TRX_END time stamp of each pool item, in symbols. */
+#endif
+#if defined( TIME_SYNC )
+static uint32_t		rx_pool_sync_time[RX_POOL_SIZE];           /* !< RX_START capture of each pool item, in Timer1 ticks. */
+#endif
 
 static bool rx_flag;                                      /* !< Flag used to mask between the two possible TRX_END events. */
 
 
 static uint8_t	debug_type_message[]		= "\r<---Type Message:\r\n";                    /* !< Debug Text. */
 static uint8_t	debug_rx_pool_overflow[]	= "RX Buffer Overflow!\r\n";                    /* !< Debug Text. */
+#if defined( RX_FRAME_PROTECTION )
+static uint8_t	debug_rx_protection_lost[]	= "\r\nRX LOST ";                               /* !< Debug Text. */
+#endif
 static uint8_t	debug_transmission_failed[]	= "TX Failed!\r\n";                             /* !< Debug Text. */
 static uint8_t	debug_fatal_error[]		= "A fatal error. System must be reset.\r\n";   /* !< Debug Text. */
 /*============================ PROTOTYPES ====================================*/
@@ -43,9 +76,21 @@ static void trx_end_handler( uint32_t time_stamp );
 static void rx_pool_init( void );
 
 
+static void rx_log_frame( hal_rx_frame_t *frame, uint32_t time_stamp );
+
+
+#if defined( AGGREGATION )
+static void rx_log_aggregate( hal_rx_frame_t *frame, uint32_t time_stamp );
+#endif
+
+
+static void rx_pool_handle( hal_rx_frame_t *frame );
+
+
 /*! \brief This function is used to initialize the TRX.
  *
- * The TAT will be set up to run on the chosen operating channel, with CLKM diabled,
+ * The TAT will be set up to run on the chosen operating channel, with CLKM diabled
+ * (or at F_CPU if it clocks the AVR),
  * and then configure the RX_AACK and TX_ARET modes.
  *
  *  \retval true if the TRX was successfully configured.
@@ -61,7 +106,7 @@ static bool trx_init( void )
 	} else if ( tat_set_operating_channel( OPERATING_CHANNEL ) != TAT_SUCCESS )
 	{
 		status = false;
-	} else if ( tat_set_clock_speed( true, CLKM_NO_CLOCK ) != TAT_SUCCESS )
+	} else if ( tat_set_clock_speed( true, TRX_CLKM_SPEED ) != TAT_SUCCESS )
 	{
 		status = false;
 	} else{
@@ -70,16 +115,21 @@ static bool trx_init( void )
 		hal_subregister_write( SR_OQPSK_DATA_RATE, ALTRATE_250KBPS );
 		hal_subregister_write( SR_ANT_DIV_EN, ANT_DIV_DISABLE );
 		hal_subregister_write( SR_ANT_EXT_SW_EN, ANT_EXT_SW_SWITCH_DISABLE );
+#if defined( RX_FRAME_PROTECTION )
+		hal_subregister_write( SR_RX_SAFE_MODE, RX_SAFE_MODE_ENABLE ); /* Keep a received frame until it is uploaded. */
+#endif
 		tat_set_short_address( SHORT_ADDRESS );                 /* Short Address. */
 		tat_set_pan_id( PAN_ID );                               /* PAN ID. */
 		tat_set_device_role( false );                           /* No Coordintor support is necessary. */
 
 		/* TX_ARET: */
 		tat_configure_csma( 234, 0xE2 );                        /* Default CSMA_SEED_0, MIN_BE = 3, MAX_CSMA_RETRIES = , and CSMA_SEED_1 = */
+		tat_randomize_csma_seed();                              /* Replace the fixed seed, so that the nodes do not back off alike. */
 
 		/* Both Modes: */
 		tat_use_auto_tx_crc( true );                            /* Automatic CRC must be enabled. */
 		hal_set_trx_end_event_handler( trx_end_handler );       /* Event handler for TRX_END events. */
+		tat_save_configuration();                               /* Written back if the radio transceiver has to be recovered. */
 
 		status = true;
 	} /* end: if (tat_init( ) != TAT_SUCCESS) ... */
@@ -126,6 +176,10 @@ static void trx_end_handler( uint32_t time_stamp )
 		if ( rx_pool_items_free == 0 )
 		{
 			rx_pool_overflow_flag = true;
+			TRACE_EVENT( TRACE_POOL_OVERFLOW, rx_pool_items_used );
+#if defined( TRACE )
+			trace_trigger( TRACE_TRIGGER_POOL_OVERFLOW );
+#endif
 		} else {
 			/* Space left, so upload the received frame. */
 			hal_frame_read( rx_pool_head );
@@ -133,6 +187,12 @@ static void trx_end_handler( uint32_t time_stamp )
 			/* Then check the CRC. Will not store frames with invalid CRC. */
 			if ( rx_pool_head->crc == true )
 			{
+#if defined( RX_LOG_METADATA ) || defined( PEER_TABLE )
+				rx_pool_time_stamp[rx_pool_head - rx_pool_start] = time_stamp;
+#endif
+#if defined( TIME_SYNC )
+				rx_pool_sync_time[rx_pool_head - rx_pool_start] = tsync_get_rx_start_time();
+#endif
 				/* Handle wrapping of rx_pool. */
 				if ( rx_pool_head == rx_pool_end )
 				{
@@ -143,21 +203,204 @@ static void trx_end_handler( uint32_t time_stamp )
 
 				--rx_pool_items_free;
 				++rx_pool_items_used;
+				TRACE_EVENT( TRACE_POOL, rx_pool_items_used );
+#if defined( LOW_POWER_LISTENING )
+				lpl_frame_received();                   /* Keeps the receive window open. */
+#endif
 			}               /* end: if (rx_pool_head->crc == true) ... */
 		}                       /* end: if (rx_pool_items_free == 0) ... */
 	}                               /* end:  if (rx_flag == true) ... */
 }
 
 
+/*! \brief This function prints a frame as an 18 byte hex record, followed by
+ *         the LQI and the time stamp with RX_LOG_METADATA.
+ *
+ *  \param[in] frame Received frame.
+ *  \param[in] time_stamp TRX_END time stamp in IEEE 802.15.4 symbols.
+ */
+static void rx_log_frame( hal_rx_frame_t *frame, uint32_t time_stamp )
+{
+	com_send_hex( frame->data[10] );
+	com_send_hex( frame->data[9] );
+	com_send_hex( frame->length );
+	com_send_hex( frame->data[4] );
+	com_send_hex( frame->data[3] );
+	com_send_hex( frame->data[19] );
+	com_send_hex( frame->data[2] );
+	com_send_hex( frame->data[6] );
+	com_send_hex( frame->data[5] );
+	com_send_hex( frame->data[8] );
+	com_send_hex( frame->data[7] );
+	com_send_hex( frame->data[12] );
+	com_send_hex( frame->data[13] );
+	com_send_hex( frame->data[14] );
+	com_send_hex( frame->data[16] );
+	com_send_hex( frame->data[15] );
+	com_send_hex( frame->data[18] );
+	com_send_hex( frame->data[17] );
+#if defined( RX_LOG_METADATA )
+	/* Trailer for the host analyser: LQI and time stamp, MSB first. */
+	com_send_hex( frame->lqi );
+	com_send_hex( (time_stamp >> 24) & 0xFF );
+	com_send_hex( (time_stamp >> 16) & 0xFF );
+	com_send_hex( (time_stamp >> 8) & 0xFF );
+	com_send_hex( time_stamp & 0xFF );
+#endif
+}
+
+
+#if defined( AGGREGATION )
+/*! \brief This function prints each message of an aggregate with rx_log_frame,
+ *         as if it was received in the frame testsend builds without
+ *         AGGREGATION. The MAC header, LQI and time stamp are those of the
+ *         aggregate. Messages that are not AGGR_RECORD_LENGTH long are skipped.
+ *
+ *  \param[in] frame Received aggregate.
+ *  \param[in] time_stamp TRX_END time stamp in IEEE 802.15.4 symbols.
+ */
+static void rx_log_aggregate( hal_rx_frame_t *frame, uint32_t time_stamp )
+{
+	static hal_rx_frame_t	record;
+	uint8_t			*message;
+	uint8_t			message_length;
+	uint8_t			position = 0;
+
+	memcpy( record.data, frame->data, AGGR_MAC_HEADER_LENGTH );
+	record.length	= frame->length;
+	record.lqi	= frame->lqi;
+	record.data[9]	= 0x0DB5 & 0xFF;                                /* Start symbol. */
+	record.data[10] = (0x0DB5 >> 8) & 0xFF;
+	record.data[11] = 3;                                            /* Data length. */
+	record.data[15] = 0xFF;
+	record.data[16] = 0xFF;
+	record.data[17] = 0x0CD5 & 0xFF;                                /* End symbol. */
+	record.data[18] = (0x0CD5 >> 8) & 0xFF;
+
+	while ( (message_length = aggr_next_message( frame->data, frame->length, &position, &message )) != 0 )
+	{
+		if ( message_length == AGGR_RECORD_LENGTH )
+		{
+			record.data[2]	= message[0];                   /* Sequence number. */
+			record.data[19] = message[1];                   /* Carry. */
+			memcpy( &record.data[12], &message[2], 3 );
+			rx_log_frame( &record, time_stamp );
+		}
+	}
+}
+#endif
+
+
+/*! \brief This function handles a frame of the rx_pool: it is decrypted, taken
+ *         by the protocol modules or printed on the UART.
+ *
+ *  The frame may be changed in place (SECURITY), so the item must not be
+ *  given back to trx_end_handler before this function returns.
+ *
+ *  \param[in] frame Received frame, an item of the rx_pool.
+ */
+static void rx_pool_handle( hal_rx_frame_t *frame )
+{
+#if defined( TIME_SYNC ) || defined( TDMA ) || defined( RX_LOG_METADATA ) || defined( PEER_TABLE )
+	uint8_t index = frame - rx_pool_start;
+#endif
+
+#if defined( OTA )
+	/* An update of this node: the bootloader takes over. */
+	if ( ota_is_start( frame->data, frame->length ) == true )
+	{
+		ota_enter_bootloader( frame->data );
+	}
+#endif
+#if defined( TIME_SYNC )
+	/* Beacons are not secured, and not printed. */
+	if ( tsync_is_beacon( frame->data, frame->length ) == true )
+	{
+		tsync_receive( frame->data, frame->length, rx_pool_sync_time[index] );
+		return;
+	}
+#endif
+#if defined( SECURITY )
+	/* Frames that are not secured, or fail the MIC check, are dropped. */
+	if ( ccm_unsecure( frame->data, &frame->length ) != TAT_SUCCESS )
+	{
+		return;
+	}
+#endif
+#if defined( FRAGMENTATION )
+	/* Fragments are reassembled, and streamed by frag_receiver_poll. */
+	if ( frag_receiver_accept( frame->data, frame->length ) != FRAG_NOT_FRAGMENT )
+	{
+		return;
+	}
+#endif
+#if defined( TDMA )
+	/* Slot use, and a slot for a new sender. */
+	tdma_coordinator_heard( frame->data, frame->length, rx_pool_sync_time[index] );
+#endif
+
+	/* Send the frame to the user: */
+	static uint8_t space[] = "  ";
+	/* com_send_string( debug_data_received, sizeof( debug_data_received ) ); */
+	DDRF	|= 1 << 2;
+	PORTF	&= ~(1 << 2);
+#if defined( RX_LOG_METADATA ) || defined( PEER_TABLE )
+	uint32_t time_stamp = rx_pool_time_stamp[index];
+#else
+	uint32_t time_stamp = 0;
+#endif
+#if defined( PEER_TABLE )
+	/* Counted before the filters below, so repeats show as duplicates. */
+	peer_update( frame, time_stamp );
+#endif
+#if defined( AGGREGATION )
+	/* Each message of an aggregate is logged as if it came in its own frame. */
+	if ( aggr_is_aggregate( frame->data, frame->length ) == true )
+	{
+		rx_log_aggregate( frame, time_stamp );
+		return;
+	}
+#endif
+#if defined( ARQ )
+	/* A frame repeated because its SACK was lost is not printed again. */
+	if ( arq_receiver_accept( frame->data, frame->length ) == ARQ_DUPLICATE )
+	{
+		return;
+	}
+#endif
+	rx_log_frame( frame, time_stamp );
+}
+
+
 int main( void )
 {
 	static uint8_t	length_of_received_data = 0;
 	static uint8_t	frame_sequence_number	= 0;
+#if defined( WATCHDOG )
+	watchdog_start();                                               /* First: counts the reset if it was the watchdog's. */
+#endif
 	rx_flag = true;
 	rx_pool_init();
 	avr_init();
 	trx_init();
 
+#if defined( SNIFFER )
+	/* Capture every frame on the channel and stream it to the host. */
+	if ( sniffer_init() != TAT_SUCCESS )
+	{
+		com_send_string( debug_fatal_error, sizeof(debug_fatal_error) );
+	}
+	tat_save_configuration();                                       /* With the promiscuous mode. */
+
+	sei();
+	hal_set_net_led();
+
+	while ( true )
+	{
+		WATCHDOG_KICK();
+	}
+#endif
+
 	/* Set system state to RX_AACK_ON */
 	if ( tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS )
 	{
@@ -165,7 +408,45 @@ int main( void )
 	} /* end: if (tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS) ... */
 
 	sei();
+#if defined( PROFILING )
+	prof_init();
+#endif
+#if defined( TRACE )
+	trace_init();
+	com_reset_receiver();                                           /* Enables the UART input for the dump command. */
+#endif
+#if defined( ARQ )
+	arq_receiver_init();
+#endif
+#if defined( FRAGMENTATION )
+	frag_receiver_init();
+#endif
+	entropy_init();
+	entropy_harvest();                                              /* Ready for nonces before the first frame. */
+#if defined( SECURITY )
+	static uint8_t security_key[] = SECURITY_KEY;
+	ccm_init( security_key );
+	com_reset_receiver();                                           /* Enables the UART input for the benchmark command. */
+#endif
+#if defined( TIME_SYNC )
+	tsync_init();
+	hal_set_rx_start_event_handler( tsync_rx_start );             /* Reference time of the beacons. */
+#endif
+#if defined( TDMA )
+	tdma_init();
+	com_reset_receiver();                                           /* Enables the UART input for the report command. */
+#endif
+#if defined( OTA )
+	com_reset_receiver();                                           /* Enables the UART input for the update command. */
+#endif
+#if defined( PEER_TABLE )
+	peer_init();
+	com_reset_receiver();                                           /* Enables the UART input for the table command. */
+#endif
 	hal_set_net_led();
+#if defined( LOW_POWER_LISTENING )
+	lpl_init();
+#endif
 
 	/* Give the user an indication that the system is ready. */
 	com_send_string( debug_type_message, sizeof(debug_type_message) );
@@ -181,6 +462,8 @@ int main( void )
 	 */
 	while ( true )
 	{
+		WATCHDOG_KICK();
+
 		/* Check if we have received something on the air interface. */
 		if ( rx_pool_items_used != 0 )
 		{
@@ -193,9 +476,11 @@ int main( void )
 				++rx_pool_tail;
 			} /* end: if (rx_pool_tail == rx_pool_end) ... */
 
+			rx_pool_handle( rx_pool_tail );
+
 			/*
-			 * Turn interrupts off for a short while to protect when status
-			 * information about the rx_pool is updated.
+			 * Give the item back only now: trx_end_handler writes the next
+			 * frame into it once the pool was full.
 			 */
 			cli();
 
@@ -204,32 +489,24 @@ int main( void )
 
 			sei();
 
-			/* Send the frame to the user: */
-			static uint8_t space[] = "  ";
-			/* com_send_string( debug_data_received, sizeof( debug_data_received ) ); */
-			DDRF	|= 1 << 2;
-			PORTF	&= ~(1 << 2);
-			com_send_hex( rx_pool_tail->data[10] );
-			com_send_hex( rx_pool_tail->data[9] );
-			com_send_hex( rx_pool_tail->length );
-			com_send_hex( rx_pool_tail->data[4] );
-			com_send_hex( rx_pool_tail->data[3] );
-			com_send_hex( rx_pool_tail->data[19] );
-			com_send_hex( rx_pool_tail->data[2] );
-			com_send_hex( rx_pool_tail->data[6] );
-			com_send_hex( rx_pool_tail->data[5] );
-			com_send_hex( rx_pool_tail->data[8] );
-			com_send_hex( rx_pool_tail->data[7] );
-			com_send_hex( rx_pool_tail->data[12] );
-			com_send_hex( rx_pool_tail->data[13] );
-			com_send_hex( rx_pool_tail->data[14] );
-			com_send_hex( rx_pool_tail->data[16] );
-			com_send_hex( rx_pool_tail->data[15] );
-			com_send_hex( rx_pool_tail->data[18] );
-			com_send_hex( rx_pool_tail->data[17] );
 			hal_clear_data_led();
 		} /* end: if (rx_pool_items_used != 0) ... */
 
+#if defined( FRAGMENTATION )
+		/* The UART is slower than the radio, so drain the rx_pool before streaming. */
+		if ( rx_pool_items_used == 0 )
+		{
+			frag_receiver_poll();
+		}
+#endif
+#if defined( PEER_TABLE )
+		/* The senders heard since the last report, between two bursts. */
+		if ( rx_pool_items_used == 0 )
+		{
+			peer_poll();
+		}
+#endif
+
 		/* Check for rx_pool overflow. */
 		if ( rx_pool_overflow_flag == true )
 		{
@@ -239,11 +516,130 @@ int main( void )
 			sei();
 		}       /* end: if (rx_pool_overflow_flag == true) ... */
 
+#if defined( RX_FRAME_PROTECTION )
+		/* Total of the frames dropped while a frame was protected, when it changes. */
+		static uint16_t			rx_protection_lost = 0;
+		hal_rx_protection_statistics_t	rx_protection;
+		hal_get_rx_protection_statistics( &rx_protection );
+		if ( rx_protection.lost != rx_protection_lost )
+		{
+			rx_protection_lost = rx_protection.lost;
+			com_send_string( debug_rx_protection_lost, sizeof(debug_rx_protection_lost) );
+			com_send_hex( rx_protection_lost >> 8 );
+			com_send_hex( rx_protection_lost & 0xFF );
+		}
+#endif
+
+#if defined( ARQ )
+		/* Acknowledge the frames that were printed. */
+		static uint8_t	sack_frame[ARQ_SACK_FRAME_LENGTH];
+		uint8_t		sack_length = arq_receiver_build_sack( sack_frame );
+		if ( sack_length != 0 )
+		{
+			if ( tat_set_trx_state( TX_ARET_ON ) == TAT_SUCCESS )
+			{
+				rx_flag = false;                                /* The TRX_END of the SACK is not a received frame. */
+				tat_send_data_with_profile( TAT_CSMA_PROFILE_CONTROL, sack_length, sack_frame );
+			}
+
+			if ( tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS )
+			{
+				com_send_string( debug_fatal_error, sizeof(debug_fatal_error) );
+			}
+
+			rx_flag = true;
+		}       /* end: if (sack_length != 0) ... */
+#endif
+#if defined( TDMA )
+		/* The schedule and the beacon, in the schedule period of the superframe. */
+		if ( tdma_schedule_due() == true )
+		{
+			static uint8_t	schedule_frame[TDMA_MAX_SCHEDULE_LENGTH];
+			static uint8_t	beacon_frame[TSYNC_BEACON_LENGTH];
+			uint8_t		schedule_length = tdma_build_schedule( schedule_frame );
+			tat_status_t	beacon_status	= TAT_TIMED_OUT;
+			if ( tat_set_trx_state( TX_ARET_ON ) == TAT_SUCCESS )
+			{
+				rx_flag = false;                                /* The TRX_END of the schedule is not a received frame. */
+				tat_send_data_with_profile( TAT_CSMA_PROFILE_CONTROL, schedule_length, schedule_frame );
+				beacon_status = tat_send_data_with_profile( TAT_CSMA_PROFILE_CONTROL, tsync_build_beacon( beacon_frame ), beacon_frame );
+			}
+			tsync_beacon_sent( beacon_status );
+
+			if ( tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS )
+			{
+				com_send_string( debug_fatal_error, sizeof(debug_fatal_error) );
+			}
+
+			rx_flag = true;
+		}       /* end: if (tdma_schedule_due( ) == true) ... */
+#elif defined( TIME_SYNC )
+		/* Beacon with the time of the previous one. */
+		if ( tsync_beacon_due() == true )
+		{
+			static uint8_t	beacon_frame[TSYNC_BEACON_LENGTH];
+			uint8_t		beacon_length	= tsync_build_beacon( beacon_frame );
+			tat_status_t	beacon_status	= TAT_TIMED_OUT;
+			if ( tat_set_trx_state( TX_ARET_ON ) == TAT_SUCCESS )
+			{
+				rx_flag		= false;                        /* The TRX_END of the beacon is not a received frame. */
+				beacon_status	= tat_send_data_with_profile( TAT_CSMA_PROFILE_CONTROL, beacon_length, beacon_frame );
+			}
+			tsync_beacon_sent( beacon_status );                     /* Before RX_AACK_ON, while the TRX_END capture is the beacon's. */
+
+			if ( tat_set_trx_state( RX_AACK_ON ) != TAT_SUCCESS )
+			{
+				com_send_string( debug_fatal_error, sizeof(debug_fatal_error) );
+			}
+
+			rx_flag = true;
+		}       /* end: if (tsync_beacon_due( ) == true) ... */
+#endif
+
 		/*
 		 * Check for new data on the serial interface.
 		 * Check if data is ready to be sent.
 		 * length_of_received_data = com_get_number_of_received_bytes( );
 		 */
+#if defined( PROFILING ) || defined( TRACE ) || defined( SECURITY ) || defined( TIME_SYNC ) || defined( OTA ) || defined( PEER_TABLE ) || defined( WATCHDOG )
+		/* Debug commands from the UART. */
+		uint8_t command = com_get_command();
+#endif
+#if defined( PROFILING )
+		prof_command( command );
+#endif
+#if defined( TRACE )
+		trace_command( command );
+		trace_poll();                                           /* Dump a triggered trace. */
+#endif
+#if defined( AES_BENCHMARK )
+		aes_bench_command( command );
+#endif
+#if defined( SECURITY )
+		ccm_command( command );
+#endif
+#if defined( TIME_SYNC )
+		tsync_command( command );
+#endif
+#if defined( TDMA )
+		tdma_command( command );
+#endif
+#if defined( OTA )
+		ota_command( command );
+#endif
+#if defined( PEER_TABLE )
+		peer_command( command );
+#endif
+#if defined( WATCHDOG )
+		watchdog_command( command );
+#endif
+#if defined( LOW_POWER_LISTENING )
+		/* Sleep until the next channel sample once the pool is empty and the channel quiet. */
+		if ( rx_pool_items_used == 0 )
+		{
+			lpl_listen();
+		}
+#endif
 	}               /* emd: while (true) ... */
 	return(0);
 }
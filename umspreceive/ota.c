@@ -0,0 +1,418 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <avr/wdt.h>
+
+#include "config_uart_extended.h"
+
+#include "compiler.h"
+#include "at86rf231.h"
+#include "hal.h"
+#include "tat.h"
+#include "com.h"
+#include "entropy.h"
+#include "ota.h"
+
+#if defined( OTA )
+/*============================ MACROS ========================================*/
+#define OTA_BODY                 ( OTA_HEADER_LENGTH ) //!< Index of the first byte after the session.
+/*============================ TYPEDEFS ======================================*/
+/*============================ VARIABLES =====================================*/
+extern uint8_t __data_load_end[ ]; //!< End of the image in flash, from the linker script.
+
+static hal_rx_frame_t ota_rx_frame; //!< Last STATUS from the target.
+static bool volatile ota_rx_flag; //!< In RX_AACK_ON, waiting for a STATUS.
+static bool volatile ota_rx_done; //!< ota_rx_frame holds a frame.
+
+static uint8_t ota_tx_frame[ OTA_DATA_LENGTH ];
+static uint8_t ota_sequence_number;
+static uint8_t ota_session;
+static uint16_t ota_target;
+static uint16_t ota_first_missing; //!< From the last STATUS.
+static uint8_t ota_missing; //!< Fragments repeated after the last STATUS.
+
+static ota_statistics_t ota_statistics;
+
+static uint8_t debug_ota[] = "\r\nOTA "; //!< Debug Text.
+/*============================ PROTOTYPES ====================================*/
+static void ota_trx_end_handler( uint32_t time_stamp );
+static tat_status_t ota_transfer( uint32_t length, uint32_t crc );
+static void ota_build_header( uint8_t type );
+static tat_status_t ota_send_fragment( uint16_t fragment, uint32_t length );
+static bool ota_query( uint16_t limit, uint32_t length );
+static bool ota_exchange( uint8_t length, uint32_t timeout );
+static void ota_put32( uint8_t *field, uint32_t value );
+static uint32_t ota_get32( uint8_t *field );
+
+/*! \brief  Check if a received frame starts an update of this node.
+ *
+ *  \param  frame Received frame, including the FCS.
+ *  \param  length Frame length.
+ *
+ *  \ingroup ota
+ */
+bool ota_is_start( uint8_t *frame, uint8_t length ){
+    return (length == OTA_START_LENGTH) && (frame[ OTA_MAC_HEADER_LENGTH ] == OTA_DISPATCH) &&
+           (frame[ OTA_MAC_HEADER_LENGTH + 1 ] == OTA_START);
+}
+
+/*! \brief  Hand a START frame to the bootloader and reset into it. The
+ *          bootloader answers the server, receives the image into the staging
+ *          area and installs it, or starts this application again if the
+ *          transfer fails.
+ *
+ *  \param  frame START frame, see ota_is_start.
+ *
+ *  \note   Does not return.
+ *
+ *  \ingroup ota
+ */
+void ota_enter_bootloader( uint8_t *frame ){
+
+    ota_boot_request_t request;
+
+    request.state         = OTA_BOOT_RECEIVE;
+    request.session       = frame[ OTA_MAC_HEADER_LENGTH + 2 ];
+    request.channel       = tat_get_operating_channel( );
+    request.pan_id        = PAN_ID;
+    request.short_address = SHORT_ADDRESS;
+    request.server        = frame[ 7 ] | (frame[ 8 ] << 8);
+    request.image_length  = ota_get32( &frame[ OTA_BODY ] );
+    request.image_crc     = ota_get32( &frame[ OTA_BODY + 4 ] );
+
+    eeprom_write_block( &request, (void *)OTA_EEPROM_ADDRESS, sizeof( request ) );
+
+    cli( );
+    wdt_enable( WDTO_15MS );
+
+    while (true) {
+        ;
+    }
+}
+
+/*! \brief  Send the application of this node to another node running the
+ *          same application, which installs it with its bootloader.
+ *
+ *          The image is streamed without waiting for the flash: the
+ *          bootloader writes a page while the next ones are on air, and the
+ *          fragments it dropped are repeated after a QUERY. The TRX_END event
+ *          handler is replaced for the duration of the update, so frames from
+ *          other nodes are lost. Must be called from the main loop, with the
+ *          radio transceiver in RX_AACK_ON.
+ *
+ *  \param  target Short address of the node to update.
+ *
+ *  \retval TAT_SUCCESS The target verified the image and installs it.
+ *  \retval TAT_INVALID_ARGUMENT The image does not fit the staging area.
+ *  \retval TAT_CRC_FAILED The target received a different image.
+ *  \retval TAT_TIMED_OUT The target did not answer, or made no progress.
+ *
+ *  \ingroup ota
+ */
+tat_status_t ota_server_update( uint16_t target ){
+
+    uint32_t length = (uint16_t)__data_load_end;
+    uint32_t crc = 0xFFFFFFFF;
+
+    memset( &ota_statistics, 0, sizeof( ota_statistics ) );
+    ota_statistics.image_length = length;
+    ota_statistics.fragments = (length + OTA_FRAGMENT_SIZE - 1) / OTA_FRAGMENT_SIZE;
+
+    if (length > OTA_IMAGE_MAX) {
+        ota_statistics.result = TAT_INVALID_ARGUMENT;
+        return TAT_INVALID_ARGUMENT;
+    }
+
+    for (uint16_t i = 0; i < length; i++) {
+        crc = ota_crc32_update( crc, pgm_read_byte( i ) );
+    }
+
+    if (entropy_get_byte( &ota_session ) == false) { ota_session++; }
+    ota_target = target;
+
+    hal_trx_end_isr_event_handler_t previous = hal_get_trx_end_event_handler( );
+    ota_rx_flag = false;
+    hal_set_trx_end_event_handler( ota_trx_end_handler );
+
+    uint32_t start = hal_get_system_time( );
+    tat_status_t status = ota_transfer( length, ~crc );
+    ota_statistics.time = HAL_ELAPSED_TIME( start );
+
+    tat_set_trx_state( RX_AACK_ON );
+    hal_set_trx_end_event_handler( previous );
+
+    ota_statistics.result = status;
+
+    return status;
+}
+
+/*! \brief  Copy the counters of the last update.
+ *
+ *  \ingroup ota
+ */
+void ota_get_statistics( ota_statistics_t *statistics ){
+    *statistics = ota_statistics;
+}
+
+/*! \brief  Send the counters of the last update on the UART: result, state of
+ *          the target, image length (4 bytes), fragments, repeated and failed
+ *          DATA frames and QUERY rounds (2 bytes each), and the time in
+ *          symbols (4 bytes).
+ *
+ *  \ingroup ota
+ */
+void ota_report( void ){
+
+    com_send_string( debug_ota, sizeof( debug_ota ) );
+    com_send_hex( ota_statistics.result );
+    com_send_hex( ota_statistics.state );
+    com_send_hex( (ota_statistics.image_length >> 24) & 0xFF );
+    com_send_hex( (ota_statistics.image_length >> 16) & 0xFF );
+    com_send_hex( (ota_statistics.image_length >> 8) & 0xFF );
+    com_send_hex( ota_statistics.image_length & 0xFF );
+    com_send_hex( ota_statistics.fragments >> 8 );
+    com_send_hex( ota_statistics.fragments & 0xFF );
+    com_send_hex( ota_statistics.repeated >> 8 );
+    com_send_hex( ota_statistics.repeated & 0xFF );
+    com_send_hex( ota_statistics.failed >> 8 );
+    com_send_hex( ota_statistics.failed & 0xFF );
+    com_send_hex( ota_statistics.rounds >> 8 );
+    com_send_hex( ota_statistics.rounds & 0xFF );
+    com_send_hex( (ota_statistics.time >> 24) & 0xFF );
+    com_send_hex( (ota_statistics.time >> 16) & 0xFF );
+    com_send_hex( (ota_statistics.time >> 8) & 0xFF );
+    com_send_hex( ota_statistics.time & 0xFF );
+}
+
+/*! \brief  Handle a command received on the UART. Must be called from the
+ *          main loop, with the result of com_get_command.
+ *
+ *  \param  command Command character. Only OTA_COMMAND_UPDATE is handled: it
+ *          updates DEST_ADDRESS and sends the report.
+ *
+ *  \retval true The update was run.
+ *  \retval false The command is not an update command.
+ *
+ *  \ingroup ota
+ */
+bool ota_command( uint8_t command ){
+
+    if (command != OTA_COMMAND_UPDATE) { return false; }
+
+    ota_server_update( DEST_ADDRESS );
+    ota_report( );
+
+    return true;
+}
+
+/*! \brief  TRX_END event handler during an update: keeps the first frame
+ *          received while waiting for a STATUS. */
+static void ota_trx_end_handler( uint32_t time_stamp ){
+
+    if ((ota_rx_flag == false) || (ota_rx_done == true)) { return; }
+
+    hal_frame_read( &ota_rx_frame );
+
+    if (ota_rx_frame.crc == true) { ota_rx_done = true; }
+}
+
+/*! \brief  START, the stream, the repeats and COMMIT. */
+static tat_status_t ota_transfer( uint32_t length, uint32_t crc ){
+
+    uint16_t fragments = ota_statistics.fragments;
+    uint8_t *state = &ota_rx_frame.data[ OTA_BODY ];
+
+    //START, answered once the target runs the bootloader.
+    ota_build_header( OTA_START );
+    ota_put32( &ota_tx_frame[ OTA_BODY ], length );
+    ota_put32( &ota_tx_frame[ OTA_BODY + 4 ], crc );
+
+    if (ota_exchange( OTA_START_LENGTH, OTA_START_TIMEOUT ) == false) { return TAT_TIMED_OUT; }
+    if (*state != OTA_STATE_RECEIVING) { return TAT_INVALID_ARGUMENT; }
+
+    //All fragments back-to-back, with the losses repeated on the way.
+    tat_set_trx_state( TX_ARET_ON );
+
+    for (uint16_t fragment = 0; fragment < fragments; fragment++) {
+
+        ota_send_fragment( fragment, length );
+
+        if ((((fragment + 1) % OTA_QUERY_INTERVAL) == 0) && ((fragment + 1) < fragments)) {
+            if (ota_query( fragment + 1, length ) == false) { return TAT_TIMED_OUT; }
+            if (*state != OTA_STATE_RECEIVING) { return TAT_INVALID_ARGUMENT; }
+        }
+    } // end: for (uint16_t fragment ...
+
+    //Repeat what the target reports missing, until it has all of it.
+    uint16_t last_first = 0;
+    uint8_t last_missing = 0;
+    uint8_t idle_rounds = 0;
+
+    while (true) {
+
+        if (ota_query( fragments, length ) == false) { return TAT_TIMED_OUT; }
+
+        if (*state == OTA_STATE_COMPLETE) { break; }
+        if (*state != OTA_STATE_RECEIVING) { return TAT_INVALID_ARGUMENT; }
+
+        //Repeats that were lost again are sent again, but not forever.
+        if ((ota_first_missing == last_first) && (ota_missing >= last_missing)) {
+            if (++idle_rounds == OTA_MAX_IDLE_ROUNDS) { return TAT_TIMED_OUT; }
+        } else {
+            idle_rounds = 0;
+        }
+
+        last_first = ota_first_missing;
+        last_missing = ota_missing;
+    } // end: while (true) ...
+
+    //COMMIT, answered after the CRC of the staging area.
+    ota_build_header( OTA_COMMIT );
+
+    if (ota_exchange( OTA_CONTROL_LENGTH, OTA_VERIFY_TIMEOUT ) == false) { return TAT_TIMED_OUT; }
+
+    return (*state == OTA_STATE_VERIFIED) ? TAT_SUCCESS : TAT_CRC_FAILED;
+}
+
+/*! \brief  MAC header and OTA header of the next frame to the target. */
+static void ota_build_header( uint8_t type ){
+
+    ota_tx_frame[ 0 ]  = 0x61; //FCF: data frame, acknowledge request, PAN ID compression.
+    ota_tx_frame[ 1 ]  = 0x88; //FCF: short addresses.
+    ota_tx_frame[ 2 ]  = ota_sequence_number++;
+    ota_tx_frame[ 3 ]  = PAN_ID & 0xFF;
+    ota_tx_frame[ 4 ]  = (PAN_ID >> 8) & 0xFF;
+    ota_tx_frame[ 5 ]  = ota_target & 0xFF;
+    ota_tx_frame[ 6 ]  = (ota_target >> 8) & 0xFF;
+    ota_tx_frame[ 7 ]  = SHORT_ADDRESS & 0xFF;
+    ota_tx_frame[ 8 ]  = (SHORT_ADDRESS >> 8) & 0xFF;
+    ota_tx_frame[ 9 ]  = OTA_DISPATCH;
+    ota_tx_frame[ 10 ] = type;
+    ota_tx_frame[ 11 ] = ota_session;
+}
+
+/*! \brief  Send one DATA frame, in TX_ARET_ON. The short CSMA-CA profile
+ *          keeps the stream close to the data rate of the radio. */
+static tat_status_t ota_send_fragment( uint16_t fragment, uint32_t length ){
+
+    uint16_t address = fragment * OTA_FRAGMENT_SIZE;
+    uint8_t *data = &ota_tx_frame[ OTA_BODY + 2 ];
+
+    ota_build_header( OTA_DATA );
+    ota_tx_frame[ OTA_BODY ]     = fragment & 0xFF;
+    ota_tx_frame[ OTA_BODY + 1 ] = (fragment >> 8) & 0xFF;
+
+    for (uint8_t i = 0; i < OTA_FRAGMENT_SIZE; i++, address++) {
+        data[ i ] = (address < length) ? pgm_read_byte( address ) : 0xFF;
+    }
+
+    tat_status_t status = tat_send_data_with_profile( TAT_CSMA_PROFILE_CONTROL, OTA_DATA_LENGTH, ota_tx_frame );
+
+    if (status != TAT_SUCCESS) { ota_statistics.failed++; }
+
+    return status;
+}
+
+/*! \brief  Send a QUERY and repeat the fragments its STATUS reports
+ *          missing, in TX_ARET_ON.
+ *
+ *  \param  limit Fragments from this one on were not sent yet.
+ *  \param  length Image length.
+ *
+ *  \return false if the target did not answer.
+ */
+static bool ota_query( uint16_t limit, uint32_t length ){
+
+    uint8_t *state = &ota_rx_frame.data[ OTA_BODY ];
+    uint8_t *missing_map = &state[ 3 ];
+
+    ota_build_header( OTA_QUERY );
+
+    if (ota_exchange( OTA_CONTROL_LENGTH, OTA_STATUS_TIMEOUT ) == false) { return false; }
+
+    ota_statistics.rounds++;
+    tat_set_trx_state( TX_ARET_ON );
+
+    if (*state != OTA_STATE_RECEIVING) { return true; }
+
+    ota_first_missing = state[ 1 ] | (state[ 2 ] << 8);
+    ota_missing = 0;
+
+    for (uint8_t i = 0; i < OTA_STATUS_WINDOW; i++) {
+
+        if ((missing_map[ i >> 3 ] & (1 << (i & 7))) == 0) { continue; }
+        if ((ota_first_missing + i) >= limit) { break; }
+
+        ota_missing++;
+        ota_send_fragment( ota_first_missing + i, length );
+        ota_statistics.repeated++;
+    } // end: for (uint8_t i ...
+
+    return true;
+}
+
+/*! \brief  Send the frame in ota_tx_frame and wait for the STATUS of the
+ *          target, up to OTA_RETRIES times.
+ *
+ *  \param  length Frame length including the FCS.
+ *  \param  timeout Symbols to wait for the STATUS after each try.
+ *
+ *  \return true if ota_rx_frame holds the STATUS.
+ */
+static bool ota_exchange( uint8_t length, uint32_t timeout ){
+
+    for (uint8_t retry = 0; retry < OTA_RETRIES; retry++) {
+
+        if (retry != 0) { ota_tx_frame[ 2 ] = ota_sequence_number++; }
+
+        if (tat_set_trx_state( TX_ARET_ON ) != TAT_SUCCESS) { continue; }
+        if (tat_send_data_with_profile( TAT_CSMA_PROFILE_CONTROL, length, ota_tx_frame ) != TAT_SUCCESS) { continue; }
+
+        ota_rx_done = false;
+        ota_rx_flag = true;
+        tat_set_trx_state( RX_AACK_ON );
+
+        uint32_t start = hal_get_system_time( );
+
+        while (HAL_ELAPSED_TIME( start ) < timeout) {
+
+            if (ota_rx_done == false) { continue; }
+
+            uint8_t *frame = ota_rx_frame.data;
+
+            if ((ota_rx_frame.length == OTA_STATUS_LENGTH) && (frame[ OTA_MAC_HEADER_LENGTH ] == OTA_DISPATCH) &&
+                (frame[ OTA_MAC_HEADER_LENGTH + 1 ] == OTA_STATUS) && (frame[ OTA_MAC_HEADER_LENGTH + 2 ] == ota_session) &&
+                ((frame[ 7 ] | (frame[ 8 ] << 8)) == ota_target)) {
+
+                ota_rx_flag = false;
+                ota_statistics.state = frame[ OTA_BODY ];
+
+                return true;
+            }
+
+            ota_rx_done = false; //Not from the target, wait for the next one.
+        } // end: while (HAL_ELAPSED_TIME( start ) < timeout) ...
+
+        ota_rx_flag = false;
+    } // end: for (uint8_t retry ...
+
+    return false;
+}
+
+/*! \brief  Store a 32 bit value LSB first. */
+static void ota_put32( uint8_t *field, uint32_t value ){
+
+    for (uint8_t i = 0; i < 4; i++, value >>= 8) {
+        field[ i ] = value & 0xFF;
+    }
+}
+
+/*! \brief  Load a 32 bit value stored LSB first. */
+static uint32_t ota_get32( uint8_t *field ){
+    return (uint32_t)field[ 0 ] | ((uint32_t)field[ 1 ] << 8) | ((uint32_t)field[ 2 ] << 16) | ((uint32_t)field[ 3 ] << 24);
+}
+#endif
+/*EOF*/
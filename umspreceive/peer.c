@@ -0,0 +1,352 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "config_uart_extended.h"
+
+#include "compiler.h"
+#include "hal.h"
+#include "com.h"
+#include "peer.h"
+
+#if defined( PEER_TABLE )
+/*============================ MACROS ========================================*/
+#define PEER_EMPTY               ( 0xFFFF ) //!< Address of a free slot: broadcast is never a source.
+#define PEER_NONE                ( 0xFF ) //!< End of the LRU list.
+#define PEER_MASK                ( PEER_TABLE_SIZE - 1 )
+#define PEER_MIN_LENGTH          ( 11 ) //!< MAC header and FCS.
+#define PEER_HASH( address )     ( (uint8_t)((uint16_t)((address) * 40503U) >> (16 - PEER_TABLE_BITS)) ) //!< Fibonacci hashing, 40503 = 2^16 / golden ratio.
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  A slot of the table. */
+typedef struct{
+    peer_statistics_t statistics; //!< address is PEER_EMPTY if the slot is free.
+    uint16_t position;  //!< Sequence number and carry of the last frame in order.
+    uint8_t newer;      //!< Slot of the sender heard next after this one, PEER_NONE for the newest.
+    uint8_t older;      //!< Slot of the sender heard before this one, PEER_NONE for the oldest.
+    bool changed;       //!< Updated since the last peer_report.
+}peer_entry_t;
+/*============================ VARIABLES =====================================*/
+static peer_entry_t peer_table[ PEER_TABLE_SIZE ];
+static uint8_t peer_newest; //!< Head of the LRU list.
+static uint8_t peer_oldest; //!< Tail of the LRU list, evicted first.
+static uint8_t peer_peers;
+static uint16_t peer_evictions;
+static uint32_t peer_last_report; //!< System time of the last periodic report.
+
+static uint8_t debug_peers[] = "\r\nPEERS "; //!< Debug Text.
+static uint8_t debug_peer_source[] = "\r\nSRC "; //!< Debug Text.
+/*============================ PROTOTYPES ====================================*/
+static uint8_t peer_find( uint16_t address );
+static uint8_t peer_add( uint16_t address );
+static void peer_remove( uint8_t slot );
+static void peer_move( uint8_t from, uint8_t to );
+static void peer_link( uint8_t slot );
+static void peer_unlink( uint8_t slot );
+static void peer_send_entry( peer_entry_t *entry, uint32_t now );
+
+/*! \brief  Clear the table.
+ *
+ *  \ingroup peer
+ */
+void peer_init( void ){
+
+    for (uint8_t slot = 0; slot < PEER_TABLE_SIZE; slot++) {
+        peer_table[ slot ].statistics.address = PEER_EMPTY;
+    }
+
+    peer_newest = PEER_NONE;
+    peer_oldest = PEER_NONE;
+    peer_peers = 0;
+    peer_evictions = 0;
+    peer_last_report = hal_get_system_time( );
+}
+
+/*! \brief  Count a received frame for its sender. Frames without a short
+ *          source address behind a compressed PAN ID are ignored.
+ *
+ *          One probe sequence and a few pointer updates, also for a new
+ *          sender: the least recently heard one is the tail of the LRU list.
+ *
+ *  \param  frame Received frame, including the FCS.
+ *  \param  time_stamp TRX_END time stamp, in symbols.
+ *
+ *  \ingroup peer
+ */
+void peer_update( hal_rx_frame_t *frame, uint32_t time_stamp ){
+
+    uint8_t *data = frame->data;
+
+    //Data frame, PAN ID compression, short destination and source address.
+    if ((frame->length < PEER_MIN_LENGTH) || ((data[ 0 ] & 0x47) != 0x41) || ((data[ 1 ] & 0xCC) != 0x88)) { return; }
+
+    uint16_t address = data[ 7 ] | (data[ 8 ] << 8);
+
+    if (address == PEER_EMPTY) { return; }
+
+    bool record = (frame->length == PEER_RECORD_LENGTH) && (data[ 9 ] == 0xB5) && (data[ 10 ] == 0x0D);
+    int32_t modulo = record ? PEER_RECORD_MODULO : PEER_SEQUENCE_MODULO;
+    uint16_t position = record ? ((uint16_t)data[ 19 ] * 255 + data[ 2 ]) : data[ 2 ];
+    bool in_order = true;
+
+    uint8_t slot = peer_find( address );
+    peer_entry_t *entry = &peer_table[ slot ];
+    peer_statistics_t *statistics = &entry->statistics;
+
+    if (statistics->address != address) {
+
+        slot = peer_add( address );
+        entry = &peer_table[ slot ];
+        statistics = &entry->statistics;
+        statistics->lqi = frame->lqi << 8;
+    } else {
+
+        //Most recently heard.
+        if (slot != peer_newest) {
+            peer_unlink( slot );
+            peer_link( slot );
+        }
+
+        int32_t ahead = (int32_t)position - entry->position;
+        if (ahead < 0) { ahead += modulo; }
+
+        if (ahead == 0) {
+            statistics->duplicates++;
+            in_order = false;
+        } else if (ahead < (modulo / 2)) {
+            statistics->lost += ahead - 1;
+        } else if ((modulo - ahead) <= PEER_MAX_REORDER) {
+            statistics->duplicates++; //A repeat that came late.
+            in_order = false;
+        } else {
+            statistics->restarts++;
+        }
+
+        statistics->lqi += ((((int32_t)frame->lqi << 8) - statistics->lqi) >> PEER_LQI_SHIFT);
+    } // end: if (statistics->address != address) ...
+
+    if (in_order == true) {
+        entry->position = position;
+        statistics->sequence = data[ 2 ];
+        statistics->carry = record ? data[ 19 ] : 0;
+    }
+
+    statistics->frames++;
+    statistics->bytes += frame->length;
+    statistics->last_seen = time_stamp;
+    entry->changed = true;
+}
+
+/*! \brief  Copy the counters of a sender.
+ *
+ *  \retval true The sender is in the table.
+ *  \retval false Not heard, or evicted.
+ *
+ *  \ingroup peer
+ */
+bool peer_get( uint16_t address, peer_statistics_t *statistics ){
+
+    peer_entry_t *entry = &peer_table[ peer_find( address ) ];
+
+    if (entry->statistics.address != address) { return false; }
+
+    *statistics = entry->statistics;
+
+    return true;
+}
+
+/*! \brief  Number of senders in the table.
+ *
+ *  \ingroup peer
+ */
+uint8_t peer_count( void ){
+    return peer_peers;
+}
+
+/*! \brief  Send the table on the UART: the number of senders and evictions,
+ *          then one line per sender, most recently heard first: address,
+ *          sequence number, carry, frames, lost, duplicates, restarts,
+ *          average LQI, symbols since the last frame (4 bytes) and bytes (4
+ *          bytes). Fields are 2 bytes unless noted.
+ *
+ *  \param  all false to send only the senders heard since the last report.
+ *
+ *  \ingroup peer
+ */
+void peer_report( bool all ){
+
+    uint32_t now = hal_get_system_time( );
+
+    com_send_string( debug_peers, sizeof( debug_peers ) );
+    com_send_hex( peer_peers );
+    com_send_hex( peer_evictions >> 8 );
+    com_send_hex( peer_evictions & 0xFF );
+
+    for (uint8_t slot = peer_newest; slot != PEER_NONE; slot = peer_table[ slot ].older) {
+
+        peer_entry_t *entry = &peer_table[ slot ];
+
+        if ((all == false) && (entry->changed == false)) { continue; }
+
+        peer_send_entry( entry, now );
+        entry->changed = false;
+    }
+}
+
+/*! \brief  Send the senders heard since the last report every
+ *          PEER_REPORT_INTERVAL. Must be called from the main loop.
+ *
+ *  \ingroup peer
+ */
+void peer_poll( void ){
+
+    if (PEER_REPORT_INTERVAL == 0) { return; }
+    if (HAL_ELAPSED_TIME( peer_last_report ) < PEER_REPORT_INTERVAL) { return; }
+
+    peer_last_report = hal_get_system_time( );
+    peer_report( false );
+}
+
+/*! \brief  Handle a command received on the UART. Must be called from the
+ *          main loop, with the result of com_get_command.
+ *
+ *  \param  command Command character. Only PEER_COMMAND_REPORT is handled.
+ *
+ *  \retval true The table was sent.
+ *  \retval false The command is not a peer table command.
+ *
+ *  \ingroup peer
+ */
+bool peer_command( uint8_t command ){
+
+    if (command != PEER_COMMAND_REPORT) { return false; }
+
+    peer_report( true );
+
+    return true;
+}
+
+/*! \brief  Slot of a sender, or the free slot that ends its probe sequence.
+ *          There is always one, the table is at most 3/4 full. */
+static uint8_t peer_find( uint16_t address ){
+
+    uint8_t slot = PEER_HASH( address );
+
+    while ((peer_table[ slot ].statistics.address != PEER_EMPTY) && (peer_table[ slot ].statistics.address != address)) {
+        slot = (slot + 1) & PEER_MASK;
+    }
+
+    return slot;
+}
+
+/*! \brief  Enter a new sender as the most recently heard, evicting the least
+ *          recently heard one if the table is full.
+ *
+ *  \return Its slot.
+ */
+static uint8_t peer_add( uint16_t address ){
+
+    if (peer_peers == PEER_MAX_PEERS) {
+        peer_remove( peer_oldest );
+        peer_evictions++;
+    }
+
+    uint8_t slot = peer_find( address ); //Again: the removal may have moved the free slot.
+    peer_entry_t *entry = &peer_table[ slot ];
+
+    memset( entry, 0, sizeof( peer_entry_t ) );
+    entry->statistics.address = address;
+
+    peer_link( slot );
+    peer_peers++;
+
+    return slot;
+}
+
+/*! \brief  Free a slot without tombstones: the entries after it in the same
+ *          cluster move back if the gap is on their probe sequence. */
+static void peer_remove( uint8_t slot ){
+
+    uint8_t hole = slot;
+
+    peer_unlink( slot );
+
+    for (uint8_t next = (slot + 1) & PEER_MASK; peer_table[ next ].statistics.address != PEER_EMPTY; next = (next + 1) & PEER_MASK) {
+
+        uint8_t home = PEER_HASH( peer_table[ next ].statistics.address );
+
+        if (((hole - home) & PEER_MASK) < ((next - home) & PEER_MASK)) {
+            peer_move( next, hole );
+            hole = next;
+        }
+    } // end: for (uint8_t next ...
+
+    peer_table[ hole ].statistics.address = PEER_EMPTY;
+    peer_peers--;
+}
+
+/*! \brief  Move an entry to another slot and update its LRU neighbours. */
+static void peer_move( uint8_t from, uint8_t to ){
+
+    peer_entry_t *entry = &peer_table[ to ];
+
+    *entry = peer_table[ from ];
+
+    if (entry->newer == PEER_NONE) { peer_newest = to; } else { peer_table[ entry->newer ].older = to; }
+    if (entry->older == PEER_NONE) { peer_oldest = to; } else { peer_table[ entry->older ].newer = to; }
+}
+
+/*! \brief  Put a slot at the head of the LRU list. */
+static void peer_link( uint8_t slot ){
+
+    peer_entry_t *entry = &peer_table[ slot ];
+
+    entry->newer = PEER_NONE;
+    entry->older = peer_newest;
+
+    if (peer_newest == PEER_NONE) { peer_oldest = slot; } else { peer_table[ peer_newest ].newer = slot; }
+
+    peer_newest = slot;
+}
+
+/*! \brief  Take a slot out of the LRU list. */
+static void peer_unlink( uint8_t slot ){
+
+    peer_entry_t *entry = &peer_table[ slot ];
+
+    if (entry->newer == PEER_NONE) { peer_newest = entry->older; } else { peer_table[ entry->newer ].older = entry->older; }
+    if (entry->older == PEER_NONE) { peer_oldest = entry->newer; } else { peer_table[ entry->older ].newer = entry->newer; }
+}
+
+/*! \brief  One line of peer_report. */
+static void peer_send_entry( peer_entry_t *entry, uint32_t now ){
+
+    peer_statistics_t *statistics = &entry->statistics;
+    uint32_t age = (now - statistics->last_seen) & HAL_SYMBOL_MASK;
+
+    com_send_string( debug_peer_source, sizeof( debug_peer_source ) );
+    com_send_hex( statistics->address >> 8 );
+    com_send_hex( statistics->address & 0xFF );
+    com_send_hex( statistics->sequence );
+    com_send_hex( statistics->carry );
+    com_send_hex( statistics->frames >> 8 );
+    com_send_hex( statistics->frames & 0xFF );
+    com_send_hex( statistics->lost >> 8 );
+    com_send_hex( statistics->lost & 0xFF );
+    com_send_hex( statistics->duplicates >> 8 );
+    com_send_hex( statistics->duplicates & 0xFF );
+    com_send_hex( statistics->restarts >> 8 );
+    com_send_hex( statistics->restarts & 0xFF );
+    com_send_hex( statistics->lqi >> 8 );
+    com_send_hex( (age >> 24) & 0xFF );
+    com_send_hex( (age >> 16) & 0xFF );
+    com_send_hex( (age >> 8) & 0xFF );
+    com_send_hex( age & 0xFF );
+    com_send_hex( (statistics->bytes >> 24) & 0xFF );
+    com_send_hex( (statistics->bytes >> 16) & 0xFF );
+    com_send_hex( (statistics->bytes >> 8) & 0xFF );
+    com_send_hex( statistics->bytes & 0xFF );
+}
+#endif
+/*EOF*/
@@ -0,0 +1,253 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <clock_config.h>
+
+#include "config_uart_extended.h"
+
+#include "compiler.h"
+#include "com.h"
+#include "prof.h"
+
+#if defined( PROFILING )
+/*============================ MACROS ========================================*/
+#define PROF_CALIBRATION_RUNS    ( 4 ) //!< Empty regions timed by prof_init.
+/*============================ TYPEDEFS ======================================*/
+/*============================ VARIABLES =====================================*/
+static uint16_t volatile prof_time_msb; //!< Timer3 overflows, the 16 MSB of the cycle counter.
+static uint16_t prof_overhead; //!< Cycles of an empty region, subtracted from each sample.
+static prof_region_t prof_regions[ PROF_REGIONS ]; //!< Samples of each region.
+/*============================ PROTOTYPES ====================================*/
+static void prof_send_byte( uint8_t value, uint16_t *crc );
+static void prof_send_bytes( uint32_t value, uint8_t length, uint16_t *crc );
+
+/*! \brief  Start the cycle counter and clear the region table.
+ *
+ *          Timer3 runs free at the CPU clock, and its overflow interrupt
+ *          extends it to 32 bits. The cost of an empty PROF_ENTER/PROF_LEAVE
+ *          pair is measured here and subtracted from every sample. The USART
+ *          receive interrupt is enabled so that commands are received.
+ *
+ *  \ingroup prof
+ */
+void prof_init( void ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    TCCR3A = 0;
+    TCCR3B = (1 << CS30); //Normal mode, clk/1.
+    TCNT3 = 0;
+    prof_time_msb = 0;
+    ETIFR = (1 << TOV3);
+    ETIMSK |= (1 << TOIE3);
+
+    prof_overhead = 0;
+    prof_reset( );
+
+    uint16_t overhead = UINT16_MAX;
+
+    for (uint8_t run = 0; run < PROF_CALIBRATION_RUNS; run++) {
+
+        uint32_t start = prof_get_cycles( );
+        uint32_t cycles = prof_get_cycles( ) - start;
+
+        if (cycles < overhead) { overhead = cycles; }
+    }
+
+    prof_overhead = overhead;
+
+    AVR_LEAVE_CRITICAL_REGION( );
+
+    com_reset_receiver( );
+}
+
+/*! \brief  Read the 32-bit cycle counter.
+ *
+ *  \return CPU cycles since prof_init, wrapping after 2^32 cycles.
+ *
+ *  \ingroup prof
+ */
+uint32_t prof_get_cycles( void ){
+
+    uint32_t cycles;
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    uint16_t lsb = TCNT3;
+    uint16_t msb = prof_time_msb;
+
+    //The overflow ISR is pending if the timer wrapped after cli.
+    if (((ETIFR & (1 << TOV3)) != 0) && (lsb < 0x8000)) { msb++; }
+
+    cycles = ((uint32_t)msb << 16) | lsb;
+
+    AVR_LEAVE_CRITICAL_REGION( );
+
+    return cycles;
+}
+
+/*! \brief  Add one sample to a region. Used by PROF_LEAVE.
+ *
+ *  \param  region Region that was left.
+ *  \param  start Value of prof_get_cycles when the region was entered.
+ *
+ *  \ingroup prof
+ */
+void prof_account( prof_region_id_t region, uint32_t start ){
+
+    uint32_t cycles = prof_get_cycles( ) - start;
+
+    if (region >= PROF_REGIONS) { return; }
+
+    cycles = (cycles > prof_overhead) ? (cycles - prof_overhead) : 0;
+
+    prof_region_t *statistics = &prof_regions[ region ];
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    statistics->count++;
+    statistics->total += cycles;
+
+    if (cycles < statistics->min) { statistics->min = cycles; }
+    if (cycles > statistics->max) { statistics->max = cycles; }
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  Read the samples of one region.
+ *
+ *  \param  region Region to read.
+ *  \param  statistics Pointer to where the samples are copied.
+ *
+ *  \ingroup prof
+ */
+void prof_get_region( prof_region_id_t region, prof_region_t *statistics ){
+
+    if (region >= PROF_REGIONS) { return; }
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    *statistics = prof_regions[ region ];
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  Clear the samples of all regions.
+ *
+ *  \ingroup prof
+ */
+void prof_reset( void ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    for (uint8_t region = 0; region < PROF_REGIONS; region++) {
+
+        prof_regions[ region ].count = 0;
+        prof_regions[ region ].min   = UINT32_MAX;
+        prof_regions[ region ].max   = 0;
+        prof_regions[ region ].total = 0;
+    }
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  Send the region table on the UART in the format described in
+ *          prof.h. Blocks until the last byte is in the USART.
+ *
+ *  \ingroup prof
+ */
+void prof_dump( void ){
+
+    uint16_t crc = 0;
+
+    prof_send_byte( PROF_SYNC_0, NULL );
+    prof_send_byte( PROF_SYNC_1, NULL );
+    prof_send_byte( PROF_REGIONS, &crc );
+    prof_send_bytes( F_CPU / 1000, 2, &crc );
+    prof_send_bytes( prof_overhead, 2, &crc );
+
+    for (uint8_t region = 0; region < PROF_REGIONS; region++) {
+
+        prof_region_t statistics;
+
+        prof_get_region( region, &statistics );
+
+        prof_send_bytes( statistics.count, 4, &crc );
+        prof_send_bytes( statistics.min, 4, &crc );
+        prof_send_bytes( statistics.max, 4, &crc );
+        prof_send_bytes( (uint32_t)statistics.total, 4, &crc );
+        prof_send_bytes( (uint32_t)(statistics.total >> 32), 4, &crc );
+    }
+
+    prof_send_bytes( crc, 2, NULL );
+}
+
+/*! \brief  Handle a command received on the UART. Must be called from the
+ *          main loop, with the result of com_get_command.
+ *
+ *  \param  command Command character, PROF_COMMAND_DUMP or PROF_COMMAND_RESET.
+ *                   Other values are ignored.
+ *
+ *  \retval true The table was dumped.
+ *  \retval false The command is not a profiling command.
+ *
+ *  \ingroup prof
+ */
+bool prof_command( uint8_t command ){
+
+    if (command == PROF_COMMAND_DUMP) {
+        prof_dump( );
+    } else if (command == PROF_COMMAND_RESET) {
+        prof_dump( );
+        prof_reset( );
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/*! \brief  Send one byte on the UART and add it to the checksum.
+ *
+ *  \param  value Byte to send.
+ *  \param  crc Running checksum, or NULL if the byte is not covered.
+ */
+static void prof_send_byte( uint8_t value, uint16_t *crc ){
+
+    for(; !(UCSR0A & (1 << UDRE0));) {;}
+    UDR0 = value;
+
+    if (crc != NULL) { *crc = crc_ccitt_update( *crc, value ); }
+}
+
+/*! \brief  Send the length least significant bytes of a value, LSB first.
+ */
+static void prof_send_bytes( uint32_t value, uint8_t length, uint16_t *crc ){
+
+    while (length-- > 0) {
+
+        prof_send_byte( (uint8_t)value, crc );
+        value >>= 8;
+    }
+}
+
+//This #if compile switch is used to provide a "standard" function body for the
+//doxygen documentation.
+#if defined( DOXYGEN )
+/*! \brief Timer3 Overflow ISR
+ * Extends the profiling cycle counter to 32 bits.
+ */
+void TIMER3_OVF_vect( void );
+#else  /* !DOXYGEN */
+ISR( TIMER3_OVF_vect ){
+    prof_time_msb++;
+}
+#endif
+#endif /* defined( PROFILING ) */
+/*EOF*/
@@ -0,0 +1,221 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <clock_config.h>
+
+#include "config_uart_extended.h"
+#include "at86rf231.h"
+
+#include "compiler.h"
+#include "hal.h"
+#include "tat.h"
+#include "sniffer.h"
+#include "prof.h"
+/*============================ MACROS ========================================*/
+#define SNIFFER_TX_BUFFER_MASK    ( SNIFFER_TX_BUFFER_SIZE - 1 )
+#define SNIFFER_RECORD_FRAMING    ( 5 ) //!< Sync bytes, record length and checksum.
+
+#if (SNIFFER_TX_BUFFER_SIZE & SNIFFER_TX_BUFFER_MASK) != 0
+    #error "SNIFFER_TX_BUFFER_SIZE must be a power of two."
+#endif
+/*============================ TYPEDEFS ======================================*/
+/*============================ VARIABLES =====================================*/
+static uint8_t sniffer_tx_buffer[ SNIFFER_TX_BUFFER_SIZE ]; //!< Encoded records waiting for the UART.
+static uint16_t sniffer_tx_head; //!< Next free byte. Only written from the TRX_END handler.
+static uint16_t sniffer_tx_tail; //!< Next byte to send. Only written from the UDRE ISR.
+
+static hal_rx_frame_t sniffer_frame; //!< Frame uploaded in the TRX_END handler.
+static uint32_t sniffer_rx_start_time; //!< Timestamp of the last RX_START.
+static uint8_t sniffer_dropped; //!< Records lost since the last queued record.
+
+static sniffer_statistics_t sniffer_statistics; //!< Capture counters.
+/*============================ PROTOTYPES ====================================*/
+static void sniffer_rx_start_handler( uint32_t time_stamp, uint8_t frame_length );
+static void sniffer_trx_end_handler( uint32_t time_stamp );
+static uint16_t sniffer_put( uint16_t head, uint8_t value );
+
+/*! \brief  Switch the node into sniffer mode.
+ *
+ *          The radio transceiver is put in RX_ON. In this basic mode there is 
+ *          no address filtering and no acknowledge, and every frame is 
+ *          signaled with TRX_END also when the FCS is wrong. The TRX event 
+ *          handlers are replaced, and the USART is set up for the capture 
+ *          stream. Must be called with interrupts disabled, after the radio 
+ *          transceiver has been initialized.
+ *
+ *  \retval TAT_SUCCESS The sniffer is running once interrupts are enabled.
+ *  \retval TAT_STATE_TRANSITION_FAILED RX_ON could not be entered. The USART 
+ *                                      is not changed.
+ *
+ *  \ingroup sniffer
+ */
+tat_status_t sniffer_init( void ){
+
+    sniffer_tx_head = 0;
+    sniffer_tx_tail = 0;
+    sniffer_dropped = 0;
+
+    sniffer_statistics.frames     = 0;
+    sniffer_statistics.crc_errors = 0;
+    sniffer_statistics.dropped    = 0;
+
+    hal_set_rx_start_event_handler( sniffer_rx_start_handler );
+    hal_set_trx_end_event_handler( sniffer_trx_end_handler );
+
+    if (tat_set_trx_state( RX_ON ) != TAT_SUCCESS) { return TAT_STATE_TRANSITION_FAILED; }
+
+    /*Double speed, 8-N-1, transmitter only. The UDRE interrupt is enabled when
+      there is something to send.*/
+    UCSR0B = 0;
+    UBRR0H = (SNIFFER_UBRR >> 8);
+    UBRR0L = (SNIFFER_UBRR & 0xFF);
+    UCSR0A = (1 << U2X0);
+    UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
+    UCSR0B = (1 << TXEN0);
+
+    return TAT_SUCCESS;
+}
+
+/*! \brief  Read the capture counters.
+ *
+ *  \param  statistics Pointer to where the counters are copied.
+ *
+ *  \ingroup sniffer
+ */
+void sniffer_get_statistics( sniffer_statistics_t *statistics ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    *statistics = sniffer_statistics;
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  Store the SFD timestamp of the frame being received.
+ */
+static void sniffer_rx_start_handler( uint32_t time_stamp, uint8_t frame_length ){
+    sniffer_rx_start_time = time_stamp;
+}
+
+/*! \brief  Upload the received frame and queue it as one capture record. 
+ *          Called from the TRX ISR.
+ *
+ *          The frame is uploaded even if no space is left in the ring buffer, 
+ *          so the frame buffer is free for the next frame.
+ */
+static void sniffer_trx_end_handler( uint32_t time_stamp ){
+
+    hal_frame_read( &sniffer_frame );
+
+    uint8_t ed_level = hal_register_read( RG_PHY_ED_LEVEL );
+    uint8_t psdu_length = sniffer_frame.length;
+    uint8_t flags = 0;
+
+    if (psdu_length == 0) {
+        flags |= SNIFFER_FLAG_BAD_LENGTH;
+    } else if (sniffer_frame.crc == true) {
+        flags |= SNIFFER_FLAG_CRC_OK;
+    }
+
+    /*Check that the whole record fits.*/
+    uint16_t used = (sniffer_tx_head - sniffer_tx_tail) & SNIFFER_TX_BUFFER_MASK;
+    uint16_t record_length = SNIFFER_RECORD_FRAMING + SNIFFER_RECORD_OVERHEAD + psdu_length;
+
+    if ((SNIFFER_TX_BUFFER_SIZE - 1 - used) < record_length) {
+
+        if (sniffer_dropped < 0xFF) { sniffer_dropped++; }
+        sniffer_statistics.dropped++;
+
+        return;
+    }
+
+    if (sniffer_dropped != 0) { flags |= SNIFFER_FLAG_DROPPED; }
+
+    /*Encode the record.*/
+    uint16_t head = sniffer_tx_head;
+    uint16_t crc = 0;
+
+    head = sniffer_put( head, SNIFFER_SYNC_0 );
+    head = sniffer_put( head, SNIFFER_SYNC_1 );
+
+    crc = crc_ccitt_update( crc, SNIFFER_RECORD_OVERHEAD + psdu_length );
+    head = sniffer_put( head, SNIFFER_RECORD_OVERHEAD + psdu_length );
+
+    uint8_t header[ SNIFFER_RECORD_OVERHEAD ];
+
+    header[ 0 ] = flags;
+    header[ 1 ] = sniffer_dropped;
+    header[ 2 ] = (sniffer_rx_start_time >> 0) & 0xFF;
+    header[ 3 ] = (sniffer_rx_start_time >> 8) & 0xFF;
+    header[ 4 ] = (sniffer_rx_start_time >> 16) & 0xFF;
+    header[ 5 ] = (sniffer_rx_start_time >> 24) & 0xFF;
+    header[ 6 ] = sniffer_frame.lqi;
+    header[ 7 ] = ed_level;
+    header[ 8 ] = psdu_length;
+
+    for (uint8_t i = 0; i < SNIFFER_RECORD_OVERHEAD; i++) {
+
+        crc = crc_ccitt_update( crc, header[ i ] );
+        head = sniffer_put( head, header[ i ] );
+    }
+
+    for (uint8_t i = 0; i < psdu_length; i++) {
+
+        crc = crc_ccitt_update( crc, sniffer_frame.data[ i ] );
+        head = sniffer_put( head, sniffer_frame.data[ i ] );
+    }
+
+    head = sniffer_put( head, crc & 0xFF );
+    head = sniffer_put( head, crc >> 8 );
+
+    /*Publish the record and start the UART.*/
+    sniffer_tx_head = head;
+    sniffer_dropped = 0;
+
+    sniffer_statistics.frames++;
+    if ((flags & SNIFFER_FLAG_CRC_OK) == 0) { sniffer_statistics.crc_errors++; }
+
+    UCSR0B |= (1 << UDRIE0);
+}
+
+/*! \brief  Write one byte to the ring buffer.
+ *
+ *  \param  head Index to write to.
+ *  \param  value Byte to write.
+ *
+ *  \return Index of the next byte.
+ */
+static uint16_t sniffer_put( uint16_t head, uint8_t value ){
+
+    sniffer_tx_buffer[ head ] = value;
+
+    return (head + 1) & SNIFFER_TX_BUFFER_MASK;
+}
+
+//This #if compile switch is used to provide a "standard" function body for the 
+//doxygen documentation.
+#if defined( DOXYGEN )
+/*! \brief USART0 data register empty ISR. Sends the next byte of the capture 
+ *         stream, and disables itself when the ring buffer is empty.
+ */
+void USART0_UDRE_vect( void );
+#else  /* !DOXYGEN */
+ISR( USART0_UDRE_vect ){
+
+    PROF_ENTER( PROF_UART_UDRE_ISR );
+
+    uint16_t tail = sniffer_tx_tail;
+
+    if (tail == sniffer_tx_head) {
+        UCSR0B &= ~(1 << UDRIE0);
+    } else {
+
+        UDR0 = sniffer_tx_buffer[ tail ];
+        sniffer_tx_tail = (tail + 1) & SNIFFER_TX_BUFFER_MASK;
+    }
+
+    PROF_LEAVE( PROF_UART_UDRE_ISR );
+}
+#endif /* defined(DOXYGEN) */
+/*EOF*/
@@ -0,0 +1,288 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "config_uart_extended.h"
+
+#include "compiler.h"
+#include "hal.h"
+#include "trace.h"
+
+#if defined( TRACE )
+/*============================ MACROS ========================================*/
+#define TRACE_BUFFER_MASK        ( TRACE_BUFFER_SIZE - 1 )
+
+#if ((TRACE_BUFFER_SIZE & TRACE_BUFFER_MASK) != 0) || (TRACE_BUFFER_SIZE > 256)
+    #error "TRACE_BUFFER_SIZE must be a power of two, at most 256."
+#endif
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  One event in the ring. Sent as is, so the layout is part of the
+ *          dump format.
+ */
+typedef struct{
+    uint8_t event;      //!< trace_event_id_t.
+    uint8_t arg;        //!< Event argument.
+    uint16_t time;      //!< 16 LSB of the system time, or the new MSB for TRACE_TIME.
+}trace_event_t;
+/*============================ VARIABLES =====================================*/
+static trace_event_t trace_ring[ TRACE_BUFFER_SIZE ]; //!< Event ring.
+static uint8_t trace_head; //!< Next event to write.
+static uint16_t trace_count; //!< Events in the ring.
+static bool trace_wrapped; //!< Events were overwritten since the last dump.
+
+static bool trace_time_valid; //!< trace_time_msb has been recorded.
+static uint16_t trace_time_msb; //!< Time MSB of the last recorded event.
+static uint16_t trace_base_msb; //!< Time MSB in effect before the oldest event.
+
+static uint8_t trace_reason; //!< Trigger reason, TRACE_TRIGGER_NONE if not triggered.
+static uint8_t trace_post_trigger; //!< Events left before the ring is frozen.
+static bool volatile trace_frozen; //!< Nothing is recorded until the next dump.
+/*============================ PROTOTYPES ====================================*/
+static void trace_put( uint8_t event, uint8_t arg, uint16_t time );
+static void trace_rearm( void );
+static void trace_send_byte( uint8_t value, uint16_t *crc );
+
+/*! \brief  Clear the ring and start recording.
+ *
+ *  \ingroup trace
+ */
+void trace_init( void ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    trace_rearm( );
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  Record an event with the current system time. Used by TRACE_EVENT.
+ *
+ *  \param  event Event type, one of trace_event_id_t.
+ *  \param  arg Event argument.
+ *
+ *  \ingroup trace
+ */
+void trace_record( uint8_t event, uint8_t arg ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    //The time is read with interrupts off, so the events are in time order.
+    trace_record_at( event, arg, hal_get_system_time( ) );
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  Record an event with a given time stamp. Used by TRACE_EVENT_AT.
+ *
+ *  \param  event Event type, one of trace_event_id_t.
+ *  \param  arg Event argument.
+ *  \param  time System time in symbols.
+ *
+ *  \ingroup trace
+ */
+void trace_record_at( uint8_t event, uint8_t arg, uint32_t time ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    uint16_t msb = (uint16_t)(time >> 16);
+
+    if ((trace_frozen == false) && ((trace_time_valid == false) || (msb != trace_time_msb))) {
+
+        if (trace_count == 0) { trace_base_msb = msb; }
+
+        trace_time_valid = true;
+        trace_time_msb = msb;
+        trace_put( TRACE_TIME, 0, msb );
+    }
+
+    if (trace_frozen == false) { trace_put( event, arg, (uint16_t)time ); }
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  Keep the history that led to a failure.
+ *
+ *          After TRACE_POST_TRIGGER more events the ring is frozen, and it is
+ *          dumped by the next trace_poll. Only the first trigger before a dump
+ *          counts.
+ *
+ *  \param  reason Why the trace is kept, one of trace_trigger_t.
+ *
+ *  \ingroup trace
+ */
+void trace_trigger( uint8_t reason ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    if ((trace_reason == TRACE_TRIGGER_NONE) && (reason != TRACE_TRIGGER_NONE)) {
+
+        trace_reason = reason;
+        trace_post_trigger = TRACE_POST_TRIGGER;
+        trace_record( TRACE_TRIGGER, reason );
+    }
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  Check if a triggered trace is waiting to be dumped.
+ *
+ *  \ingroup trace
+ */
+bool trace_is_frozen( void ){
+    return trace_frozen;
+}
+
+/*! \brief  Send the ring on the UART in the format described in trace.h,
+ *          then clear it and start recording again.
+ *
+ *          Recording is stopped while the ring is sent. At 9600 baud a full
+ *          ring of 128 events takes about 0.5 s.
+ *
+ *  \ingroup trace
+ */
+void trace_dump( void ){
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    trace_frozen = true;
+
+    AVR_LEAVE_CRITICAL_REGION( );
+
+    uint16_t crc = 0;
+    uint8_t flags = 0;
+    uint8_t index = (uint8_t)((trace_head - trace_count) & TRACE_BUFFER_MASK);
+
+    if (trace_wrapped == true) { flags |= TRACE_FLAG_WRAPPED; }
+    if (trace_reason != TRACE_TRIGGER_NONE) { flags |= TRACE_FLAG_TRIGGERED; }
+
+    trace_send_byte( TRACE_SYNC_0, NULL );
+    trace_send_byte( TRACE_SYNC_1, NULL );
+    trace_send_byte( (uint8_t)trace_count, &crc );
+    trace_send_byte( (uint8_t)(trace_count >> 8), &crc );
+    trace_send_byte( flags, &crc );
+    trace_send_byte( trace_reason, &crc );
+    trace_send_byte( (uint8_t)trace_base_msb, &crc );
+    trace_send_byte( (uint8_t)(trace_base_msb >> 8), &crc );
+
+    for (uint16_t i = 0; i < trace_count; i++) {
+
+        trace_event_t const *event = &trace_ring[ index ];
+
+        trace_send_byte( event->event, &crc );
+        trace_send_byte( event->arg, &crc );
+        trace_send_byte( (uint8_t)event->time, &crc );
+        trace_send_byte( (uint8_t)(event->time >> 8), &crc );
+
+        index = (index + 1) & TRACE_BUFFER_MASK;
+    }
+
+    trace_send_byte( (uint8_t)crc, NULL );
+    trace_send_byte( (uint8_t)(crc >> 8), NULL );
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    trace_rearm( );
+
+    AVR_LEAVE_CRITICAL_REGION( );
+}
+
+/*! \brief  Dump the ring if it was frozen by a trigger. Must be called from
+ *          the main loop.
+ *
+ *  \retval true The ring was dumped.
+ *  \retval false Nothing to dump.
+ *
+ *  \ingroup trace
+ */
+bool trace_poll( void ){
+
+    if (trace_frozen == false) { return false; }
+
+    trace_dump( );
+
+    return true;
+}
+
+/*! \brief  Handle a command received on the UART. Must be called from the
+ *          main loop, with the result of com_get_command.
+ *
+ *  \param  command Command character. Only TRACE_COMMAND_DUMP is handled.
+ *
+ *  \retval true The ring was dumped.
+ *  \retval false The command is not a trace command.
+ *
+ *  \ingroup trace
+ */
+bool trace_command( uint8_t command ){
+
+    if (command != TRACE_COMMAND_DUMP) { return false; }
+
+    trace_dump( );
+
+    return true;
+}
+
+/*! \brief  Write one event to the ring, overwriting the oldest when full.
+ *          Called with interrupts off.
+ */
+static void trace_put( uint8_t event, uint8_t arg, uint16_t time ){
+
+    trace_event_t *slot = &trace_ring[ trace_head ];
+
+    if (trace_count == TRACE_BUFFER_SIZE) {
+
+        //The oldest event is lost. Keep the time MSB it carried.
+        if (slot->event == TRACE_TIME) { trace_base_msb = slot->time; }
+
+        trace_wrapped = true;
+    } else {
+        trace_count++;
+    }
+
+    slot->event = event;
+    slot->arg   = arg;
+    slot->time  = time;
+
+    trace_head = (trace_head + 1) & TRACE_BUFFER_MASK;
+
+    if ((trace_reason != TRACE_TRIGGER_NONE) && (--trace_post_trigger == 0)) {
+        trace_frozen = true;
+    }
+}
+
+/*! \brief  Empty the ring and clear the trigger. Called with interrupts off.
+ */
+static void trace_rearm( void ){
+
+    trace_head         = 0;
+    trace_count        = 0;
+    trace_wrapped      = false;
+    trace_time_valid   = false;
+    trace_base_msb     = 0;
+    trace_reason       = TRACE_TRIGGER_NONE;
+    trace_post_trigger = 0;
+    trace_frozen       = false;
+}
+
+/*! \brief  Send one byte on the UART and add it to the checksum.
+ *
+ *  \param  value Byte to send.
+ *  \param  crc Running checksum, or NULL if the byte is not covered.
+ */
+static void trace_send_byte( uint8_t value, uint16_t *crc ){
+
+    for(; !(UCSR0A & (1 << UDRE0));) {;}
+    UDR0 = value;
+
+    if (crc != NULL) { *crc = crc_ccitt_update( *crc, value ); }
+}
+#endif /* defined( TRACE ) */
+/*EOF*/
@@ -0,0 +1,558 @@
+/*============================ INCLDUE =======================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "config_uart_extended.h"
+
+#include "compiler.h"
+#include "hal.h"
+#include "tat.h"
+#include "com.h"
+#include "tsync.h"
+
+#if defined( TIME_SYNC )
+#if defined( LOW_POWER_LISTENING )
+    #error "TIME_SYNC cannot be used with LOW_POWER_LISTENING, beacons are missed while the radio sleeps."
+#endif
+/*============================ MACROS ========================================*/
+#define TSYNC_NO_PARENT          ( TSYNC_BROADCAST )
+#define TSYNC_NOT_SYNCHRONIZED   ( 0xFF ) //!< Hop count of a node that is not synchronized.
+#define TSYNC_TX_AIR_TIME        ( (uint32_t)TSYNC_BEACON_LENGTH * 2 * HAL_US_PER_SYMBOL ) //!< PSDU of a beacon, in ticks.
+/*============================ TYPEDEFS ======================================*/
+
+/*! \brief  One regression sample. */
+typedef struct{
+    uint32_t local;     //!< Local time of a beacon of the parent, in ticks.
+    int32_t offset;     //!< Global minus local time of that beacon.
+}tsync_sample_t;
+
+/*! \brief  A node whose beacons are heard. */
+typedef struct{
+    bool valid;
+    uint16_t address;
+    uint8_t hop;
+    uint8_t number;         //!< Number of the last beacon.
+    uint32_t rx_time;       //!< Local time of the last beacon, in ticks.
+    uint32_t last_heard;    //!< System time of the last beacon.
+    int16_t error_us;       //!< Its global time minus ours, for the last paired beacon.
+    uint16_t max_error_us;  //!< Largest absolute error_us.
+}tsync_neighbour_t;
+/*============================ VARIABLES =====================================*/
+static uint32_t volatile tsync_rx_start_capture; //!< Capture of the last RX_START, in ticks.
+
+static tsync_sample_t tsync_samples[ TSYNC_SAMPLES ]; //!< Ring of samples.
+static uint8_t tsync_sample_count;
+static uint8_t tsync_sample_next; //!< Where the next sample goes.
+static uint8_t tsync_outliers; //!< Outliers in a row.
+
+static uint32_t tsync_local_ref; //!< Mean local time of the samples, in ticks.
+static int32_t tsync_offset_ref; //!< Global minus local time at tsync_local_ref.
+static float tsync_skew; //!< Change of the offset per local tick.
+
+static uint16_t tsync_parent;
+static uint8_t tsync_parent_hop;
+static uint32_t tsync_parent_heard; //!< System time of the last beacon of the parent.
+
+static int16_t tsync_error_us;
+static uint16_t tsync_max_error_us;
+static uint16_t tsync_restarts;
+
+static uint8_t tsync_beacon_number; //!< Number of the next beacon.
+static uint32_t tsync_last_tx_time; //!< Local time of the last beacon sent, in ticks.
+static bool tsync_last_tx_valid; //!< The last beacon was sent, so its time is known.
+static uint32_t tsync_last_beacon; //!< System time when the last beacon was built.
+
+static tsync_neighbour_t tsync_neighbours[ TSYNC_NEIGHBOURS ];
+
+static uint8_t debug_tsync[] = "\r\nSYNC "; //!< Debug Text.
+static uint8_t debug_tsync_peer[] = "\r\nPEER "; //!< Debug Text.
+/*============================ PROTOTYPES ====================================*/
+static bool tsync_is_root( void );
+static void tsync_restart( void );
+static void tsync_add_sample( uint32_t local, uint32_t global );
+static void tsync_regression( void );
+static uint32_t tsync_global_ticks( uint32_t local );
+static int16_t tsync_ticks_to_us( int32_t ticks );
+static tsync_neighbour_t *tsync_neighbour( uint16_t address );
+static int32_t tsync_round( float value );
+
+/*! \brief  Start unsynchronized, or as the root if SHORT_ADDRESS is
+ *          TSYNC_ROOT_ADDRESS.
+ *
+ *          tsync_rx_start must be installed as the RX_START event handler,
+ *          and its time stored with each received frame (see
+ *          tsync_get_rx_start_time).
+ *
+ *  \ingroup tsync
+ */
+void tsync_init( void ){
+
+    tsync_restart( );
+    tsync_restarts = 0;
+
+    tsync_parent = TSYNC_NO_PARENT;
+    tsync_last_tx_valid = false;
+    tsync_last_beacon = (hal_get_system_time( ) - TSYNC_BEACON_INTERVAL) & HAL_SYMBOL_MASK;
+
+    memset( tsync_neighbours, 0, sizeof( tsync_neighbours ) );
+}
+
+/*! \brief  RX_START event handler: keeps the capture time of the frame being
+ *          received.
+ *
+ *  \ingroup tsync
+ */
+void tsync_rx_start( uint32_t isr_timestamp, uint8_t frame_length ){
+    tsync_rx_start_capture = hal_get_capture_time( );
+}
+
+/*! \brief  Time of the last RX_START, for the TRX_END event handler to store
+ *          with the frame.
+ *
+ *  \return Timer1 ticks (see hal_get_capture_time).
+ *
+ *  \ingroup tsync
+ */
+uint32_t tsync_get_rx_start_time( void ){
+
+    uint32_t rx_start;
+
+    AVR_ENTER_CRITICAL_REGION( );
+    cli( );
+
+    rx_start = tsync_rx_start_capture;
+
+    AVR_LEAVE_CRITICAL_REGION( );
+
+    return rx_start;
+}
+
+/*! \brief  Check if a received frame is a beacon.
+ *
+ *  \param  frame Received frame, including the FCS.
+ *  \param  length Frame length.
+ *
+ *  \ingroup tsync
+ */
+bool tsync_is_beacon( uint8_t *frame, uint8_t length ){
+    return (length == TSYNC_BEACON_LENGTH) && (frame[ TSYNC_MAC_HEADER_LENGTH ] == TSYNC_DISPATCH);
+}
+
+/*! \brief  Process a received beacon.
+ *
+ *          The beacon carries the global time of the previous beacon of its
+ *          sender, which is paired with the local time at which that beacon
+ *          was received. Pairs from the parent go into the regression; for
+ *          every sender the difference to our own global time is kept as its
+ *          synchronization error.
+ *
+ *          The parent is the neighbour with the lowest hop count. It is only
+ *          replaced by a lower hop count, or after TSYNC_PARENT_TIMEOUT.
+ *
+ *  \param  frame Beacon, including the FCS (see tsync_is_beacon).
+ *  \param  length Frame length.
+ *  \param  rx_start_time RX_START time of the beacon.
+ *
+ *  \ingroup tsync
+ */
+void tsync_receive( uint8_t *frame, uint8_t length, uint32_t rx_start_time ){
+
+    if (tsync_is_beacon( frame, length ) == false) { return; }
+
+    uint16_t source  = frame[ 7 ] | ((uint16_t)frame[ 8 ] << 8);
+    uint8_t number   = frame[ 10 ];
+    uint8_t hop      = frame[ 11 ];
+    uint16_t root    = frame[ 12 ] | ((uint16_t)frame[ 13 ] << 8);
+    uint32_t global  = frame[ 14 ] | ((uint32_t)frame[ 15 ] << 8) | ((uint32_t)frame[ 16 ] << 16) | ((uint32_t)frame[ 17 ] << 24);
+    bool global_valid = (frame[ 18 ] != 0);
+    uint32_t now = hal_get_system_time( );
+
+    if ((root != TSYNC_ROOT_ADDRESS) || (hop == TSYNC_NOT_SYNCHRONIZED) || (source == SHORT_ADDRESS)) { return; }
+
+    //Parent selection.
+    if (tsync_is_root( ) == false) {
+
+        if (source == tsync_parent) {
+
+            tsync_parent_hop   = hop;
+            tsync_parent_heard = now;
+        } else if ((tsync_parent == TSYNC_NO_PARENT) || (hop < tsync_parent_hop) ||
+                   (((now - tsync_parent_heard) & HAL_SYMBOL_MASK) > TSYNC_PARENT_TIMEOUT)) {
+
+            tsync_parent       = source;
+            tsync_parent_hop   = hop;
+            tsync_parent_heard = now;
+            tsync_restart( );
+        }
+    }
+
+    tsync_neighbour_t *neighbour = tsync_neighbour( source );
+
+    if (neighbour->valid && global_valid && ((uint8_t)(neighbour->number + 1) == number)) {
+
+        if (tsync_is_synchronized( )) {
+
+            neighbour->error_us = tsync_ticks_to_us( (int32_t)(global - tsync_global_ticks( neighbour->rx_time )) );
+
+            uint16_t magnitude = (neighbour->error_us < 0) ? -neighbour->error_us : neighbour->error_us;
+            if (magnitude > neighbour->max_error_us) { neighbour->max_error_us = magnitude; }
+        }
+
+        if ((tsync_is_root( ) == false) && (source == tsync_parent)) { tsync_add_sample( neighbour->rx_time, global ); }
+    }
+
+    neighbour->valid      = true;
+    neighbour->address    = source;
+    neighbour->hop        = hop;
+    neighbour->number     = number;
+    neighbour->rx_time    = rx_start_time;
+    neighbour->last_heard = now;
+}
+
+/*! \brief  Check if it is time to send a beacon: the node is synchronized
+ *          and TSYNC_BEACON_INTERVAL passed since the last one.
+ *
+ *  \ingroup tsync
+ */
+bool tsync_beacon_due( void ){
+    return tsync_is_synchronized( ) && (HAL_ELAPSED_TIME( tsync_last_beacon ) >= TSYNC_BEACON_INTERVAL);
+}
+
+/*! \brief  Build the next beacon.
+ *
+ *          Send it with TX_ARET, then call tsync_beacon_sent before the
+ *          next radio interrupt, so that its TRX_END capture is used.
+ *
+ *  \param  frame Buffer of at least TSYNC_BEACON_LENGTH bytes.
+ *
+ *  \return Frame length including the FCS, or 0 if not synchronized.
+ *
+ *  \ingroup tsync
+ */
+uint8_t tsync_build_beacon( uint8_t *frame ){
+
+    if (tsync_is_synchronized( ) == false) { return 0; }
+
+    uint16_t root = TSYNC_ROOT_ADDRESS;
+    uint32_t global = tsync_last_tx_valid ? tsync_global_ticks( tsync_last_tx_time ) : 0;
+
+    frame[ 0 ]  = 0x41; //FCF: data frame, no acknowledge request, PAN ID compression.
+    frame[ 1 ]  = 0x88; //FCF: short addresses.
+    frame[ 2 ]  = tsync_beacon_number;
+    frame[ 3 ]  = PAN_ID & 0xFF;
+    frame[ 4 ]  = (PAN_ID >> 8) & 0xFF;
+    frame[ 5 ]  = TSYNC_BROADCAST & 0xFF;
+    frame[ 6 ]  = (TSYNC_BROADCAST >> 8) & 0xFF;
+    frame[ 7 ]  = SHORT_ADDRESS & 0xFF;
+    frame[ 8 ]  = (SHORT_ADDRESS >> 8) & 0xFF;
+    frame[ 9 ]  = TSYNC_DISPATCH;
+    frame[ 10 ] = tsync_beacon_number;
+    frame[ 11 ] = tsync_is_root( ) ? 0 : (tsync_parent_hop + 1);
+    frame[ 12 ] = root & 0xFF;
+    frame[ 13 ] = (root >> 8) & 0xFF;
+    frame[ 14 ] = global & 0xFF;
+    frame[ 15 ] = (global >> 8) & 0xFF;
+    frame[ 16 ] = (global >> 16) & 0xFF;
+    frame[ 17 ] = (global >> 24) & 0xFF;
+    frame[ 18 ] = tsync_last_tx_valid ? 1 : 0;
+
+    tsync_last_beacon = hal_get_system_time( );
+
+    return TSYNC_BEACON_LENGTH;
+}
+
+/*! \brief  Record the transmission of the beacon from tsync_build_beacon.
+ *
+ *  \param  status Result of the transmission.
+ *
+ *  \ingroup tsync
+ */
+void tsync_beacon_sent( tat_status_t status ){
+
+    tsync_last_tx_valid = (status == TAT_SUCCESS);
+
+    if (tsync_last_tx_valid) { tsync_last_tx_time = hal_get_capture_time( ) - TSYNC_TX_AIR_TIME; }
+
+    tsync_beacon_number++;
+}
+
+/*! \brief  Check if the global time is known.
+ *
+ *  \ingroup tsync
+ */
+bool tsync_is_synchronized( void ){
+    return tsync_is_root( ) || (tsync_sample_count >= TSYNC_MIN_SAMPLES);
+}
+
+/*! \brief  Convert a local time to global time.
+ *
+ *  \param  local_time Local time in symbols (see hal_get_system_time).
+ *
+ *  \return Global time in symbols. Without synchronization the local time is
+ *          returned.
+ *
+ *  \ingroup tsync
+ */
+uint32_t tsync_local_to_global( uint32_t local_time ){
+    return (tsync_global_ticks( local_time * HAL_US_PER_SYMBOL ) / HAL_US_PER_SYMBOL) & HAL_SYMBOL_MASK;
+}
+
+/*! \brief  Convert a global time to local time, e.g. to start the HAL timer
+ *          at a global time.
+ *
+ *  \param  global_time Global time in symbols.
+ *
+ *  \return Local time in symbols. Without synchronization the global time is
+ *          returned.
+ *
+ *  \ingroup tsync
+ */
+uint32_t tsync_global_to_local( uint32_t global_time ){
+
+    uint32_t global = global_time * HAL_US_PER_SYMBOL;
+    uint32_t local  = global;
+
+    if ((tsync_is_root( ) == false) && (tsync_sample_count != 0)) {
+
+        //global = local + offset + skew * (local - reference), solved by iteration.
+        local = global - tsync_offset_ref;
+        local = global - tsync_offset_ref - tsync_round( tsync_skew * (float)(int32_t)(local - tsync_local_ref) );
+    }
+
+    return (local / HAL_US_PER_SYMBOL) & HAL_SYMBOL_MASK;
+}
+
+/*! \brief  Current global time in symbols.
+ *
+ *  \ingroup tsync
+ */
+uint32_t tsync_get_global_time( void ){
+    return tsync_local_to_global( hal_get_system_time( ) );
+}
+
+/*! \brief  Get the state of the local clock estimate.
+ *
+ *  \param  status Where the state is stored.
+ *
+ *  \ingroup tsync
+ */
+void tsync_get_status( tsync_status_t *status ){
+
+    status->synchronized = tsync_is_synchronized( );
+    status->hop          = tsync_is_root( ) ? 0 : (status->synchronized ? (tsync_parent_hop + 1) : TSYNC_NOT_SYNCHRONIZED);
+    status->parent       = tsync_is_root( ) ? SHORT_ADDRESS : tsync_parent;
+    status->samples      = tsync_sample_count;
+    status->skew_ppm     = (int16_t)tsync_round( tsync_skew * 1e6f );
+    status->error_us     = tsync_error_us;
+    status->max_error_us = tsync_max_error_us;
+    status->restarts     = tsync_restarts;
+}
+
+/*! \brief  Send the state on the UART as hex, MSB first.
+ *
+ *          One SYNC line: synchronized, hop, parent (2 bytes), samples, skew
+ *          in ppm, error and maximum error in us and restarts (2 bytes
+ *          each). Then one PEER line per neighbour: address (2 bytes), hop,
+ *          and the error of its global time against ours, last and maximum
+ *          in us (2 bytes each). At the root the PEER errors are the
+ *          synchronization errors that the nodes achieved.
+ *
+ *  \ingroup tsync
+ */
+void tsync_report( void ){
+
+    tsync_status_t status;
+
+    tsync_get_status( &status );
+
+    com_send_string( debug_tsync, sizeof( debug_tsync ) );
+    com_send_hex( status.synchronized );
+    com_send_hex( status.hop );
+    com_send_hex( status.parent >> 8 );
+    com_send_hex( status.parent & 0xFF );
+    com_send_hex( status.samples );
+    com_send_hex( (uint16_t)status.skew_ppm >> 8 );
+    com_send_hex( (uint16_t)status.skew_ppm & 0xFF );
+    com_send_hex( (uint16_t)status.error_us >> 8 );
+    com_send_hex( (uint16_t)status.error_us & 0xFF );
+    com_send_hex( status.max_error_us >> 8 );
+    com_send_hex( status.max_error_us & 0xFF );
+    com_send_hex( status.restarts >> 8 );
+    com_send_hex( status.restarts & 0xFF );
+
+    for (uint8_t i = 0; i < TSYNC_NEIGHBOURS; i++) {
+
+        tsync_neighbour_t *neighbour = &tsync_neighbours[ i ];
+
+        if (neighbour->valid == false) { continue; }
+
+        com_send_string( debug_tsync_peer, sizeof( debug_tsync_peer ) );
+        com_send_hex( neighbour->address >> 8 );
+        com_send_hex( neighbour->address & 0xFF );
+        com_send_hex( neighbour->hop );
+        com_send_hex( (uint16_t)neighbour->error_us >> 8 );
+        com_send_hex( (uint16_t)neighbour->error_us & 0xFF );
+        com_send_hex( neighbour->max_error_us >> 8 );
+        com_send_hex( neighbour->max_error_us & 0xFF );
+    }
+}
+
+/*! \brief  Handle a command received on the UART. Must be called from the
+ *          main loop, with the result of com_get_command.
+ *
+ *  \param  command Command character. Only TSYNC_COMMAND_REPORT is handled.
+ *
+ *  \retval true The report was sent.
+ *  \retval false The command is not a time synchronization command.
+ *
+ *  \ingroup tsync
+ */
+bool tsync_command( uint8_t command ){
+
+    if (command != TSYNC_COMMAND_REPORT) { return false; }
+
+    tsync_report( );
+
+    return true;
+}
+
+/*! \brief  The root defines the global time. */
+static bool tsync_is_root( void ){
+    return (SHORT_ADDRESS == TSYNC_ROOT_ADDRESS);
+}
+
+/*! \brief  Clear the regression, e.g. for a new parent. */
+static void tsync_restart( void ){
+
+    tsync_sample_count = 0;
+    tsync_sample_next  = 0;
+    tsync_outliers     = 0;
+    tsync_skew         = 0;
+    tsync_offset_ref   = 0;
+    tsync_local_ref    = 0;
+    tsync_max_error_us = 0;
+    tsync_error_us     = 0;
+    tsync_restarts++;
+}
+
+/*! \brief  Add a sample, unless it is an outlier. TSYNC_MAX_OUTLIERS in a
+ *          row mean that the estimate is wrong, so it is restarted.
+ */
+static void tsync_add_sample( uint32_t local, uint32_t global ){
+
+    if (tsync_is_synchronized( )) {
+
+        int32_t error = (int32_t)(global - tsync_global_ticks( local ));
+
+        if ((error > TSYNC_MAX_ERROR) || (error < -TSYNC_MAX_ERROR)) {
+
+            if (++tsync_outliers < TSYNC_MAX_OUTLIERS) { return; }
+
+            tsync_restart( );
+        } else {
+
+            tsync_outliers = 0;
+            tsync_error_us = tsync_ticks_to_us( error );
+
+            uint16_t magnitude = (tsync_error_us < 0) ? -tsync_error_us : tsync_error_us;
+            if (magnitude > tsync_max_error_us) { tsync_max_error_us = magnitude; }
+        }
+    }
+
+    tsync_samples[ tsync_sample_next ].local  = local;
+    tsync_samples[ tsync_sample_next ].offset = (int32_t)(global - local);
+
+    tsync_sample_next = (tsync_sample_next + 1) % TSYNC_SAMPLES;
+    if (tsync_sample_count < TSYNC_SAMPLES) { tsync_sample_count++; }
+
+    tsync_regression( );
+}
+
+/*! \brief  Least squares fit of the offset over the local time.
+ *
+ *          The sums are taken relative to the newest sample, so the values
+ *          stay small and the wrap of the 32-bit times does not matter.
+ */
+static void tsync_regression( void ){
+
+    tsync_sample_t *newest = &tsync_samples[ (tsync_sample_next + TSYNC_SAMPLES - 1) % TSYNC_SAMPLES ];
+    float mean_x = 0;
+    float mean_y = 0;
+    float sxx = 0;
+    float sxy = 0;
+
+    for (uint8_t i = 0; i < tsync_sample_count; i++) {
+
+        mean_x += (float)(int32_t)(tsync_samples[ i ].local - newest->local);
+        mean_y += (float)(tsync_samples[ i ].offset - newest->offset);
+    }
+
+    mean_x /= tsync_sample_count;
+    mean_y /= tsync_sample_count;
+
+    for (uint8_t i = 0; i < tsync_sample_count; i++) {
+
+        float x = (float)(int32_t)(tsync_samples[ i ].local - newest->local) - mean_x;
+        float y = (float)(tsync_samples[ i ].offset - newest->offset) - mean_y;
+
+        sxx += x * x;
+        sxy += x * y;
+    }
+
+    tsync_skew = (sxx > 0) ? (sxy / sxx) : 0;
+
+    //Move the reference to a whole tick near the mean.
+    int32_t reference = tsync_round( mean_x );
+
+    tsync_local_ref  = newest->local + reference;
+    tsync_offset_ref = newest->offset + tsync_round( mean_y + tsync_skew * ((float)reference - mean_x) );
+}
+
+/*! \brief  Global time of a local time, both in ticks. */
+static uint32_t tsync_global_ticks( uint32_t local ){
+
+    if (tsync_is_root( ) || (tsync_sample_count == 0)) { return local; }
+
+    return local + tsync_offset_ref + tsync_round( tsync_skew * (float)(int32_t)(local - tsync_local_ref) );
+}
+
+static int16_t tsync_ticks_to_us( int32_t ticks ){
+
+    int32_t us = ticks * TSYNC_US_PER_TICK;
+
+    if (us > INT16_MAX) { return INT16_MAX; }
+    if (us < -INT16_MAX) { return -INT16_MAX; }
+
+    return (int16_t)us;
+}
+
+/*! \brief  Find a neighbour, or replace the one heard longest ago. */
+static tsync_neighbour_t *tsync_neighbour( uint16_t address ){
+
+    tsync_neighbour_t *oldest = &tsync_neighbours[ 0 ];
+    uint32_t now = hal_get_system_time( );
+
+    for (uint8_t i = 0; i < TSYNC_NEIGHBOURS; i++) {
+
+        tsync_neighbour_t *neighbour = &tsync_neighbours[ i ];
+
+        if (neighbour->valid && (neighbour->address == address)) { return neighbour; }
+
+        if (neighbour->valid == false) {
+            oldest = neighbour;
+        } else if (oldest->valid && (((now - neighbour->last_heard) & HAL_SYMBOL_MASK) > ((now - oldest->last_heard) & HAL_SYMBOL_MASK))) {
+            oldest = neighbour;
+        }
+    }
+
+    memset( oldest, 0, sizeof( *oldest ) );
+
+    return oldest;
+}
+
+static int32_t tsync_round( float value ){
+    return (int32_t)((value >= 0) ? (value + 0.5f) : (value - 0.5f));
+}
+#endif /* defined( TIME_SYNC ) */
+/*EOF*/